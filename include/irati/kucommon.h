@@ -807,9 +807,24 @@ struct irati_ctrldev_ctldata {
 	irati_msg_port_t port_id;
 };
 
+/*
+ * In batch read mode a read() on a control device returns as many whole
+ * queued messages as fit in the buffer, in batch write mode a write() may
+ * carry several messages. Each message is preceded by its serialized
+ * length, as a uint32_t.
+ */
+#define IRATI_CTRL_MODE_BATCH_READ	0x1
+#define IRATI_CTRL_MODE_BATCH_WRITE	0x2
+
+/* Data structure passed along with ioctl */
+struct irati_ctrldev_mode {
+	uint32_t flags;
+};
+
 #define IRATI_FLOW_BIND _IOW(0xAF, 0x00, struct irati_iodev_ctldata)
 #define IRATI_CTRL_FLOW_BIND _IOW(0xAF, 0x01, struct irati_ctrldev_ctldata)
 #define IRATI_IOCTL_MSS_GET _IOR(0xAF, 0x02, struct irati_iodev_ctldata)
+#define IRATI_CTRL_MODE_SET _IOW(0xAF, 0x03, struct irati_ctrldev_mode)
 
 #ifdef __cplusplus
 }
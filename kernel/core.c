@@ -61,6 +61,15 @@ int irati_verbosity = LOG_VERB_INFO;
 EXPORT_SYMBOL(irati_verbosity);
 module_param(irati_verbosity, int, 0644);
 
+/*
+ * Ordered queues received PDUs are spread over by connection, at most one
+ * per possible CPU, 0 disables it. Fixed at load time: changing it would
+ * move connections with PDUs queued.
+ */
+unsigned int irati_rx_cpus = 0;
+EXPORT_SYMBOL(irati_rx_cpus);
+module_param(irati_rx_cpus, uint, 0444);
+
 static int __init mod_init(void)
 {
         LOG_DBG("IRATI RINA implementation initializing");
@@ -71,8 +80,15 @@ static int __init mod_init(void)
                 return -1;
 	}
 
+        LOG_DBG("Initializing receive queues");
+        if (rx_steer_init()) {
+                robject_del(&core_object);
+                return -1;
+        }
+
         LOG_DBG("Initializing IODEV");
         if (iodev_init()) {
+                rx_steer_fini();
                 robject_del(&core_object);
                 return -1;
         }
@@ -80,6 +96,7 @@ static int __init mod_init(void)
         LOG_DBG("Initializing CTRLDEV");
         if (ctrldev_init()) {
                 iodev_fini();
+                rx_steer_fini();
                 robject_del(&core_object);
                 return -1;
         }
@@ -88,6 +105,7 @@ static int __init mod_init(void)
         if (kipcm_init(&core_object)) {
         	ctrldev_fini();
                 iodev_fini();
+                rx_steer_fini();
                 robject_del(&core_object);
                 return -1;
         }
@@ -114,6 +132,8 @@ static void __exit mod_exit(void)
 	iodev_fini();
 	LOG_INFO("IODEV finalized successfully");
 
+	rx_steer_fini();
+
 	robject_del(&core_object);
 	LOG_INFO("IRATI RINA implementation kernel modules removed");
 }
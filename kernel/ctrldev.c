@@ -32,6 +32,9 @@
 #include <linux/sched.h>
 #include <linux/spinlock.h>
 #include <linux/compat.h>
+#include <linux/hashtable.h>
+#include <linux/rcupdate.h>
+#include <linux/atomic.h>
 
 #define RINA_PREFIX "ctrldev"
 
@@ -45,17 +48,30 @@
 #include "irati/serdes-utils.h"
 
 #define IRATI_CTRL_MSG_MAX_SIZE 5000
+#define CTRL_PORTS_HASH_BITS    8
 
 extern struct kipcm *default_kipcm;
 
+/* Maximum number of messages waiting to be read on a port, 0 = unbounded */
+static unsigned int ctrl_queue_max_msgs = 8192;
+module_param(ctrl_queue_max_msgs, uint, 0644);
+
 /* Private data to an ctrldev file instance. */
 struct ctrldev_priv {
 	irati_msg_port_t   port_id;
 	struct rfifo      *pending_msgs;
 	spinlock_t 	   pending_msgs_lock;
-	struct list_head   node;        /* queue of ctrl device file descriptors */
+	struct hlist_node  node;        /* hash of bound ctrl device files */
+	struct rcu_head    rcu;
 	struct file 	  *file; 	/* backpointer */
 	wait_queue_head_t  read_wqueue;
+	/* Several length-prefixed messages per read/write syscall */
+	bool		   batch_read;
+	bool		   batch_write;
+
+	/* Overflow accounting, under pending_msgs_lock */
+	unsigned int	   max_depth;
+	unsigned long	   drops;
 };
 
 struct message_handler {
@@ -64,18 +80,19 @@ struct message_handler {
 };
 
 struct irati_ctrl_dm {
-	/* List that contains all the IRATI ctrl devices that
-	 * are currently opened. */
-	struct list_head ctrl_devs;
+	/* The IRATI ctrl devices bound to a port, hashed by port-id.
+	 * Lookups run under rcu_read_lock(), updates under ports_lock. */
+	DECLARE_HASHTABLE(ctrl_ports, CTRL_PORTS_HASH_BITS);
+	spinlock_t ports_lock;
 
 	/* Array with message handlers */
 	struct message_handler handlers[IRATI_RINA_C_MAX];
 
-	/* Lock for ctrl_devs list */
+	/* Lock for the handlers */
 	struct mutex general_lock;
 
 	/* Sequence number counter */
-	uint32_t sn_counter;
+	atomic_t sn_counter;
 };
 
 static struct irati_ctrl_dm irati_ctrl_dm;
@@ -85,6 +102,17 @@ struct msg_queue_entry {
 	uint32_t   serlen;
 };
 
+static void msg_queue_entry_destroy(void * e)
+{
+	struct msg_queue_entry * entry = e;
+
+	if (!entry)
+		return;
+
+	rkfree(entry->sermsg);
+	rkfree(entry);
+}
+
 int irati_handler_register(irati_msg_t msg_type,
 		           irati_msg_handler_t handler,
 			   void * data)
@@ -159,25 +187,23 @@ uint32_t ctrl_dev_get_next_seqn()
 {
         uint32_t tmp;
 
-        mutex_lock(&irati_ctrl_dm.general_lock);
-
-        tmp = irati_ctrl_dm.sn_counter++;
-        if (irati_ctrl_dm.sn_counter == 0) {
+        tmp = (uint32_t) atomic_inc_return(&irati_ctrl_dm.sn_counter) - 1;
+        if (tmp == U32_MAX) {
                 LOG_WARN("RNL Sequence number rolled-over");
                 /* FIXME: What to do about roll-over? */
         }
 
-        mutex_unlock(&irati_ctrl_dm.general_lock);
-
         return tmp;
 }
 EXPORT_SYMBOL(ctrl_dev_get_next_seqn);
 
+/* To be called under rcu_read_lock() or ports_lock */
 static struct ctrldev_priv * get_ctrl_dev(irati_msg_port_t port_id)
 {
 	struct ctrldev_priv * pos;
 
-        list_for_each_entry(pos, &(irati_ctrl_dm.ctrl_devs), node) {
+	hash_for_each_possible_rcu(irati_ctrl_dm.ctrl_ports, pos, node,
+				   port_id) {
                 if (pos->port_id == port_id) {
                         return pos;
                 }
@@ -186,31 +212,52 @@ static struct ctrldev_priv * get_ctrl_dev(irati_msg_port_t port_id)
         return NULL;
 }
 
+/* Takes the ownership of entry on success only */
 static int ctrl_dev_data_post(struct msg_queue_entry * entry, irati_msg_port_t port_id)
 {
 	struct ctrldev_priv * ctrl_dev;
+	ssize_t depth;
 	int retval = 0;
 
-        mutex_lock(&irati_ctrl_dm.general_lock);
+	rcu_read_lock();
 
         ctrl_dev = get_ctrl_dev(port_id);
         if (!ctrl_dev) {
-        	mutex_unlock(&irati_ctrl_dm.general_lock);
+        	rcu_read_unlock();
         	LOG_ERR("Could not get IRATI ctrl dev for port-id %u",
         		port_id);
-        	return -1;
+        	return -ENOENT;
         }
 
-        /* TODO implement maximum queue size */
         spin_lock(&ctrl_dev->pending_msgs_lock);
         if (!ctrl_dev->pending_msgs) {
         	LOG_ERR("Control device has been closed");
-        	retval = -1;
-        } else if (rfifo_push_ni(ctrl_dev->pending_msgs, entry)) {
+        	retval = -EPIPE;
+        	goto out;
+        }
+
+        depth = rfifo_length(ctrl_dev->pending_msgs);
+        if (ctrl_queue_max_msgs && depth >= ctrl_queue_max_msgs) {
+        	ctrl_dev->drops++;
+        	if (printk_ratelimit())
+        		LOG_WARN("Ctrl port %u queue full (%zd msgs), "
+        			 "%lu msgs dropped so far", port_id,
+        			 depth, ctrl_dev->drops);
+        	retval = -ENOBUFS;
+        	goto out;
+        }
+
+        if (rfifo_push_ni(ctrl_dev->pending_msgs, entry)) {
         	LOG_ERR("Could not write %zd bytes into port-id %u fifo",
         			sizeof(*entry), port_id);
-        	retval = -1;
+        	retval = -ENOMEM;
+        	goto out;
         }
+
+        if (depth + 1 > ctrl_dev->max_depth)
+        	ctrl_dev->max_depth = depth + 1;
+
+ out:
         spin_unlock(&ctrl_dev->pending_msgs_lock);
 
         if (retval == 0) {
@@ -219,7 +266,7 @@ static int ctrl_dev_data_post(struct msg_queue_entry * entry, irati_msg_port_t p
 					   POLLIN | POLLRDNORM | POLLRDBAND);
         }
 
-        mutex_unlock(&irati_ctrl_dm.general_lock);
+        rcu_read_unlock();
 
         return retval;
 }
@@ -265,24 +312,121 @@ int irati_ctrl_dev_snd_resp_msg(irati_msg_port_t port,
 }
 EXPORT_SYMBOL(irati_ctrl_dev_snd_resp_msg);
 
+/* Queues a message for another control port, takes the ownership of
+ * sermsg on success */
+static int ctrldev_msg_forward(char * sermsg, uint32_t serlen,
+			       irati_msg_port_t port_id)
+{
+	struct msg_queue_entry * entry;
+	int ret;
+
+	entry = rkzalloc(sizeof(*entry), GFP_KERNEL);
+	if (!entry)
+		return -ENOMEM;
+
+	entry->sermsg = sermsg;
+	entry->serlen = serlen;
+
+	ret = ctrl_dev_data_post(entry, port_id);
+	if (ret)
+		rkfree(entry);
+
+	return ret;
+}
+
+/* Delivers a message addressed to the kernel to its handler */
+static int ctrldev_msg_handle(struct ctrldev_priv * priv,
+			      const char * sermsg, uint32_t serlen)
+{
+        struct irati_msg_base * bmsg = IRATI_MB(sermsg);
+        int ret;
+
+        if (bmsg->msg_type >= IRATI_RINA_C_MAX ||
+        		!irati_ctrl_dm.handlers[bmsg->msg_type].cb) {
+        	return -EINVAL;
+        }
+        /* TODO check permissions */
+
+        /* Deserialize message */
+        bmsg = (struct irati_msg_base *) deserialize_irati_msg(irati_ker_numtables, IRATI_RINA_C_MAX,
+        						       sermsg, serlen);
+        if (!bmsg) {
+        	return -EINVAL;
+        }
+
+        /* Invoke the message handler */
+        ret = irati_ctrl_dm.handlers[bmsg->msg_type].cb(priv->port_id, bmsg,
+        		 irati_ctrl_dm.handlers[bmsg->msg_type].data);
+
+        irati_msg_free(irati_ker_numtables, IRATI_RINA_C_MAX, bmsg);
+        rkfree(bmsg);
+
+        return ret;
+}
+
+/* Batch write mode: kbuf holds a sequence of messages, each one preceded
+ * by its uint32_t length. Returns the bytes consumed by the messages
+ * delivered before the first failure, if any. */
+static ssize_t ctrldev_write_batch(struct ctrldev_priv * priv,
+				   const char * kbuf, size_t len)
+{
+	struct irati_msg_base * bmsg;
+	char *                  sermsg;
+	uint32_t                serlen;
+	size_t                  off = 0;
+	int                     ret = -EINVAL;
+
+	while (len - off >= sizeof(serlen)) {
+		memcpy(&serlen, kbuf + off, sizeof(serlen));
+		if (serlen < sizeof(struct irati_msg_base) ||
+				serlen > len - off - sizeof(serlen)) {
+			ret = -EINVAL;
+			break;
+		}
+
+		bmsg = IRATI_MB(kbuf + off + sizeof(serlen));
+		if (bmsg->dest_port != 0) {
+			sermsg = rkmalloc(serlen, GFP_KERNEL);
+			if (!sermsg) {
+				ret = -ENOMEM;
+				break;
+			}
+			memcpy(sermsg, bmsg, serlen);
+
+			ret = ctrldev_msg_forward(sermsg, serlen,
+						  bmsg->dest_port);
+			if (ret)
+				rkfree(sermsg);
+		} else {
+			ret = ctrldev_msg_handle(priv, (const char *) bmsg,
+						 serlen);
+		}
+
+		if (ret)
+			break;
+
+		off += sizeof(serlen) + serlen;
+	}
+
+	return off ? off : ret;
+}
+
 static ssize_t
 ctrldev_write(struct file *f, const char __user *ubuf, size_t len, loff_t *ppos)
 {
         struct ctrldev_priv    * priv = (struct ctrldev_priv *) f->private_data;
         struct irati_msg_base  * bmsg;
-        struct msg_queue_entry * entry;
         char 		       * kbuf;
         ssize_t 		 ret = 0;
-        bool 			 destroy_kbuf = true;
-
-        LOG_DBG("Syscall write SDU (size = %zd, port-id = %d)",
-                        len, priv->port_id);
 
         if (!priv) {
         	LOG_ERR("Device has been closed");
         	return -1;
         }
 
+        LOG_DBG("Syscall write SDU (size = %zd, port-id = %d)",
+                        len, priv->port_id);
+
         if (len < sizeof(irati_msg_t)) {
         	/* This message doesn't even contain a message type. */
         	return -EINVAL;
@@ -300,50 +444,27 @@ ctrldev_write(struct file *f, const char __user *ubuf, size_t len, loff_t *ppos)
         	return -EFAULT;
         }
 
+        if (priv->batch_write) {
+        	ret = ctrldev_write_batch(priv, kbuf, len);
+        	rkfree(kbuf);
+        	if (ret > 0)
+        		*ppos += ret;
+        	return ret;
+        }
+
         bmsg = IRATI_MB(kbuf);
         /* Check if message is for the kernel, otherwise, put in right queue */
         if (bmsg->dest_port != 0) {
-        	entry = rkzalloc(sizeof(*entry), GFP_KERNEL);
-        	if (!entry) {
+        	/* The queued entry keeps kbuf */
+        	ret = ctrldev_msg_forward(kbuf, len, bmsg->dest_port);
+        	if (ret) {
         		rkfree(kbuf);
-        		return -ENOMEM;
-        	}
-
-        	entry->sermsg = kbuf;
-        	entry->serlen = len;
-        	destroy_kbuf = false;
-
-        	if (ctrl_dev_data_post(entry, bmsg->dest_port)) {
-        		rkfree(kbuf);
-        		rkfree(entry);
-			return -EFAULT;
+        		return ret;
         	}
         } else {
-        	if (bmsg->msg_type >= IRATI_RINA_C_MAX ||
-        			!irati_ctrl_dm.handlers[bmsg->msg_type].cb) {
-        		rkfree(kbuf);
-        		return -EINVAL;
-        	}
-        	/* TODO check permissions */
-
-                /* Deserialize message */
-                bmsg = (struct irati_msg_base *) deserialize_irati_msg(irati_ker_numtables, IRATI_RINA_C_MAX,
-                						       kbuf, len);
-                if (!bmsg) {
-                	rkfree(kbuf);
-                	return -EINVAL;
-                }
-
-        	/* Invoke the message handler */
-        	ret = irati_ctrl_dm.handlers[bmsg->msg_type].cb(priv->port_id, bmsg,
-        			 irati_ctrl_dm.handlers[bmsg->msg_type].data);
-
-        	irati_msg_free(irati_ker_numtables, IRATI_RINA_C_MAX, bmsg);
-        	rkfree(bmsg);
-        }
-
-        if (destroy_kbuf)
+        	ret = ctrldev_msg_handle(priv, kbuf, len);
         	rkfree(kbuf);
+        }
 
 	if (ret) {
 		return ret;
@@ -365,6 +486,50 @@ bool queue_ready(struct ctrldev_priv * priv)
 	return !rfifo_is_empty(priv->pending_msgs);
 }
 
+/* Batch read mode: hands out as many whole queued messages as fit in buffer,
+ * each one preceded by its uint32_t length. Called with the queue not empty
+ * and pending_msgs_lock held, which is released. */
+static ssize_t ctrldev_read_batch(struct ctrldev_priv * priv,
+				  char __user * buffer, size_t size)
+{
+	struct msg_queue_entry * entry;
+	size_t                   copied = 0;
+	uint32_t                 serlen;
+	bool                     fault;
+
+	for (;;) {
+		entry = rfifo_peek(priv->pending_msgs);
+		if (!entry ||
+		    sizeof(entry->serlen) + entry->serlen > size - copied)
+			break;
+
+		rfifo_pop(priv->pending_msgs);
+		spin_unlock(&priv->pending_msgs_lock);
+
+		fault = copy_to_user(buffer + copied, &entry->serlen,
+				     sizeof(entry->serlen)) ||
+			copy_to_user(buffer + copied + sizeof(entry->serlen),
+				     entry->sermsg, entry->serlen);
+		serlen = entry->serlen;
+		msg_queue_entry_destroy(entry);
+		if (unlikely(fault))
+			return copied ? copied : -EFAULT;
+
+		copied += sizeof(serlen) + serlen;
+
+		spin_lock(&priv->pending_msgs_lock);
+		if (!priv->pending_msgs)
+			break;
+	}
+	spin_unlock(&priv->pending_msgs_lock);
+
+	LOG_DBG("Batch read on port %u finishing, read %zd bytes",
+		priv->port_id, copied);
+
+	/* Not even the first message fits */
+	return copied ? copied : -ENOBUFS;
+}
+
 static ssize_t
 ctrldev_read(struct file *f, char __user *buffer, size_t size, loff_t *ppos)
 {
@@ -453,6 +618,13 @@ ctrldev_read(struct file *f, char __user *buffer, size_t size, loff_t *ppos)
 		goto finish;
 	}
 
+	if (priv->batch_read) {
+		ret = ctrldev_read_batch(priv, buffer, size);
+		if (ret > 0)
+			*ppos += ret;
+		goto finish;
+	}
+
 	if (entry->serlen > size) {
 		spin_unlock(&priv->pending_msgs_lock);
 		ret = -ENOBUFS;
@@ -521,28 +693,29 @@ ctrldev_open(struct inode *inode, struct file *f)
 
 	spin_lock_init(&priv->pending_msgs_lock);
 	init_waitqueue_head(&priv->read_wqueue);
+	INIT_HLIST_NODE(&priv->node);
 
         priv->port_id = port_id_bad();
         priv->file = f;
         f->private_data = priv;
 
-        mutex_lock(&irati_ctrl_dm.general_lock);
-        list_add_tail(&priv->node, &irati_ctrl_dm.ctrl_devs);
-        mutex_unlock(&irati_ctrl_dm.general_lock);
-
         return 0;
 }
 
+static void ctrldev_priv_free_rcu(struct rcu_head * head)
+{ rkfree(container_of(head, struct ctrldev_priv, rcu)); }
+
 static int
 ctrldev_release(struct inode *inode, struct file *f)
 {
         struct ctrldev_priv *priv = (struct ctrldev_priv *) f->private_data;
         struct rfifo * pmsgs;
 
-        mutex_lock(&irati_ctrl_dm.general_lock);
         LOG_DBG("Releasing file descriptor associated to port-id %d", priv->port_id);
-        list_del_init(&priv->node);
-        mutex_unlock(&irati_ctrl_dm.general_lock);
+        spin_lock(&irati_ctrl_dm.ports_lock);
+        if (hash_hashed(&priv->node))
+        	hash_del_rcu(&priv->node);
+        spin_unlock(&irati_ctrl_dm.ports_lock);
 
         spin_lock(&priv->pending_msgs_lock);
         pmsgs = priv->pending_msgs;
@@ -550,11 +723,16 @@ ctrldev_release(struct inode *inode, struct file *f)
         spin_unlock(&priv->pending_msgs_lock);
 
         /* Drain queue of pending messages */
-        if (rfifo_destroy(pmsgs, (void (*) (void *)) rkfree)) {
+        if (rfifo_destroy(pmsgs, msg_queue_entry_destroy)) {
         	LOG_ERR("Ctrl-dev %u FIFO has not been destroyed",
         		priv->port_id);
         }
 
+        if (priv->drops) {
+        	LOG_WARN("Ctrl port %u dropped %lu msgs, max queue depth %u",
+        		 priv->port_id, priv->drops, priv->max_depth);
+        }
+
         //TODO If IPC Manager has died, destroy all control devices and IPCPs
         if (priv->port_id == 1) {
         	LOG_WARN("IPC Manager process has been destroyed");
@@ -567,37 +745,17 @@ ctrldev_release(struct inode *inode, struct file *f)
         wake_up_interruptible_poll(&priv->read_wqueue,
         			   POLLIN | POLLRDNORM | POLLRDBAND);
 
-        return 0;
-}
+        /* Posters may still be looking at it */
+        f->private_data = NULL;
+        call_rcu(&priv->rcu, ctrldev_priv_free_rcu);
 
-static bool ctrl_port_in_use(irati_msg_port_t port_id)
-{
-	struct ctrldev_priv * pos;
-
-        mutex_lock(&irati_ctrl_dm.general_lock);
-        list_for_each_entry(pos, &(irati_ctrl_dm.ctrl_devs), node) {
-                if (port_id == pos->port_id) {
-                	mutex_unlock(&irati_ctrl_dm.general_lock);
-                	return true;
-                }
-        }
-        mutex_unlock(&irati_ctrl_dm.general_lock);
-
-        return false;
+        return 0;
 }
 
-static long
-ctrldev_ioctl(struct file *f, unsigned int cmd, unsigned long arg)
+static long ctrldev_bind(struct ctrldev_priv * priv, void __user * p)
 {
-        struct ctrldev_priv *priv = (struct ctrldev_priv *) f->private_data;
-        void __user *p = (void __user *)arg;
         struct irati_ctrldev_ctldata data;
 
-        if (cmd != IRATI_CTRL_FLOW_BIND) {
-                LOG_ERR("Invalid cmd %u", cmd);
-                return -EINVAL;
-        }
-
         if (copy_from_user(&data, p, sizeof(data))) {
                 return -EFAULT;
         }
@@ -607,12 +765,15 @@ ctrldev_ioctl(struct file *f, unsigned int cmd, unsigned long arg)
                 return -EINVAL;
         }
 
-        if (ctrl_port_in_use(data.port_id)) {
+        spin_lock(&irati_ctrl_dm.ports_lock);
+        if (get_ctrl_dev(data.port_id)) {
+        	spin_unlock(&irati_ctrl_dm.ports_lock);
         	LOG_ERR("Control port is already in use, %d", data.port_id);
         	return -EINVAL;
         }
 
         if (is_port_id_ok(priv->port_id)) {
+        	spin_unlock(&irati_ctrl_dm.ports_lock);
                 LOG_ERR("Cannot bind to port %d, "
                         "already bound to port id %d",
                         data.port_id, priv->port_id);
@@ -620,12 +781,54 @@ ctrldev_ioctl(struct file *f, unsigned int cmd, unsigned long arg)
         }
 
         priv->port_id = data.port_id;
+        hash_add_rcu(irati_ctrl_dm.ctrl_ports, &priv->node, priv->port_id);
+        spin_unlock(&irati_ctrl_dm.ports_lock);
 
         LOG_DBG("Control device instance bound to port id %d", data.port_id);
 
         return 0;
 }
 
+static long ctrldev_mode_set(struct ctrldev_priv * priv, void __user * p)
+{
+        struct irati_ctrldev_mode mode;
+
+        if (copy_from_user(&mode, p, sizeof(mode))) {
+                return -EFAULT;
+        }
+
+        if (mode.flags & ~(IRATI_CTRL_MODE_BATCH_READ |
+        		   IRATI_CTRL_MODE_BATCH_WRITE)) {
+                LOG_ERR("Unknown mode flags %#x", mode.flags);
+                return -EINVAL;
+        }
+
+        priv->batch_read = !!(mode.flags & IRATI_CTRL_MODE_BATCH_READ);
+        priv->batch_write = !!(mode.flags & IRATI_CTRL_MODE_BATCH_WRITE);
+
+        LOG_DBG("Control device on port %d, batch read %d, batch write %d",
+        	priv->port_id, priv->batch_read, priv->batch_write);
+
+        return 0;
+}
+
+static long
+ctrldev_ioctl(struct file *f, unsigned int cmd, unsigned long arg)
+{
+        struct ctrldev_priv *priv = (struct ctrldev_priv *) f->private_data;
+        void __user *p = (void __user *)arg;
+
+        switch (cmd) {
+        case IRATI_CTRL_FLOW_BIND:
+        	return ctrldev_bind(priv, p);
+        case IRATI_CTRL_MODE_SET:
+        	return ctrldev_mode_set(priv, p);
+        default:
+                LOG_ERR("Invalid cmd %u", cmd);
+                return -EINVAL;
+        }
+}
+
 #ifdef CONFIG_COMPAT
 static long
 ctrldev_compat_ioctl(struct file *f, unsigned int cmd, unsigned long arg)
@@ -660,9 +863,10 @@ ctrldev_init(void)
         int ret;
 
         mutex_init(&irati_ctrl_dm.general_lock);
-        INIT_LIST_HEAD(&irati_ctrl_dm.ctrl_devs);
+        spin_lock_init(&irati_ctrl_dm.ports_lock);
+        hash_init(irati_ctrl_dm.ctrl_ports);
 
-        irati_ctrl_dm.sn_counter = 0;
+        atomic_set(&irati_ctrl_dm.sn_counter, 0);
 
         ret = misc_register(&irati_ctrl_misc);
         if (ret) {
@@ -677,6 +881,9 @@ void
 ctrldev_fini(void)
 {
         misc_deregister(&irati_ctrl_misc);
+
+        /* Wait for the pending frees of released devices */
+        rcu_barrier();
 }
 
 MODULE_LICENSE("GPL");
@@ -0,0 +1,483 @@
+/*
+ * Delimiting (SDU fragmentation, reassembly and concatenation)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <linux/export.h>
+#include <linux/kernel.h>
+#include <linux/string.h>
+
+#define RINA_PREFIX "delim"
+
+#include "logs.h"
+#include "utils.h"
+#include "debug.h"
+#include "delim.h"
+#include "dtp.h"
+#include "efcp-str.h"
+#include "pci.h"
+#include "policies.h"
+#include "rds/rqueue.h"
+#include "rds/rtimer.h"
+
+#define DELIM_CONCAT_MAX_SDU_DEFAULT 128 /* bytes */
+#define DELIM_CONCAT_FLUSH_DEFAULT   1   /* ms */
+
+struct delim {
+        struct dtp *         dtp;
+        struct efcp_config * cfg;
+
+        /* User data of a DT PDU, after the delimiting header */
+        size_t               max_payload;
+        bool                 frag;
+        bool                 concat;
+        size_t               concat_max_sdu;
+        unsigned int         concat_flush;
+
+        /* Sender: the PDU being filled with concatenated SDUs */
+        spinlock_t           tx_lock;
+        struct du *          tx_concat;
+        struct rtimer *      tx_timer;
+
+        /* Receiver: fragments of the SDU being reassembled */
+        spinlock_t           rx_lock;
+        struct rqueue *      rx_frags;
+        size_t               rx_len;
+        seq_num_t            rx_next;
+};
+
+bool delim_required(const struct dt_cons * dt_cons)
+{ return dt_cons && (dt_cons->dif_frag || dt_cons->dif_concat); }
+EXPORT_SYMBOL(delim_required);
+
+static unsigned int delim_param(struct policy * ps,
+                                const char *    name,
+                                unsigned int    def)
+{
+        struct policy_parm * parm;
+        unsigned int         val;
+
+        parm = ps ? policy_param_find(ps, name) : NULL;
+        if (!parm)
+                return def;
+
+        if (kstrtouint(policy_param_value(parm), 10, &val)) {
+                LOG_WARN("Bogus value for delimiting parameter %s", name);
+                return def;
+        }
+
+        return val;
+}
+
+/* A DT PDU with room for what the IPCPs below will add to it */
+static struct du * delim_pdu_create(struct delim * delim, size_t len)
+{
+        size_t headroom;
+        size_t tailroom;
+
+        rmt_du_room(delim->dtp->efcp->container->rmt, &headroom, &tailroom);
+
+        return du_create_room_ni(len, headroom, tailroom);
+}
+
+/* tx_lock held */
+static int delim_concat_flush(struct delim * delim)
+{
+        struct du * du;
+
+        du = delim->tx_concat;
+        if (!du)
+                return 0;
+
+        delim->tx_concat = NULL;
+
+        return dtp_write_pdu(delim->dtp, du);
+}
+
+static void tf_concat_flush(void * data)
+{
+        struct delim * delim = data;
+
+        spin_lock_bh(&delim->tx_lock);
+        if (delim_concat_flush(delim))
+                LOG_ERR("Could not flush concatenated SDUs");
+        spin_unlock_bh(&delim->tx_lock);
+}
+
+/* tx_lock held */
+static int delim_concat_add(struct delim * delim, struct du * du)
+{
+        size_t          len;
+        size_t          off;
+        unsigned char * p;
+
+        len = du_len(du);
+
+        if (delim->tx_concat &&
+            du_len(delim->tx_concat) + DELIM_LEN_LEN + len >
+            DELIM_HDR_LEN + delim->max_payload) {
+                if (delim_concat_flush(delim))
+                        LOG_ERR("Could not flush concatenated SDUs");
+        }
+
+        if (!delim->tx_concat) {
+                delim->tx_concat = delim_pdu_create(delim, DELIM_HDR_LEN +
+                                                    delim->max_payload);
+                if (!delim->tx_concat) {
+                        du_destroy(du);
+                        return -1;
+                }
+                du_tail_shrink(delim->tx_concat, delim->max_payload);
+                delim->tx_concat->cfg = delim->cfg;
+                du_buffer(delim->tx_concat)[0] = DELIM_FLAGS_CONCAT;
+
+                /* Bounds the delay added to the first SDU */
+                rtimer_start(delim->tx_timer, delim->concat_flush);
+        }
+
+        off = du_len(delim->tx_concat);
+        if (du_tail_grow(delim->tx_concat, DELIM_LEN_LEN + len)) {
+                du_destroy(du);
+                return -1;
+        }
+
+        p = du_buffer(delim->tx_concat) + off;
+        p[0] = (len >> 8) & 0xff;
+        p[1] = len & 0xff;
+        memcpy(p + DELIM_LEN_LEN, du_buffer(du), len);
+        du_destroy(du);
+
+        /* Flush right away if not even an empty SDU would fit */
+        if (du_len(delim->tx_concat) + DELIM_LEN_LEN >=
+            DELIM_HDR_LEN + delim->max_payload)
+                return delim_concat_flush(delim);
+
+        return 0;
+}
+
+/* tx_lock held */
+static int delim_fragment(struct delim * delim, struct du * du)
+{
+        struct du *     frag;
+        unsigned char * p;
+        size_t          len;
+        size_t          off;
+        size_t          n;
+        int             ret = 0;
+
+        len = du_len(du);
+
+        for (off = 0; off < len; off += n) {
+                n = min(len - off, delim->max_payload);
+
+                frag = delim_pdu_create(delim, DELIM_HDR_LEN + n);
+                if (!frag) {
+                        ret = -1;
+                        break;
+                }
+                frag->cfg = delim->cfg;
+
+                p = du_buffer(frag);
+                p[0] = 0;
+                if (off == 0)
+                        p[0] |= DELIM_FLAGS_FIRST;
+                if (off + n == len)
+                        p[0] |= DELIM_FLAGS_LAST;
+                memcpy(p + DELIM_HDR_LEN, du_buffer(du) + off, n);
+
+                /* The receiver drops the SDU if we stop half-way */
+                if (dtp_write_pdu(delim->dtp, frag)) {
+                        ret = -1;
+                        break;
+                }
+        }
+
+        du_destroy(du);
+
+        return ret;
+}
+
+int delim_write(struct delim * delim, struct du * du)
+{
+        size_t len;
+        int    ret;
+
+        ASSERT(delim);
+
+        len = du_len(du);
+
+        spin_lock_bh(&delim->tx_lock);
+
+        if (delim->concat && len <= delim->concat_max_sdu) {
+                ret = delim_concat_add(delim, du);
+                spin_unlock_bh(&delim->tx_lock);
+                return ret;
+        }
+
+        /* Keep the SDUs in order, the ones being concatenated go first */
+        if (delim_concat_flush(delim))
+                LOG_ERR("Could not flush concatenated SDUs");
+
+        if (len <= delim->max_payload) {
+                if (du_head_grow(du, DELIM_HDR_LEN)) {
+                        spin_unlock_bh(&delim->tx_lock);
+                        du_destroy(du);
+                        return -1;
+                }
+                du_buffer(du)[0] = DELIM_FLAGS_FIRST | DELIM_FLAGS_LAST;
+                ret = dtp_write_pdu(delim->dtp, du);
+        } else if (delim->frag) {
+                ret = delim_fragment(delim, du);
+        } else {
+                LOG_ERR("SDU of %zu bytes does not fit a PDU and "
+                        "fragmentation is disabled", len);
+                du_destroy(du);
+                ret = -1;
+        }
+
+        spin_unlock_bh(&delim->tx_lock);
+
+        return ret;
+}
+EXPORT_SYMBOL(delim_write);
+
+/* rx_lock held */
+static void delim_reasm_drop(struct delim * delim)
+{
+        struct du * du;
+
+        if (rqueue_is_empty(delim->rx_frags))
+                return;
+
+        LOG_DBG("Dropping incomplete SDU (%zu bytes)", delim->rx_len);
+
+        while (!rqueue_is_empty(delim->rx_frags)) {
+                du = rqueue_head_pop(delim->rx_frags);
+                if (du)
+                        du_destroy(du);
+        }
+        delim->rx_len = 0;
+}
+
+/* rx_lock held */
+static int delim_reasm_add(struct delim * delim,
+                           struct du *    du,
+                           seq_num_t      sn,
+                           unsigned char  flags)
+{
+        struct du *     sdu;
+        struct du *     frag;
+        unsigned char * p;
+
+        if (flags & DELIM_FLAGS_FIRST) {
+                delim_reasm_drop(delim);
+        } else if (rqueue_is_empty(delim->rx_frags) ||
+                   sn != delim->rx_next) {
+                /* A fragment got lost, so did the whole SDU */
+                delim_reasm_drop(delim);
+                du_destroy(du);
+                return 0;
+        }
+
+        if (delim->rx_len + du_len(du) > DELIM_MAX_SDU_SIZE ||
+            rqueue_tail_push_ni(delim->rx_frags, du)) {
+                LOG_ERR("Could not reassemble SDU, dropping it");
+                delim_reasm_drop(delim);
+                du_destroy(du);
+                return -1;
+        }
+        delim->rx_len += du_len(du);
+        delim->rx_next = sn + 1;
+
+        if (!(flags & DELIM_FLAGS_LAST))
+                return 0;
+
+        sdu = du_create_ni(delim->rx_len);
+        if (!sdu) {
+                delim_reasm_drop(delim);
+                return -1;
+        }
+
+        p = du_buffer(sdu);
+        while (!rqueue_is_empty(delim->rx_frags)) {
+                frag = rqueue_head_pop(delim->rx_frags);
+                if (!frag)
+                        continue;
+                memcpy(p, du_buffer(frag), du_len(frag));
+                p += du_len(frag);
+                du_destroy(frag);
+        }
+        delim->rx_len = 0;
+
+        return dtp_sdu_post(delim->dtp, sdu);
+}
+
+/* rx_lock held */
+static int delim_concat_split(struct delim * delim, struct du * du)
+{
+        struct du *     sdu;
+        unsigned char * p;
+        size_t          len;
+        size_t          off;
+        size_t          n;
+
+        len = du_len(du);
+        off = 0;
+
+        while (off + DELIM_LEN_LEN <= len) {
+                p = du_buffer(du) + off;
+                n = (p[0] << 8) | p[1];
+                off += DELIM_LEN_LEN;
+
+                if (off + n > len)
+                        break;
+
+                if (off + n == len) {
+                        /* The last SDU keeps the PDU buffer */
+                        du_consume_data(du, off);
+                        return dtp_sdu_post(delim->dtp, du);
+                }
+
+                sdu = du_create_ni(n);
+                if (!sdu) {
+                        du_destroy(du);
+                        return -1;
+                }
+                memcpy(du_buffer(sdu), p + DELIM_LEN_LEN, n);
+                dtp_sdu_post(delim->dtp, sdu);
+
+                off += n;
+        }
+
+        LOG_ERR("Malformed concatenated PDU (%zu bytes)", len);
+        du_destroy(du);
+
+        return -1;
+}
+
+int delim_receive(struct delim * delim, struct du * du)
+{
+        unsigned char flags;
+        seq_num_t     sn;
+        int           ret;
+
+        ASSERT(delim);
+
+        if (du_len(du) < DELIM_HDR_LEN) {
+                LOG_ERR("PDU too short for the delimiting header");
+                du_destroy(du);
+                return -1;
+        }
+
+        sn    = pci_sequence_number_get(&du->pci);
+        flags = du_buffer(du)[0];
+        du_consume_data(du, DELIM_HDR_LEN);
+
+        spin_lock_bh(&delim->rx_lock);
+
+        if (flags & DELIM_FLAGS_CONCAT) {
+                delim_reasm_drop(delim);
+                ret = delim_concat_split(delim, du);
+        } else if ((flags & DELIM_FLAGS_FIRST) &&
+                   (flags & DELIM_FLAGS_LAST)) {
+                delim_reasm_drop(delim);
+                ret = dtp_sdu_post(delim->dtp, du);
+        } else {
+                ret = delim_reasm_add(delim, du, sn, flags);
+        }
+
+        spin_unlock_bh(&delim->rx_lock);
+
+        return ret;
+}
+EXPORT_SYMBOL(delim_receive);
+
+struct delim * delim_create(struct dtp *         dtp,
+                            struct efcp_config * cfg,
+                            struct policy *      ps)
+{
+        struct delim * delim;
+        ssize_t        pci_len;
+
+        ASSERT(dtp);
+        ASSERT(cfg && cfg->dt_cons);
+
+        pci_len = pci_calculate_size(cfg, PDU_TYPE_DT);
+        if (pci_len < 0 ||
+            cfg->dt_cons->max_pdu_size <=
+            pci_len + DELIM_HDR_LEN + DELIM_LEN_LEN) {
+                LOG_ERR("Max PDU size %u too small for delimiting",
+                        cfg->dt_cons->max_pdu_size);
+                return NULL;
+        }
+
+        delim = rkzalloc(sizeof(*delim), GFP_KERNEL);
+        if (!delim)
+                return NULL;
+
+        delim->dtp         = dtp;
+        delim->cfg         = cfg;
+        delim->max_payload = cfg->dt_cons->max_pdu_size - pci_len -
+                DELIM_HDR_LEN;
+        delim->frag        = cfg->dt_cons->dif_frag &&
+                delim_param(ps, "fragmentation", 1);
+        delim->concat      = cfg->dt_cons->dif_concat &&
+                delim_param(ps, "concatenation", 0);
+        delim->concat_max_sdu = min_t(size_t,
+                delim_param(ps, "concat_max_sdu_size",
+                            DELIM_CONCAT_MAX_SDU_DEFAULT),
+                min_t(size_t, delim->max_payload - DELIM_LEN_LEN, 0xffff));
+        delim->concat_flush = delim_param(ps, "concat_flush_timer",
+                                          DELIM_CONCAT_FLUSH_DEFAULT);
+
+        spin_lock_init(&delim->tx_lock);
+        spin_lock_init(&delim->rx_lock);
+
+        delim->tx_timer = rtimer_create(tf_concat_flush, delim);
+        delim->rx_frags = rqueue_create();
+        if (!delim->tx_timer || !delim->rx_frags) {
+                delim_destroy(delim);
+                return NULL;
+        }
+
+        LOG_DBG("Delimiting: payload %zu, fragmentation %d, "
+                "concatenation %d (up to %zu bytes, %u ms)",
+                delim->max_payload, delim->frag, delim->concat,
+                delim->concat_max_sdu, delim->concat_flush);
+
+        return delim;
+}
+EXPORT_SYMBOL(delim_create);
+
+int delim_destroy(struct delim * delim)
+{
+        if (!delim)
+                return -1;
+
+        /* The flush timer writes to the DTP, stop it first */
+        if (delim->tx_timer)
+                rtimer_destroy(delim->tx_timer);
+        if (delim->tx_concat)
+                du_destroy(delim->tx_concat);
+        if (delim->rx_frags)
+                rqueue_destroy(delim->rx_frags,
+                               (void (*)(void *)) du_destroy);
+
+        rkfree(delim);
+
+        return 0;
+}
+EXPORT_SYMBOL(delim_destroy);
@@ -0,0 +1,66 @@
+/*
+ * Delimiting (SDU fragmentation, reassembly and concatenation)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef RINA_DELIM_H
+#define RINA_DELIM_H
+
+#include "common.h"
+#include "du.h"
+
+/*
+ * On DIFs supporting fragmentation or concatenation the user data of
+ * every DT PDU starts with a delimiting header. A concatenated PDU then
+ * carries one or more complete SDUs, each one preceded by its length
+ * (16 bits, network order).
+ */
+#define DELIM_HDR_LEN       1
+#define DELIM_LEN_LEN       2
+
+#define DELIM_FLAGS_FIRST   0x01 /* Carries the first byte of an SDU */
+#define DELIM_FLAGS_LAST    0x02 /* Carries the last byte of an SDU */
+#define DELIM_FLAGS_CONCAT  0x04 /* Carries concatenated SDUs */
+
+/* Largest SDU accepted on DIFs supporting fragmentation */
+#define DELIM_MAX_SDU_SIZE  (64 * 1024)
+
+struct dtp;
+struct dt_cons;
+struct efcp_config;
+struct policy;
+struct delim;
+
+bool           delim_required(const struct dt_cons * dt_cons);
+
+/*
+ * The connection policy parameters (ps) may disable fragmentation
+ * ("fragmentation") and enable concatenation ("concatenation") of SDUs
+ * up to "concat_max_sdu_size" bytes, flushed after "concat_flush_timer"
+ * milliseconds
+ */
+struct delim * delim_create(struct dtp *         dtp,
+                            struct efcp_config * cfg,
+                            struct policy *      ps);
+int            delim_destroy(struct delim * delim);
+
+/* Takes the ownership of the SDU, writes the resulting PDUs to the DTP */
+int            delim_write(struct delim * delim, struct du * du);
+
+/* Takes the ownership of the PDU, posts the resulting SDUs from the DTP */
+int            delim_receive(struct delim * delim, struct du * du);
+
+#endif
@@ -24,6 +24,7 @@
 #include <linux/module.h>
 #include <linux/string.h>
 #include <linux/random.h>
+#include <linux/ktime.h>
 
 #define RINA_PREFIX "dtcp-ps-default"
 
@@ -147,6 +148,28 @@ int default_sending_ack(struct dtcp_ps * ps, seq_num_t seq)
         return ret;
 }
 
+int default_receiving_ack_list(struct dtcp_ps *  ps,
+                               const seq_num_t * blocks,
+                               int               n_blocks)
+{
+        struct dtcp * dtcp = ps->dm;
+
+        if (!dtcp) {
+                LOG_ERR("No instance passed, cannot run policy");
+                return -1;
+        }
+
+        if (!ps->rtx_ctrl)
+                return 0;
+
+        if (!dtcp->parent->rtxq) {
+                LOG_ERR("Couldn't find the Retransmission queue");
+                return -1;
+        }
+
+        return rtxq_sack(dtcp->parent->rtxq, blocks, n_blocks);
+}
+
 int default_receiving_flow_control(struct dtcp_ps * ps, const struct pci * pci)
 {
         struct dtcp * dtcp = ps->dm;
@@ -179,6 +202,7 @@ int default_rcvr_flow_control(struct dtcp_ps * ps, const struct pci * pci)
         struct dtcp * dtcp = ps->dm;
         seq_num_t LWE;
         seq_num_t RWE;
+        uint_t    credit;
 
         if (!dtcp) {
                 LOG_ERR("No instance passed, cannot run policy");
@@ -189,9 +213,13 @@ int default_rcvr_flow_control(struct dtcp_ps * ps, const struct pci * pci)
                 return -1;
         }
 
+        /* The credit is clamped while the reader lags behind */
+        credit = dtcp_rcvr_credit(dtcp);
+
         spin_lock_bh(&dtcp->parent->sv_lock);
         LWE = dtcp->parent->sv->rcv_left_window_edge;
-        dtcp->sv->rcvr_rt_wind_edge = LWE + dtcp->sv->rcvr_credit;
+        if (LWE + credit > dtcp->sv->rcvr_rt_wind_edge)
+                dtcp->sv->rcvr_rt_wind_edge = LWE + credit;
         RWE = dtcp->sv->rcvr_rt_wind_edge;
         spin_unlock_bh(&dtcp->parent->sv_lock);
 
@@ -237,9 +265,11 @@ int default_rate_reduction(struct dtcp_ps * ps, const struct pci * pci)
 int default_rtt_estimator(struct dtcp_ps * ps, seq_num_t sn)
 {
         struct dtcp *       dtcp;
-        uint_t              rtt, new_sample, srtt, rttvar, trmsecs;
-        timeout_t           start_time, a;
-        int                 abs;
+        uint_t              rtt, srtt, rttvar;
+        unsigned int        as, bs;
+        ktime_t             start_time;
+        s64                 sample;
+        u64                 var, rto;
 
         if (!ps)
                 return -1;
@@ -250,51 +280,54 @@ int default_rtt_estimator(struct dtcp_ps * ps, seq_num_t sn)
         LOG_DBG("RTT Estimator...");
 
         start_time = rtxq_entry_timestamp(dtcp->parent->rtxq, sn);
-        if (start_time == 0) {
+        if (ktime_to_ns(start_time) == 0) {
         	LOG_DBG("RTTestimator: PDU %u has been retransmitted", sn);
                 return 0;
         }
 
-        new_sample = jiffies_to_msecs(jiffies - start_time);
+        sample = ktime_us_delta(ktime_get(), start_time);
+        if (sample < 0)
+                sample = 0;
+        rtt = sample > UINT_MAX ? UINT_MAX : (uint_t) sample;
+
+        /* Keep the shifts sane whatever was configured */
+        as = min_t(unsigned int, ps->rtx.rtt_alpha_shift, 16);
+        bs = min_t(unsigned int, ps->rtx.rtt_beta_shift, 16);
 
         spin_lock_bh(&dtcp->parent->sv_lock);
 
-        rtt        = dtcp->sv->rtt;
         srtt       = dtcp->sv->srtt;
         rttvar     = dtcp->sv->rttvar;
-        a 	   = dtcp->parent->sv->A;
 
-        if (!rtt) {
-        	rtt = new_sample;
-                rttvar = new_sample >> 1;
-                srtt   = new_sample;
+        /* RFC 6298, all values in us */
+        if (!srtt) {
+                srtt   = rtt;
+                rttvar = rtt >> 1;
         } else {
-        	/* RTT <== RTT * (112/128) + SAMPLE * (16/128)*/
-        	rtt = (rtt * 112 + (new_sample << 4)) >> 7;
-                abs = srtt - new_sample;
-                abs = abs < 0 ? -abs : abs;
-                rttvar = ((3 * rttvar) >> 2) + (((uint_t)abs) >> 2);
+                /* RTTVAR <- (1 - beta) * RTTVAR + beta * |SRTT - R| */
+                var    = srtt > rtt ? srtt - rtt : rtt - srtt;
+                rttvar = (((u64) rttvar << bs) - rttvar + var) >> bs;
+                /* SRTT <- (1 - alpha) * SRTT + alpha * R */
+                srtt   = (((u64) srtt << as) - srtt + rtt) >> as;
         }
 
-        /*FIXME: k, G, alpha and betha should be parameters passed to the policy
-         * set. Probably moving them to ps->priv */
-
-        /* k * rttvar = 4 * rttvar */
-        trmsecs  = rttvar << 2;
-        /* G is 0.1s according to RFC6298, then 100ms */
-        trmsecs  = 100 > trmsecs ? 100 : trmsecs;
-        trmsecs += srtt + jiffies_to_msecs(a);
-        /* RTO (tr) less than 1s? (not for the common policy) */
-        /*trmsecs  = trmsecs < 1000 ? 1000 : trmsecs;*/
+        /* RTO <- SRTT + max(G, K * RTTVAR) + A */
+        var = (u64) ps->rtx.rto_k * rttvar;
+        rto = srtt + max_t(u64, ps->rtx.rto_g_us, var) +
+                (u64) dtcp->parent->sv->A * USEC_PER_MSEC;
+        if (ps->rtx.rto_max_us && rto > ps->rtx.rto_max_us)
+                rto = ps->rtx.rto_max_us;
+        if (rto > UINT_MAX)
+                rto = UINT_MAX;
 
         dtcp->sv->rtt = rtt;
         dtcp->sv->rttvar = rttvar;
         dtcp->sv->srtt = srtt;
-        dtcp->parent->sv->tr = msecs_to_jiffies(trmsecs);
+        dtcp->parent->sv->tr = (timeout_t) rto;
 
         spin_unlock_bh(&dtcp->parent->sv_lock);
 
-	LOG_DBG("New RTT %u; New Tr: %u ms", rtt, trmsecs);
+	LOG_DBG("New RTT %u us; SRTT %u us; New Tr: %llu us", rtt, srtt, rto);
 
         return 0;
 }
@@ -318,7 +351,7 @@ struct ps_base * dtcp_ps_default_create(struct rina_component * component)
         ps->received_retransmission     = NULL;
         ps->sender_ack                  = default_sender_ack;
         ps->sending_ack                 = default_sending_ack;
-        ps->receiving_ack_list          = NULL;
+        ps->receiving_ack_list          = default_receiving_ack_list;
         ps->initial_rate                = NULL;
         ps->receiving_flow_control      = default_receiving_flow_control;
         ps->update_credit               = NULL;
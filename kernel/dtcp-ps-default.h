@@ -47,6 +47,10 @@ int default_sender_ack(struct dtcp_ps * ps, seq_num_t seq_num);
 
 int default_sending_ack(struct dtcp_ps * ps, seq_num_t seq);
 
+int default_receiving_ack_list(struct dtcp_ps *  ps,
+                               const seq_num_t * blocks,
+                               int               n_blocks);
+
 int default_receiving_flow_control(struct dtcp_ps * ps, const struct pci * pci);
 
 int default_rcvr_flow_control(struct dtcp_ps * ps, const struct pci * pci);
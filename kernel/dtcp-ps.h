@@ -23,6 +23,7 @@
 #define RINA_DTCP_PS_H
 
 #include <linux/types.h>
+#include <linux/time.h>
 
 #include "dtcp.h"
 #include "rds/rfifo.h"
@@ -51,10 +52,25 @@ struct dtcp_flowctrl_params {
         unsigned int rcvd_buffers_th;
 };
 
+/* RFC 6298 defaults; G keeps the historical 100 ms floor of the RTO */
+#define RTT_ALPHA_SHIFT 3
+#define RTT_BETA_SHIFT  2
+#define RTO_K           4
+#define RTO_G_US        (100 * USEC_PER_MSEC)
+#define RTO_MAX_US      (60 * USEC_PER_SEC)
+
 struct dtcp_rtx_params {
         unsigned int max_time_retry;
         unsigned int data_retransmit_max;
         unsigned int initial_tr;
+        bool sack;
+        /* RTO estimation (RFC 6298): alpha = 1/2^alpha_shift,
+         * beta = 1/2^beta_shift, RTO = SRTT + max(G, K * RTTVAR) + A */
+        unsigned int rtt_alpha_shift;
+        unsigned int rtt_beta_shift;
+        unsigned int rto_k;
+        unsigned int rto_g_us;
+        unsigned int rto_max_us;
 };
 
 struct dtcp_ps {
@@ -69,7 +85,10 @@ struct dtcp_ps {
         int (* rcvr_ack)(struct dtcp_ps * instance, const struct pci * pci);
         int (* sender_ack)(struct dtcp_ps * instance, seq_num_t seq);
         int (* sending_ack)(struct dtcp_ps * instance, seq_num_t seq);
-        int (* receiving_ack_list)(struct dtcp_ps * instance);
+        /* Selective ACK, blocks holds n_blocks (first, last) pairs */
+        int (* receiving_ack_list)(struct dtcp_ps *  instance,
+                                   const seq_num_t * blocks,
+                                   int               n_blocks);
         int (* initial_rate)(struct dtcp_ps * instance);
         int (* receiving_flow_control)(struct dtcp_ps * instance,
                                        const struct pci * pci);
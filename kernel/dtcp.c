@@ -40,6 +40,9 @@
 #include "rds/rmem.h"
 #include "debug.h"
 
+/* Largest number of blocks in a Selective ACK */
+#define DTCP_SACK_MAX_BLOCKS 8
+
 static struct policy_set_list policy_sets = {
         .head = LIST_HEAD_INIT(policy_sets.head)
 };
@@ -89,15 +92,29 @@ static ssize_t dtcp_attr_show(struct robject *		     robj,
 	if (!instance || !instance->sv || !instance->parent || !instance->cfg)
 		return 0;
 
+	/* RTT estimation is kept in us, rtt/srtt/rttvar are shown in ms */
 	if (strcmp(robject_attr_name(attr), "rtt") == 0) {
-		return sprintf(buf, "%u\n", instance->sv->rtt);
+		return sprintf(buf, "%u\n", instance->sv->rtt / USEC_PER_MSEC);
 	}
 	if (strcmp(robject_attr_name(attr), "srtt") == 0) {
-		return sprintf(buf, "%u\n", instance->sv->srtt);
+		return sprintf(buf, "%u\n", instance->sv->srtt / USEC_PER_MSEC);
 	}
 	if (strcmp(robject_attr_name(attr), "rttvar") == 0) {
+		return sprintf(buf, "%u\n",
+			instance->sv->rttvar / USEC_PER_MSEC);
+	}
+	if (strcmp(robject_attr_name(attr), "rtt_us") == 0) {
+		return sprintf(buf, "%u\n", instance->sv->rtt);
+	}
+	if (strcmp(robject_attr_name(attr), "srtt_us") == 0) {
+		return sprintf(buf, "%u\n", instance->sv->srtt);
+	}
+	if (strcmp(robject_attr_name(attr), "rttvar_us") == 0) {
 		return sprintf(buf, "%u\n", instance->sv->rttvar);
 	}
+	if (strcmp(robject_attr_name(attr), "rto_us") == 0) {
+		return sprintf(buf, "%u\n", instance->parent->sv->tr);
+	}
 	/* Flow control */
 	if (strcmp(robject_attr_name(attr), "closed_win_q_length") == 0) {
 		return sprintf(buf, "%zu\n", cwq_size(instance->parent->cwq));
@@ -168,7 +185,8 @@ static ssize_t dtcp_attr_show(struct robject *		     robj,
 	return 0;
 }
 RINA_SYSFS_OPS(dtcp);
-RINA_ATTRS(dtcp, rtt, srtt, rttvar, ps_name);
+RINA_ATTRS(dtcp, rtt, srtt, rttvar, rtt_us, srtt_us, rttvar_us, rto_us,
+	   ps_name);
 RINA_KTYPE(dtcp);
 
 static int push_pdus_rmt(struct dtcp * dtcp)
@@ -239,6 +257,7 @@ static int populate_ctrl_pci(struct pci *  pci,
 
         switch (pci_type(pci)) {
         case PDU_TYPE_ACK_AND_FC:
+        case PDU_TYPE_SACK_AND_FC:
                 if (pci_control_ack_seq_num_set(pci, LWE)) {
                         LOG_ERR("Could not set sn to ACK");
                         return -1;
@@ -249,6 +268,7 @@ static int populate_ctrl_pci(struct pci *  pci,
         	}
                 return 0;
         case PDU_TYPE_ACK:
+        case PDU_TYPE_SACK:
                 if (pci_control_ack_seq_num_set(pci, LWE)) {
                         LOG_ERR("Could not set sn to ACK");
                         return -1;
@@ -274,6 +294,81 @@ static int populate_ctrl_pci(struct pci *  pci,
         return 0;
 }
 
+static void sack_sn_put(unsigned char * p, size_t len, seq_num_t sn)
+{
+        switch (len) {
+        case 1:
+                *((__u8 *) p) = sn;
+                break;
+        case 2:
+                *((__u16 *) p) = sn;
+                break;
+        case 4:
+                *((__u32 *) p) = sn;
+                break;
+        }
+}
+
+static seq_num_t sack_sn_get(const unsigned char * p, size_t len)
+{
+        switch (len) {
+        case 1:
+                return *((__u8 *) p);
+        case 2:
+                return *((__u16 *) p);
+        case 4:
+                return *((__u32 *) p);
+        }
+
+        return 0;
+}
+
+/* Appends the blocks of PDUs waiting in the sequencing queue */
+static int sack_blocks_put(struct dtcp * dtcp, struct du * du)
+{
+        seq_num_t       blocks[2 * DTCP_SACK_MAX_BLOCKS];
+        unsigned char * p;
+        size_t          len;
+        int             n, i;
+
+        spin_lock_bh(&dtcp->parent->sv_lock);
+        n = dtp_sack_blocks(dtcp->parent, blocks, DTCP_SACK_MAX_BLOCKS);
+        spin_unlock_bh(&dtcp->parent->sv_lock);
+
+        if (!n)
+                return 0;
+
+        len = du->cfg->dt_cons->seq_num_length;
+        if (du_tail_grow(du, 2 * n * len))
+                return -1;
+
+        /* The PCI is already in place, the blocks follow it */
+        p = du->pci.h + du->pci.len;
+        for (i = 0; i < 2 * n; i++, p += len)
+                sack_sn_put(p, len, blocks[i]);
+
+        return 0;
+}
+
+static int sack_blocks_get(struct du * du, seq_num_t * blocks, int max_blocks)
+{
+        unsigned char * p;
+        size_t          len;
+        int             n, i;
+
+        len = du->cfg->dt_cons->seq_num_length;
+        if (!len)
+                return 0;
+
+        n = min_t(int, du_data_len(du) / (2 * len), max_blocks);
+
+        p = du_buffer(du);
+        for (i = 0; i < 2 * n; i++, p += len)
+                blocks[i] = sack_sn_get(p, len);
+
+        return n;
+}
+
 struct du * pdu_ctrl_generate(struct dtcp * dtcp, pdu_type_t type)
 {
         struct du *     du;
@@ -305,6 +400,13 @@ struct du * pdu_ctrl_generate(struct dtcp * dtcp, pdu_type_t type)
                 return NULL;
         }
 
+        if ((type == PDU_TYPE_SACK || type == PDU_TYPE_SACK_AND_FC) &&
+            sack_blocks_put(dtcp, du)) {
+                LOG_ERR("Could not add the SACK blocks");
+                du_destroy(du);
+                return NULL;
+        }
+
         return du;
 }
 EXPORT_SYMBOL(pdu_ctrl_generate);
@@ -455,26 +557,13 @@ static int rcv_flow_ctl(struct dtcp * dtcp,
         return 0;
 }
 
-static int rcv_ack_and_flow_ctl(struct dtcp * dtcp,
+/* Sender side of the flow control fields of an ACK and FC PDU */
+static void snd_flow_ctl_update(struct dtcp * dtcp,
                                 struct du *   du)
 {
-        struct dtcp_ps * ps;
-        seq_num_t        seq;
         uint_t		 rt;
         uint_t           tf;
 
-        seq = pci_control_ack_seq_num(&du->pci);
-
-        rcu_read_lock();
-        ps = container_of(rcu_dereference(dtcp->base.ps),
-                          struct dtcp_ps, base);
-        /* This updates sender LWE */
-	if (ps->rtx_ctrl && ps->rtt_estimator)
-        	ps->rtt_estimator(ps, pci_control_ack_seq_num(&du->pci));
-        if (ps->sender_ack(ps, seq))
-                LOG_ERR("Could not update RTXQ and LWE");
-        rcu_read_unlock();
-
         spin_lock_bh(&dtcp->parent->sv_lock);
 	if(dtcp_window_based_fctrl(dtcp->cfg)) {
 		dtcp->sv->snd_rt_wind_edge =
@@ -498,6 +587,27 @@ static int rcv_ack_and_flow_ctl(struct dtcp * dtcp,
 
         LOG_DBG("Calling CWQ_deliver for DTCP: %pK", dtcp);
         push_pdus_rmt(dtcp);
+}
+
+static int rcv_ack_and_flow_ctl(struct dtcp * dtcp,
+                                struct du *   du)
+{
+        struct dtcp_ps * ps;
+        seq_num_t        seq;
+
+        seq = pci_control_ack_seq_num(&du->pci);
+
+        rcu_read_lock();
+        ps = container_of(rcu_dereference(dtcp->base.ps),
+                          struct dtcp_ps, base);
+        /* This updates sender LWE */
+	if (ps->rtx_ctrl && ps->rtt_estimator)
+        	ps->rtt_estimator(ps, pci_control_ack_seq_num(&du->pci));
+        if (ps->sender_ack(ps, seq))
+                LOG_ERR("Could not update RTXQ and LWE");
+        rcu_read_unlock();
+
+        snd_flow_ctl_update(dtcp, du);
 
         /* FIXME: Verify values for the receiver side */
         LOG_DBG("DTCP received ACK-FC (CPU: %d)", smp_processor_id());
@@ -508,6 +618,42 @@ static int rcv_ack_and_flow_ctl(struct dtcp * dtcp,
         return 0;
 }
 
+static int rcv_sack(struct dtcp * dtcp,
+                    struct du *   du)
+{
+        struct dtcp_ps * ps;
+        seq_num_t        seq;
+        seq_num_t        blocks[2 * DTCP_SACK_MAX_BLOCKS];
+        int              n;
+        int              ret;
+
+        seq = pci_control_ack_seq_num(&du->pci);
+        n   = sack_blocks_get(du, blocks, DTCP_SACK_MAX_BLOCKS);
+
+        rcu_read_lock();
+        ps = container_of(rcu_dereference(dtcp->base.ps),
+                          struct dtcp_ps, base);
+	if (ps->rtx_ctrl && ps->rtt_estimator)
+        	ps->rtt_estimator(ps, seq);
+        /* The cumulative part, as with any other ACK */
+	ret = ps->sender_ack(ps, seq);
+        if (n && ps->receiving_ack_list &&
+            ps->receiving_ack_list(ps, blocks, n))
+                LOG_ERR("Could not process the SACK blocks");
+        rcu_read_unlock();
+
+        if (pci_type(&du->pci) == PDU_TYPE_SACK_AND_FC)
+                snd_flow_ctl_update(dtcp, du);
+
+        LOG_DBG("DTCP received SACK with %d blocks (CPU: %d)",
+                n, smp_processor_id());
+        dump_we(dtcp, &du->pci);
+
+        du_destroy(du);
+
+        return ret;
+}
+
 int dtcp_common_rcv_control(struct dtcp * dtcp, struct du * du)
 {
         struct dtcp_ps * ps;
@@ -540,9 +686,11 @@ int dtcp_common_rcv_control(struct dtcp * dtcp, struct du * du)
                 	dtcp->sv->flow_ctl++;
                         break;
                 case PDU_TYPE_ACK:
+                case PDU_TYPE_SACK:
                 	dtcp->sv->acks++;
                         break;
                 case PDU_TYPE_ACK_AND_FC:
+                case PDU_TYPE_SACK_AND_FC:
                 	dtcp->sv->flow_ctl++;
                 	dtcp->sv->acks++;
                         break;
@@ -586,6 +734,10 @@ int dtcp_common_rcv_control(struct dtcp * dtcp, struct du * du)
         case PDU_TYPE_ACK_AND_FC:
                 ret = rcv_ack_and_flow_ctl(dtcp, du);
                 break;
+        case PDU_TYPE_SACK:
+        case PDU_TYPE_SACK_AND_FC:
+                ret = rcv_sack(dtcp, du);
+                break;
         default:
                 ret = -1;
                 break;
@@ -617,7 +769,9 @@ pdu_type_t pdu_ctrl_type_get(struct dtcp * dtcp, seq_num_t seq)
 {
         struct dtcp_ps *ps;
         bool flow_ctrl;
+        bool sack;
         seq_num_t    LWE;
+        seq_num_t    first[2];
         timeout_t    a;
 
         if (!dtcp) {
@@ -636,12 +790,29 @@ pdu_type_t pdu_ctrl_type_get(struct dtcp * dtcp, seq_num_t seq)
         ps = container_of(rcu_dereference(dtcp->base.ps),
                           struct dtcp_ps, base);
         flow_ctrl = ps->flow_ctrl;
+        sack = ps->rtx_ctrl && ps->rtx.sack;
         rcu_read_unlock();
 
         spin_lock_bh(&dtcp->parent->sv_lock);
         a = dtcp->parent->sv->A;
         LWE = dtcp->parent->sv->rcv_left_window_edge;
 
+        /*
+         * While there are gaps, tell the sender what arrived above them
+         * on every new or out of order PDU
+         */
+        if (sack && (seq > LWE || dtcp->sv->last_snd_data_ack < LWE) &&
+            dtp_sack_blocks(dtcp->parent, first, 1)) {
+                if (dtcp->sv->last_snd_data_ack < LWE)
+                        dtcp->sv->last_snd_data_ack = LWE;
+        	spin_unlock_bh(&dtcp->parent->sv_lock);
+
+                LOG_DBG("This is a SACK");
+                if (flow_ctrl)
+                        return PDU_TYPE_SACK_AND_FC;
+                return PDU_TYPE_SACK;
+        }
+
         if (dtcp->sv->last_snd_data_ack < LWE) {
         	dtcp->sv->last_snd_data_ack = LWE;
         	spin_unlock_bh(&dtcp->parent->sv_lock);
@@ -728,6 +899,94 @@ int dtcp_ack_flow_control_pdu_send(struct dtcp * dtcp, seq_num_t seq)
 }
 EXPORT_SYMBOL(dtcp_ack_flow_control_pdu_send);
 
+/* Receiver credit, bounded by the room left in the user receive buffer */
+uint_t dtcp_rcvr_credit(struct dtcp * dtcp)
+{
+        struct ipcp_instance * user_ipcp;
+        uint_t                 credit;
+        int                    room;
+
+        spin_lock_bh(&dtcp->parent->sv_lock);
+        credit = dtcp->sv->rcvr_credit;
+        spin_unlock_bh(&dtcp->parent->sv_lock);
+
+        user_ipcp = dtcp->parent->efcp->user_ipcp;
+        if (!user_ipcp || !user_ipcp->ops->flow_rx_credit)
+                return credit;
+
+        room = user_ipcp->ops->flow_rx_credit(user_ipcp->data,
+                        dtcp->parent->efcp->connection->port_id,
+                        credit);
+        if (room < 0)
+                return credit;
+
+        return min_t(uint_t, credit, room);
+}
+EXPORT_SYMBOL(dtcp_rcvr_credit);
+
+/*
+ * Advances the receiver right window edge after the user has drained its
+ * buffer, and tells the sender with a Flow Control PDU. The window is
+ * never shrunk.
+ */
+int dtcp_rcvr_window_open(struct dtcp * dtcp)
+{
+        struct dtcp_ps * ps;
+        struct du *      du;
+        bool             win_based;
+        bool             open = false;
+        uint_t           credit;
+        seq_num_t        RWE;
+
+        if (!dtcp) {
+                LOG_ERR("No instance passed, cannot open the window");
+                return -1;
+        }
+
+        rcu_read_lock();
+        ps = container_of(rcu_dereference(dtcp->base.ps),
+                          struct dtcp_ps, base);
+        win_based = ps->flow_ctrl && ps->flowctrl.window_based;
+        rcu_read_unlock();
+
+        if (!win_based)
+                return 0;
+
+        credit = dtcp_rcvr_credit(dtcp);
+
+        spin_lock_bh(&dtcp->parent->sv_lock);
+        RWE = dtcp->parent->sv->rcv_left_window_edge + credit;
+        if (RWE > dtcp->sv->rcvr_rt_wind_edge) {
+                dtcp->sv->rcvr_rt_wind_edge = RWE;
+                open = true;
+        }
+        spin_unlock_bh(&dtcp->parent->sv_lock);
+
+        if (!open)
+                return 0;
+
+        atomic_inc(&dtcp->cpdus_in_transit);
+
+        du = pdu_ctrl_generate(dtcp, PDU_TYPE_FC);
+        if (!du) {
+                atomic_dec(&dtcp->cpdus_in_transit);
+                return -1;
+        }
+
+        LOG_DBG("DTCP Sending FC, window reopened up to %u", RWE);
+        dump_we(dtcp, &du->pci);
+
+        if (dtcp_pdu_send(dtcp, du)) {
+                atomic_dec(&dtcp->cpdus_in_transit);
+                return -1;
+        }
+
+        atomic_dec(&dtcp->cpdus_in_transit);
+
+        return 0;
+}
+EXPORT_SYMBOL(dtcp_rcvr_window_open);
+
 static struct dtcp_sv default_sv = {
         .pdus_per_time_unit     = 0,
         .next_snd_ctl_seq       = 0,
@@ -837,6 +1096,21 @@ dtcp_from_component(struct rina_component * component)
 }
 EXPORT_SYMBOL(dtcp_from_component);
 
+/* Optional "rtx.*" DTCP policy parameters, e.g. "rtx.sack" */
+static unsigned int dtcp_rtx_param(struct dtcp_config * cfg,
+                                   const char *         name,
+                                   unsigned int         def)
+{
+        struct policy_parm * parm;
+        unsigned int         val;
+
+        parm = cfg->dtcp_ps ? policy_param_find(cfg->dtcp_ps, name) : NULL;
+        if (!parm || kstrtouint(policy_param_value(parm), 10, &val))
+                return def;
+
+        return val;
+}
+
 int dtcp_select_policy_set(struct dtcp * dtcp,
                            const string_t * path,
                            const string_t * name)
@@ -873,6 +1147,20 @@ int dtcp_select_policy_set(struct dtcp * dtcp,
                 ps->rtx.max_time_retry          = dtcp_max_time_retry(cfg);
                 ps->rtx.data_retransmit_max     = dtcp_data_retransmit_max(cfg);
                 ps->rtx.initial_tr              = dtcp_initial_tr(cfg);
+                ps->rtx.sack                    =
+                        dtcp_rtx_param(cfg, "rtx.sack", 0) != 0;
+                ps->rtx.rtt_alpha_shift         =
+                        dtcp_rtx_param(cfg, "rtx.rtt_alpha_shift",
+                                       RTT_ALPHA_SHIFT);
+                ps->rtx.rtt_beta_shift          =
+                        dtcp_rtx_param(cfg, "rtx.rtt_beta_shift",
+                                       RTT_BETA_SHIFT);
+                ps->rtx.rto_k                   =
+                        dtcp_rtx_param(cfg, "rtx.rto_k", RTO_K);
+                ps->rtx.rto_g_us                =
+                        dtcp_rtx_param(cfg, "rtx.rto_g_us", RTO_G_US);
+                ps->rtx.rto_max_us              =
+                        dtcp_rtx_param(cfg, "rtx.rto_max_us", RTO_MAX_US);
                 ps->flowctrl.window.max_closed_winq_length
                                                 = dtcp_max_closed_winq_length(cfg);
                 ps->flowctrl.window.initial_credit
@@ -900,6 +1188,9 @@ int dtcp_select_policy_set(struct dtcp * dtcp,
                 if (!ps->sending_ack) {
                         ps->sending_ack = default_sending_ack;
                 }
+                if (!ps->receiving_ack_list) {
+                        ps->receiving_ack_list = default_receiving_ack_list;
+                }
                 if (!ps->receiving_flow_control) {
                         ps->receiving_flow_control =
                                 default_receiving_flow_control;
@@ -993,6 +1284,21 @@ int dtcp_set_policy_set_param(struct dtcp * dtcp,
                                          &ps->rtx.data_retransmit_max);
                 } else if (strcmp(name, "rtx.initial_tr") == 0) {
                         ret = kstrtouint(value, 10, &ps->rtx.initial_tr);
+                } else if (strcmp(name, "rtx.sack") == 0) {
+                        ret = kstrtoint(value, 10, &bool_value);
+                        if (ret == 0) {
+                                ps->rtx.sack = bool_value;
+                        }
+                } else if (strcmp(name, "rtx.rtt_alpha_shift") == 0) {
+                        ret = kstrtouint(value, 10, &ps->rtx.rtt_alpha_shift);
+                } else if (strcmp(name, "rtx.rtt_beta_shift") == 0) {
+                        ret = kstrtouint(value, 10, &ps->rtx.rtt_beta_shift);
+                } else if (strcmp(name, "rtx.rto_k") == 0) {
+                        ret = kstrtouint(value, 10, &ps->rtx.rto_k);
+                } else if (strcmp(name, "rtx.rto_g_us") == 0) {
+                        ret = kstrtouint(value, 10, &ps->rtx.rto_g_us);
+                } else if (strcmp(name, "rtx.rto_max_us") == 0) {
+                        ret = kstrtouint(value, 10, &ps->rtx.rto_max_us);
                 } else if (strcmp(name,
                                 "flowctrl.window.max_closed_winq_length")
                                         == 0) {
@@ -78,6 +78,8 @@ struct du	*pdu_ctrl_generate(struct dtcp *dtcp, pdu_type_t type);
 int		dtcp_last_time_set(struct dtcp *dtcp,
 					   struct timespec *s);
 bool		dtcp_rate_exceeded(struct dtcp *dtcp, int send);
+uint_t		dtcp_rcvr_credit(struct dtcp *dtcp);
+int		dtcp_rcvr_window_open(struct dtcp *dtcp);
 
 /* end SDK */
 
@@ -39,8 +39,11 @@
 
 #define RTIMER_ENABLED 1
 
-/* Maximum retransmission time is 60 seconds */
-#define MAX_RTX_WAIT_TIME msecs_to_jiffies(60000)
+/* Maximum retransmission time is 60 seconds (in us) */
+#define MAX_RTX_WAIT_TIME (60 * USEC_PER_SEC)
+
+/* PDUs selectively acked above a hole before it is considered lost */
+#define RTX_SACK_DUP_THRESH 3
 
 struct cwq * cwq_create(void)
 {
@@ -378,7 +381,7 @@ static struct rtxq_entry * rtxq_entry_create_gfp(struct du * du, gfp_t flag)
                 return NULL;
 
         tmp->du        = du;
-        tmp->time_stamp = jiffies;
+        tmp->time_stamp = ktime_get();
         tmp->retries    = 0;
 
         INIT_LIST_HEAD(&tmp->next);
@@ -473,6 +476,36 @@ static int rtxqueue_entries_ack(struct rtxqueue * q,
         return 0;
 }
 
+/* Accounts a retransmission in the rate, true if it has to wait */
+static bool rtx_rate_exceeded(struct dtp * dtp, struct rtxq_entry * cur)
+{
+        struct dtcp * dtcp;
+        int           sz;
+        uint_t        sc;
+
+        dtcp = dtp ? dtp->dtcp : NULL;
+        if (!dtcp || !dtcp_rate_based_fctrl(dtcp->cfg))
+                return false;
+
+        sz = du_data_len(cur->du);
+        sc = dtcp->sv->pdus_sent_in_time_unit;
+
+        if (sz >= 0) {
+                if ((sz + sc) >= dtcp->sv->sndr_rate)
+                        dtcp->sv->pdus_sent_in_time_unit = dtcp->sv->sndr_rate;
+                else
+                        dtcp->sv->pdus_sent_in_time_unit += sz;
+        }
+
+        if (dtcp_rate_exceeded(dtcp, 1)) {
+                dtp->sv->rate_fulfiled = true;
+                dtp_start_rate_timer(dtp, dtcp);
+                return true;
+        }
+
+        return false;
+}
+
 static int rtxqueue_entries_nack(struct rtxqueue * q,
                                  struct dtp *      dtp,
                                  struct rmt *      rmt,
@@ -481,13 +514,6 @@ static int rtxqueue_entries_nack(struct rtxqueue * q,
 {
         struct rtxq_entry * cur, * p;
         struct du *        tmp;
-        // Used by rbfc.
-        struct dtcp *	    dtcp;
-
-        int sz;
-	uint_t sc;
-
-        dtcp = dtp->dtcp;
 
         /*
          * FIXME: this should be change since we are sending in inverse order
@@ -496,6 +522,8 @@ static int rtxqueue_entries_nack(struct rtxqueue * q,
         list_for_each_entry_safe_reverse(cur, p, &q->head, next) {
                 if (pci_sequence_number_get(&cur->du->pci) >=
                     seq_num) {
+                        if (cur->sacked)
+                                continue;
                         cur->retries++;
                         if (cur->retries >= data_rtx_max) {
                                 LOG_ERR("Maximum number of rtx has been "
@@ -505,28 +533,8 @@ static int rtxqueue_entries_nack(struct rtxqueue * q,
 				q->drop_pdus++;
                                 continue;
                         }
-			if(dtp &&
-				dtcp &&
-				dtcp_rate_based_fctrl(dtcp->cfg)) {
-
-				sz = du_data_len(cur->du);
-				sc = dtcp->sv->pdus_sent_in_time_unit;
-
-				if(sz >= 0) {
-					if ( (sz + sc) >= dtcp->sv->sndr_rate) {
-						dtcp->sv->pdus_sent_in_time_unit =
-							dtcp->sv->sndr_rate;
-					} else {
-						dtcp->sv->pdus_sent_in_time_unit += sz;
-					}
-				}
-
-				if(dtcp_rate_exceeded(dtcp, 1)) {
-					dtp->sv->rate_fulfiled = true;
-					dtp_start_rate_timer(dtp, dtcp);
-					break;
-				}
-			}
+			if (rtx_rate_exceeded(dtp, cur))
+				break;
                         tmp = du_dup_ni(cur->du);
                         if (dtp_pdu_send(dtp,
 					 rmt,
@@ -539,7 +547,80 @@ static int rtxqueue_entries_nack(struct rtxqueue * q,
         return 0;
 }
 
-unsigned long rtxqueue_entry_timestamp(struct rtxqueue * q, seq_num_t sn)
+static bool sack_blocks_has(const seq_num_t * blocks,
+                            int               n_blocks,
+                            seq_num_t         seq)
+{
+        int i;
+
+        for (i = 0; i < n_blocks; i++)
+                if (seq >= blocks[2 * i] && seq <= blocks[2 * i + 1])
+                        return true;
+
+        return false;
+}
+
+/*
+ * Marks the PDUs the receiver holds and retransmits, once, the holes with
+ * at least RTX_SACK_DUP_THRESH PDUs selectively acked above them. The rest
+ * is left to the retransmission timer.
+ */
+static int rtxqueue_entries_sack(struct rtxqueue *  q,
+                                 struct dtp *       dtp,
+                                 struct rmt *       rmt,
+                                 const seq_num_t *  blocks,
+                                 int                n_blocks,
+                                 uint_t             data_rtx_max)
+{
+        struct rtxq_entry * cur, * n;
+        struct du *         tmp;
+        seq_num_t           seq;
+        int                 above = 0;
+
+        list_for_each_entry(cur, &q->head, next) {
+                if (!cur->sacked)
+                        cur->sacked = sack_blocks_has(blocks, n_blocks,
+                                pci_sequence_number_get(&cur->du->pci));
+                if (cur->sacked)
+                        above++;
+        }
+
+        list_for_each_entry_safe(cur, n, &q->head, next) {
+                if (above < RTX_SACK_DUP_THRESH)
+                        break;
+                if (cur->sacked) {
+                        above--;
+                        continue;
+                }
+                if (cur->sack_rtx)
+                        continue;
+
+                if (rtx_rate_exceeded(dtp, cur))
+                        break;
+
+                seq = pci_sequence_number_get(&cur->du->pci);
+                cur->sack_rtx = true;
+                cur->retries++;
+                cur->time_stamp = ktime_get();
+                if (cur->retries >= data_rtx_max) {
+                        LOG_ERR("Maximum number of rtx has been "
+                                "achieved for SeqN %u. Can't "
+                                "maintain QoS", seq);
+                        rtxq_entry_destroy(cur);
+                        q->len--;
+                        q->drop_pdus++;
+                        continue;
+                }
+                tmp = du_dup_ni(cur->du);
+                if (dtp_pdu_send(dtp, rmt, tmp))
+                        continue;
+                LOG_DBG("Retransmitted PDU with seqN %u after SACK", seq);
+        }
+
+        return 0;
+}
+
+static ktime_t rtxqueue_entry_timestamp(struct rtxqueue * q, seq_num_t sn)
 {
         struct rtxq_entry * cur;
         seq_num_t           csn;
@@ -549,17 +630,17 @@ unsigned long rtxqueue_entry_timestamp(struct rtxqueue * q, seq_num_t sn)
                 if (csn > sn) {
                         LOG_WARN("PDU not in rtxq (duplicate ACK). Received "
                         		"SN: %u, RtxQ SN: %u", sn, csn);
-                        return 0;
+                        return ktime_set(0, 0);
                 }
                 if (csn == sn) {
                 	/* Ignore time_stamps from retransmitted PDUs */
                         if (cur->retries != 0)
-                        	return 0;
+                        	return ktime_set(0, 0);
                         return cur->time_stamp;
                 }
         }
 
-        return 0;
+        return ktime_set(0, 0);
 }
 
 /* push in seq_num order */
@@ -621,16 +702,16 @@ static int rtxqueue_push_ni(struct rtxqueue * q, struct du * du)
         return 0;
 }
 
-/* Exponential backoff after each retransmission */
-static unsigned long time_to_rtx(struct rtxq_entry * cur, unsigned int tr)
+/* Exponential backoff after each retransmission, tr in us */
+static ktime_t time_to_rtx(struct rtxq_entry * cur, unsigned int tr)
 {
-	unsigned long rtx_wtime;
+	u64 rtx_wtime;
 
-	rtx_wtime = (1 + cur->retries*cur->retries)*tr;
+	rtx_wtime = (1 + (u64) cur->retries * cur->retries) * tr;
 	if (rtx_wtime > MAX_RTX_WAIT_TIME)
 		rtx_wtime = MAX_RTX_WAIT_TIME;
 
-	return cur->time_stamp + rtx_wtime;
+	return ktime_add_us(cur->time_stamp, rtx_wtime);
 }
 
 static int rtxqueue_rtx(struct rtxqueue * q,
@@ -642,24 +723,26 @@ static int rtxqueue_rtx(struct rtxqueue * q,
         struct rtxq_entry * cur, * n;
         struct du *        tmp;
         seq_num_t           seq = 0;
-        // Used by rbfc.
-        struct dtcp *	    dtcp;
-        int sz;
-        uint_t sc;
+        ktime_t             now;
 
         ASSERT(q);
         ASSERT(dt);
         ASSERT(rmt);
 
-        dtcp = dtp->dtcp;
+        now = ktime_get();
 
         list_for_each_entry_safe(cur, n, &q->head, next) {
+                /* The receiver already has it, wait for the cumulative ACK */
+                if (cur->sacked)
+                        continue;
+
                 seq = pci_sequence_number_get(&cur->du->pci);
-                LOG_DBG("Checking RTX PDU %u, now: %lu >?< %lu + %u",
-                        seq, jiffies, cur->time_stamp, tr);
-                if (time_before_eq(time_to_rtx(cur, tr), jiffies)) {
+                LOG_DBG("Checking RTX PDU %u, now: %lld >?< %lld + %u us",
+                        seq, ktime_to_us(now), ktime_to_us(cur->time_stamp),
+                        tr);
+                if (ktime_compare(time_to_rtx(cur, tr), now) <= 0) {
                         cur->retries++;
-                        cur->time_stamp = jiffies;
+                        cur->time_stamp = now;
                         if (cur->retries >= data_rtx_max) {
                                 LOG_ERR("Maximum number of rtx has been "
                                         "achieved for SeqN %u. Can't "
@@ -669,28 +752,8 @@ static int rtxqueue_rtx(struct rtxqueue * q,
 				q->drop_pdus++;
                                 continue;
                         }
-                        if(dtp &&
-				dtcp &&
-				dtcp_rate_based_fctrl(dtcp->cfg)) {
-
-                        	sz = du_data_len(cur->du);
-				sc = dtcp->sv->pdus_sent_in_time_unit;
-
-				if(sz >= 0) {
-					if ( (sz + sc) >= dtcp->sv->sndr_rate) {
-						dtcp->sv->pdus_sent_in_time_unit = 
-							dtcp->sv->sndr_rate;
-					} else {
-						dtcp->sv->pdus_sent_in_time_unit += sz; 
-					}
-				}
-
-				if(dtcp_rate_exceeded(dtcp, 1)) {
-					dtp->sv->rate_fulfiled = true;
-					dtp_start_rate_timer(dtp, dtcp);
-					break;
-				}
-                        }
+                        if (rtx_rate_exceeded(dtp, cur))
+                                break;
                         tmp = du_dup_ni(cur->du);
                         if (dtp_pdu_send(dtp,
                                          rmt,
@@ -759,7 +822,7 @@ static void rtx_timer_func(void * data)
 
 #if RTIMER_ENABLED
         if (!rtxqueue_empty(q->queue))
-                rtimer_restart(q->r_timer, tr);
+                rtimer_restart_us(q->r_timer, tr);
         LOG_DBG("RTX timer ending...");
 #endif
 
@@ -775,11 +838,12 @@ int rtxq_destroy(struct rtxq * q)
         if (!q)
                 return -1;
 
-        spin_lock_irqsave(&q->lock, flags);
+        /* The timer function takes the lock, and waiting for it may sleep */
 #if RTIMER_ENABLED
         if (q->r_timer && rtimer_destroy(q->r_timer))
                 LOG_ERR("Problems destroying timer for RTXQ %pK", q->r_timer);
 #endif
+        spin_lock_irqsave(&q->lock, flags);
         if (q->queue && rtxqueue_destroy(q->queue))
                 LOG_ERR("Problems destroying queue for RTXQ %pK", q->queue);
 
@@ -813,7 +877,8 @@ struct rtxq * rtxq_create(struct dtp * dtp,
         data->efcpc = container;
         data->cep_id = cep_id;
         data->data_retransmit_max = dtcp_cfg->rxctrl_cfg->data_retransmit_max;
-        tmp->r_timer = rtimer_create(rtx_timer_func, data);
+        /* RTOs go down to tens of microseconds in data-centre DIFs */
+        tmp->r_timer = rtimer_create_hr(rtx_timer_func, data);
         if (!tmp->r_timer) {
                 LOG_ERR("Failed to create retransmission queue");
                 rtxq_destroy(tmp);
@@ -863,12 +928,12 @@ int rtxq_drop_pdus(struct rtxq * q)
         return ret;
 }
 
-unsigned long rtxq_entry_timestamp(struct rtxq * q, seq_num_t sn)
+ktime_t rtxq_entry_timestamp(struct rtxq * q, seq_num_t sn)
 {
-        unsigned long timestamp;
+        ktime_t timestamp;
 
         if (!q)
-                return 0;
+                return ktime_set(0, 0);
 
         spin_lock_bh(&q->lock);
         timestamp = rtxqueue_entry_timestamp(q->queue, sn);
@@ -884,7 +949,7 @@ int rtxq_push_ni(struct rtxq * q,
         spin_lock_bh(&q->lock);
 #if RTIMER_ENABLED
         /* is the first transmitted PDU */
-        rtimer_start(q->r_timer, q->parent->sv->tr);
+        rtimer_start_us(q->r_timer, q->parent->sv->tr);
 #endif
         rtxqueue_push_ni(q->queue, du);
         spin_unlock_bh(&q->lock);
@@ -917,7 +982,7 @@ int rtxq_ack(struct rtxq * q,
         spin_lock_bh(&q->lock);
         rtxqueue_entries_ack(q->queue, seq_num);
 #if RTIMER_ENABLED
-        rtimer_restart(q->r_timer, tr);
+        rtimer_restart_us(q->r_timer, tr);
 #endif
         spin_unlock_bh(&q->lock);
 
@@ -951,7 +1016,7 @@ int rtxq_nack(struct rtxq * q,
                               seq_num,
                               data_retransmit_max);
 #if RTIMER_ENABLED
-        if (rtimer_restart(q->r_timer, tr)) {
+        if (rtimer_restart_us(q->r_timer, tr)) {
                 spin_unlock(&q->lock);
                 return -1;
         }
@@ -961,6 +1026,78 @@ int rtxq_nack(struct rtxq * q,
         return 0;
 }
 
+int rtxq_sack(struct rtxq *      q,
+              const seq_num_t *  blocks,
+              int                n_blocks)
+{
+        unsigned int data_retransmit_max;
+
+        if (!q || !q->parent || !q->rmt)
+                return -1;
+
+        if (n_blocks <= 0)
+                return 0;
+
+        rcu_read_lock();
+        data_retransmit_max = dtcp_ps_get(q->parent->dtcp)->
+                                        rtx.data_retransmit_max;
+        rcu_read_unlock();
+
+        spin_lock_bh(&q->lock);
+        rtxqueue_entries_sack(q->queue,
+                              q->parent,
+                              q->rmt,
+                              blocks,
+                              n_blocks,
+                              data_retransmit_max);
+        spin_unlock_bh(&q->lock);
+
+        return 0;
+}
+EXPORT_SYMBOL(rtxq_sack);
+
+/*
+ * Rate based flow control releases a whole time unit worth of PDUs at once.
+ * Stamp DT PDUs with an earliest departure time spaced at the sender rate,
+ * so a pacing RMT policy set can spread them over the time unit. Without a
+ * shaping policy set nobody looks at the stamp, so it is not computed.
+ */
+static void pdu_tx_time_set(struct dtp * dtp,
+                            struct rmt * rmt,
+                            struct du *  du)
+{
+        struct dtcp * dtcp;
+        uint_t        rate, tu;
+        ssize_t       len;
+        s64           now, old, start;
+        u64           gap;
+
+        du->tx_time = ktime_set(0, 0);
+
+        dtcp = dtp->dtcp;
+        if (!dtcp || !dtp->sv->rate_based || pci_type(&du->pci) != PDU_TYPE_DT)
+                return;
+
+        if (!rmt_is_shaping(rmt))
+                return;
+
+        /* sndr_rate is accounted in bytes per time unit (ms) */
+        rate = dtcp->sv->sndr_rate;
+        tu   = dtcp->sv->time_unit;
+        len  = du_len(du);
+        if (!rate || !tu || len <= 0)
+                return;
+
+        gap = div_u64((u64) len * tu * NSEC_PER_MSEC, rate);
+        now = ktime_to_ns(ktime_get());
+        do {
+                old   = atomic64_read(&dtp->tx_next);
+                start = max(old, now);
+        } while (atomic64_cmpxchg(&dtp->tx_next, old, start + gap) != old);
+
+        du->tx_time = ns_to_ktime(start);
+}
+
 int dtp_pdu_send(struct dtp *  dtp,
         	 struct rmt *  rmt,
 		 struct du *   du)
@@ -970,6 +1107,7 @@ int dtp_pdu_send(struct dtp *  dtp,
 
 	/* Remote flow case */
 	if (pci_source(&du->pci) != pci_destination(&du->pci)) {
+		pdu_tx_time_set(dtp, rmt, du);
 	        if (rmt_send(rmt, du)) {
 	                LOG_ERR("Problems sending PDU to RMT");
 	                return -1;
@@ -57,19 +57,24 @@ int                 rtxq_destroy(struct rtxq * q);
 
 int		    rtxq_size(struct rtxq * q);
 int		    rtxq_drop_pdus(struct rtxq * q);
-unsigned long       rtxq_entry_timestamp(struct rtxq * q,
+ktime_t             rtxq_entry_timestamp(struct rtxq * q,
                                          seq_num_t sn);
 int                 rtxq_entry_destroy(struct rtxq_entry * entry);
 int                 rtxq_push_sn(struct rtxq * q,
                                  seq_num_t sn);
 int                 rtxq_push_ni(struct rtxq * q,
                                  struct du *  du);
+/* tr is the retransmission timeout, in us */
 int                 rtxq_ack(struct rtxq * q,
                              seq_num_t     seq_num,
                              timeout_t     tr);
 int                 rtxq_nack(struct rtxq * q,
                               seq_num_t     seq_num,
                               timeout_t     tr);
+/* Selective ACK, blocks holds n_blocks (first, last) pairs */
+int                 rtxq_sack(struct rtxq *     q,
+                              const seq_num_t * blocks,
+                              int               n_blocks);
 int                 rtxq_flush(struct rtxq * q);
 
 int 		    dtp_pdu_send(struct dtp *  dtp,
@@ -41,6 +41,7 @@
 #include "pci.h"
 #include "rds/robjects.h"
 #include "efcp-str.h"
+#include "delim.h"
 
 #define TO_POST_LENGTH 100
 #define TO_SEND_LENGTH 16
@@ -318,8 +319,8 @@ static struct du * seq_queue_pop(struct seq_queue * q)
 
 static int seq_queue_push_ni(struct seq_queue * q, struct du * du)
 {
-        static struct seq_queue_entry * tmp, * cur, * last = NULL;
-        seq_num_t                       csn, psn;
+        struct seq_queue_entry * tmp, * cur, * last = NULL;
+        seq_num_t                csn, psn;
 
         tmp = seq_queue_entry_create_gfp(du, GFP_ATOMIC);
         if (!tmp) {
@@ -356,10 +357,11 @@ static int seq_queue_push_ni(struct seq_queue * q, struct du * du)
                 return 0;
         }
 
-        list_for_each_entry(cur, &q->head, next) {
+        /* Keep the queue sorted, dtp_sack_blocks() relies on it */
+        list_for_each_entry_reverse(cur, &q->head, next) {
                 psn = pci_sequence_number_get(&cur->du->pci);
                 if (csn == psn) {
-                        LOG_ERR("Another PDU with the same seq_num is in the rtx queue!");
+                        LOG_ERR("Another PDU with the same seq_num is in the seqq");
                         seq_queue_entry_destroy(tmp);
                         return 0;
                 }
@@ -371,9 +373,44 @@ static int seq_queue_push_ni(struct seq_queue * q, struct du * du)
                 }
         }
 
+        list_add(&tmp->next, &q->head);
+        LOG_DBG("First PDU with seqnum: %u push to seqq at: %pk", csn, q);
+
         return 0;
 }
 
+/*
+ * Fills blocks with up to max_blocks (first, last) pairs of the sequence
+ * numbers waiting in the sequencing queue, lowest first. Returns the number
+ * of blocks, 0 if there are no gaps. Called with the sv_lock held.
+ */
+int dtp_sack_blocks(struct dtp * dtp,
+                    seq_num_t *  blocks,
+                    int          max_blocks)
+{
+        struct seq_queue_entry * cur;
+        seq_num_t                sn;
+        int                      n = 0;
+
+        ASSERT(dtp && dtp->seqq);
+
+        list_for_each_entry(cur, &dtp->seqq->queue->head, next) {
+                sn = pci_sequence_number_get(&cur->du->pci);
+                if (n && sn == blocks[2 * n - 1] + 1) {
+                        blocks[2 * n - 1] = sn;
+                        continue;
+                }
+                if (n == max_blocks)
+                        break;
+                blocks[2 * n]     = sn;
+                blocks[2 * n + 1] = sn;
+                n++;
+        }
+
+        return n;
+}
+EXPORT_SYMBOL(dtp_sack_blocks);
+
 static int squeue_destroy(struct squeue * seqq)
 {
         if (!seqq)
@@ -405,8 +442,8 @@ static struct squeue * squeue_create(struct dtp * dtp)
         return tmp;
 }
 
-static inline int pdu_post(struct dtp * instance,
-                    	   struct du * du)
+int dtp_sdu_post(struct dtp * instance,
+                 struct du *  du)
 {
         struct efcp *   efcp;
 
@@ -421,6 +458,16 @@ static inline int pdu_post(struct dtp * instance,
         return 0;
 }
 
+/* Delivers the user data of an in-order PDU, reassembling SDUs if needed */
+static inline int pdu_post(struct dtp * instance,
+                    	   struct du * du)
+{
+        if (instance->delim)
+                return delim_receive(instance->delim, du);
+
+        return dtp_sdu_post(instance, du);
+}
+
 /* Runs the SenderInactivityTimerPolicy */
 static void tf_sender_inactivity(void * data)
 {
@@ -525,8 +572,6 @@ struct pci * process_A_expiration(struct dtp * dtp, struct dtcp * dtcp)
         spin_lock_bh(&dtp->sv_lock);
         a = msecs_to_jiffies(dtp->sv->A);
 
-        /* FIXME: Invoke delimiting */
-
         LOG_DBG("Processing A timer expiration");
 
         LWE = dtp->sv->rcv_left_window_edge;
@@ -790,7 +835,8 @@ int dtp_sv_init(struct dtp * dtp,
         dtp->sv->MPL               = mpl;
         dtp->sv->A                 = a;
         dtp->sv->R                 = r;
-        dtp->sv->tr                = tr;
+        /* tr comes in ms from the connection, DTP keeps it in us */
+        dtp->sv->tr                = tr * USEC_PER_MSEC;
 
         return 0;
 }
@@ -985,6 +1031,7 @@ struct dtp * dtp_create(struct efcp *       efcp,
         /* FIXME: fixups to the state-vector should be placed here */
 
         spin_lock_init(&dtp->sv_lock);
+        atomic64_set(&dtp->tx_next, 0);
 
         dtp->cfg   = dtp_cfg;
         dtp->rmt  = rmt;
@@ -1040,6 +1087,16 @@ struct dtp * dtp_create(struct efcp *       efcp,
                 return NULL;
         }
 
+        if (delim_required(efcp->container->config->dt_cons)) {
+                dtp->delim = delim_create(dtp, efcp->container->config,
+                                          dtp_conf_ps_get(dtp_cfg));
+                if (!dtp->delim) {
+                        LOG_ERR("Could not create delimiting");
+                        dtp_destroy(dtp);
+                        return NULL;
+                }
+        }
+
         spin_lock_init(&dtp->lock);
 
         LOG_DBG("Instance %pK with STimer %pK created successfully", dtp,
@@ -1058,6 +1115,10 @@ int dtp_destroy(struct dtp * instance)
         if (!instance)
                 return -1;
 
+        /* Its flush timer may still write PDUs */
+        if (instance->delim)
+                delim_destroy(instance->delim);
+
 	spin_lock_bh(&instance->lock);
 
         if (instance->dtcp) {
@@ -1168,8 +1229,8 @@ static bool window_is_closed(struct dtp *    dtp,
         return retval;
 }
 
-int dtp_write(struct dtp * instance,
-              struct du * du)
+int dtp_write_pdu(struct dtp * instance,
+                  struct du *  du)
 {
         struct dtcp *     dtcp;
         struct rtxq *     rtxq;
@@ -1190,7 +1251,7 @@ int dtp_write(struct dtp * instance,
                 LOG_ERR("Failed to stop timer");
         }
 #endif
-        /* Step 1: Delimiting (fragmentation/reassembly) + Protection */
+        /* Step 1: Delimiting has already been done, see dtp_write() */
 
         /*
          * FIXME: The two ways of carrying out flow control
@@ -1198,10 +1259,6 @@ int dtp_write(struct dtp * instance,
          * the first and default case if both are present.
          */
 
-        /* FIXME: from now on, this should be done for each user data
-         * generated by Delimiting *
-         */
-
         /* Step 2: Sequencing */
         /*
          * Incrementing here means the PDU cannot
@@ -1341,6 +1398,15 @@ stats_nounlock_err_exit:
 	return -1;
 }
 
+int dtp_write(struct dtp * instance,
+              struct du * du)
+{
+        if (instance->delim)
+                return delim_write(instance->delim, du);
+
+        return dtp_write_pdu(instance, du);
+}
+
 /* Must be called with sv lock taken */
 static bool is_fc_overrun(struct dtp * dtp, struct dtcp * dtcp,
 			  seq_num_t seq_num, int pdul)
@@ -1519,7 +1585,6 @@ int dtp_receive(struct dtp * instance,
         if (!a) {
                 bool set_lft_win_edge;
 
-                /* FIXME: delimiting goes here */
                 if (!in_order && !dtcp) {
                 	spin_unlock_bh(&instance->sv_lock);
                         LOG_DBG("DTP Receive deliver, seq_num: %d, LWE: %d",
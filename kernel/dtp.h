@@ -51,6 +51,14 @@ int          dtp_sv_init(struct dtp * dtp,
 int          dtp_write(struct dtp * instance,
                        struct du * du);
 
+/* Sends a PDU worth of user data, already delimited (takes the ownership) */
+int          dtp_write_pdu(struct dtp * instance,
+                           struct du *  du);
+
+/* Delivers a (reassembled) SDU to the user of the connection */
+int          dtp_sdu_post(struct dtp * instance,
+                          struct du *  du);
+
 /* DTP receives a PDU from RMT */
 int          dtp_receive(struct dtp * instance,
                          struct du * du);
@@ -62,6 +70,11 @@ int          dtp_initial_sequence_number(struct dtp * instance);
 
 void         dtp_squeue_flush(struct dtp * dtp);
 
+/* Blocks of PDUs received above the LWE, for Selective ACKs (sv_lock held) */
+int          dtp_sack_blocks(struct dtp * dtp,
+                             seq_num_t *  blocks,
+                             int          max_blocks);
+
 // Does not start the timer(return false) if it's not necessary and packets can
 // be processed.
 void         dtp_start_rate_timer(struct dtp * dtp, struct dtcp * dtcp);
@@ -33,8 +33,6 @@
 
 /* If this is defined PCI is considered when growing/shrinking PDUs in SDUP */
 #define PDU_HEAD_GROW_WITH_PCI
-#define MAX_PCIS_LEN (40 * 5)
-#define MAX_TAIL_LEN 20
 
 int du_destroy(struct du * du)
 {
@@ -75,7 +73,10 @@ struct sk_buff * du_detach_skb(struct du * du)
 }
 EXPORT_SYMBOL(du_detach_skb);
 
-struct du *du_create_gfp(size_t data_len, gfp_t flags)
+static struct du *du_create_room_gfp(size_t data_len,
+				     size_t headroom,
+				     size_t tailroom,
+				     gfp_t  flags)
 {
 	struct du *tmp;
 
@@ -83,7 +84,7 @@ struct du *du_create_gfp(size_t data_len, gfp_t flags)
 	if (unlikely(!tmp))
 		return NULL;
 
-	tmp->skb = alloc_skb(MAX_PCIS_LEN + data_len + MAX_TAIL_LEN, flags);
+	tmp->skb = alloc_skb(headroom + data_len + tailroom, flags);
 	if (unlikely(!tmp->skb)) {
 		rkfree(tmp);
 		LOG_ERR("Could not allocate DU...");
@@ -96,7 +97,7 @@ struct du *du_create_gfp(size_t data_len, gfp_t flags)
 	tmp->cfg = NULL;
 	tmp->sdup_head = NULL;
 	tmp->sdup_tail = NULL;
-	skb_reserve(tmp->skb, MAX_PCIS_LEN);
+	skb_reserve(tmp->skb, headroom);
 	skb_put(tmp->skb, data_len);
 	tmp->skb->ip_summed = CHECKSUM_UNNECESSARY;
 
@@ -106,13 +107,21 @@ struct du *du_create_gfp(size_t data_len, gfp_t flags)
 }
 
 struct du * du_create(size_t data_len)
-{ return du_create_gfp(data_len, GFP_KERNEL); }
+{ return du_create_room_gfp(data_len, MAX_PCIS_LEN, MAX_TAIL_LEN, GFP_KERNEL); }
 EXPORT_SYMBOL(du_create);
 
 struct du *du_create_ni(size_t data_len)
-{ return du_create_gfp(data_len, GFP_ATOMIC); }
+{ return du_create_room_gfp(data_len, MAX_PCIS_LEN, MAX_TAIL_LEN, GFP_ATOMIC); }
 EXPORT_SYMBOL(du_create_ni);
 
+struct du * du_create_room(size_t data_len, size_t headroom, size_t tailroom)
+{ return du_create_room_gfp(data_len, headroom, tailroom, GFP_KERNEL); }
+EXPORT_SYMBOL(du_create_room);
+
+struct du * du_create_room_ni(size_t data_len, size_t headroom, size_t tailroom)
+{ return du_create_room_gfp(data_len, headroom, tailroom, GFP_ATOMIC); }
+EXPORT_SYMBOL(du_create_room_ni);
+
 struct pci * du_pci(struct du * du)
 {
 	return &du->pci;
@@ -196,6 +205,7 @@ static struct du *du_dup_gfp(gfp_t flags,
 	tmp->pci.h = du->pci.h;
 	tmp->pci.len = du->pci.len;
 	tmp->cfg = du->cfg;
+	tmp->tx_time = du->tx_time;
 
 	return tmp;
 }
@@ -22,20 +22,32 @@
 #define RINA_DU_H
 
 #include <linux/skbuff.h>
+#include <linux/ktime.h>
 
 #include "pci.h"
 
+/*
+ * Room reserved around the data of DUs created without knowing the stack
+ * of IPCPs they will go through (enough for a few DIF levels)
+ */
+#define MAX_PCIS_LEN (40 * 5)
+#define MAX_TAIL_LEN 20
+
 struct du {
 	struct efcp_config *cfg;
 	struct pci pci;
 	void *sdup_head; /* opaque used by SDU protection policy (TTL)*/
 	void *sdup_tail; /* opaque used by SDU protection policy (error check) */
+	ktime_t tx_time; /* earliest departure time (EDT), 0 if unpaced */
 	struct sk_buff *skb;
 };
 
 struct pci * du_pci(struct du * du);
 struct du * du_create_ni(size_t data_len);
 struct du * du_create(size_t data_len);
+/* Reserves exactly the given room for the PCIs/trailers added below */
+struct du * du_create_room_ni(size_t data_len, size_t headroom, size_t tailroom);
+struct du * du_create_room(size_t data_len, size_t headroom, size_t tailroom);
 struct du *du_create_efcp_ni(pdu_type_t type, struct efcp_config *cfg);
 struct du *du_create_efcp(pdu_type_t type, struct efcp_config *cfg);
 int du_destroy(struct du * du);
@@ -22,6 +22,7 @@
 #define RINA_EFCP_STR_H
 
 #include <linux/list.h>
+#include <linux/ktime.h>
 
 #include "common.h"
 #include "kfa.h"
@@ -85,9 +86,11 @@ struct efcp {
 };
 
 struct rtxq_entry {
-        unsigned long    time_stamp;
+        ktime_t          time_stamp;
         struct du *      du;
         int              retries;
+        bool             sacked;   /* Selectively acked by the receiver */
+        bool             sack_rtx; /* Retransmitted because of a SACK */
         struct list_head next;
 };
 
@@ -117,7 +120,7 @@ struct dtp_sv {
         timeout_t    MPL;
         timeout_t    R;
         timeout_t    A;
-        timeout_t    tr;
+        timeout_t    tr;   /* Retransmission timeout (RTO), in us */
         seq_num_t    rcv_left_window_edge;
         bool         window_closed;
         bool         drf_flag;
@@ -146,6 +149,7 @@ struct dtp_sv {
 struct dtp {
         struct dtcp *       dtcp;
         struct efcp *       efcp;
+        struct delim *      delim;
 
         struct cwq *        cwq;
         struct rtxq *       rtxq;
@@ -172,6 +176,9 @@ struct dtp {
 	struct robject		  robj;
 
 	spinlock_t          lock;
+
+        /* Earliest departure time (ns) of the next rate controlled PDU */
+        atomic64_t          tx_next;
 };
 
 /* This is the DT-SV part maintained by DTCP */
@@ -276,7 +283,7 @@ struct dtcp_sv {
         uint_t       acks;
         uint_t       flow_ctl;
 
-        /* RTT estimation */
+        /* RTT estimation, in us */
         uint_t       rtt;
         uint_t       srtt;
         uint_t       rttvar;
@@ -81,7 +81,8 @@ static ssize_t efcp_attr_show(struct robject *		     robj,
 	if (strcmp(robject_attr_name(attr), "r_timer") == 0)
 		return sprintf(buf, "%u\n", instance->dtp->sv->R);
 	if (strcmp(robject_attr_name(attr), "tr_timeout") == 0)
-		return sprintf(buf, "%u\n", instance->dtp->sv->tr);
+		return sprintf(buf, "%u\n",
+			       instance->dtp->sv->tr / USEC_PER_MSEC);
 	if (strcmp(robject_attr_name(attr), "max_flow_pdu_size") == 0)
 		return sprintf(buf, "%u\n",
 			       instance->dtp->sv->max_flow_pdu_size);
@@ -369,6 +370,48 @@ int efcp_container_write(struct efcp_container * container,
 }
 EXPORT_SYMBOL(efcp_container_write);
 
+int efcp_container_rx_resume(struct efcp_container * container,
+                             cep_id_t                cep_id)
+{
+        struct efcp * efcp;
+        int           ret = 0;
+
+        if (!is_cep_id_ok(cep_id)) {
+                LOG_ERR("Bad cep-id, cannot resume reception");
+                return -1;
+        }
+
+        spin_lock_bh(&container->lock);
+        efcp = efcp_imap_find(container->instances, cep_id);
+        if (!efcp) {
+                spin_unlock_bh(&container->lock);
+                LOG_ERR("There is no EFCP bound to this cep-id %d", cep_id);
+                return -1;
+        }
+        if (efcp->state == EFCP_DEALLOCATED) {
+                spin_unlock_bh(&container->lock);
+                LOG_DBG("EFCP already deallocated");
+                return 0;
+        }
+        atomic_inc(&efcp->pending_ops);
+        spin_unlock_bh(&container->lock);
+
+        if (efcp->dtp->dtcp)
+                ret = dtcp_rcvr_window_open(efcp->dtp->dtcp);
+
+        spin_lock_bh(&container->lock);
+        if (atomic_dec_and_test(&efcp->pending_ops) &&
+        		efcp->state == EFCP_DEALLOCATED) {
+                spin_unlock_bh(&container->lock);
+		wake_up_interruptible(&container->del_wq);
+                return ret;
+        }
+        spin_unlock_bh(&container->lock);
+
+        return ret;
+}
+EXPORT_SYMBOL(efcp_container_rx_resume);
+
 static int efcp_receive(struct efcp * efcp,
                         struct du *  du)
 {
@@ -635,6 +678,20 @@ cep_id_t efcp_connection_create(struct efcp_container * container,
 
         efcp->dtp->efcp = efcp;
 
+        /*
+         * The user bounds what it queues for reading (per QoS cube). Only
+         * window based flow control can hold the sender back (through the
+         * credit), other flows are tail-dropped, even with retransmissions
+         */
+        if (user_ipcp && user_ipcp->ops->flow_rx_limits &&
+            user_ipcp->ops->flow_rx_limits(user_ipcp->data, port_id,
+                                           dtcp_rcvd_bytes_th(dtcp_cfg),
+                                           dtcp_rcvd_buffers_th(dtcp_cfg),
+                                           dtcp &&
+                                           dtcp_window_based_fctrl(dtcp_cfg)))
+                LOG_WARN("Could not bound receive buffer of port-id %d",
+                         port_id);
+
         /* FIXME: This is crap and have to be rethinked */
 
         /* FIXME: max pdu and sdu sizes are not stored anywhere. Maybe add them
@@ -43,6 +43,9 @@ int                     efcp_container_write(struct efcp_container * container,
 int                     efcp_container_receive(struct efcp_container * c,
                                                cep_id_t                cep_id,
                                                struct du *             du);
+/* Reopens the receiver window once the user has drained its buffer */
+int                     efcp_container_rx_resume(struct efcp_container * c,
+                                                 cep_id_t                cep_id);
 
 /* FIXME: Rename efcp_connection_*() as efcp_*() */
 cep_id_t                efcp_connection_create(struct efcp_container * container,
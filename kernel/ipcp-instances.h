@@ -70,6 +70,16 @@ struct ipcp_instance_ops {
                           struct du *                 du,
                           bool                        blocking);
 
+        /*
+         * Optional. Writes count SDUs in order, stopping at the first one
+         * the N-1 flow cannot take now, and returns how many it took the
+         * ownership of. The caller waits for enable_write to retry the rest
+         */
+        int  (* du_write_batch)(struct ipcp_instance_data * data,
+                                port_id_t                   id,
+                                struct du **                dus,
+                                int                         count);
+
         cep_id_t (* connection_create)(struct ipcp_instance_data * data,
         			       struct ipcp_instance *      user_ipcp,
                                        port_id_t                   port_id,
@@ -122,6 +132,15 @@ struct ipcp_instance_ops {
                                 port_id_t                   id,
                                 struct du *                 du);
 
+        /*
+         * Optional, takes the ownership of count DUs received in a row
+         * from the same N-1 flow
+         */
+        int      (* du_enqueue_batch)(struct ipcp_instance_data * data,
+                                      port_id_t                   id,
+                                      struct du **                dus,
+                                      int                         count);
+
         /* Takes the ownership of the passed sdu */
         int (* mgmt_du_write)(struct ipcp_instance_data * data,
                               port_id_t                   port_id,
@@ -187,6 +206,39 @@ struct ipcp_instance_ops {
          * The maximum size of SDUs that this IPCP will accept
          */
         size_t (* max_sdu_size)(struct ipcp_instance_data * data);
+
+        /*
+         * Room that SDUs written to this IPCP need in front of and behind
+         * their data for the headers and trailers added by this IPCP and
+         * the ones below it. Optional, returns 0 if the room is known.
+         */
+        int (* du_room)(struct ipcp_instance_data * data,
+                        size_t *                    headroom,
+                        size_t *                    tailroom);
+
+        /*
+         * Receive buffering of a flow, implemented by its user (the KFA).
+         * flow_rx_limits bounds the SDUs queued for the application (0
+         * keeps the default); lossless flows are never tail-dropped and
+         * rely on flow_rx_credit to stop the sender instead.
+         * flow_rx_credit returns how much of the credit the provider
+         * wants to grant still fits in the buffer (negative if unknown).
+         */
+        int (* flow_rx_limits)(struct ipcp_instance_data * data,
+                               port_id_t                   id,
+                               size_t                      max_bytes,
+                               unsigned int                max_sdus,
+                               bool                        lossless);
+        int (* flow_rx_credit)(struct ipcp_instance_data * data,
+                               port_id_t                   id,
+                               unsigned int                credit);
+
+        /*
+         * Called on the provider IPCP when the user has drained a receive
+         * buffer which had limited the credit of the flow
+         */
+        int (* flow_rx_resume)(struct ipcp_instance_data * data,
+                               port_id_t                   id);
 };
 
 /* FIXME: Should work on struct ipcp_instance, not on ipcp_instance_ops */
@@ -44,6 +44,7 @@
 #include "du.h"
 #include "sdup.h"
 #include "efcp-utils.h"
+#include "delim.h"
 #include "rds/rtimer.h"
 #include "irati/kernel-msg.h"
 
@@ -186,6 +187,19 @@ static int normal_du_enqueue(struct ipcp_instance_data * data,
         return 0;
 }
 
+static int normal_du_enqueue_batch(struct ipcp_instance_data * data,
+                                   port_id_t                   id,
+                                   struct du **                dus,
+                                   int                         count)
+{
+        if (rmt_receive_batch(data->rmt, dus, count, id)) {
+                LOG_DBG("Could not enqueue all SDUs into the RMT");
+                return -1;
+        }
+
+        return 0;
+}
+
 static int normal_du_write(struct ipcp_instance_data * data,
                            port_id_t                   id,
                            struct du *                 du,
@@ -662,6 +676,25 @@ static int disable_write(struct ipcp_instance_data * data,
         return 0;
 }
 
+static int normal_flow_rx_resume(struct ipcp_instance_data * data,
+                                 port_id_t                   port_id)
+{
+        struct normal_flow * flow;
+        cep_id_t             cep_id;
+
+        spin_lock_bh(&data->lock);
+        flow = find_flow(data, port_id);
+        if (!flow) {
+                spin_unlock_bh(&data->lock);
+                LOG_ERR("Could not find flow with port-id %d", port_id);
+                return -1;
+        }
+        cep_id = flow->active;
+        spin_unlock_bh(&data->lock);
+
+        return efcp_container_rx_resume(data->efcpc, cep_id);
+}
+
 static int normal_assign_to_dif(struct ipcp_instance_data * data,
 		                const struct name * dif_name,
 				const string_t * type,
@@ -921,12 +954,23 @@ static const struct name * normal_dif_name(struct ipcp_instance_data * data)
 
 static size_t normal_max_sdu_size(struct ipcp_instance_data * data)
 {
+        struct dt_cons * dt_cons;
+        size_t           size;
+
         ASSERT(data);
         if (!data->efcpc || !data->efcpc->config)
         	return 0;
 
-        return data->efcpc->config->dt_cons->max_pdu_size -
+        dt_cons = data->efcpc->config->dt_cons;
+        if (dt_cons->dif_frag)
+                return DELIM_MAX_SDU_SIZE;
+
+        size = dt_cons->max_pdu_size -
         		pci_calculate_size(data->efcpc->config, PDU_TYPE_DT);
+        if (delim_required(dt_cons))
+                size -= DELIM_HDR_LEN;
+
+        return size;
 }
 
 ipc_process_id_t normal_ipcp_id(struct ipcp_instance_data * data)
@@ -1129,9 +1173,24 @@ int normal_update_crypto_state(struct ipcp_instance_data * data,
 			       struct sdup_crypto_state * state,
 		               port_id_t 	      port_id)
 {
-	return sdup_update_crypto_state(data->sdup,
-				        state,
-				        port_id);
+	if (sdup_update_crypto_state(data->sdup, state, port_id))
+		return -1;
+
+	/* Enabling encryption changes the overhead of the port */
+	rmt_du_room_update(data->rmt);
+
+	return 0;
+}
+
+static int normal_du_room(struct ipcp_instance_data * data,
+			  size_t *                    headroom,
+			  size_t *                    tailroom)
+{
+	ASSERT(data);
+
+	rmt_du_room(data->rmt, headroom, tailroom);
+
+	return 0;
 }
 
 int normal_address_change(struct ipcp_instance_data * data,
@@ -1219,7 +1278,9 @@ static struct ipcp_instance_ops normal_instance_ops = {
 	.connection_modify 	   = connection_modify_request,
 
         .du_enqueue               = normal_du_enqueue,
+        .du_enqueue_batch         = normal_du_enqueue_batch,
         .du_write                 = normal_du_write,
+        .du_write_batch           = NULL,
 
         .mgmt_du_write            = normal_mgmt_du_write,
         .mgmt_du_post             = normal_mgmt_du_post,
@@ -1244,7 +1305,9 @@ static struct ipcp_instance_ops normal_instance_ops = {
         .update_crypto_state       = normal_update_crypto_state,
 	.address_change            = normal_address_change,
         .dif_name		   = normal_dif_name,
-	.max_sdu_size		   = normal_max_sdu_size
+	.max_sdu_size		   = normal_max_sdu_size,
+	.du_room		   = normal_du_room,
+	.flow_rx_resume		   = normal_flow_rx_resume
 };
 
 static struct ipcp_instance * normal_create(struct ipcp_factory_data * data,
@@ -1391,6 +1454,8 @@ static int normal_destroy(struct ipcp_factory_data * data,
 
         robject_del(&instance->robj);
 
+        /* No received PDU may reach the EFCP container from now on */
+        rmt_rx_flush(tmp->rmt);
         efcp_container_destroy(tmp->efcpc);
         rmt_destroy(tmp->rmt);
         sdup_destroy(tmp->sdup);
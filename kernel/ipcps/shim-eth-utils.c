@@ -187,6 +187,65 @@ static struct Qdisc_ops shim_eth_qdisc_ops __read_mostly = {
 	.owner	   = THIS_MODULE,
 };
 
+int shim_eth_qdisc_room(struct net_device * dev)
+{
+	struct shim_eth_qdisc_priv * priv;
+	struct Qdisc *		     qdisc;
+	unsigned int		     q_index;
+	int			     room, qroom;
+
+	ASSERT(dev);
+
+	room = INT_MAX;
+	for (q_index = 0; q_index < dev->real_num_tx_queues; q_index++) {
+		qdisc = netdev_get_tx_queue(dev, q_index)->qdisc_sleeping;
+		if (!qdisc || qdisc->ops != &shim_eth_qdisc_ops)
+			return -1;
+
+		priv = qdisc_priv(qdisc);
+		qroom = (int) priv->q_max_size - (int) qdisc->q.qlen;
+		if (qroom <= 0)
+			return 0;
+		if (qroom < room)
+			room = qroom;
+	}
+
+	return room;
+}
+EXPORT_SYMBOL(shim_eth_qdisc_room);
+
+void shim_eth_qdisc_notify(struct net_device * dev)
+{
+	struct shim_eth_qdisc_priv * priv;
+	struct Qdisc *		     qdisc;
+	unsigned int		     q_index;
+	bool			     drained;
+
+	ASSERT(dev);
+
+	drained = true;
+	for (q_index = 0; q_index < dev->real_num_tx_queues; q_index++) {
+		qdisc = netdev_get_tx_queue(dev, q_index)->qdisc_sleeping;
+		if (!qdisc || qdisc->ops != &shim_eth_qdisc_ops)
+			continue;
+
+		priv = qdisc_priv(qdisc);
+		spin_lock_bh(qdisc_lock(qdisc));
+		/* As on a drop, the dequeue enables once below the threshold */
+		if (qdisc->q.qlen > priv->q_enable_thres) {
+			priv->notifications = MAX_NOTIFICATIONS;
+			priv->started_notifying = false;
+			drained = false;
+		}
+		spin_unlock_bh(qdisc_lock(qdisc));
+	}
+
+	/* No dequeue will get to the threshold any more */
+	if (drained)
+		enable_write_all(dev);
+}
+EXPORT_SYMBOL(shim_eth_qdisc_notify);
+
 void restore_qdisc(struct net_device * dev)
 {
 	struct Qdisc * 		    qdisc;
@@ -259,6 +318,12 @@ int  update_qdisc(struct net_device * dev,
 			return -1;
 		}
 
+#ifdef TCQ_F_ONETXQUEUE
+		/* Each one feeds a single TX queue, so it can be bulk
+		 * dequeued (xmit_more) within the BQL limits */
+		qdisc->flags |= TCQ_F_ONETXQUEUE;
+#endif
+
 		attr.nla_len = qdisc_max_size;
 		attr.nla_type = qdisc_enable_size;
 		if (shim_eth_qdisc_init(qdisc, &attr)) {
@@ -34,6 +34,11 @@
 #include <linux/if_packet.h>
 #include <linux/workqueue.h>
 #include <linux/notifier.h>
+#include <linux/version.h>
+#include <linux/etherdevice.h>
+#include <linux/hashtable.h>
+#include <linux/jhash.h>
+#include <linux/rcupdate.h>
 #include <net/pkt_sched.h>
 #include <net/sch_generic.h>
 
@@ -57,6 +62,8 @@
 
 #define DEFAULT_QDISC_MAX_SIZE 50
 #define DEFAULT_QDISC_ENABLE_SIZE 10
+#define FLOWS_HASH_BITS 7
+#define RX_BATCH 16
 
 /* FIXME: To be solved properly */
 static struct workqueue_struct * rcv_wq;
@@ -103,6 +110,10 @@ struct shim_eth_flow {
         /* Used when flow is not allocated yet */
         struct rfifo *         sdu_queue;
         struct ipcp_instance * user_ipcp;
+
+        /* In flows_by_ha once dest_ha is known, freed after a grace period */
+        struct hlist_node      ha_node;
+        struct rcu_head        rcu;
 };
 
 /*
@@ -130,6 +141,9 @@ struct ipcp_instance_data {
         spinlock_t             lock;
         struct list_head       flows;
 
+        /* Flows by destination MAC, looked up under RCU on reception */
+        DECLARE_HASHTABLE(flows_by_ha, FLOWS_HASH_BITS);
+
         /* FIXME: Remove it as soon as the kipcm_kfa gets removed */
         struct kfa *           kfa;
 
@@ -274,19 +288,31 @@ static struct gpa * name_to_gpa(const struct name * name)
         return gpa;
 }
 
+static u32 flow_ha_key(const unsigned char * mac)
+{ return jhash(mac, ETH_ALEN, 0); }
+
+/* Called with data->lock taken, once flow->dest_ha is set */
+static void flow_hash_ha(struct ipcp_instance_data * data,
+                         struct shim_eth_flow *      flow)
+{
+        hash_add_rcu(data->flows_by_ha, &flow->ha_node,
+                     flow_ha_key(gha_address(flow->dest_ha)));
+}
+
+/* Called under rcu_read_lock() or with data->lock taken */
 static struct shim_eth_flow *
-find_flow_by_gha(struct ipcp_instance_data * data,
-                 const struct gha *          addr)
+find_flow_by_mac(struct ipcp_instance_data * data,
+                 const unsigned char *       mac)
 {
         struct shim_eth_flow * flow;
 
 	ASSERT(data);
-        ASSERT(gha_is_ok(addr));
 
-        list_for_each_entry(flow, &data->flows, list) {
-                if (gha_is_equal(addr, flow->dest_ha)) {
+        hash_for_each_possible_rcu(data->flows_by_ha, flow, ha_node,
+                                   flow_ha_key(mac)) {
+                if (ether_addr_equal_unaligned(mac,
+                                               gha_address(flow->dest_ha)))
                         return flow;
-                }
         }
 
         return NULL;
@@ -368,6 +394,15 @@ static string_t * create_vlan_interface_name(string_t * interface_name,
         return complete_interface;
 }
 
+static void flow_free_rcu(struct rcu_head * head)
+{
+        struct shim_eth_flow * flow;
+
+        flow = container_of(head, struct shim_eth_flow, rcu);
+        if (flow->dest_ha) gha_destroy(flow->dest_ha);
+        rkfree(flow);
+}
+
 static int flow_destroy(struct ipcp_instance_data * data,
                         struct shim_eth_flow *      flow)
 {
@@ -379,13 +414,16 @@ static int flow_destroy(struct ipcp_instance_data * data,
         	LOG_DBG("Deleting flow %d from list and destroying it", flow->port_id);
                 list_del(&flow->list);
         }
+        if (!hlist_unhashed(&flow->ha_node))
+                hash_del_rcu(&flow->ha_node);
         spin_unlock(&data->lock);
 
         if (flow->dest_pa) gpa_destroy(flow->dest_pa);
-        if (flow->dest_ha) gha_destroy(flow->dest_ha);
         if (flow->sdu_queue)
                 rfifo_destroy(flow->sdu_queue, (void (*)(void *)) du_destroy);
-        rkfree(flow);
+
+        /* The receive path may still be comparing dest_ha */
+        call_rcu(&flow->rcu, flow_free_rcu);
 
         return 0;
 }
@@ -469,9 +507,10 @@ static void rinarp_resolve_handler(void *             opaque,
 
         if (flow->port_id_state == PORT_STATE_PENDING) {
                 flow->port_id_state = PORT_STATE_ALLOCATED;
-                spin_unlock_bh(&data->lock);
-
                 flow->dest_ha = gha_dup_ni(dest_ha);
+                if (flow->dest_ha)
+                        flow_hash_ha(data, flow);
+                spin_unlock_bh(&data->lock);
 
                 user_ipcp = flow->user_ipcp;
                 ASSERT(user_ipcp);
@@ -940,6 +979,34 @@ static bool qdisc_should_be_restored(struct net_device * dev)
 	return true;
 }
 
+/* Adds the Ethernet header, the skb is ready for dev_queue_xmit() */
+static int eth_vlan_skb_prepare(struct ipcp_instance_data * data,
+                                struct sk_buff *            skb,
+                                const unsigned char *       dest_hw,
+                                const unsigned char *       src_hw)
+{
+        int retval;
+
+        if (unlikely(skb_tailroom(skb) < data->dev->needed_tailroom)) {
+		LOG_ERR("Missing tail room in SKB, bailing out...");
+        	return -1;
+        }
+
+        skb_reset_network_header(skb);
+        skb->protocol = htons(ETH_P_RINA);
+
+        retval = dev_hard_header(skb, data->dev,
+                                 ETH_P_RINA, dest_hw, src_hw, skb->len);
+        if (retval < 0) {
+                LOG_ERR("Problems in dev_hard_header (%d)", retval);
+                return -1;
+        }
+
+        skb->dev = data->dev;
+
+        return 0;
+}
+
 static int eth_vlan_du_write(struct ipcp_instance_data * data,
                              port_id_t                   id,
                              struct du *                 du,
@@ -950,7 +1017,7 @@ static int eth_vlan_du_write(struct ipcp_instance_data * data,
         struct sk_buff *	 bup_skb;
         const unsigned char *    src_hw;
         const unsigned char *    dest_hw;
-        int                      hlen, tlen, length;
+        int                      hlen, length;
         int                      retval;
 
 
@@ -962,7 +1029,6 @@ static int eth_vlan_du_write(struct ipcp_instance_data * data,
 	}
 
         hlen   = sizeof(struct ethhdr);
-        tlen   = data->dev->needed_tailroom;
         length = du_len(du);
 
         if (unlikely(length > (data->dev->mtu - hlen))) {
@@ -1012,26 +1078,12 @@ static int eth_vlan_du_write(struct ipcp_instance_data * data,
         }
         du_attach_skb(du, skb);
 
-        if (unlikely(skb_tailroom(bup_skb) < tlen)) {
-		LOG_ERR("Missing tail room in SKB, bailing out...");
-                kfree_skb(bup_skb);
-        	du_destroy(du);
-        	return -1;
-        }
-
-        skb_reset_network_header(bup_skb);
-        bup_skb->protocol = htons(ETH_P_RINA);
-
-        retval = dev_hard_header(bup_skb, data->dev,
-                                 ETH_P_RINA, dest_hw, src_hw, bup_skb->len);
-        if (retval < 0) {
-                LOG_ERR("Problems in dev_hard_header (%d)", retval);
+        if (eth_vlan_skb_prepare(data, bup_skb, dest_hw, src_hw)) {
                 kfree_skb(bup_skb);
                 du_destroy(du);
                 return -1;
         }
 
-        bup_skb->dev = data->dev;
         retval = dev_queue_xmit(bup_skb);
 
         if (retval == -ENETDOWN) {
@@ -1049,6 +1101,105 @@ static int eth_vlan_du_write(struct ipcp_instance_data * data,
         return 0;
 }
 
+/*
+ * Sends the SDUs while the qdisc has room for them, so that they do not
+ * have to be cloned to be kept for a retry: the qdisc enables the port
+ * again once it has drained. The qdisc bulk dequeues what accumulates,
+ * letting the driver see xmit_more. Without the shim qdisc there is no
+ * room to check, so every SDU goes through eth_vlan_du_write().
+ */
+static int eth_vlan_du_write_batch(struct ipcp_instance_data * data,
+                                   port_id_t                   id,
+                                   struct du **                dus,
+                                   int                         count)
+{
+        struct shim_eth_flow *   flow;
+        struct sk_buff *         skb;
+        const unsigned char *    src_hw;
+        const unsigned char *    dest_hw;
+        int                      hlen, room, retval, i;
+
+	if (unlikely(!data)) {
+		LOG_ERR("Bogus data passed, bailing out");
+		return -1;
+	}
+
+        hlen = sizeof(struct ethhdr);
+
+        flow = find_flow(data, id);
+        if (!flow) {
+                LOG_ERR("Flow does not exist, you shouldn't call this");
+                goto drop_all;
+        }
+
+        spin_lock_bh(&data->lock);
+        if (flow->port_id_state != PORT_STATE_ALLOCATED) {
+                LOG_ERR("Flow is not in the right state to call this");
+                spin_unlock_bh(&data->lock);
+                goto drop_all;
+        }
+        spin_unlock_bh(&data->lock);
+
+        src_hw  = data->dev->dev_addr;
+        dest_hw = gha_address(flow->dest_ha);
+        if (!src_hw || !dest_hw) {
+                LOG_ERR("Source or destination HW address unknown");
+                goto drop_all;
+        }
+
+        room = shim_eth_qdisc_room(data->phy_dev);
+        if (room < 0) {
+                for (i = 0; i < count; i++) {
+                        if (eth_vlan_du_write(data, id, dus[i],
+                                              false) == -EAGAIN)
+                                return i;
+                }
+                return count;
+        }
+
+        for (i = 0; i < count; i++) {
+                if (!room) {
+                	LOG_DBG("qdisc full, %d SDUs left", count - i);
+                	shim_eth_qdisc_notify(data->phy_dev);
+                	return i;
+                }
+
+                if (unlikely(du_len(dus[i]) > (data->dev->mtu - hlen))) {
+                	LOG_ERR("SDU too large (%zd), dropping",
+                		du_len(dus[i]));
+                	du_destroy(dus[i]);
+                	continue;
+                }
+
+                skb = du_detach_skb(dus[i]);
+                du_destroy(dus[i]);
+                if (eth_vlan_skb_prepare(data, skb, dest_hw, src_hw)) {
+                	kfree_skb(skb);
+                	continue;
+                }
+
+                room--;
+
+                retval = dev_queue_xmit(skb);
+                if (retval == -ENETDOWN) {
+                	LOG_ERR("dev_q_xmit returned device down");
+                	for (i++; i < count; i++)
+                		du_destroy(dus[i]);
+                	return count;
+                }
+                if (retval != NET_XMIT_SUCCESS)
+                	LOG_DBG("qdisc dropped SDU (%d)", retval);
+        }
+
+        LOG_DBG("%d packets sent", count);
+        return count;
+
+ drop_all:
+        for (i = 0; i < count; i++)
+        	du_destroy(dus[i]);
+        return count;
+}
+
 static int eth_vlan_rcv_worker(void * o)
 {
         struct ipcp_instance_data *     data;
@@ -1188,197 +1339,208 @@ static int eth_vlan_rcv_worker(void * o)
         return 0;
 }
 
-static int eth_vlan_recv_process_packet(struct sk_buff *    skb,
-					struct net_device * dev)
+/*
+ * A frame from an unknown peer starts a flow allocation, the DU waits in
+ * the queue of the new flow. Called with data->lock taken, it always
+ * takes the ownership of the DU.
+ */
+static int eth_vlan_flow_arrived(struct ipcp_instance_data * data,
+                                 const unsigned char *       saddr,
+                                 struct du *                 du)
 {
-        struct ethhdr *                 mh;
-        unsigned char *                 saddr;
-        struct ipcp_instance_data *     data;
-        struct interface_data_mapping * mapping;
-        struct shim_eth_flow *          flow;
-        struct gha *                    ghaddr;
-        struct du *                     du;
-	struct sk_buff *                linear_skb;
-
-        struct rcv_work_data          * wdata;
-        struct rwq_work_item          * item;
-
-        /* C-c-c-checks */
-	if (!skb) {
-		LOG_ERR("Bogus skb passed, bailing out");
-		return -1;
-	}
-
-	if (!dev) {
-		LOG_ERR("Bogus dev passed, bailing out");
-		return -1;
-	}
+        struct shim_eth_flow * flow;
+        struct rcv_work_data * wdata;
+        struct rwq_work_item * item;
 
-        mapping = inst_data_mapping_get(dev);
-        if (!mapping) {
-                LOG_ERR("Failed to get mapping");
-                kfree_skb(skb);
+        flow = rkzalloc(sizeof(*flow), GFP_ATOMIC);
+        if (!flow) {
+                du_destroy(du);
                 return -1;
         }
 
-        data = mapping->data;
-        if (!data) {
-                kfree_skb(skb);
+        flow->port_id_state = PORT_STATE_PENDING;
+        INIT_LIST_HEAD(&flow->list);
+        flow->dest_ha = gha_create_ni(MAC_ADDR_802_3, saddr);
+        if (!flow->dest_ha) {
+                du_destroy(du);
+                rkfree(flow);
                 return -1;
         }
 
-        if (!data->app_name) {
-                LOG_ERR("No app registered yet! Someone is doing something bad on the network");
-                kfree_skb(skb);
+        flow->sdu_queue = rfifo_create_ni();
+        if (!flow->sdu_queue) {
+                LOG_ERR("Couldn't create the SDU queue for a new flow");
+                du_destroy(du);
+                gha_destroy(flow->dest_ha);
+                rkfree(flow);
                 return -1;
         }
 
-        if (skb->pkt_type == PACKET_OTHERHOST ||
-            skb->pkt_type == PACKET_LOOPBACK) {
+        /* Store SDU in queue */
+        if (rfifo_push_ni(flow->sdu_queue, du)) {
+                LOG_ERR("Could not push a SDU into the flow queue");
+                du_destroy(du);
+                goto fail;
+        }
+
+        wdata = rkzalloc(sizeof(* wdata), GFP_ATOMIC);
+        if (!wdata)
+                goto fail;
+
+        wdata->dev  = data->dev;
+        wdata->flow = flow;
+        wdata->data = data;
+        item = rwq_work_create_ni(eth_vlan_rcv_worker, wdata);
+        if (!item) {
+                rkfree(wdata);
+                goto fail;
+        }
+
+        list_add(&flow->list, &data->flows);
+        flow_hash_ha(data, flow);
+
+        rwq_work_post(rcv_wq, item);
+
+        LOG_DBG("eth_vlan_flow_arrived added work");
+
+        return 0;
+
+ fail:
+        rfifo_destroy(flow->sdu_queue, (void (*)(void *)) du_destroy);
+        gha_destroy(flow->dest_ha);
+        rkfree(flow);
+        return -1;
+}
+
+/*
+ * Turns a received frame into a DU. Returns the flow the DU has to be
+ * delivered on, or NULL if the frame was consumed here (dropped, queued
+ * in a pending flow or starting a new one). Allocated flows are found
+ * without taking any lock, so it must be called within an RCU read-side
+ * critical section, as protocol handlers are.
+ */
+static struct shim_eth_flow *
+eth_vlan_recv_process_packet(struct ipcp_instance_data * data,
+                             struct sk_buff *            skb,
+                             struct du **                pdu)
+{
+        const unsigned char *           saddr;
+        struct shim_eth_flow *          flow;
+        struct du *                     du;
+
+        if (unlikely(!data)) {
                 kfree_skb(skb);
-                return -1;
+                return NULL;
         }
 
-        mh    = eth_hdr(skb);
-        saddr = mh->h_source;
-        if (!saddr) {
-                LOG_ERR("Couldn't get source address");
+        if (unlikely(!data->app_name)) {
+                LOG_ERR("No app registered yet! Someone is doing something bad on the network");
                 kfree_skb(skb);
-                return -1;
+                return NULL;
         }
 
-        /* Get correct flow based on hwaddr */
-        ghaddr = gha_create_ni(MAC_ADDR_802_3, saddr);
-        if (!ghaddr) {
+        if (skb->pkt_type == PACKET_OTHERHOST ||
+            skb->pkt_type == PACKET_LOOPBACK) {
                 kfree_skb(skb);
-                return -1;
+                return NULL;
         }
-        ASSERT(gha_is_ok(ghaddr));
-
-	/* FIXME: If skb is not linear we need to make a copy... */
-	linear_skb = skb;
-	if (skb_is_nonlinear(skb)) {
-		LOG_DBG("SKB is fragmented, creating linear SKB");
-		linear_skb = skb_copy(skb, GFP_ATOMIC);
-		if (!linear_skb) {
-			LOG_ERR("Could not linearize received SKB");
-			kfree_skb(skb);
-			return -1;
-		}
-		LOG_DBG("Linear SKB fragmens: %d", skb_shinfo(linear_skb)->nr_frags);
+
+	/* Pulls the fragments in place, instead of copying the whole skb */
+	if (skb_linearize(skb)) {
+		LOG_ERR("Could not linearize received SKB");
 		kfree_skb(skb);
+		return NULL;
 	}
 
-	du = du_create_from_skb(linear_skb);
+	du = du_create_from_skb(skb);
 	if (!du) {
 		LOG_ERR("Could not create SDU from buffer");
-                kfree_skb(linear_skb);
-                return -1;
+                kfree_skb(skb);
+                return NULL;
+        }
+
+        saddr = eth_hdr(skb)->h_source;
+
+        /* Fast path, the flow is allocated already */
+        flow = find_flow_by_mac(data, saddr);
+        if (likely(flow &&
+                   READ_ONCE(flow->port_id_state) == PORT_STATE_ALLOCATED)) {
+                *pdu = du;
+                return flow;
         }
 
         spin_lock(&data->lock);
-        flow = find_flow_by_gha(data, ghaddr);
+        flow = find_flow_by_mac(data, saddr);
         if (!flow) {
+                eth_vlan_flow_arrived(data, saddr, du);
                 spin_unlock(&data->lock);
-                /* Create flow and its queue to handle next packets */
-                flow = rkzalloc(sizeof(*flow), GFP_ATOMIC);
-                if (!flow) {
-                        du_destroy(du);
-                        gha_destroy(ghaddr);
-                        return -1;
-                }
+                return NULL;
+        }
 
-                flow->port_id_state = PORT_STATE_PENDING;
-                flow->dest_ha       = ghaddr;
-                INIT_LIST_HEAD(&flow->list);
-                flow->sdu_queue = rfifo_create_ni();
-                if (!flow->sdu_queue) {
-                        LOG_ERR("Couldn't create the SDU queue "
-                                "for a new flow");
-                        du_destroy(du);
-                        gha_destroy(ghaddr);
-                        rkfree(flow);
-                        return -1;
-                }
+        LOG_DBG("Flow exists, queueing or delivering or dropping");
+        if (flow->port_id_state == PORT_STATE_ALLOCATED) {
+                spin_unlock(&data->lock);
+                *pdu = du;
+                return flow;
+        }
+
+        if (flow->port_id_state == PORT_STATE_PENDING) {
+                LOG_DBG("Queueing frame");
 
-                /* Store SDU in queue */
                 if (rfifo_push_ni(flow->sdu_queue, du)) {
-                        LOG_ERR("Could not push a SDU into the flow queue");
+                        LOG_ERR("Failed to write %zd bytes"
+                                "into the fifo",
+                                sizeof(struct sdu *));
                         du_destroy(du);
-                        gha_destroy(ghaddr);
-                        rkfree (flow);
-                        rfifo_destroy(flow->sdu_queue,
-                                      (void (*)(void *)) du_destroy);
-                        return -1;
                 }
+        } else
+                du_destroy(du);
+        spin_unlock(&data->lock);
 
-                spin_lock(&data->lock);
-                list_add(&flow->list, &data->flows);
-                spin_unlock(&data->lock);
-
-                /*FIXME: add checks */
-
-                wdata = rkzalloc(sizeof(* wdata), GFP_ATOMIC);
-                wdata->dev  = dev;
-                wdata->flow = flow;
-                wdata->data = data;
-                item  = rwq_work_create_ni(eth_vlan_rcv_worker, wdata);
-
-                rwq_work_post(rcv_wq, item);
-
-                LOG_DBG("eth_vlan_recv_process_packet added work");
-        } else {
-                gha_destroy(ghaddr);
-                LOG_DBG("Flow exists, queueing or delivering or dropping");
-                if (flow->port_id_state == PORT_STATE_ALLOCATED) {
-                        if (!flow->user_ipcp) {
-                        	spin_unlock(&data->lock);
-                        	LOG_ERR("Flow is being deallocated, dropping PDU");
-                                du_destroy(du);
-                                return -1;
-                        }
-
-                        spin_unlock(&data->lock);
-
-                        ASSERT(flow->user_ipcp->ops);
-                        ASSERT(flow->user_ipcp->ops->sdu_enqueue);
-                        if (flow->user_ipcp->ops->
-                            du_enqueue(flow->user_ipcp->data,
-                                       flow->port_id,
-                                       du)) {
-                                LOG_ERR("Couldn't enqueue SDU to user IPCP");
-                                return -1;
-                        }
-
-                } else if (flow->port_id_state == PORT_STATE_PENDING) {
-                        LOG_DBG("Queueing frame");
+        return NULL;
+}
 
-                        if (rfifo_push_ni(flow->sdu_queue, du)) {
-                                LOG_ERR("Failed to write %zd bytes"
-                                        "into the fifo",
-                                        sizeof(struct sdu *));
-                                spin_unlock(&data->lock);
-                                du_destroy(du);
-                                return -1;
-                        }
+/* Hands received DUs of an allocated flow to its user IPCP */
+static void eth_vlan_deliver(struct shim_eth_flow * flow,
+                             struct du **           dus,
+                             int                    count)
+{
+        struct ipcp_instance * user_ipcp;
+        int                    i;
 
-                        spin_unlock(&data->lock);
-                } else if (flow->port_id_state == PORT_STATE_NULL) {
-                        spin_unlock(&data->lock);
-                        du_destroy(du);
-                }
+        user_ipcp = READ_ONCE(flow->user_ipcp);
+        if (!user_ipcp) {
+                LOG_ERR("Flow is being deallocated, dropping %d PDUs", count);
+                for (i = 0; i < count; i++)
+                        du_destroy(dus[i]);
+                return;
+        }
 
-                LOG_DBG("eth_vlan_recv_process_packet ends ...");
+        ASSERT(user_ipcp->ops);
+        if (user_ipcp->ops->du_enqueue_batch) {
+                if (user_ipcp->ops->du_enqueue_batch(user_ipcp->data,
+                                                     flow->port_id,
+                                                     dus, count))
+                        LOG_DBG("Couldn't enqueue all SDUs to user IPCP");
+                return;
         }
 
-        return 0;
+        ASSERT(user_ipcp->ops->du_enqueue);
+        for (i = 0; i < count; i++)
+                if (user_ipcp->ops->du_enqueue(user_ipcp->data,
+                                               flow->port_id,
+                                               dus[i]))
+                        LOG_ERR("Couldn't enqueue SDU to user IPCP");
 }
 
 static int eth_vlan_rcv(struct sk_buff *     skb,
                         struct net_device *  dev,
-                        struct packet_type * pt,       /* not used */
+                        struct packet_type * pt,
                         struct net_device *  orig_dev) /* not used */
 {
+        struct shim_eth_flow * flow;
+        struct du *            du;
+
 	ASSERT(skb);
 	ASSERT(dev);
 
@@ -1389,13 +1551,59 @@ static int eth_vlan_rcv(struct sk_buff *     skb,
                 return 0;
         }
 
-        if (eth_vlan_recv_process_packet(skb, dev))
-                LOG_DBG("Failed to process packet");
+        flow = eth_vlan_recv_process_packet(pt->af_packet_priv, skb, &du);
+        if (flow)
+                eth_vlan_deliver(flow, &du, 1);
 
         LOG_DBG("eth_vlan_rcv ends");
         return 0;
 };
 
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,19,0)
+/*
+ * Receives the frames of a NAPI poll cycle at once. Consecutive DUs of
+ * the same flow are handed to the user IPCP together, up to RX_BATCH.
+ */
+static void eth_vlan_rcv_list(struct list_head *   head,
+                              struct packet_type * pt,
+                              struct net_device *  orig_dev) /* not used */
+{
+        struct shim_eth_flow * flow;
+        struct shim_eth_flow * cur;
+        struct du *            dus[RX_BATCH];
+        struct du *            du;
+        struct sk_buff *       skb;
+        struct sk_buff *       next;
+        int                    n;
+
+        cur = NULL;
+        n   = 0;
+        list_for_each_entry_safe(skb, next, head, list) {
+                skb_list_del_init(skb);
+                skb = skb_share_check(skb, GFP_ATOMIC);
+                if (!skb) {
+                        LOG_ERR("Couldn't obtain ownership of the skb");
+                        continue;
+                }
+
+                flow = eth_vlan_recv_process_packet(pt->af_packet_priv,
+                                                    skb, &du);
+                if (!flow)
+                        continue;
+
+                if (n && (flow != cur || n == RX_BATCH)) {
+                        eth_vlan_deliver(cur, dus, n);
+                        n = 0;
+                }
+                cur      = flow;
+                dus[n++] = du;
+        }
+
+        if (n)
+                eth_vlan_deliver(cur, dus, n);
+}
+#endif
+
 static int eth_vlan_assign_to_dif(struct ipcp_instance_data * data,
                 		  const struct name * dif_name,
 				  const string_t * type,
@@ -1509,6 +1717,9 @@ static int eth_vlan_assign_to_dif(struct ipcp_instance_data * data,
 
         data->eth_vlan_packet_type->type = cpu_to_be16(ETH_P_RINA);
         data->eth_vlan_packet_type->func = eth_vlan_rcv;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,19,0)
+        data->eth_vlan_packet_type->list_func = eth_vlan_rcv_list;
+#endif
 
         if (info->vlan_id != 0) {
                 complete_interface =
@@ -1585,6 +1796,7 @@ static int eth_vlan_assign_to_dif(struct ipcp_instance_data * data,
         spin_unlock(&data_instances_lock);
 
         data->eth_vlan_packet_type->dev = data->dev;
+        data->eth_vlan_packet_type->af_packet_priv = data;
         dev_add_pack(data->eth_vlan_packet_type);
         rkfree(complete_interface);
 
@@ -1671,6 +1883,9 @@ static int eth_vlan_update_dif_config(struct ipcp_instance_data * data,
 
         data->eth_vlan_packet_type->type = cpu_to_be16(ETH_P_RINA);
         data->eth_vlan_packet_type->func = eth_vlan_rcv;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,19,0)
+        data->eth_vlan_packet_type->list_func = eth_vlan_rcv_list;
+#endif
 
         if (info->vlan_id != 0) {
                 complete_interface =
@@ -1725,6 +1940,7 @@ static int eth_vlan_update_dif_config(struct ipcp_instance_data * data,
         spin_unlock(&data_instances_lock);
 
         data->eth_vlan_packet_type->dev = data->dev;
+        data->eth_vlan_packet_type->af_packet_priv = data;
         dev_add_pack(data->eth_vlan_packet_type);
         rkfree(complete_interface);
 
@@ -1761,6 +1977,20 @@ static size_t eth_vlan_max_sdu_size(struct ipcp_instance_data * data)
         return data->dev->mtu - sizeof(struct ethhdr);
 }
 
+/* Frames are built in place, in front of the PDU and behind it */
+static int eth_vlan_du_room(struct ipcp_instance_data * data,
+                            size_t *                    headroom,
+                            size_t *                    tailroom)
+{
+	if (!data || !data->dev)
+		return -1;
+
+        *headroom = LL_RESERVED_SPACE(data->dev);
+        *tailroom = data->dev->needed_tailroom;
+
+        return 0;
+}
+
 ipc_process_id_t eth_vlan_ipcp_id(struct ipcp_instance_data * data)
 {
 	ASSERT(data);
@@ -1802,7 +2032,9 @@ static struct ipcp_instance_ops eth_vlan_instance_ops = {
 	.connection_modify 	   = NULL,
 
         .du_enqueue               = NULL,
+        .du_enqueue_batch         = NULL,
         .du_write                 = eth_vlan_du_write,
+        .du_write_batch           = eth_vlan_du_write_batch,
 
         .mgmt_du_write            = NULL,
         .mgmt_du_post             = NULL,
@@ -1824,7 +2056,8 @@ static struct ipcp_instance_ops eth_vlan_instance_ops = {
         .update_crypto_state	   = NULL,
 	.address_change            = NULL,
         .dif_name		   = eth_vlan_dif_name,
-	.max_sdu_size		   = eth_vlan_max_sdu_size
+	.max_sdu_size		   = eth_vlan_max_sdu_size,
+	.du_room		   = eth_vlan_du_room
 };
 
 static int ntfy_user_ipcp_on_if_state_change(struct ipcp_instance_data * data,
@@ -2048,6 +2281,7 @@ static struct ipcp_instance * eth_vlan_create(struct ipcp_factory_data * data,
         spin_lock_init(&inst->data->lock);
 
         INIT_LIST_HEAD(&(inst->data->flows));
+        hash_init(inst->data->flows_by_ha);
 
         /*
          * Bind the shim-instance to the shims set, to keep all our data
@@ -2340,6 +2574,9 @@ static void __exit mod_exit(void)
         flush_workqueue(rcv_wq);
         destroy_workqueue(rcv_wq);
 
+        /* Wait for the flows still being freed */
+        rcu_barrier();
+
         kipcm_ipcp_factory_unregister(default_kipcm, shim_eth_vlan);
         kipcm_ipcp_factory_unregister(default_kipcm, shim_wifi_ap);
         kipcm_ipcp_factory_unregister(default_kipcm, shim_wifi_sta);
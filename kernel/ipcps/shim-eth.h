@@ -27,6 +27,12 @@
 /* Enables all N-flows whose shim-eth-vlan IPCP is associated to the device */
 void enable_write_all(struct net_device * dev);
 
+/* PDUs the shim-eth-qdiscs of a net_device can still take, -1 if absent */
+int  shim_eth_qdisc_room(struct net_device * dev);
+
+/* Has the shim-eth-qdiscs enable the N+1 ports once they have drained */
+void shim_eth_qdisc_notify(struct net_device * dev);
+
 /* Restores the qdiscs of a net_device to the default ones */
 void restore_qdisc(struct net_device * dev);
 
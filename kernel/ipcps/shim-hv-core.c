@@ -36,7 +36,7 @@
 #include "kipcm.h"
 #include "debug.h"
 #include "utils.h"
-#include "sdu.h"
+#include "du.h"
 #include "ipcp-utils.h"
 #include "ipcp-factories.h"
 #include "vmpi.h"
@@ -663,7 +663,8 @@ static void shim_hv_handle_allocate_req(struct ipcp_instance_data *priv,
 
         if (!user_ipcp->ops->ipcp_name(user_ipcp->data)) {
                 LOG_DBG("This flow goes for an app");
-                if (kfa_flow_create(priv->kfa, port_id, ipcp)) {
+                if (kfa_flow_create(priv->kfa, port_id, ipcp,
+                                    priv->id, NULL, false)) {
                         LOG_ERR("Could not create flow in KFA");
                         goto flow_arrived;
                 }
@@ -750,7 +751,7 @@ static void shim_hv_handle_allocate_resp(struct ipcp_instance_data *priv,
                  * state. This is done **before** invoking
                  * kipcm_notify_alloc_req_result() so that we avoid a race
                  * condition with the application invoking the lockless
-                 * sdu_write() when the channel is yet in the PENDING state.
+                 * du_write() when the channel is yet in the PENDING state.
                  */
                 priv->vmpi.channels[ch].state = CHANNEL_STATE_ALLOCATED;
                 LOG_DBGF("channel %d --> ALLOCATED", ch);
@@ -831,6 +832,7 @@ static void shim_hv_handle_control_msg(struct ipcp_instance_data *priv,
         /* Deserialize the control command code. */
         if (des_uint8(&msg, &cmd, &len)) {
                 LOG_ERR("%s: truncated msg: while reading command", __func__);
+                vmpi_buf_free(vb);
                 return;
         }
 
@@ -873,6 +875,7 @@ shim_hv_recv_cb(void *opaque, unsigned int ch, struct vmpi_buf *vb)
         /* User data channel. */
         if (unlikely(ch >= vmpi_num_channels)) {
                 LOG_ERR("%s: invalid channel %u", __func__, ch);
+                vmpi_buf_free(vb);
                 return;
         }
 
@@ -880,6 +883,7 @@ shim_hv_recv_cb(void *opaque, unsigned int ch, struct vmpi_buf *vb)
                      CHANNEL_STATE_ALLOCATED)) {
                 LOG_INFO("dropping packet from channel %u: no "
                          "associated flow", ch);
+                vmpi_buf_free(vb);
                 return;
         }
 
@@ -888,16 +892,17 @@ shim_hv_recv_cb(void *opaque, unsigned int ch, struct vmpi_buf *vb)
 
         if (!channel.user_ipcp){
         	LOG_ERR("Flow is being deallocated, dropping SDU");
+        	vmpi_buf_free(vb);
         	return;
         }
 
         ASSERT(channel.user_ipcp->ops);
-        ASSERT(channel.user_ipcp->ops->sdu_enqueue);
-        ret = channel.user_ipcp->ops->sdu_enqueue(channel.user_ipcp->data,
-                                                  port_id,
-                                                  vb);
+        ASSERT(channel.user_ipcp->ops->du_enqueue);
+        ret = channel.user_ipcp->ops->du_enqueue(channel.user_ipcp->data,
+                                                 port_id,
+                                                 vb);
         if (unlikely(ret)) {
-                LOG_ERR("%s: sdu_enqueue() failed", __func__);
+                LOG_ERR("%s: du_enqueue() failed", __func__);
                 return;
         }
         LOG_DBGF("SDU received");
@@ -1095,10 +1100,10 @@ shim_hv_assign_to_dif(struct ipcp_instance_data *priv,
  * SDU to a flow managed by this shim IPC process.
  */
 static int
-shim_hv_sdu_write(struct ipcp_instance_data *   priv,
-		  port_id_t 		        port_id,
-                  struct vmpi_buf *	        vb,
-                  bool                          blocking)
+shim_hv_du_write(struct ipcp_instance_data *   priv,
+		 port_id_t 		       port_id,
+                 struct vmpi_buf *	       vb,
+                 bool                          blocking)
 {
         unsigned int ch = port_id_to_channel(priv, port_id);
         int ret;
@@ -1198,11 +1203,13 @@ static struct ipcp_instance_ops shim_hv_ipcp_ops = {
         .connection_create_arrived = NULL,
 	.connection_modify 	   = NULL,
 
-        .sdu_enqueue               = NULL,
-        .sdu_write                 = shim_hv_sdu_write,
+        .du_enqueue                = NULL,
+        .du_enqueue_batch          = NULL,
+        .du_write                  = shim_hv_du_write,
+        .du_write_batch            = NULL,
 
-        .mgmt_sdu_write            = NULL,
-        .mgmt_sdu_post             = NULL,
+        .mgmt_du_write             = NULL,
+        .mgmt_du_post              = NULL,
 
         .pff_add                   = NULL,
         .pff_remove                = NULL,
@@ -1252,7 +1259,7 @@ static struct ipcp_instance *
 shim_hv_factory_ipcp_create(struct ipcp_factory_data * factory_data,
                             const struct name *        name,
                             ipc_process_id_t           id,
-			    uint_t		       us_nl_port)
+			    irati_msg_port_t	       us_nl_port)
 {
         struct ipcp_instance *      ipcp;
         struct ipcp_instance_data * priv;
@@ -31,6 +31,7 @@
 #include <linux/workqueue.h>
 #include <linux/mutex.h>
 #include <linux/inet.h>
+#include <linux/hash.h>
 #include <net/sock.h>
 #include <linux/version.h>
 
@@ -54,16 +55,26 @@
 #define CUBE_RELIABLE   1
 #define SEND_WQ_MAX_SIZE 1000
 
+/* Sockets with data to read, processed by a single worker at a time */
+struct rcv_queue {
+        spinlock_t         lock;
+        struct list_head   data;
+        struct work_struct work;
+};
+
 static struct workqueue_struct * rcv_wq;
 static struct workqueue_struct * snd_wq;
-static struct work_struct        rcv_work;
 static struct work_struct        snd_work;
-static struct list_head          rcv_wq_data;
 static struct list_head          snd_wq_data;
 static int snd_wq_size;
-static DEFINE_SPINLOCK(rcv_wq_lock);
 static DEFINE_SPINLOCK(snd_wq_lock);
 
+/* Used when receive steering is off, see rx_steer_queue() */
+static struct rcv_queue          rcv_queue;
+/* One per receive queue, for the sockets steered by rx_steer_queue() */
+static struct rcv_queue *        rcv_steer_queues;
+static int                       rcv_steer_nr;
+
 static int parse_assign_conf(struct ipcp_instance_data * data,
                              const struct dif_config *   config);
 
@@ -638,10 +649,37 @@ static int tcp_unbind_and_destroy_flow(struct ipcp_instance_data * data,
         return unbind_and_destroy_flow(data, flow);
 }
 
-static void tcp_udp_rcv(struct sock * sk)
+/* Forgets the pending reads of a socket that is going away */
+static void rcv_queue_forget(struct rcv_queue * q,
+                             struct socket *    sock)
 {
         struct rcv_data * recvd;
 
+        spin_lock_bh(&q->lock);
+        list_for_each_entry(recvd, &q->data, list) {
+                if (recvd->sk && recvd->sk->sk_socket == sock) {
+                        LOG_DBG("Setting socket to NULL");
+                        recvd->sk = NULL;
+                }
+        }
+        spin_unlock_bh(&q->lock);
+}
+
+static void rcv_queues_forget(struct socket * sock)
+{
+        int i;
+
+        rcv_queue_forget(&rcv_queue, sock);
+        for (i = 0; i < rcv_steer_nr; i++)
+                rcv_queue_forget(&rcv_steer_queues[i], sock);
+}
+
+static void tcp_udp_rcv(struct sock * sk)
+{
+        struct rcv_data *  recvd;
+        struct rcv_queue * q;
+        int                i;
+
         if (!sk) {
                 LOG_ERR("Bad socket passed to callback, bailing out");
                 return;
@@ -657,11 +695,18 @@ static void tcp_udp_rcv(struct sock * sk)
         recvd->sk = sk;
         INIT_LIST_HEAD(&recvd->list);
 
-        spin_lock(&rcv_wq_lock);
-        list_add_tail(&recvd->list, &rcv_wq_data);
-        spin_unlock(&rcv_wq_lock);
+        /* Each socket is read on its own queue, UDP flows share theirs */
+        i = rx_steer_queue(hash_ptr(sk, 32));
+        q = i < 0 ? &rcv_queue : &rcv_steer_queues[i];
 
-        queue_work(rcv_wq, &rcv_work);
+        spin_lock(&q->lock);
+        list_add_tail(&recvd->list, &q->data);
+        spin_unlock(&q->lock);
+
+        if (i < 0)
+                queue_work(rcv_wq, &q->work);
+        else
+                rx_steer_work(i, &q->work);
 }
 
 static int
@@ -967,7 +1012,6 @@ static int flow_deallocate(struct ipcp_instance_data * data,
 			   struct shim_tcp_udp_flow * flow)
 {
         struct reg_app_data *      app;
-        struct rcv_data *          recvd;
 
 	ASSERT(data);
 	ASSERT(flow);
@@ -978,14 +1022,7 @@ static int flow_deallocate(struct ipcp_instance_data * data,
             flow->port_id_state == PORT_STATE_ALLOCATED) {
 
                 /* FIXME: better cleanup (= removing from list) */
-                spin_lock_bh(&rcv_wq_lock);
-                list_for_each_entry(recvd, &rcv_wq_data, list) {
-                        if (recvd->sk->sk_socket == flow->sock) {
-                                LOG_DBG("Setting socket to NULL");
-                                recvd->sk = NULL;
-                        }
-                }
-                spin_unlock_bh(&rcv_wq_lock);
+                rcv_queues_forget(flow->sock);
 
                 LOG_DBG("Closing socket");
                 kernel_sock_shutdown(flow->sock, SHUT_RDWR);
@@ -1480,7 +1517,6 @@ static int tcp_process_msg(struct ipcp_instance_data * data,
                            struct socket *             sock)
 {
         struct shim_tcp_udp_flow * flow;
-        struct rcv_data *          recvd;
         int                        size;
 
         ASSERT(data);
@@ -1515,12 +1551,7 @@ static int tcp_process_msg(struct ipcp_instance_data * data,
                 write_unlock_bh(&flow->sock->sk->sk_callback_lock);
 
                 /* FIXME: better cleanup */
-                spin_lock_bh(&rcv_wq_lock);
-                list_for_each_entry(recvd, &rcv_wq_data, list) {
-                        if (recvd->sk->sk_socket == flow->sock)
-                                recvd->sk = NULL;
-                }
-                spin_unlock_bh(&rcv_wq_lock);
+                rcv_queues_forget(flow->sock);
 
                 sock_release(flow->sock);
 
@@ -1728,13 +1759,16 @@ static int tcp_udp_rcv_process_msg(struct sock * sk)
 
 static void tcp_udp_rcv_worker(struct work_struct * work)
 {
-        struct rcv_data * recvd, * next;
+        struct rcv_data *  recvd, * next;
+        struct rcv_queue * q;
+
+        q = container_of(work, struct rcv_queue, work);
 
         /* FIXME: more efficient locking and better cleanup */
-        spin_lock_bh(&rcv_wq_lock);
-        list_for_each_entry_safe(recvd, next, &rcv_wq_data, list) {
+        spin_lock_bh(&q->lock);
+        list_for_each_entry_safe(recvd, next, &q->data, list) {
                 list_del(&recvd->list);
-                spin_unlock_bh(&rcv_wq_lock);
+                spin_unlock_bh(&q->lock);
 
                 LOG_DBG("Worker on %pK", recvd->sk);
 
@@ -1746,9 +1780,9 @@ static void tcp_udp_rcv_worker(struct work_struct * work)
 
                 rkfree(recvd);
 
-                spin_lock_bh(&rcv_wq_lock);
+                spin_lock_bh(&q->lock);
         }
-        spin_unlock_bh(&rcv_wq_lock);
+        spin_unlock_bh(&q->lock);
 
         LOG_DBG("Worker finished for now");
 }
@@ -2601,6 +2635,17 @@ static size_t tcp_udp_max_sdu_size(struct ipcp_instance_data * data)
         return 2000000;
 }
 
+/* SDUs are copied into the socket, nothing is added in place */
+static int tcp_udp_du_room(struct ipcp_instance_data * data,
+                           size_t *                    headroom,
+                           size_t *                    tailroom)
+{
+        *headroom = 0;
+        *tailroom = 0;
+
+        return 0;
+}
+
 ipc_process_id_t tcp_udp_ipcp_id(struct ipcp_instance_data * data)
 {
 	ASSERT(data);
@@ -2642,7 +2687,9 @@ static struct ipcp_instance_ops tcp_udp_instance_ops = {
 	.connection_modify 	   = NULL,
 
         .du_enqueue               = NULL,
+        .du_enqueue_batch         = NULL,
         .du_write                 = tcp_udp_du_write,
+        .du_write_batch           = NULL,
 
         .mgmt_du_write            = NULL,
         .mgmt_du_post             = NULL,
@@ -2664,22 +2711,44 @@ static struct ipcp_instance_ops tcp_udp_instance_ops = {
         .update_crypto_state	   = NULL,
 	.address_change            = NULL,
         .dif_name		   = tcp_udp_dif_name,
-	.max_sdu_size		   = tcp_udp_max_sdu_size
+	.max_sdu_size		   = tcp_udp_max_sdu_size,
+	.du_room		   = tcp_udp_du_room
 };
 
+static void rcv_queue_init(struct rcv_queue * q)
+{
+        spin_lock_init(&q->lock);
+        INIT_LIST_HEAD(&q->data);
+        INIT_WORK(&q->work, tcp_udp_rcv_worker);
+}
+
+static void rcv_queue_flush(struct rcv_queue * q)
+{
+        struct rcv_data * recvd, * nxt_r;
+
+        list_for_each_entry_safe(recvd, nxt_r, &q->data, list) {
+                LOG_DBG("Disposing stale data in receiver-wq");
+                list_del(&recvd->list);
+                rkfree(recvd);
+        }
+}
+
 static int tcp_udp_init(struct ipcp_factory_data * data)
 {
+        int i;
+
         ASSERT(data);
 
         bzero(&tcp_udp_data, sizeof(tcp_udp_data));
         INIT_LIST_HEAD(&(data->instances));
 
-        INIT_LIST_HEAD(&rcv_wq_data);
         INIT_LIST_HEAD(&snd_wq_data);
 
         spin_lock_init(&data->lock);
 
-        INIT_WORK(&rcv_work, tcp_udp_rcv_worker);
+        rcv_queue_init(&rcv_queue);
+        for (i = 0; i < rcv_steer_nr; i++)
+                rcv_queue_init(&rcv_steer_queues[i]);
         INIT_WORK(&snd_work, tcp_udp_write_worker);
 
         snd_wq_size = 0;
@@ -2954,10 +3023,25 @@ static int __init mod_init(void)
                 return -1;
         }
 
+        /* irati_rx_cpus is fixed at load time */
+        rcv_steer_nr = rx_steer_queue(0) < 0 ? 0 : irati_rx_cpus;
+        if (rcv_steer_nr) {
+                rcv_steer_queues = rkzalloc(rcv_steer_nr *
+                                            sizeof(*rcv_steer_queues),
+                                            GFP_KERNEL);
+                if (!rcv_steer_queues) {
+                        LOG_CRIT("Cannot create the steered receive queues");
+                        destroy_workqueue(rcv_wq);
+                        return -1;
+                }
+        }
+
         snd_wq = alloc_workqueue(SHIM_NAME_WWQ,
                                  WQ_MEM_RECLAIM | WQ_HIGHPRI | WQ_UNBOUND, 1);
         if (!snd_wq) {
                 LOG_CRIT("Cannot create the sender-wq");
+                if (rcv_steer_queues)
+                        rkfree(rcv_steer_queues);
                 destroy_workqueue(rcv_wq);
                 return -1;
         }
@@ -2967,6 +3051,8 @@ static int __init mod_init(void)
                                            &tcp_udp_data, &tcp_udp_ops);
         if (!shim) {
                 destroy_workqueue(snd_wq);
+                if (rcv_steer_queues)
+                        rkfree(rcv_steer_queues);
                 destroy_workqueue(rcv_wq);
                 return -1;
         }
@@ -2976,17 +3062,19 @@ static int __init mod_init(void)
 
 static void __exit mod_exit(void)
 {
-        struct rcv_data * recvd, * nxt_r;
         struct rcv_data * sendd, * nxt_s;
+        int               i;
 
         LOG_DBG("Disposing receiver-wq");
         flush_workqueue(rcv_wq);
         destroy_workqueue(rcv_wq);
-        list_for_each_entry_safe(recvd, nxt_r, &rcv_wq_data, list) {
-                LOG_DBG("Disposing stale data in receiver-wq");
-                list_del(&recvd->list);
-                rkfree(recvd);
-        }
+        for (i = 0; i < rcv_steer_nr; i++)
+                cancel_work_sync(&rcv_steer_queues[i].work);
+        rcv_queue_flush(&rcv_queue);
+        for (i = 0; i < rcv_steer_nr; i++)
+                rcv_queue_flush(&rcv_steer_queues[i]);
+        if (rcv_steer_queues)
+                rkfree(rcv_steer_queues);
 
         LOG_DBG("Disposing sender-wq");
         flush_workqueue(snd_wq);
@@ -21,31 +21,31 @@
 #include <linux/gfp.h>
 #include <linux/slab.h>
 #include "vmpi-bufs.h"
-#include "../sdu.h"
+#include "../du.h"
 
 struct vmpi_buf *
 vmpi_buf_alloc(size_t size, size_t unused, gfp_t gfp)
 {
-        struct sdu *sdu;
+        struct du *du;
 
         if (gfp == GFP_ATOMIC) {
-                sdu = sdu_create_ni(size);
+                du = du_create_ni(size);
         } else {
-                sdu = sdu_create(size);
+                du = du_create(size);
         }
 
-        if (!sdu) {
+        if (!du) {
                 return NULL;
         }
 
-        return sdu;
+        return du;
 }
 EXPORT_SYMBOL_GPL(vmpi_buf_alloc);
 
 void
 vmpi_buf_free(struct vmpi_buf *vb)
 {
-        sdu_destroy(vb);
+        du_destroy(vb);
 }
 EXPORT_SYMBOL_GPL(vmpi_buf_free);
 
@@ -75,30 +75,30 @@ EXPORT_SYMBOL_GPL(vmpi_buf_node_free);
 uint8_t *
 vmpi_buf_data(struct vmpi_buf *vb)
 {
-        return sdu_buffer(vb);
+        return du_buffer(vb);
 }
 EXPORT_SYMBOL_GPL(vmpi_buf_data);
 
 size_t
 vmpi_buf_len(struct vmpi_buf *vb)
-{ return (size_t)sdu_len(vb); }
+{ return (size_t)du_len(vb); }
 EXPORT_SYMBOL_GPL(vmpi_buf_len);
 
 void
 vmpi_buf_set_len(struct vmpi_buf *vb, size_t len)
 {
-	BUG_ON(len > sdu_len(vb));
-	sdu_shrink(vb, sdu_len(vb) - len);
+	BUG_ON(len > du_len(vb));
+	du_tail_shrink(vb, du_len(vb) - len);
 	return;
 }
 EXPORT_SYMBOL_GPL(vmpi_buf_set_len);
 
 void
 vmpi_buf_pop(struct vmpi_buf *vb, size_t len)
-{ sdu_pop(vb, len); }
+{ du_head_shrink(vb, len); }
 EXPORT_SYMBOL_GPL(vmpi_buf_pop);
 
 void
 vmpi_buf_push(struct vmpi_buf *vb, size_t len)
-{ sdu_push(vb, len); }
+{ du_head_grow(vb, len); }
 EXPORT_SYMBOL_GPL(vmpi_buf_push);
@@ -20,6 +20,7 @@
 
 #include <linux/hashtable.h>
 #include <linux/list.h>
+#include <linux/rcupdate.h>
 
 #define RINA_PREFIX "kfa-utils"
 
@@ -31,6 +32,9 @@
 
 /*
  * PMAPs
+ *
+ * Updates (add, update, remove) must be serialized by the caller; lookups
+ * may run concurrently with them under rcu_read_lock()
  */
 
 #define PMAP_HASH_BITS 7
@@ -44,6 +48,7 @@ struct kfa_pmap_entry {
         struct ipcp_flow * value_flow;
 
         struct hlist_node  hlist;
+        struct rcu_head    rcu;
 };
 
 struct kfa_pmap * kfa_pmap_create(void)
@@ -94,7 +99,7 @@ static struct kfa_pmap_entry * pmap_entry_find(struct kfa_pmap * map,
         ASSERT(map);
 
         head = &map->table[pmap_hash(map->table, key)];
-        hlist_for_each_entry(entry, head, hlist) {
+        hlist_for_each_entry_rcu(entry, head, hlist) {
                 if (entry->key == key)
                         return entry;
         }
@@ -150,7 +155,7 @@ static int kfa_pmap_add_gfp(gfp_t              flags,
         tmp->value_flow = value_flow;
         INIT_HLIST_NODE(&tmp->hlist);
 
-        hash_add(map->table, &tmp->hlist, key);
+        hash_add_rcu(map->table, &tmp->hlist, key);
 
         return 0;
 }
@@ -165,6 +170,9 @@ int kfa_pmap_add_ni(struct kfa_pmap *  map,
                     struct ipcp_flow * value_flow)
 { return kfa_pmap_add_gfp(GFP_ATOMIC, map, key, value_flow); }
 
+static void pmap_entry_free_rcu(struct rcu_head * head)
+{ rkfree(container_of(head, struct kfa_pmap_entry, rcu)); }
+
 int kfa_pmap_remove(struct kfa_pmap * map,
                     port_id_t         key)
 {
@@ -176,8 +184,8 @@ int kfa_pmap_remove(struct kfa_pmap * map,
         if (!cur)
                 return -1;
 
-        hash_del(&cur->hlist);
-        rkfree(cur);
+        hash_del_rcu(&cur->hlist);
+        call_rcu(&cur->rcu, pmap_entry_free_rcu);
 
         return 0;
 }
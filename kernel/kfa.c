@@ -25,6 +25,8 @@
 #include <linux/kfifo.h>
 #include <linux/sched.h>
 #include <linux/poll.h>
+#include <linux/rcupdate.h>
+#include <linux/workqueue.h>
 #include <linux/version.h>
 
 #define RINA_PREFIX "kfa"
@@ -35,9 +37,34 @@
 #include "pidm.h"
 #include "kfa.h"
 #include "kfa-utils.h"
+#include "rds/robjects.h"
 
 #define RINA_IP_FLOW_ENT_NAME "RINA_IP"
 
+/* Default bounds of the SDUs queued for reading on a flow */
+#define KFA_RX_MAX_BYTES_DEFAULT (4 * 1024 * 1024)
+#define KFA_RX_MAX_SDUS_DEFAULT  4096
+
+/*
+ * Locking: the flows map is only modified (and the PIDM only accessed)
+ * with kfa->lock held, while lookups in the I/O paths run under
+ * rcu_read_lock(). The state of each flow (state, wqs, sdu_ready, users)
+ * is protected by its own lock. Users (readers, writers) hold a
+ * reference on the flow while they sleep or call into the IPCP; the flow
+ * is unmapped when it is deallocated and has no users, and freed after
+ * an RCU grace period.
+ *
+ * The SDUs queued on a flow are bounded (rx_max_bytes, rx_max_sdus).
+ * Lossy flows are tail-dropped at the bounds, while lossless ones (DTCP
+ * window based flow control) have their credit clamped by
+ * kfa_flow_rx_credit() and are resumed by the provider once the reader
+ * drains the queue. Their room is counted in SDUs of the largest size
+ * seen so far, so that the credit granted never exceeds rx_max_bytes.
+ *
+ * Flows are freed in process context (flowdelq) after the grace period,
+ * since removing their sysfs entry may sleep; their port-id is released
+ * only then, so that it cannot be reused while the entry still exists.
+ */
 struct kfa {
 	spinlock_t		 lock;
 	struct pidm             *pidm;
@@ -45,6 +72,7 @@ struct kfa {
 	struct ipcp_instance    *ipcp;
 	struct list_head	 list;
 	struct workqueue_struct *flowdelq;
+	struct rset		*flows_rset;
 };
 
 enum flow_state {
@@ -56,17 +84,61 @@ enum flow_state {
 };
 
 struct ipcp_flow {
+	spinlock_t	       lock;
 	port_id_t	       port_id;
 	enum flow_state	       state;
 	struct ipcp_instance * ipc_process;
 	struct rfifo         * sdu_ready;
 	struct iowaitqs	     * wqs;
-	atomic_t	       readers;
-	atomic_t	       writers;
-	atomic_t	       posters;
+	unsigned int	       users;
+	bool		       dead;
 	bool		       msg_boundaries;
+	size_t		       rx_bytes;
+	unsigned int	       rx_sdus;
+	size_t		       rx_max_bytes;
+	unsigned int	       rx_max_sdus;
+	size_t		       rx_sdu_len;
+	unsigned int	       rx_resume_at;
+	unsigned long	       rx_dropped;
+	bool		       rx_lossless;
+	bool		       rx_blocked;
+	struct kfa	     * kfa;
+	struct robject	       robj;
+	struct rcu_head	       rcu;
+	struct work_struct     free_work;
 };
 
+static ssize_t kfa_flow_attr_show(struct robject *	  robj,
+				  struct robj_attribute * attr,
+				  char *		  buf)
+{
+	struct ipcp_flow *flow;
+	ssize_t		  ret = 0;
+
+	flow = container_of(robj, struct ipcp_flow, robj);
+
+	spin_lock_bh(&flow->lock);
+	if (strcmp(robject_attr_name(attr), "rx_queued_bytes") == 0)
+		ret = sprintf(buf, "%zu\n", flow->rx_bytes);
+	else if (strcmp(robject_attr_name(attr), "rx_queued_sdus") == 0)
+		ret = sprintf(buf, "%u\n", flow->rx_sdus);
+	else if (strcmp(robject_attr_name(attr), "rx_max_bytes") == 0)
+		ret = sprintf(buf, "%zu\n", flow->rx_max_bytes);
+	else if (strcmp(robject_attr_name(attr), "rx_max_sdus") == 0)
+		ret = sprintf(buf, "%u\n", flow->rx_max_sdus);
+	else if (strcmp(robject_attr_name(attr), "rx_dropped_sdus") == 0)
+		ret = sprintf(buf, "%lu\n", flow->rx_dropped);
+	else if (strcmp(robject_attr_name(attr), "rx_blocked") == 0)
+		ret = sprintf(buf, "%u\n", flow->rx_blocked ? 1 : 0);
+	spin_unlock_bh(&flow->lock);
+
+	return ret;
+}
+RINA_SYSFS_OPS(kfa_flow);
+RINA_ATTRS(kfa_flow, rx_queued_bytes, rx_queued_sdus, rx_max_bytes,
+	   rx_max_sdus, rx_dropped_sdus, rx_blocked);
+RINA_KTYPE(kfa_flow);
+
 struct flowdel_data {
 	struct kfa *kfa;
 	port_id_t  id;
@@ -110,7 +182,52 @@ port_id_t kfa_port_id_reserve(struct kfa      *instance,
 }
 EXPORT_SYMBOL(kfa_port_id_reserve);
 
-/* NOTE: Add instance-locking IFF exporting to API */
+static void kfa_flow_free(struct ipcp_flow *flow)
+{
+	robject_del(&flow->robj);
+
+	if (flow->sdu_ready &&
+	    rfifo_destroy(flow->sdu_ready, (void (*) (void *)) du_destroy))
+		LOG_ERR("Flow %d FIFO has not been destroyed", flow->port_id);
+
+	rkfree(flow);
+}
+
+/* Process context, frees a flow that never got to own its port-id */
+static void kfa_flow_free_worker(struct work_struct *work)
+{
+	kfa_flow_free(container_of(work, struct ipcp_flow, free_work));
+}
+
+/* Process context, frees a flow and then gives its port-id back */
+static void kfa_flow_destroy_worker(struct work_struct *work)
+{
+	struct ipcp_flow *flow;
+	struct kfa	 *instance;
+	port_id_t	  id;
+
+	flow	 = container_of(work, struct ipcp_flow, free_work);
+	instance = flow->kfa;
+	id	 = flow->port_id;
+
+	kfa_flow_free(flow);
+
+	spin_lock_bh(&instance->lock);
+	if (pidm_release(instance->pidm, id))
+		LOG_ERR("Could not release pid %d from the map", id);
+	spin_unlock_bh(&instance->lock);
+}
+
+/* Any context; the flow goes once lockless lookups are done with it */
+static void kfa_flow_free_rcu(struct rcu_head *head)
+{
+	struct ipcp_flow *flow;
+
+	flow = container_of(head, struct ipcp_flow, rcu);
+	queue_work(flow->kfa->flowdelq, &flow->free_work);
+}
+
+/* Must be called without locks, once the flow has been marked dead */
 static int kfa_flow_destroy(struct kfa       *instance,
 			    struct ipcp_flow *flow,
 			    port_id_t	      id)
@@ -118,40 +235,88 @@ static int kfa_flow_destroy(struct kfa       *instance,
 	int retval = 0;
 
 	ASSERT(flow);
+	ASSERT(flow->dead);
 
 	LOG_DBG("We are destroying flow %d", id);
 
 	/* FIXME: Should we ASSERT() here ? */
-	if (!flow->sdu_ready) {
+	if (!flow->sdu_ready)
 		LOG_WARN("Instance %pK SDU-ready FIFO is NULL", instance);
-	} else {
-		if (rfifo_destroy(flow->sdu_ready,
-				  (void (*) (void *)) du_destroy)) {
-			LOG_ERR("Flow %d FIFO has not been destroyed", id);
-			retval = -1;
-		}
-	}
+
+	spin_lock_bh(&instance->lock);
 
 	if (kfa_pmap_remove(instance->flows, id)) {
 		LOG_ERR("Could not remove pending flow with port-id %d", id);
 		retval = -1;
 	}
 
-	if (pidm_release(instance->pidm, id)) {
-		LOG_ERR("Could not release pid %d from the map", id);
-		retval = -1;
-	}
+	spin_unlock_bh(&instance->lock);
 
 	if (flow->wqs) {
 		wake_up_interruptible_all(&flow->wqs->read_wqueue);
 		wake_up_interruptible_all(&flow->wqs->write_wqueue);
 	}
 
-	rkfree(flow);
+	/* Lockless lookups may still be looking at the flow */
+	INIT_WORK(&flow->free_work, kfa_flow_destroy_worker);
+	call_rcu(&flow->rcu, kfa_flow_free_rcu);
 
 	return retval;
 }
 
+/* Flow lock held; returns true if the caller has to destroy the flow */
+static bool kfa_flow_must_destroy(struct ipcp_flow *flow)
+{
+	if (flow->dead || flow->users ||
+	    flow->state != PORT_STATE_DEALLOCATED)
+		return false;
+
+	flow->dead = true;
+
+	return true;
+}
+
+/*
+ * Looks up the flow bound to @id and takes a reference on it. Returns
+ * NULL if there is no such flow or it is being destroyed.
+ */
+static struct ipcp_flow *kfa_flow_get(struct kfa *instance, port_id_t id)
+{
+	struct ipcp_flow *flow;
+
+	rcu_read_lock();
+	flow = kfa_pmap_find(instance->flows, id);
+	if (flow) {
+		spin_lock_bh(&flow->lock);
+		if (flow->dead) {
+			spin_unlock_bh(&flow->lock);
+			rcu_read_unlock();
+			return NULL;
+		}
+		flow->users++;
+		spin_unlock_bh(&flow->lock);
+	}
+	rcu_read_unlock();
+
+	return flow;
+}
+
+static void kfa_flow_put(struct kfa       *instance,
+			 struct ipcp_flow *flow,
+			 port_id_t	   id)
+{
+	bool destroy;
+
+	spin_lock_bh(&flow->lock);
+	ASSERT(flow->users);
+	flow->users--;
+	destroy = kfa_flow_must_destroy(flow);
+	spin_unlock_bh(&flow->lock);
+
+	if (destroy && kfa_flow_destroy(instance, flow, id))
+		LOG_ERR("Could not destroy the flow correctly");
+}
+
 int  kfa_port_id_release(struct kfa *instance,
 			 port_id_t   port_id)
 {
@@ -171,7 +336,7 @@ int  kfa_port_id_release(struct kfa *instance,
 
 	/* To avoid releasing the port if it is used by a flow in the KFA
 	 * (to an app) which will be automatically destroyed when the flow is
-	 * unbound by the provider IPCP and the writers/readers/posters in KFA
+	 * unbound by the provider IPCP and its users in KFA
 	 * are 0. This avoids allocating the freed port again before the KFA
 	 * finally destroys everything.
 	 */
@@ -205,6 +370,7 @@ static int kfa_flow_deallocate_worker(void *data)
 	struct kfa          *instance;
 	port_id_t	     id;
 	struct flowdel_data *wqdata;
+	bool		     destroy;
 
 	wqdata = (struct flowdel_data *) data;
 	if (!wqdata) {
@@ -226,37 +392,49 @@ static int kfa_flow_deallocate_worker(void *data)
 		return -1;
 	}
 
-	spin_lock_bh(&instance->lock);
+	rcu_read_lock();
 
 	flow = kfa_pmap_find(instance->flows, id);
 	if (!flow) {
-		spin_unlock_bh(&instance->lock);
+		rcu_read_unlock();
 		LOG_ERR("The flow with port-id %d was already destroyed", id);
 		return 0;
 	}
 
+	spin_lock_bh(&flow->lock);
+
+	if (flow->dead) {
+		spin_unlock_bh(&flow->lock);
+		rcu_read_unlock();
+		LOG_DBG("The flow with port-id %d is being destroyed", id);
+		return 0;
+	}
+
 	if (flow->state != PORT_STATE_DEALLOCATED) {
-		spin_unlock_bh(&instance->lock);
+		spin_unlock_bh(&flow->lock);
+		rcu_read_unlock();
 		LOG_ERR("Port %u should be deallocated but it is not...", id);
 		return 0;
 	}
 
-	if ((atomic_read(&flow->readers) == 0) &&
-	    (atomic_read(&flow->writers) == 0) &&
-	    (atomic_read(&flow->posters) == 0)) {
+	destroy = kfa_flow_must_destroy(flow);
+	spin_unlock_bh(&flow->lock);
+
+	if (destroy) {
+		rcu_read_unlock();
 		if (kfa_flow_destroy(instance, flow, id))
 			LOG_ERR("Could not destroy the flow correctly");
-		spin_unlock_bh(&instance->lock);
 		return 0;
 	}
 
-	spin_unlock_bh(&instance->lock);
-
+	/* Users will destroy the flow when they are done with it */
 	if (flow->wqs) {
 		wake_up_interruptible_all(&flow->wqs->read_wqueue);
 		wake_up_interruptible_all(&flow->wqs->write_wqueue);
 	}
 
+	rcu_read_unlock();
+
 	return 0;
 }
 
@@ -267,6 +445,7 @@ static int kfa_flow_deallocate(struct ipcp_instance_data *data,
 	struct flowdel_data  *wqdata;
 	struct ipcp_flow     *flow;
 	struct kfa           *instance;
+	bool		      destroy;
 
 	if (!data) {
 		LOG_ERR("Bogus data passed, bailing out");
@@ -283,28 +462,38 @@ static int kfa_flow_deallocate(struct ipcp_instance_data *data,
 		return -1;
 	}
 
-	spin_lock_bh(&instance->lock);
+	rcu_read_lock();
 
 	flow = kfa_pmap_find(instance->flows, id);
 	if (!flow) {
-		spin_unlock_bh(&instance->lock);
+		rcu_read_unlock();
 		LOG_ERR("There is no flow created with port-id %d", id);
 		return -1;
 	}
 
+	spin_lock_bh(&flow->lock);
+	if (flow->dead) {
+		spin_unlock_bh(&flow->lock);
+		rcu_read_unlock();
+		LOG_ERR("The flow with port-id %d is being destroyed", id);
+		return -1;
+	}
 	flow->state = PORT_STATE_DEALLOCATED;
+	destroy = kfa_flow_must_destroy(flow);
+	spin_unlock_bh(&flow->lock);
 
-	if ((atomic_read(&flow->readers) == 0) &&
-	    (atomic_read(&flow->writers) == 0) &&
-	    (atomic_read(&flow->posters) == 0)) {
+	rcu_read_unlock();
+
+	if (destroy) {
 		LOG_DBG("Destroying kfa flow now...");
 		if (kfa_flow_destroy(instance, flow, id))
 			LOG_ERR("Could not destroy the flow correctly");
-		spin_unlock_bh(&instance->lock);
 		return 0;
 	}
 
-	wqdata	       = rkzalloc(sizeof(*wqdata), GFP_ATOMIC);
+	wqdata = rkzalloc(sizeof(*wqdata), GFP_ATOMIC);
+	if (!wqdata)
+		return -1;
 	wqdata->kfa    = instance;
 	wqdata->id     = id;
 
@@ -315,7 +504,6 @@ static int kfa_flow_deallocate(struct ipcp_instance_data *data,
 	}
 
 	rwq_work_post(data->kfa->flowdelq, item);
-	spin_unlock_bh(&instance->lock);
 
 	return 0;
 }
@@ -327,10 +515,6 @@ static bool ok_write(struct ipcp_flow *flow)
 		 flow->state == PORT_STATE_DEALLOCATED);
 }
 
-/*
- * NOTE: This function does NOT take the mutex, because it will be called only
- *	 during a write operation and then the mutex will be already taken.
- */
 static int disable_write(struct ipcp_instance_data *data, port_id_t id)
 {
 	struct ipcp_flow *flow;
@@ -352,23 +536,26 @@ static int disable_write(struct ipcp_instance_data *data, port_id_t id)
 	}
 	LOG_DBG("DISABLED write op");
 
-	spin_lock_bh(&instance->lock);
+	rcu_read_lock();
 	flow = kfa_pmap_find(instance->flows, id);
 	if (!flow) {
-		spin_unlock_bh(&instance->lock);
+		rcu_read_unlock();
 		LOG_ERR("There is no flow bound to port-id %d", id);
 		return -1;
 	}
 
+	spin_lock_bh(&flow->lock);
 	if (flow->state == PORT_STATE_DEALLOCATED) {
-		spin_unlock_bh(&instance->lock);
+		spin_unlock_bh(&flow->lock);
+		rcu_read_unlock();
 		LOG_DBG("Flow with port-id %d is already deallocated", id);
 		return 0;
 	}
 
 	flow->state = PORT_STATE_DISABLED;
 	LOG_DBG("Disabled write in port id %d", id);
-	spin_unlock_bh(&instance->lock);
+	spin_unlock_bh(&flow->lock);
+	rcu_read_unlock();
 
 	LOG_DBG("IPCP notified CWQ exhausted");
 
@@ -379,7 +566,7 @@ static int enable_write(struct ipcp_instance_data *data, port_id_t id)
 {
 	struct ipcp_flow  *flow;
 	struct kfa        *instance;
-	wait_queue_head_t *wq;
+	wait_queue_head_t *wq = NULL;
 
 	if (!data) {
 		LOG_ERR("Bogus ipcp data instance passed, can't enable pid");
@@ -398,34 +585,37 @@ static int enable_write(struct ipcp_instance_data *data, port_id_t id)
 
 	LOG_DBG("ENABLED write op");
 
-	spin_lock_bh(&instance->lock);
+	rcu_read_lock();
 	flow = kfa_pmap_find(instance->flows, id);
 	if (!flow) {
-		spin_unlock_bh(&instance->lock);
+		rcu_read_unlock();
 		LOG_ERR("There is no flow bound to port-id %d", id);
 		return -1;
 	}
 
+	spin_lock_bh(&flow->lock);
 	if (flow->state == PORT_STATE_DEALLOCATED) {
-		spin_unlock_bh(&instance->lock);
+		spin_unlock_bh(&flow->lock);
+		rcu_read_unlock();
 		LOG_DBG("Flow with port-id %d is already deallocated", id);
 		return 0;
 	}
 	if (flow->state == PORT_STATE_DISABLED) {
 		flow->state = PORT_STATE_ALLOCATED;
-		if (flow->wqs) {
+		if (flow->wqs)
 			wq = &flow->wqs->write_wqueue;
-			spin_unlock_bh(&instance->lock);
-			LOG_DBG("IPCP notified CWQ is now enabled");
-			LOG_DBG("Enabled write in port id %d", id);
-			wake_up_interruptible(wq);
-			return 0;
-		}
 	} else {
 		LOG_DBG("IPCP notified CWQ already enabled");
 	}
+	spin_unlock_bh(&flow->lock);
 
-	spin_unlock_bh(&instance->lock);
+	if (wq) {
+		LOG_DBG("IPCP notified CWQ is now enabled");
+		LOG_DBG("Enabled write in port id %d", id);
+		wake_up_interruptible(wq);
+	}
+
+	rcu_read_unlock();
 
 	return 0;
 }
@@ -439,73 +629,57 @@ int kfa_flow_du_write(struct kfa  *kfa,
 	int		      retval = 0;
 	size_t max_sdu_size = 0;
 	ssize_t length = du_len(du);
+	enum flow_state state;
 
 	LOG_DBG("Trying to write SDU of length %zd to port-id %d",
 		length, id);
 
-	spin_lock_bh(&kfa->lock);
-
-	flow = kfa_pmap_find(kfa->flows, id);
+	flow = kfa_flow_get(kfa, id);
 	if (!flow) {
-		spin_unlock_bh(&kfa->lock);
 		du_destroy(du);
 		LOG_ERR("There is no flow bound to port-id %d", id);
 		return -EBADF;
 	}
-	if (flow->state == PORT_STATE_DEALLOCATED) {
-		spin_unlock_bh(&kfa->lock);
-		du_destroy(du);
+
+	spin_lock_bh(&flow->lock);
+	state = flow->state;
+	ipcp = flow->ipc_process;
+	spin_unlock_bh(&flow->lock);
+
+	if (state == PORT_STATE_DEALLOCATED) {
 		LOG_ERR("Flow with port-id %d is already deallocated", id);
-		return -ESHUTDOWN;
+		du_destroy(du);
+		retval = -ESHUTDOWN;
+		goto finish;
 	}
 
-	ipcp = flow->ipc_process;
 	max_sdu_size = ipcp->ops->max_sdu_size(ipcp->data);
 	if (length > max_sdu_size) {
-		spin_unlock_bh(&kfa->lock);
 		LOG_ERR("SDU is larger than the max SDU handled by "
 				"the IPCP: %zd, %zd", max_sdu_size, length);
 		du_destroy(du);
-	        return -EMSGSIZE;
+	        retval = -EMSGSIZE;
+		goto finish;
 	}
 
-	atomic_inc(&flow->writers);
-
-	if (flow->state == PORT_STATE_PENDING
-			|| flow->state == PORT_STATE_DISABLED) {
+	if (state == PORT_STATE_PENDING || state == PORT_STATE_DISABLED) {
 		LOG_DBG("Flow %d is not ready for writing", id);
 		du_destroy(du);
 		retval = -EAGAIN;
 		goto finish;
 	}
 
-	if (flow->state == PORT_STATE_DEALLOCATED) {
-		LOG_ERR("Flow %d has been deallocated", id);
-		du_destroy(du);
-		retval = -ESHUTDOWN;
-		goto finish;
-	}
-
-	spin_unlock_bh(&kfa->lock);
 	if (ipcp->ops->du_write(ipcp->data, id, du, false)) {
 		LOG_ERR("Couldn't write SDU on port-id %d", id);
 		retval = -EIO;
 	} else {
 		retval = length;
 	}
-	spin_lock_bh(&kfa->lock);
 
  finish:
 	LOG_DBG("Finishing (write)");
 
-	if (atomic_dec_and_test(&flow->writers) &&
-	    (atomic_read(&flow->readers) == 0)	&&
-	    (atomic_read(&flow->posters) == 0)	&&
-	    (flow->state == PORT_STATE_DEALLOCATED))
-		if (kfa_flow_destroy(kfa, flow, id))
-			LOG_ERR("Could not destroy the flow correctly");
-
-	spin_unlock_bh(&kfa->lock);
+	kfa_flow_put(kfa, flow, id);
 
 	return retval;
 }
@@ -525,40 +699,46 @@ int kfa_flow_ub_write(struct kfa * instance,
 	size_t max_sdu_size = 0;
 	size_t copylen = 0;
 	size_t data_written = 0;
+	size_t headroom = MAX_PCIS_LEN;
+	size_t tailroom = MAX_TAIL_LEN;
 
 	LOG_DBG("Trying to write SDU to port-id %d", id);
 
-	spin_lock_bh(&instance->lock);
-
-	flow = kfa_pmap_find(instance->flows, id);
+	flow = kfa_flow_get(instance, id);
 	if (!flow) {
-		spin_unlock_bh(&instance->lock);
 		LOG_ERR("There is no flow bound to port-id %d", id);
 		return -EBADF;
 	}
+
+	spin_lock_bh(&flow->lock);
 	if (flow->state == PORT_STATE_DEALLOCATED) {
-		spin_unlock_bh(&instance->lock);
+		spin_unlock_bh(&flow->lock);
 		LOG_ERR("Flow with port-id %d is already deallocated", id);
-		return -ESHUTDOWN;
+		retval = -ESHUTDOWN;
+		goto finish;
 	}
-
 	ipcp = flow->ipc_process;
+	spin_unlock_bh(&flow->lock);
+
 	max_sdu_size = ipcp->ops->max_sdu_size(ipcp->data);
 	if (flow->msg_boundaries && left > max_sdu_size) {
-		spin_unlock_bh(&instance->lock);
 		LOG_ERR("SDU is larger than the max SDU handled by "
 				"the IPCP: %zd, %zd", max_sdu_size, left);
-	        return -EMSGSIZE;
+	        retval = -EMSGSIZE;
+		goto finish;
 	}
 
-	atomic_inc(&flow->writers);
+	/* Room for the headers and trailers of the IPCPs below the flow */
+	if (ipcp->ops->du_room &&
+	    ipcp->ops->du_room(ipcp->data, &headroom, &tailroom)) {
+		headroom = MAX_PCIS_LEN;
+		tailroom = MAX_TAIL_LEN;
+	}
 
 	while (left) {
-		spin_unlock_bh(&instance->lock);
-
 		copylen = min(left, max_sdu_size);
 
-		du = du_create(copylen);
+		du = du_create_room(copylen, headroom, tailroom);
 		if (!du) {
 			retval = -ENOMEM;
 			goto finish;
@@ -571,10 +751,11 @@ int kfa_flow_ub_write(struct kfa * instance,
 			goto finish;
 		}
 
-		spin_lock_bh(&instance->lock);
+		spin_lock_bh(&flow->lock);
 
 		if (blocking) { /* blocking I/O */
 			if (flow->wqs == 0) {
+				spin_unlock_bh(&flow->lock);
 				LOG_ERR("Waitqueues are null, flow %d is being deallocated", id);
 				retval = -EBADF;
 				du_destroy(du);
@@ -584,7 +765,7 @@ int kfa_flow_ub_write(struct kfa * instance,
 			}
 
 			while (!ok_write(flow)) {
-				spin_unlock_bh(&instance->lock);
+				spin_unlock_bh(&flow->lock);
 
 				LOG_DBG("Going to sleep on wait queue %pK (writing)",
 						&wqs->write_wqueue);
@@ -609,18 +790,10 @@ int kfa_flow_ub_write(struct kfa * instance,
 					}
 				}
 
-				spin_lock_bh(&instance->lock);
-
-				flow = kfa_pmap_find(instance->flows, id);
-				if (!flow) {
-					spin_unlock_bh(&instance->lock);
-					du_destroy(du);
-					LOG_ERR("No more flow bound to port-id %d", id);
-					retval = -EBADF;
-					goto finish;
-				}
+				spin_lock_bh(&flow->lock);
 
 				if (flow->wqs == 0) {
+					spin_unlock_bh(&flow->lock);
 					LOG_ERR("Waitqueues are null, flow %d is being deallocated", id);
 					retval = -EBADF;
 					du_destroy(du);
@@ -628,61 +801,50 @@ int kfa_flow_ub_write(struct kfa * instance,
 				}
 
 				if (retval < 0) {
+					spin_unlock_bh(&flow->lock);
 					du_destroy(du);
 					goto finish;
 				}
 
 				if (flow->state == PORT_STATE_DEALLOCATED) {
+					spin_unlock_bh(&flow->lock);
 					du_destroy(du);
 					retval = -ESHUTDOWN;
 					goto finish;
 				}
 			}
-
-			ipcp = flow->ipc_process;
-			if (!ipcp) {
-				retval = -EBADF;
-				du_destroy(du);
-				goto finish;
-			}
-
-			spin_unlock_bh(&instance->lock);
-			if (ipcp->ops->du_write(ipcp->data, id, du, blocking)) {
-				spin_lock_bh(&instance->lock);
-				LOG_ERR("Couldn't write SDU on port-id %d", id);
-				retval = -EIO;
-				goto finish;
-			}
-			spin_lock_bh(&instance->lock);
 		} else { /* non-blocking I/O */
 			if (flow->state == PORT_STATE_PENDING
 					|| flow->state == PORT_STATE_DISABLED) {
+				spin_unlock_bh(&flow->lock);
 				LOG_DBG("Flow %d is not ready for writing", id);
+				du_destroy(du);
 				retval = -EAGAIN;
 				goto finish;
 			}
 
 			if (flow->state == PORT_STATE_DEALLOCATED) {
+				spin_unlock_bh(&flow->lock);
 				LOG_ERR("Flow %d has been deallocated", id);
+				du_destroy(du);
 				retval = -ESHUTDOWN;
 				goto finish;
 			}
+		}
 
-			ipcp = flow->ipc_process;
-			if (!ipcp) {
-				retval = -EBADF;
-				du_destroy(du);
-				goto finish;
-			}
+		ipcp = flow->ipc_process;
+		spin_unlock_bh(&flow->lock);
 
-			spin_unlock_bh(&instance->lock);
-			if (ipcp->ops->du_write(ipcp->data, id, du, blocking)) {
-				spin_lock_bh(&instance->lock);
-				LOG_ERR("Couldn't write SDU on port-id %d", id);
-				retval = -EIO;
-				goto finish;
-			}
-			spin_lock_bh(&instance->lock);
+		if (!ipcp) {
+			retval = -EBADF;
+			du_destroy(du);
+			goto finish;
+		}
+
+		if (ipcp->ops->du_write(ipcp->data, id, du, blocking)) {
+			LOG_ERR("Couldn't write SDU on port-id %d", id);
+			retval = -EIO;
+			goto finish;
 		}
 
 		left -= copylen;
@@ -692,14 +854,7 @@ int kfa_flow_ub_write(struct kfa * instance,
  finish:
 	LOG_DBG("Finishing (write)");
 
-	if (atomic_dec_and_test(&flow->writers) &&
-	    (atomic_read(&flow->readers) == 0)	&&
-	    (atomic_read(&flow->posters) == 0)	&&
-	    (flow->state == PORT_STATE_DEALLOCATED))
-		if (kfa_flow_destroy(instance, flow, id))
-			LOG_ERR("Could not destroy the flow correctly");
-
-	spin_unlock_bh(&instance->lock);
+	kfa_flow_put(instance, flow, id);
 
 	if (data_written == 0)
 		return retval;
@@ -737,6 +892,7 @@ int kfa_flow_readable(struct kfa       *instance,
                       poll_table       *wait)
 {
         struct ipcp_flow *flow;
+        struct iowaitqs  *wqs;
 
 	if (!instance) {
 		LOG_ERR("Bogus instance passed, bailing out");
@@ -750,25 +906,30 @@ int kfa_flow_readable(struct kfa       *instance,
 		return -1;
 	}
 
-	spin_lock_bh(&instance->lock);
-
-	flow = kfa_pmap_find(instance->flows, id);
+	flow = kfa_flow_get(instance, id);
 	if (!flow) {
-		spin_unlock_bh(&instance->lock);
 		LOG_ERR("There is no flow bound to port-id %d", id);
 		*mask |= POLLIN | POLLRDNORM;
 		return 0;
 	}
 
-        poll_wait(f, &flow->wqs->read_wqueue, wait);
+	spin_lock_bh(&flow->lock);
+	wqs = flow->wqs;
+	spin_unlock_bh(&flow->lock);
+
+	/* poll_wait() may sleep, so no locks here */
+	if (wqs)
+		poll_wait(f, &wqs->read_wqueue, wait);
 
         /* We set a POLLIN event if there is something in the receive queue
          * or if the flow has been deallocated, which is our EOF condition. */
+	spin_lock_bh(&flow->lock);
         if (queue_ready(flow)) {
                 *mask |= POLLIN | POLLRDNORM;
         }
+	spin_unlock_bh(&flow->lock);
 
-	spin_unlock_bh(&instance->lock);
+	kfa_flow_put(instance, flow, id);
 
 	return 0;
 }
@@ -789,18 +950,20 @@ int kfa_flow_set_iowqs(struct kfa * instance,
 		return -1;
 	}
 
-	spin_lock_bh(&instance->lock);
+	rcu_read_lock();
 
 	flow = kfa_pmap_find(instance->flows, pid);
 	if (!flow) {
-		spin_unlock_bh(&instance->lock);
+		rcu_read_unlock();
 		LOG_ERR("There is no flow bound to port-id %d", pid);
 		return -1;
 	}
 
+	spin_lock_bh(&flow->lock);
 	flow->wqs = wqs;
+	spin_unlock_bh(&flow->lock);
 
-	spin_unlock_bh(&instance->lock);
+	rcu_read_unlock();
 
 	return 0;
 }
@@ -817,18 +980,20 @@ void kfa_flow_cancel_iowqs(struct kfa      * instance,
 	if (!is_port_id_ok(pid))
 		return;
 
-	spin_lock_bh(&instance->lock);
+	rcu_read_lock();
 
 	flow = kfa_pmap_find(instance->flows, pid);
 	if (!flow) {
-		spin_unlock_bh(&instance->lock);
+		rcu_read_unlock();
 		return;
 	}
 
+	spin_lock_bh(&flow->lock);
 	wqs = flow->wqs;
 	flow->wqs = 0;
+	spin_unlock_bh(&flow->lock);
 
-	spin_unlock_bh(&instance->lock);
+	rcu_read_unlock();
 
 	if (wqs) {
 		wake_up_interruptible_all(&wqs->read_wqueue);
@@ -836,14 +1001,51 @@ void kfa_flow_cancel_iowqs(struct kfa      * instance,
 	}
 }
 
+/* Flow lock held; SDUs (or their room) accepted on top of the queued ones */
+static unsigned int kfa_flow_rx_room(struct ipcp_flow *flow)
+{
+	size_t bytes;
+
+	if (flow->rx_bytes >= flow->rx_max_bytes ||
+	    flow->rx_sdus >= flow->rx_max_sdus)
+		return 0;
+
+	/* The SDUs to come are as large as the largest one seen */
+	bytes = (flow->rx_max_bytes - flow->rx_bytes) /
+		max_t(size_t, flow->rx_sdu_len, 1);
+
+	return min_t(size_t, flow->rx_max_sdus - flow->rx_sdus, bytes);
+}
+
+/* Flow lock held; returns true if the provider has to be resumed */
+static bool kfa_flow_rx_resume_check(struct ipcp_flow *flow)
+{
+	if (!flow->rx_blocked ||
+	    kfa_flow_rx_room(flow) < flow->rx_resume_at)
+		return false;
+
+	flow->rx_blocked = false;
+
+	return true;
+}
+
+/* Flow lock held */
 struct du * get_du_to_read(struct ipcp_flow * flow, size_t size)
 {
 	struct du * du;
+	size_t	    len;
 
 	du = rfifo_peek(flow->sdu_ready);
-	if (size >= du_len(du)) {
+	len = du_len(du);
+	if (size >= len) {
 		du = rfifo_pop(flow->sdu_ready);
+		if (flow->rx_sdus)
+			flow->rx_sdus--;
+	} else {
+		/* The reader consumes size bytes, the rest stays queued */
+		len = size;
 	}
+	flow->rx_bytes -= min(flow->rx_bytes, len);
 
 	return du;
 }
@@ -854,9 +1056,11 @@ int kfa_flow_du_read(struct kfa  *instance,
 		     size_t       size,
                      bool blocking)
 {
-	struct ipcp_flow *flow;
-	int		  retval = 0;
-	struct iowaitqs * wqs = 0;
+	struct ipcp_flow     *flow;
+	struct ipcp_instance *ipcp;
+	int		      retval = 0;
+	struct iowaitqs      *wqs = 0;
+	bool		      resume;
 
 	if (!instance) {
 		LOG_ERR("Bogus instance passed, bailing out");
@@ -873,22 +1077,20 @@ int kfa_flow_du_read(struct kfa  *instance,
 
 	LOG_DBG("Trying to read SDU from port-id %d", id);
 
-	spin_lock_bh(&instance->lock);
-
-	flow = kfa_pmap_find(instance->flows, id);
+	flow = kfa_flow_get(instance, id);
 	if (!flow) {
 		LOG_ERR("There is no flow bound to port-id %d", id);
-		spin_unlock_bh(&instance->lock);
 		return 0;
 	}
+
+	spin_lock_bh(&flow->lock);
+
 	if (flow->state == PORT_STATE_DEALLOCATED) {
 		LOG_ERR("Flow with port-id %d is already deallocated", id);
-		spin_unlock_bh(&instance->lock);
-		return 0;
+		retval = 0;
+		goto finish;
 	}
 
-	atomic_inc(&flow->readers);
-
 	if (blocking) { /* blocking I/O */
 		if (flow->wqs == 0) {
 			LOG_ERR("Waitqueues are null, flow %d is being deallocated", id);
@@ -900,7 +1102,7 @@ int kfa_flow_du_read(struct kfa  *instance,
 
 		while (flow->state == PORT_STATE_PENDING ||
 				rfifo_is_empty(flow->sdu_ready)) {
-			spin_unlock_bh(&instance->lock);
+			spin_unlock_bh(&flow->lock);
 
 			LOG_DBG("Going to sleep on wait queue %pK (reading)",
 					&wqs->read_wqueue);
@@ -923,13 +1125,7 @@ int kfa_flow_du_read(struct kfa  *instance,
 				}
 			}
 
-			spin_lock_bh(&instance->lock);
-			flow = kfa_pmap_find(instance->flows, id);
-			if (!flow) {
-				spin_unlock_bh(&instance->lock);
-				LOG_ERR("No more flow bound to port-id %d", id);
-				return 0;
-			}
+			spin_lock_bh(&flow->lock);
 
 			if (flow->wqs == 0) {
 				LOG_ERR("Waitqueues are null, flow %d is being deallocated", id);
@@ -984,14 +1180,16 @@ int kfa_flow_du_read(struct kfa  *instance,
  finish:
 	LOG_DBG("Finishing (read)");
 
-	if (atomic_dec_and_test(&flow->readers) &&
-	    (atomic_read(&flow->writers) == 0)	&&
-	    (atomic_read(&flow->posters) == 0)	&&
-	    (flow->state == PORT_STATE_DEALLOCATED))
-		if (kfa_flow_destroy(instance, flow, id))
-			LOG_ERR("Could not destroy the flow correctly");
+	resume = kfa_flow_rx_resume_check(flow);
+	ipcp = flow->ipc_process;
+	spin_unlock_bh(&flow->lock);
 
-	spin_unlock_bh(&instance->lock);
+	/* Let the provider reopen the window we had been holding back */
+	if (resume && ipcp && ipcp->ops->flow_rx_resume &&
+	    ipcp->ops->flow_rx_resume(ipcp->data, id))
+		LOG_ERR("Could not resume reception on port-id %d", id);
+
+	kfa_flow_put(instance, flow, id);
 
 	return retval;
 }
@@ -1001,9 +1199,10 @@ static int kfa_du_post(struct ipcp_instance_data *data,
 		       struct du                * du)
 {
 	struct ipcp_flow  *flow;
-	wait_queue_head_t *wq;
+	wait_queue_head_t *wq = NULL;
 	struct kfa        *instance;
 	int		   retval = 0;
+	size_t		   len;
 
 	if (!data || !is_port_id_ok(id) || !is_du_ok(du)) {
 		LOG_ERR("Bogus ipcp data instance passed, cannot post SDU");
@@ -1020,53 +1219,133 @@ static int kfa_du_post(struct ipcp_instance_data *data,
 
 	LOG_DBG("Posting DU to port-id %d ", id);
 
-	spin_lock_bh(&instance->lock);
+	/* The flow cannot go away while we hold its lock, no need for a
+	 * reference */
+	rcu_read_lock();
 	flow = kfa_pmap_find(instance->flows, id);
 	if (!flow) {
-		spin_unlock_bh(&instance->lock);
+		rcu_read_unlock();
 		LOG_ERR("There is no flow bound to port-id %d", id);
 		du_destroy(du);
 		return -1;
 	}
 
-	if (flow->state == PORT_STATE_DEALLOCATED) {
-		spin_unlock_bh(&instance->lock);
+	spin_lock_bh(&flow->lock);
+	if (flow->dead || flow->state == PORT_STATE_DEALLOCATED) {
+		spin_unlock_bh(&flow->lock);
+		rcu_read_unlock();
 		LOG_ERR("Flow with port-id %d is already deallocated", id);
 		du_destroy(du);
 		return -1;
 	}
 
+	len = du_len(du);
+	if (len > flow->rx_sdu_len)
+		flow->rx_sdu_len = len;
+	if (!flow->rx_lossless && !kfa_flow_rx_room(flow)) {
+		flow->rx_dropped++;
+		spin_unlock_bh(&flow->lock);
+		rcu_read_unlock();
+		LOG_DBG("Receive buffer of port-id %d is full, dropping SDU",
+			id);
+		du_destroy(du);
+		return 0;
+	}
+
 	if (rfifo_push_ni(flow->sdu_ready, du)) {
 		LOG_ERR("Could not write %zd bytes into port-id %d fifo",
 				sizeof(struct du *), id);
 		retval = -1;
+	} else {
+		flow->rx_bytes += len;
+		flow->rx_sdus++;
+		if (flow->wqs)
+			wq = &flow->wqs->read_wqueue;
 	}
+	spin_unlock_bh(&flow->lock);
 
-	atomic_inc(&flow->posters);
-	if (atomic_dec_and_test(&flow->posters) &&
-	    (atomic_read(&flow->writers) == 0)	&&
-	    (atomic_read(&flow->readers) == 0)	&&
-	    (flow->state == PORT_STATE_DEALLOCATED)) {
-		if (kfa_flow_destroy(instance, flow, id))
-			LOG_ERR("Could not destroy the flow correctly");
-		flow = NULL;
-	}
-
-	spin_unlock_bh(&instance->lock);
-
-	if (flow && (retval == 0) && (flow->wqs != 0)) {
-		wq = &flow->wqs->read_wqueue;
-		ASSERT(wq);
-
+	if (wq) {
 		/* set_tsk_need_resched(current); */
 		wake_up_interruptible_poll(wq, POLLIN | POLLRDNORM
                                                 | POLLRDBAND);
 		LOG_DBG("SDU posted");
 	}
 
+	rcu_read_unlock();
+
 	return retval;
 }
 
+static int kfa_flow_rx_limits(struct ipcp_instance_data *data,
+			      port_id_t			 id,
+			      size_t			 max_bytes,
+			      unsigned int		 max_sdus,
+			      bool			 lossless)
+{
+	struct ipcp_flow *flow;
+
+	if (!data || !data->kfa || !is_port_id_ok(id)) {
+		LOG_ERR("Bogus parameters passed, cannot set receive limits");
+		return -1;
+	}
+
+	rcu_read_lock();
+	flow = kfa_pmap_find(data->kfa->flows, id);
+	if (!flow) {
+		rcu_read_unlock();
+		LOG_ERR("There is no flow bound to port-id %d", id);
+		return -1;
+	}
+
+	spin_lock_bh(&flow->lock);
+	if (max_bytes)
+		flow->rx_max_bytes = max_bytes;
+	if (max_sdus)
+		flow->rx_max_sdus = max_sdus;
+	flow->rx_lossless = lossless;
+	spin_unlock_bh(&flow->lock);
+
+	rcu_read_unlock();
+
+	LOG_DBG("Port-id %d queues up to %zu bytes and %u SDUs (%s)", id,
+		max_bytes, max_sdus, lossless ? "lossless" : "lossy");
+
+	return 0;
+}
+
+static int kfa_flow_rx_credit(struct ipcp_instance_data *data,
+			      port_id_t			 id,
+			      unsigned int		 credit)
+{
+	struct ipcp_flow *flow;
+	unsigned int	  room;
+
+	if (!data || !data->kfa || !is_port_id_ok(id))
+		return -1;
+
+	rcu_read_lock();
+	flow = kfa_pmap_find(data->kfa->flows, id);
+	if (!flow) {
+		rcu_read_unlock();
+		return -1;
+	}
+
+	spin_lock_bh(&flow->lock);
+	room = kfa_flow_rx_room(flow);
+	if (room < credit) {
+		/* Resume once a full credit (or half the buffer) fits */
+		flow->rx_blocked   = true;
+		flow->rx_resume_at = min(credit,
+					 max(1U, flow->rx_max_sdus / 2));
+		credit = room;
+	}
+	spin_unlock_bh(&flow->lock);
+
+	rcu_read_unlock();
+
+	return min_t(unsigned int, credit, INT_MAX);
+}
+
 #if 0
 struct ipcp_flow *kfa_flow_find_by_pid(struct kfa *instance, port_id_t pid)
 {
@@ -1098,23 +1377,34 @@ int kfa_flow_create(struct kfa           *instance,
 		LOG_ERR("Failed to created flow, bailing out");
 		return -1;
 	}
-	atomic_set(&flow->readers, 0);
-	atomic_set(&flow->writers, 0);
-	atomic_set(&flow->posters, 0);
+	spin_lock_init(&flow->lock);
+	flow->port_id = pid;
+	flow->users = 0;
+	flow->dead = false;
 	flow->wqs = 0;
 	flow->msg_boundaries = msg_boundaries;
+	flow->rx_max_bytes = KFA_RX_MAX_BYTES_DEFAULT;
+	flow->rx_max_sdus = KFA_RX_MAX_SDUS_DEFAULT;
+	flow->kfa = instance;
 
 	flow->ipc_process = ipcp;
 
 	flow->state	  = PORT_STATE_PENDING;
 	LOG_DBG("Flow pre-bound to port-id %d", pid);
 
+	if (robject_rset_init_and_add(&flow->robj, &kfa_flow_rtype,
+				      instance->flows_rset, "%d", pid)) {
+		rkfree(flow);
+		LOG_ERR("Could not add the sysfs entry of port-id %d", pid);
+		return -1;
+	}
+
 	spin_lock_bh(&instance->lock);
 
 	if (kfa_pmap_add_ni(instance->flows, pid, flow)) {
-		rkfree(flow);
-
 		spin_unlock_bh(&instance->lock);
+		robject_del(&flow->robj);
+		rkfree(flow);
 		LOG_ERR("Could not map flow and port-id %d", pid);
 		return -1;
 	}
@@ -1131,6 +1421,7 @@ static int kfa_flow_ipcp_bind(struct ipcp_instance_data *data,
 {
 	struct ipcp_flow *flow;
 	struct kfa       *instance;
+	struct rfifo     *sdu_ready;
 
 	LOG_DBG("Binding IPCP %pK to flow on port %d", ipcp, pid);
 
@@ -1154,27 +1445,38 @@ static int kfa_flow_ipcp_bind(struct ipcp_instance_data *data,
 		return -1;
 	}
 
-	spin_lock_bh(&instance->lock);
+	rcu_read_lock();
 	flow = kfa_pmap_find(instance->flows, pid);
 	if (!flow) {
-		spin_unlock_bh(&instance->lock);
+		rcu_read_unlock();
 		LOG_ERR("Cannot bind IPCP %pK, missing flow on port %d",
 			ipcp,
 			pid);
 		return -1;
 	}
 
-	flow->ipc_process = ipcp;
-	flow->state	  = PORT_STATE_ALLOCATED;
-	flow->sdu_ready	  = rfifo_create_ni();
-	if (!flow->sdu_ready) {
+	sdu_ready = rfifo_create_ni();
+
+	spin_lock_bh(&flow->lock);
+	if (!sdu_ready) {
+		flow->dead = true;
+		spin_unlock_bh(&flow->lock);
+		rcu_read_unlock();
+
+		spin_lock_bh(&instance->lock);
 		kfa_pmap_remove(instance->flows, pid);
-		rkfree(flow);
 		spin_unlock_bh(&instance->lock);
+		INIT_WORK(&flow->free_work, kfa_flow_free_worker);
+		call_rcu(&flow->rcu, kfa_flow_free_rcu);
 		return -1;
 	}
 
-	spin_unlock_bh(&instance->lock);
+	flow->ipc_process = ipcp;
+	flow->sdu_ready	  = sdu_ready;
+	flow->state	  = PORT_STATE_ALLOCATED;
+	spin_unlock_bh(&flow->lock);
+
+	rcu_read_unlock();
 
 	LOG_DBG("Flow bound to port-id %d", pid);
 
@@ -1211,10 +1513,12 @@ static struct ipcp_instance_ops kfa_instance_ops = {
 	.du_write		   = NULL,
 	.ipcp_name		   = kfa_name,
 	.enable_write		   = enable_write,
-	.disable_write		   = disable_write
+	.disable_write		   = disable_write,
+	.flow_rx_limits		   = kfa_flow_rx_limits,
+	.flow_rx_credit		   = kfa_flow_rx_credit
 };
 
-struct kfa *kfa_create(void)
+struct kfa *kfa_create(struct robject *parent)
 {
 	struct kfa *instance;
 
@@ -1264,6 +1568,16 @@ struct kfa *kfa_create(void)
 		return NULL;
 	}
 
+	instance->flows_rset = rset_create_and_add("flows", parent);
+	if (!instance->flows_rset) {
+		LOG_ERR("Could not initialize flows sys entry");
+		rwq_destroy(instance->flowdelq);
+		pidm_destroy(instance->pidm);
+		kfa_pmap_destroy(instance->flows);
+		rkfree(instance);
+		return NULL;
+	}
+
 	spin_lock_init(&instance->lock);
 
 	return instance;
@@ -1278,10 +1592,15 @@ int kfa_destroy(struct kfa *instance)
 
 	/* FIXME: Destroy all the committed flows */
 	ASSERT(kfa_pmap_empty(instance->flows));
+	/* Wait for the flows (and map entries) freed after a grace period */
+	rcu_barrier();
+	/* ... and then for their workers, which still give port-ids back */
+	rwq_flush(instance->flowdelq);
 	kfa_pmap_destroy(instance->flows);
 
 	pidm_destroy(instance->pidm);
 	rwq_destroy(instance->flowdelq);
+	rset_unregister(instance->flows_rset);
 
 	rkfree(instance);
 
@@ -1292,10 +1611,10 @@ bool kfa_flow_exists(struct kfa *kfa, port_id_t port_id)
 {
         struct ipcp_flow *flow;
 
-        spin_lock_bh(&kfa->lock);
+        rcu_read_lock();
         flow = kfa_pmap_find(kfa->flows, port_id);
         /* XXX check flow->state ? */
-        spin_unlock_bh(&kfa->lock);
+        rcu_read_unlock();
 
         return flow != NULL;
 }
@@ -1306,7 +1625,7 @@ size_t kfa_flow_max_sdu_size(struct kfa * kfa, port_id_t port_id)
 	size_t result;
 	struct ipcp_flow *flow;
 
-        spin_lock_bh(&kfa->lock);
+        rcu_read_lock();
         flow = kfa_pmap_find(kfa->flows, port_id);
         if (!flow) {
         	result = 0;
@@ -1314,7 +1633,7 @@ size_t kfa_flow_max_sdu_size(struct kfa * kfa, port_id_t port_id)
         	result = flow->ipc_process->
         			ops->max_sdu_size(flow->ipc_process->data);
         }
-        spin_unlock_bh(&kfa->lock);
+        rcu_read_unlock();
 
         return result;
 }
@@ -29,8 +29,9 @@
 #include "iodev.h"
 
 struct kfa;
+struct robject;
 
-struct kfa *kfa_create(void);
+struct kfa *kfa_create(struct robject *parent);
 int	    kfa_destroy(struct kfa *instance);
 
 /* Only requests the pidm to reserve a valid port-id */
@@ -1832,7 +1832,7 @@ int kipcm_init(struct robject * parent)
                 return -1;
         }
 
-        tmp->kfa = kfa_create();
+        tmp->kfa = kfa_create(parent);
         if (!tmp->kfa) {
                 if (kipcm_pmap_destroy(tmp->messages->ingress)) {
                         /* FIXME: What could we do here ? */
@@ -443,8 +443,10 @@ ssize_t pci_calculate_size(struct efcp_config *cfg, pdu_type_t type)
 		case PDU_TYPE_FC:
 			return cfg->pci_offset_table[PCI_FC_SIZE];
 		case PDU_TYPE_ACK:
+		case PDU_TYPE_SACK:
 			return cfg->pci_offset_table[PCI_ACK_SIZE];
 		case PDU_TYPE_ACK_AND_FC:
+		case PDU_TYPE_SACK_AND_FC:
 			return cfg->pci_offset_table[PCI_ACK_FC_SIZE];
 		case PDU_TYPE_CACK:
 			return cfg->pci_offset_table[PCI_CACK_SIZE];
@@ -474,8 +476,10 @@ seq_num_t pci_control_ack_seq_num(const struct pci *pci)
 {
 	switch (pci_type(pci)) {
 	case PDU_TYPE_ACK:
+	case PDU_TYPE_SACK:
 		PCI_GETTER(pci, PCI_ACK_ACKED_SN, seq_num_length, seq_num_t);
 	case PDU_TYPE_ACK_AND_FC:
+	case PDU_TYPE_SACK_AND_FC:
 		PCI_GETTER(pci, PCI_ACK_FC_ACKED_SN, seq_num_length, seq_num_t);
 	default:
 		return -1;
@@ -491,6 +495,7 @@ seq_num_t pci_control_new_rt_wind_edge(const struct pci *pci)
 	case PDU_TYPE_CACK:
 		PCI_GETTER(pci, PCI_CACK_NEW_RWE, seq_num_length, seq_num_t);
 	case PDU_TYPE_ACK_AND_FC:
+	case PDU_TYPE_SACK_AND_FC:
 		PCI_GETTER(pci, PCI_ACK_FC_NEW_RWE, seq_num_length, seq_num_t);
 	default:
 		return -1;
@@ -504,6 +509,7 @@ seq_num_t pci_control_new_left_wind_edge(const struct pci *pci)
 	case PDU_TYPE_CACK:
 		PCI_GETTER(pci, PCI_CACK_NEW_LWE, seq_num_length, seq_num_t);
 	case PDU_TYPE_ACK_AND_FC:
+	case PDU_TYPE_SACK_AND_FC:
 		PCI_GETTER(pci, PCI_ACK_FC_NEW_LWE, seq_num_length, seq_num_t);
 	default:
 		return -1;
@@ -519,6 +525,7 @@ seq_num_t pci_control_my_rt_wind_edge(const struct pci *pci)
 	case PDU_TYPE_CACK:
 		PCI_GETTER(pci, PCI_CACK_MY_RWE, seq_num_length, seq_num_t);
 	case PDU_TYPE_ACK_AND_FC:
+	case PDU_TYPE_SACK_AND_FC:
 		PCI_GETTER(pci, PCI_ACK_FC_MY_RWE, seq_num_length, seq_num_t);
 	default:
 		return -1;
@@ -534,6 +541,7 @@ seq_num_t pci_control_my_left_wind_edge(const struct pci *pci)
 	case PDU_TYPE_CACK:
 		PCI_GETTER(pci, PCI_CACK_MY_LWE, seq_num_length, seq_num_t);
 	case PDU_TYPE_ACK_AND_FC:
+	case PDU_TYPE_SACK_AND_FC:
 		PCI_GETTER(pci, PCI_ACK_FC_MY_LWE, seq_num_length, seq_num_t);
 	default:
 		return -1;
@@ -547,6 +555,7 @@ seq_num_t pci_control_last_seq_num_rcvd(const struct pci *pci)
 	case PDU_TYPE_CACK:
 		PCI_GETTER(pci, PCI_CACK_LAST_CSN_RCVD, seq_num_length, seq_num_t);
 	case PDU_TYPE_ACK_AND_FC:
+	case PDU_TYPE_SACK_AND_FC:
 		PCI_GETTER(pci, PCI_ACK_FC_LAST_CSN_RCVD, seq_num_length, seq_num_t);
 	default:
 		return -1;
@@ -562,6 +571,7 @@ u_int32_t pci_control_sndr_rate(const struct pci *pci)
 	case PDU_TYPE_CACK:
 		PCI_GETTER(pci, PCI_CACK_SNDR_RATE, rate_length, u_int32_t);
 	case PDU_TYPE_ACK_AND_FC:
+	case PDU_TYPE_SACK_AND_FC:
 		PCI_GETTER(pci, PCI_ACK_FC_SNDR_RATE, rate_length, u_int32_t);
 	default:
 		return 0;
@@ -577,6 +587,7 @@ u_int32_t pci_control_time_frame(const struct pci *pci)
 	case PDU_TYPE_CACK:
 		PCI_GETTER(pci, PCI_CACK_TIME_FRAME, frame_length, u_int32_t);
 	case PDU_TYPE_ACK_AND_FC:
+	case PDU_TYPE_SACK_AND_FC:
 		PCI_GETTER(pci, PCI_ACK_FC_TIME_FRAME, frame_length, u_int32_t);
 	default:
 		return 0;
@@ -589,8 +600,10 @@ int pci_control_ack_seq_num_set(struct pci *pci, seq_num_t seq)
 {
 	switch (pci_type(pci)) {
 	case PDU_TYPE_ACK:
+	case PDU_TYPE_SACK:
 		PCI_SETTER(pci, PCI_ACK_ACKED_SN, seq_num_length, seq);
 	case PDU_TYPE_ACK_AND_FC:
+	case PDU_TYPE_SACK_AND_FC:
 		PCI_SETTER(pci, PCI_ACK_FC_ACKED_SN, seq_num_length, seq);
 	default:
 		return -1;
@@ -606,6 +619,7 @@ int pci_control_new_rt_wind_edge_set(struct pci *pci, seq_num_t seq)
 	case PDU_TYPE_CACK:
 		PCI_SETTER(pci, PCI_CACK_NEW_RWE, seq_num_length, seq);
 	case PDU_TYPE_ACK_AND_FC:
+	case PDU_TYPE_SACK_AND_FC:
 		PCI_SETTER(pci, PCI_ACK_FC_NEW_RWE, seq_num_length, seq);
 	default:
 		return -1;
@@ -619,6 +633,7 @@ int pci_control_new_left_wind_edge_set(struct pci *pci, seq_num_t seq)
 	case PDU_TYPE_CACK:
 		PCI_SETTER(pci, PCI_CACK_NEW_LWE, seq_num_length, seq);
 	case PDU_TYPE_ACK_AND_FC:
+	case PDU_TYPE_SACK_AND_FC:
 		PCI_SETTER(pci, PCI_ACK_FC_NEW_LWE, seq_num_length, seq);
 	default:
 		return -1;
@@ -634,6 +649,7 @@ int pci_control_my_rt_wind_edge_set(struct pci *pci, seq_num_t seq)
 	case PDU_TYPE_CACK:
 		PCI_SETTER(pci, PCI_CACK_MY_RWE, seq_num_length, seq);
 	case PDU_TYPE_ACK_AND_FC:
+	case PDU_TYPE_SACK_AND_FC:
 		PCI_SETTER(pci, PCI_ACK_FC_MY_RWE, seq_num_length, seq);
 	default:
 		return -1;
@@ -649,6 +665,7 @@ int pci_control_my_left_wind_edge_set(struct pci *pci, seq_num_t seq)
 	case PDU_TYPE_CACK:
 		PCI_SETTER(pci, PCI_CACK_MY_LWE, seq_num_length, seq);
 	case PDU_TYPE_ACK_AND_FC:
+	case PDU_TYPE_SACK_AND_FC:
 		PCI_SETTER(pci, PCI_ACK_FC_MY_LWE, seq_num_length, seq);
 	default:
 		return -1;
@@ -662,6 +679,7 @@ int pci_control_last_seq_num_rcvd_set(struct pci *pci, seq_num_t seq)
 	case PDU_TYPE_CACK:
 		PCI_SETTER(pci, PCI_CACK_LAST_CSN_RCVD, seq_num_length, seq);
 	case PDU_TYPE_ACK_AND_FC:
+	case PDU_TYPE_SACK_AND_FC:
 		PCI_SETTER(pci, PCI_ACK_FC_LAST_CSN_RCVD, seq_num_length, seq);
 	default:
 		return -1;
@@ -677,6 +695,7 @@ int pci_control_sndr_rate_set(struct pci *pci, u_int32_t rate)
 	case PDU_TYPE_CACK:
 		PCI_SETTER(pci, PCI_CACK_SNDR_RATE, rate_length, rate);
 	case PDU_TYPE_ACK_AND_FC:
+	case PDU_TYPE_SACK_AND_FC:
 		PCI_SETTER(pci, PCI_ACK_FC_SNDR_RATE, rate_length, rate);
 	default:
 		return -1;
@@ -692,6 +711,7 @@ int pci_control_time_frame_set(struct pci *pci, u_int32_t frame)
 	case PDU_TYPE_CACK:
 		PCI_SETTER(pci, PCI_CACK_TIME_FRAME, frame_length, frame);
 	case PDU_TYPE_ACK_AND_FC:
+	case PDU_TYPE_SACK_AND_FC:
 		PCI_SETTER(pci, PCI_ACK_FC_TIME_FRAME, frame_length, frame);
 	default:
 		return -1;
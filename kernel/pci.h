@@ -51,6 +51,11 @@ typedef uint8_t pdu_flags_t;
 #define PDU_TYPE_SNACK         0xCA /* Selective NACK */
 #define PDU_TYPE_SACK_AND_FC   0xCD /* Selective ACK and Flow Control */
 #define PDU_TYPE_SNACK_AND_FC  0xCE /* Selective NACK and Flow Control */
+/*
+ * Selective ACK PDUs share the PCI of ACK (and ACK and Flow Control) PDUs,
+ * whose acked sequence number stays cumulative. Their user data lists the
+ * blocks of PDUs received above it, as (first, last) sequence numbers.
+ */
 /* Management PDUs */
 #define PDU_TYPE_MGMT          0x40 /* Management */
 /* Number of different PDU types */
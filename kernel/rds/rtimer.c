@@ -21,6 +21,8 @@
 #include <linux/export.h>
 #include <linux/types.h>
 #include <linux/timer.h>
+#include <linux/hrtimer.h>
+#include <linux/interrupt.h>
 
 #define RINA_PREFIX "rtimer"
 
@@ -33,9 +35,37 @@ struct rtimer {
         struct timer_list tl;
         void (* function)(void * data);
         void * data;
+
+        /*
+         * High resolution timers expire in hard-irq context, the function
+         * is run from a tasklet as it is for the timer_list ones. Once the
+         * timer is dying it is neither re-armed nor run again
+         */
+        bool                  hr;
+        bool                  dying;
+        struct hrtimer        hrt;
+        struct tasklet_struct tasklet;
 };
 
+static enum hrtimer_restart rtimer_hr_expired(struct hrtimer * hrt)
+{
+        struct rtimer * timer = container_of(hrt, struct rtimer, hrt);
+
+        if (!READ_ONCE(timer->dying))
+                tasklet_schedule(&timer->tasklet);
+
+        return HRTIMER_NORESTART;
+}
+
+static void rtimer_hr_tasklet(unsigned long data)
+{
+        struct rtimer * timer = (struct rtimer *) data;
+
+        timer->function(timer->data);
+}
+
 static struct rtimer * rtimer_create_gfp(gfp_t   flags,
+                                         bool    hr,
                                          void (* function)(void * data),
                                          void *  data)
 {
@@ -52,8 +82,16 @@ static struct rtimer * rtimer_create_gfp(gfp_t   flags,
 
         tmp->function = function;
         tmp->data     = data;
+        tmp->hr       = hr;
+        tmp->dying    = false;
 
-        init_timer(&tmp->tl);
+        if (hr) {
+                hrtimer_init(&tmp->hrt, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+                tmp->hrt.function = rtimer_hr_expired;
+                tasklet_init(&tmp->tasklet, rtimer_hr_tasklet,
+                             (unsigned long) tmp);
+        } else
+                init_timer(&tmp->tl);
 
         LOG_DBG("Timer %pK created", tmp);
 
@@ -61,17 +99,24 @@ static struct rtimer * rtimer_create_gfp(gfp_t   flags,
 }
 
 struct rtimer * rtimer_create(void (* function)(void * data), void * data)
-{ return rtimer_create_gfp(GFP_KERNEL, function, data); }
+{ return rtimer_create_gfp(GFP_KERNEL, false, function, data); }
 EXPORT_SYMBOL(rtimer_create);
 
 struct rtimer * rtimer_create_ni(void (* function)(void * data), void * data)
-{ return rtimer_create_gfp(GFP_ATOMIC, function, data); }
+{ return rtimer_create_gfp(GFP_ATOMIC, false, function, data); }
 EXPORT_SYMBOL(rtimer_create_ni);
 
+struct rtimer * rtimer_create_hr(void (* function)(void * data), void * data)
+{ return rtimer_create_gfp(GFP_KERNEL, true, function, data); }
+EXPORT_SYMBOL(rtimer_create_hr);
+
 static bool __rtimer_is_pending(struct rtimer * timer)
 {
         ASSERT(timer);
 
+        if (timer->hr)
+                return hrtimer_active(&timer->hrt) ? true : false;
+
         return timer_pending(&timer->tl) ? true : false;
 }
 
@@ -85,32 +130,59 @@ bool rtimer_is_pending(struct rtimer * timer)
 EXPORT_SYMBOL(rtimer_is_pending);
 
 static int __rtimer_start(struct rtimer * timer,
-                          unsigned int    millisecs)
+                          u64             usecs)
 {
         int status;
 
         ASSERT(timer);
 
+        if (timer->hr) {
+                if (READ_ONCE(timer->dying)) {
+                        LOG_DBG("Timer %pK is being destroyed", timer);
+                        return 0;
+                }
+                hrtimer_start(&timer->hrt,
+                              ns_to_ktime(usecs * NSEC_PER_USEC),
+                              HRTIMER_MODE_REL);
+                LOG_DBG("Timer %pK restarted (%llu us)", timer, usecs);
+                return 0;
+        }
+
         /* FIXME: Crappy, rearrange */
         timer->tl.function = (void (*)(unsigned long)) timer->function;
         timer->tl.data     = (unsigned long)           timer->data;
-        timer->tl.expires  = jiffies + (millisecs * HZ) / 1000;
+        timer->tl.expires  = jiffies + nsecs_to_jiffies(usecs * NSEC_PER_USEC);
 
         status = mod_timer(&timer->tl, timer->tl.expires);
 
 
         LOG_DBG("Previously %s Timer %pK restarted (function = %pK, data = %pK, "
-                "expires = %ld (%u)",
+                "expires = %ld (%llu us)",
                 status ? "active" : "inactive",
                 timer,
                 (void *) timer->tl.function,
                 (void *) timer->tl.data,
                 timer->tl.expires,
-                millisecs);
+                usecs);
 
         return 0;
 }
 
+int rtimer_start_us(struct rtimer * timer,
+                    unsigned int    usecs)
+{
+        if (!timer)
+                return -1;
+
+        if (__rtimer_is_pending(timer)) {
+                LOG_DBG("Timer %pK is pending, can't start it", timer);
+                return 0;
+        }
+
+        return __rtimer_start(timer, usecs);
+}
+EXPORT_SYMBOL(rtimer_start_us);
+
 int rtimer_start(struct rtimer * timer,
                  unsigned int    millisecs)
 {
@@ -122,7 +194,7 @@ int rtimer_start(struct rtimer * timer,
                 return 0;
         }
 
-        return __rtimer_start(timer, millisecs);
+        return __rtimer_start(timer, (u64) millisecs * USEC_PER_MSEC);
 }
 EXPORT_SYMBOL(rtimer_start);
 
@@ -135,7 +207,10 @@ static int __rtimer_stop(struct rtimer * timer)
                 return 0;
         }
 
-        del_timer_sync(&timer->tl);
+        if (timer->hr)
+                hrtimer_cancel(&timer->hrt);
+        else
+                del_timer_sync(&timer->tl);
         LOG_DBG("Timer %pK stopped", timer);
 
         return 0;
@@ -150,13 +225,23 @@ int rtimer_stop(struct rtimer * timer)
 }
 EXPORT_SYMBOL(rtimer_stop);
 
+int rtimer_restart_us(struct rtimer * timer,
+                      unsigned int    usecs)
+{
+        if (!timer)
+                return -1;
+
+        return __rtimer_start(timer, usecs);
+}
+EXPORT_SYMBOL(rtimer_restart_us);
+
 int rtimer_restart(struct rtimer * timer,
                    unsigned int    millisecs)
 {
         if (!timer)
                 return -1;
 
-        return __rtimer_start(timer, millisecs);
+        return __rtimer_start(timer, (u64) millisecs * USEC_PER_MSEC);
 }
 EXPORT_SYMBOL(rtimer_restart);
 
@@ -165,8 +250,19 @@ int rtimer_destroy(struct rtimer * timer)
         if (!timer)
                 return -1;
 
-        if (__rtimer_stop(timer))
+        if (timer->hr) {
+                /*
+                 * The function may still be scheduled, and re-arm the
+                 * timer before it is done: stop any new start, wait for
+                 * the tasklet and cancel whatever it may have armed
+                 */
+                WRITE_ONCE(timer->dying, true);
+                hrtimer_cancel(&timer->hrt);
+                tasklet_kill(&timer->tasklet);
+                hrtimer_cancel(&timer->hrt);
+        } else if (__rtimer_stop(timer)) {
                 return -1;
+        }
 
         rkfree(timer);
 
@@ -27,6 +27,9 @@ struct rtimer * rtimer_create(void (* function)(void * data),
                               void *  data);
 struct rtimer * rtimer_create_ni(void (* function)(void * data),
                                  void *  data);
+/* High resolution timer, for the *_us variants below */
+struct rtimer * rtimer_create_hr(void (* function)(void * data),
+                                 void *  data);
 int             rtimer_destroy(struct rtimer * timer);
 
 int             rtimer_start(struct rtimer * timer,
@@ -35,5 +38,9 @@ bool            rtimer_is_pending(struct rtimer * timer);
 int             rtimer_stop(struct rtimer * timer);
 int             rtimer_restart(struct rtimer * timer,
                                unsigned int    millisecs);
+int             rtimer_start_us(struct rtimer * timer,
+                                unsigned int    usecs);
+int             rtimer_restart_us(struct rtimer * timer,
+                                  unsigned int    usecs);
 
 #endif
@@ -48,6 +48,14 @@ struct rmt_ps {
 	int (*rmt_q_destroy_policy)(struct rmt_ps *,
 				    struct rmt_n1_port *);
 
+	/*
+	 * Shaping policy sets (e.g. pacing) get every PDU through
+	 * rmt_enqueue_policy, and their rmt_dequeue_policy may return NULL
+	 * while PDUs are still queued. They call rmt_egress_schedule() once
+	 * the held PDUs become eligible.
+	 */
+	bool shaping;
+
 	/* Reference used to access the RMT data model. */
 	struct rmt *dm;
 
@@ -29,6 +29,9 @@
 #include <linux/sched.h>
 #include <linux/wait.h>
 #include <linux/string.h>
+#include <linux/jhash.h>
+#include <linux/skbuff.h>
+#include <linux/workqueue.h>
 /* FIXME: to be re-removed after removing tasklets */
 #include <linux/interrupt.h>
 
@@ -47,10 +50,12 @@
 #include "ipcp-instances.h"
 #include "ipcp-utils.h"
 #include "du.h"
+#include "delim.h"
 #include "rmt-ps-default.h"
 
 #define rmap_hash(T, K) hash_min(K, HASH_BITS(T))
 #define MAX_PDUS_SENT_PER_CYCLE 10
+#define RMT_RX_BACKLOG_MAX 1000
 
 static struct policy_set_list policy_sets = {
 	.head = LIST_HEAD_INIT(policy_sets.head)
@@ -68,6 +73,20 @@ struct rmt_address {
         struct list_head list;
 };
 
+/* Received PDUs waiting to be processed on the queue they are steered to */
+struct rmt_rx_backlog {
+	struct sk_buff_head pdus;
+	struct work_struct work;
+	struct rmt *rmt;
+};
+
+struct rmt_rx_cb {
+	struct du *du;
+	port_id_t from;
+};
+
+#define RMT_RX_CB(skb) ((struct rmt_rx_cb *) (skb)->cb)
+
 struct rmt {
 	struct rina_component base;
 	spinlock_t	      lock;
@@ -82,6 +101,14 @@ struct rmt {
 	struct rmt_config *rmt_cfg;
 	struct sdup *sdup;
 	struct robject robj;
+	/* Worst case room needed by SDUs sent through this IPCP */
+	size_t du_headroom;
+	size_t du_tailroom;
+	/* One per receive queue, see rx_steer_queue() */
+	struct rmt_rx_backlog *rx_backlog;
+	int rx_queues;
+	/* Set once received PDUs can no longer be delivered to EFCP */
+	bool rx_closed;
 };
 
 #define stats_get(name, n1_port, retval)				\
@@ -236,8 +263,8 @@ static int n1_port_destroy(struct rmt_n1_port *n1p)
 	if (n1p->sdup_port)
 		sdup_destroy_port_config(n1p->sdup_port);
 
-	if (n1p->pending_du)
-		du_destroy(n1p->pending_du);
+	while (n1p->npending)
+		du_destroy(n1p->pending_dus[--n1p->npending]);
 
 	if (n1p->wbusy)
 		LOG_WARN("Deleting n1_port with bussy writer... there may be something wrong...");
@@ -579,6 +606,36 @@ int rmt_address_remove(struct rmt *instance,
 }
 EXPORT_SYMBOL(rmt_address_remove);
 
+void rmt_rx_flush(struct rmt *instance)
+{
+	struct rmt_rx_backlog *b;
+	struct sk_buff *skb;
+	int i;
+
+	if (!instance)
+		return;
+
+	WRITE_ONCE(instance->rx_closed, true);
+	/* Wait for the PDUs being steered or processed right now */
+	synchronize_rcu();
+
+	for (i = 0; i < instance->rx_queues; i++) {
+		b = &instance->rx_backlog[i];
+		cancel_work_sync(&b->work);
+		while ((skb = skb_dequeue(&b->pdus)) != NULL)
+			du_destroy(RMT_RX_CB(skb)->du);
+	}
+}
+EXPORT_SYMBOL(rmt_rx_flush);
+
+static void rmt_rx_backlog_destroy(struct rmt *instance)
+{
+	rmt_rx_flush(instance);
+
+	rkfree(instance->rx_backlog);
+	instance->rx_backlog = NULL;
+}
+
 int rmt_destroy(struct rmt *instance)
 {
 	struct rmt_address * addr, * naddr;
@@ -589,8 +646,12 @@ int rmt_destroy(struct rmt *instance)
 	}
 
 	tasklet_kill(&instance->egress_tasklet);
+	if (instance->rx_backlog)
+		rmt_rx_backlog_destroy(instance);
 	if (instance->n1_ports)
 		n1pmap_destroy(instance);
+	/* Shaping policies may have kicked it before their queues went away */
+	tasklet_kill(&instance->egress_tasklet);
 	pff_cache_fini(&instance->cache);
 
 	if (instance->pff)
@@ -675,6 +736,16 @@ int rmt_config_set(struct rmt *instance,
 }
 EXPORT_SYMBOL(rmt_config_set);
 
+/* The N-1 IPCP takes no more PDUs until it enables the port again */
+static void n1_port_hold(struct rmt *rmt, struct rmt_n1_port *n1_port)
+{
+	if (n1_port->state == N1_PORT_STATE_DO_NOT_DISABLE) {
+		n1_port->state = N1_PORT_STATE_ENABLED;
+		tasklet_hi_schedule(&rmt->egress_tasklet);
+	} else
+		n1_port->state = N1_PORT_STATE_DISABLED;
+}
+
 static int n1_port_write_du(struct rmt *rmt,
 			    struct rmt_n1_port *n1_port,
 			    struct du * du)
@@ -691,21 +762,17 @@ static int n1_port_write_du(struct rmt *rmt,
 
 	if (ret == -EAGAIN) {
 		n1_port_lock(n1_port);
-		if (n1_port->pending_du) {
+		if (n1_port->npending) {
 			LOG_ERR("Already a pending SDU present for port %d",
 					n1_port->port_id);
-			du_destroy(n1_port->pending_du);
+			du_destroy(n1_port->pending_dus[0]);
+			n1_port->npending = 0;
 			n1_port->stats.plen--;
 		}
 
-		n1_port->pending_du = du;
+		n1_port->pending_dus[n1_port->npending++] = du;
 		n1_port->stats.plen++;
-
-		if (n1_port->state == N1_PORT_STATE_DO_NOT_DISABLE) {
-			n1_port->state = N1_PORT_STATE_ENABLED;
-			tasklet_hi_schedule(&rmt->egress_tasklet);
-		} else
-			n1_port->state = N1_PORT_STATE_DISABLED;
+		n1_port_hold(rmt, n1_port);
 
 		n1_port_unlock(n1_port);
 	}
@@ -713,11 +780,10 @@ static int n1_port_write_du(struct rmt *rmt,
 	return ret;
 }
 
-static inline int n1_port_write(struct rmt *rmt,
-				struct rmt_n1_port *n1_port,
-				struct du *du)
+/* SDU Protection, destroys the PDU on failure */
+static inline int n1_port_protect(struct rmt_n1_port *n1_port,
+				  struct du *du)
 {
-	/* SDU Protection */
 	if (sdup_set_lifetime_limit(n1_port->sdup_port, du)){
 		LOG_ERR("Error adding a Lifetime limit to serialized PDU");
 		du_destroy(du);
@@ -730,9 +796,89 @@ static inline int n1_port_write(struct rmt *rmt,
 		return -1;
 	}
 
+	return 0;
+}
+
+static inline int n1_port_write(struct rmt *rmt,
+				struct rmt_n1_port *n1_port,
+				struct du *du)
+{
+	if (n1_port_protect(n1_port, du))
+		return -1;
+
 	return n1_port_write_du(rmt, n1_port, du);
 }
 
+/*
+ * Hands up to RMT_TX_BATCH PDUs at once to an N-1 IPCP that takes batches.
+ * Called and returning with the n1_port lock taken, it returns the number
+ * of PDUs sent and tells if the policy set is holding PDUs back.
+ */
+static int n1_port_write_batch(struct rmt *rmt,
+			       struct rmt_ps *ps,
+			       struct rmt_n1_port *n1_port,
+			       bool *held)
+{
+	struct du *dus[RMT_TX_BATCH];
+	ssize_t bytes[RMT_TX_BATCH];
+	struct du *du;
+	int n, npend, i, j, sent;
+
+	/* Left overs of the previous batch go first, already protected */
+	for (n = 0; n < n1_port->npending; n++)
+		dus[n] = n1_port->pending_dus[n];
+	npend = n;
+	n1_port->npending = 0;
+	n1_port->stats.plen -= npend;
+
+	while (n < RMT_TX_BATCH && n1_port->stats.plen) {
+		du = ps->rmt_dequeue_policy(ps, n1_port);
+		if (!du) {
+			/* A shaping policy holds them back */
+			*held = ps->shaping;
+			break;
+		}
+		n1_port->stats.plen--;
+		dus[n++] = du;
+	}
+	spin_unlock(&n1_port->lock);
+
+	for (i = j = npend; i < n; i++) {
+		if (n1_port_protect(n1_port, dus[i]))
+			continue;
+		dus[j++] = dus[i];
+	}
+	n = j;
+
+	for (i = 0; i < n; i++)
+		bytes[i] = du_len(dus[i]);
+
+	sent = 0;
+	if (n) {
+		LOG_DBG("Gonna send %d SDUs to port-id %d", n,
+			n1_port->port_id);
+		sent = n1_port->n1_ipcp->ops->du_write_batch(
+				n1_port->n1_ipcp->data, n1_port->port_id,
+				dus, n);
+		if (sent < 0)
+			sent = 0;
+	}
+
+	spin_lock(&n1_port->lock);
+	for (i = 0; i < sent; i++) {
+		stats_inc(tx, n1_port, bytes[i]);
+	}
+
+	if (sent < n) {
+		for (i = sent; i < n; i++)
+			n1_port->pending_dus[n1_port->npending++] = dus[i];
+		n1_port->stats.plen += n - sent;
+		n1_port_hold(rmt, n1_port);
+	}
+
+	return sent;
+}
+
 static void send_worker(unsigned long o)
 {
 	struct rmt *rmt;
@@ -741,6 +887,7 @@ static void send_worker(unsigned long o)
 	int bucket;
 	int reschedule = 0;
 	int pdus_sent;
+	bool held;
 	struct rmt_ps *ps;
 	struct du * du = NULL;
 	struct du * pendu = NULL;
@@ -794,20 +941,28 @@ static void send_worker(unsigned long o)
 
 		pdus_sent = 0;
 		ret = 0;
+		held = false;
 		/* Try to send PDUs on that port-id here */
 
-		while ((pdus_sent < MAX_PDUS_SENT_PER_CYCLE) &&
+		if (n1_port->n1_ipcp->ops->du_write_batch)
+			pdus_sent = n1_port_write_batch(rmt, ps, n1_port,
+							&held);
+
+		while (!n1_port->n1_ipcp->ops->du_write_batch &&
+		       (pdus_sent < MAX_PDUS_SENT_PER_CYCLE) &&
 			n1_port->stats.plen) {
 			du = NULL;
 			pendu = NULL;
-			if (n1_port->pending_du) {
-				pendu = n1_port->pending_du;
-				n1_port->pending_du = NULL;
+			if (n1_port->npending) {
+				pendu = n1_port->pending_dus[0];
+				n1_port->npending = 0;
 				n1_port->stats.plen--;
 			} else {
 				du = ps->rmt_dequeue_policy(ps, n1_port);
 				if (!du) {
-					if (n1_port->stats.plen)
+					/* A shaping policy holds them back */
+					held = ps->shaping;
+					if (n1_port->stats.plen && !held)
 						LOG_ERR("rmt_dequeue_policy returned no pdu but plen is %u",
 								n1_port->stats.plen);
 					break;
@@ -831,7 +986,7 @@ static void send_worker(unsigned long o)
 
 		if ((n1_port->state == N1_PORT_STATE_ENABLED ||
 		    n1_port->state == N1_PORT_STATE_DO_NOT_DISABLE) &&
-		    n1_port->stats.plen)
+		    n1_port->stats.plen && !held)
 			reschedule++;
 
 		n1_port->wbusy = false;
@@ -856,6 +1011,32 @@ static void send_worker(unsigned long o)
 	}
 }
 
+void rmt_egress_schedule(struct rmt *instance)
+{
+	if (!instance)
+		return;
+
+	tasklet_hi_schedule(&instance->egress_tasklet);
+}
+EXPORT_SYMBOL(rmt_egress_schedule);
+
+bool rmt_is_shaping(struct rmt *instance)
+{
+	struct rmt_ps *ps;
+	bool shaping;
+
+	if (!instance)
+		return false;
+
+	rcu_read_lock();
+	ps = container_of(rcu_dereference(instance->base.ps),
+			  struct rmt_ps, base);
+	shaping = ps && ps->shaping;
+	rcu_read_unlock();
+
+	return shaping;
+}
+
 int rmt_send_port_id(struct rmt *instance,
 		     port_id_t id,
 		     struct du * du)
@@ -884,7 +1065,8 @@ int rmt_send_port_id(struct rmt *instance,
 	}
 
 	n1_port_lock(n1_port);
-	if (n1_port->stats.plen 				||
+	if (ps->shaping						||
+		n1_port->stats.plen 				||
 		n1_port->wbusy 					||
 		n1_port->state == N1_PORT_STATE_DISABLED) {
 		ret = ps->rmt_enqueue_policy(ps, n1_port, du);
@@ -1073,6 +1255,72 @@ exit:
 }
 EXPORT_SYMBOL(rmt_disable_port_id);
 
+void rmt_du_room_update(struct rmt *instance)
+{
+	struct rmt_n1_port *entry;
+	struct efcp_config *cfg;
+	int bucket;
+	size_t n1_head, n1_tail;
+	size_t sdup_head, sdup_tail;
+	size_t head = 0, tail = 0;
+	bool ports = false;
+
+	if (!instance || !instance->n1_ports)
+		return;
+
+	spin_lock_bh(&instance->n1_ports->lock);
+	hash_for_each(instance->n1_ports->n1_ports, bucket, entry, hlist) {
+		if (entry->state == N1_PORT_STATE_DEALLOCATED)
+			continue;
+
+		if (!entry->n1_ipcp->ops->du_room ||
+		    entry->n1_ipcp->ops->du_room(entry->n1_ipcp->data,
+						 &n1_head, &n1_tail)) {
+			n1_head = MAX_PCIS_LEN;
+			n1_tail = MAX_TAIL_LEN;
+		}
+		sdup_port_room(entry->sdup_port, &sdup_head, &sdup_tail);
+
+		head = max(head, n1_head + sdup_head);
+		tail = max(tail, n1_tail + sdup_tail);
+		ports = true;
+	}
+	spin_unlock_bh(&instance->n1_ports->lock);
+
+	cfg = instance->efcpc ? instance->efcpc->config : NULL;
+	if (!ports || !cfg || !cfg->pci_offset_table) {
+		head = MAX_PCIS_LEN;
+		tail = MAX_TAIL_LEN;
+	} else {
+		head += pci_calculate_size(cfg, PDU_TYPE_DT);
+		if (cfg->dt_cons && delim_required(cfg->dt_cons))
+			head += DELIM_HDR_LEN;
+	}
+
+	instance->du_headroom = head;
+	instance->du_tailroom = tail;
+
+	LOG_DBG("SDUs need %zu bytes of headroom and %zu of tailroom",
+		head, tail);
+}
+EXPORT_SYMBOL(rmt_du_room_update);
+
+void rmt_du_room(struct rmt *instance, size_t *headroom, size_t *tailroom)
+{
+	*headroom = instance->du_headroom;
+	*tailroom = instance->du_tailroom;
+}
+EXPORT_SYMBOL(rmt_du_room);
+
+struct efcp_config *rmt_efcp_config(struct rmt *instance)
+{
+	if (!instance || !instance->efcpc)
+		return NULL;
+
+	return instance->efcpc->config;
+}
+EXPORT_SYMBOL(rmt_efcp_config);
+
 int rmt_n1port_bind(struct rmt *instance,
 		    port_id_t id,
 		    struct ipcp_instance *n1_ipcp)
@@ -1138,13 +1386,16 @@ int rmt_n1port_bind(struct rmt *instance,
 		instance, id);
 
 	dif_name = n1_ipcp->ops->dif_name(n1_ipcp->data);
-	tmp->sdup_port = sdup_init_port_config(instance->sdup, dif_name, id);
+	tmp->sdup_port = sdup_init_port_config(instance->sdup, dif_name, id,
+					       sdup_n1_ipcp_integrity(n1_ipcp));
 	if (!tmp->sdup_port){
 		LOG_ERR("Failed init of SDUP configuration for port-id %d", id);
 		n1_port_destroy(tmp);
 		return -1;
 	}
 
+	rmt_du_room_update(instance);
+
 	return 0;
 }
 EXPORT_SYMBOL(rmt_n1port_bind);
@@ -1182,6 +1433,7 @@ int rmt_n1port_unbind(struct rmt *instance,
 	 * not wrong since once in N1_PORT_STATE_DEALLOCATED no other action
 	 * will be performed on the n1_port but this action should be atomic */
 	n1pmap_release(instance, n1_port);
+	rmt_du_room_update(instance);
 	return 0;
 }
 EXPORT_SYMBOL(rmt_n1port_unbind);
@@ -1234,6 +1486,74 @@ static int process_dt_pdu(struct rmt *rmt,
 	return 0;
 }
 
+static void rmt_rx_backlog_worker(struct work_struct *work)
+{
+	struct rmt_rx_backlog *b;
+	struct sk_buff_head pdus;
+	struct sk_buff *skb;
+
+	b = container_of(work, struct rmt_rx_backlog, work);
+
+	__skb_queue_head_init(&pdus);
+	spin_lock_irq(&b->pdus.lock);
+	skb_queue_splice_tail_init(&b->pdus, &pdus);
+	spin_unlock_irq(&b->pdus.lock);
+
+	/* As if they were processed by the N-1 IPCP receive path */
+	local_bh_disable();
+	while ((skb = __skb_dequeue(&pdus)) != NULL)
+		process_dt_pdu(b->rmt, RMT_RX_CB(skb)->from,
+			       RMT_RX_CB(skb)->du);
+	local_bh_enable();
+}
+
+/*
+ * Processes the PDU on the queue its connection is steered to, see
+ * rx_steer_queue(). PDUs of a connection are always addressed to the same
+ * local CEP-id, so they keep their order.
+ */
+static int rmt_rx_steer(struct rmt *rmt,
+			port_id_t from,
+			struct du *du)
+{
+	struct rmt_rx_backlog *b;
+	int q, ret;
+
+	/* rmt_rx_flush() waits for us before tearing EFCP down */
+	rcu_read_lock();
+	if (unlikely(READ_ONCE(rmt->rx_closed))) {
+		rcu_read_unlock();
+		LOG_DBG("RMT no longer receiving, dropping PDU");
+		du_destroy(du);
+		return -1;
+	}
+
+	q = rx_steer_queue(jhash_3words(pci_cep_destination(&du->pci),
+					pci_cep_source(&du->pci),
+					pci_source(&du->pci), 0));
+	if (q < 0) {
+		ret = process_dt_pdu(rmt, from, du);
+		rcu_read_unlock();
+		return ret;
+	}
+
+	b = &rmt->rx_backlog[q];
+	if (skb_queue_len(&b->pdus) >= RMT_RX_BACKLOG_MAX) {
+		rcu_read_unlock();
+		LOG_DBG("RX backlog of queue %d full, dropping PDU", q);
+		du_destroy(du);
+		return -1;
+	}
+
+	RMT_RX_CB(du->skb)->du = du;
+	RMT_RX_CB(du->skb)->from = from;
+	skb_queue_tail(&b->pdus, du->skb);
+	rx_steer_work(q, &b->work);
+	rcu_read_unlock();
+
+	return 0;
+}
+
 int pdu_is_addressed_to_me(struct rmt * rmt, address_t address)
 {
 	struct rmt_address * addr;
@@ -1250,36 +1570,20 @@ int pdu_is_addressed_to_me(struct rmt * rmt, address_t address)
 	return 0;
 }
 
-int rmt_receive(struct rmt *rmt,
-		struct du * du,
-		port_id_t from)
+/* Processes a PDU from n1_port, the caller holds a reference to it */
+static int rmt_receive_du(struct rmt *rmt,
+			  struct rmt_n1_port *n1_port,
+			  struct du * du,
+			  port_id_t from)
 {
 	pdu_type_t pdu_type;
 	address_t dst_addr;
 	qos_id_t qos_id;
-	struct rmt_n1_port *n1_port;
 	ssize_t bytes;
 
-	if (!rmt) {
-		LOG_ERR("No RMT passed");
-		du_destroy(du);
-		return -1;
-	}
-	if (!is_port_id_ok(from)) {
-		LOG_ERR("Wrong port-id %d", from);
-		du_destroy(du);
-		return -1;
-	}
-
 	bytes = du_len(du);
 	du->cfg = rmt->efcpc->config;
 
-	n1_port = n1pmap_find(rmt, from);
-	if (!n1_port) {
-		LOG_ERR("Could not retrieve N-1 port for the received PDU...");
-                du_destroy(du);
-		return -1;
-	}
 	stats_inc(rx, n1_port, bytes);
 
 	/* SDU Protection */
@@ -1297,8 +1601,6 @@ int rmt_receive(struct rmt *rmt,
         }
 	/* end SDU Protection */
 
-	n1pmap_release(rmt, n1_port);
-
 	if (unlikely(du_decap(du))) { /*Decap PDU */
 		LOG_ERR("Could not decap PDU");
 		du_destroy(du);
@@ -1330,6 +1632,7 @@ int rmt_receive(struct rmt *rmt,
 		case PDU_TYPE_FC:
 		case PDU_TYPE_ACK:
 		case PDU_TYPE_ACK_AND_FC:
+		case PDU_TYPE_SACK_AND_FC:
 		case PDU_TYPE_DT:
 			/*
 			 * (FUTURE)
@@ -1337,7 +1640,7 @@ int rmt_receive(struct rmt *rmt,
 			 * enqueue PDU in pdus_dt[dest-addr, qos-id]
 			 * don't process it now ...
 			 */
-			return process_dt_pdu(rmt, from, du);
+			return rmt_rx_steer(rmt, from, du);
 
 		default:
 			LOG_ERR("Unknown PDU type %d", pdu_type);
@@ -1363,14 +1666,83 @@ int rmt_receive(struct rmt *rmt,
 		}
 	}
 }
+
+int rmt_receive(struct rmt *rmt,
+		struct du * du,
+		port_id_t from)
+{
+	struct rmt_n1_port *n1_port;
+	int ret;
+
+	if (!rmt) {
+		LOG_ERR("No RMT passed");
+		du_destroy(du);
+		return -1;
+	}
+	if (!is_port_id_ok(from)) {
+		LOG_ERR("Wrong port-id %d", from);
+		du_destroy(du);
+		return -1;
+	}
+
+	n1_port = n1pmap_find(rmt, from);
+	if (!n1_port) {
+		LOG_ERR("Could not retrieve N-1 port for the received PDU...");
+                du_destroy(du);
+		return -1;
+	}
+
+	ret = rmt_receive_du(rmt, n1_port, du, from);
+	n1pmap_release(rmt, n1_port);
+
+	return ret;
+}
 EXPORT_SYMBOL(rmt_receive);
 
+/* Same as rmt_receive, looking the N-1 port up once for all the PDUs */
+int rmt_receive_batch(struct rmt *rmt,
+		      struct du **dus,
+		      int count,
+		      port_id_t from)
+{
+	struct rmt_n1_port *n1_port;
+	int i, ret;
+
+	n1_port = NULL;
+	if (!rmt)
+		LOG_ERR("No RMT passed");
+	else if (!is_port_id_ok(from))
+		LOG_ERR("Wrong port-id %d", from);
+	else {
+		n1_port = n1pmap_find(rmt, from);
+		if (!n1_port)
+			LOG_ERR("Could not retrieve N-1 port for the received PDUs...");
+	}
+
+	if (!n1_port) {
+		for (i = 0; i < count; i++)
+			du_destroy(dus[i]);
+		return -1;
+	}
+
+	ret = 0;
+	for (i = 0; i < count; i++)
+		if (rmt_receive_du(rmt, n1_port, dus[i], from))
+			ret = -1;
+	n1pmap_release(rmt, n1_port);
+
+	return ret;
+}
+EXPORT_SYMBOL(rmt_receive_batch);
+
 struct rmt *rmt_create(struct kfa *kfa,
 		       struct efcp_container *efcpc,
 		       struct sdup *sdup,
 		       struct robject *parent)
 {
 	struct rmt *tmp;
+	struct rmt_rx_backlog *b;
+	int i;
 
 	if (!parent || !kfa || !efcpc) {
 		LOG_ERR("Bogus input parameters");
@@ -1386,6 +1758,8 @@ struct rmt *rmt_create(struct kfa *kfa,
 	tmp->kfa = kfa;
 	tmp->efcpc = efcpc;
 	tmp->sdup = sdup;
+	tmp->du_headroom = MAX_PCIS_LEN;
+	tmp->du_tailroom = MAX_TAIL_LEN;
 	rina_component_init(&tmp->base);
 
 	if (robject_init_and_add(&tmp->robj, &rmt_rtype, parent, "rmt")) {
@@ -1413,6 +1787,27 @@ struct rmt *rmt_create(struct kfa *kfa,
 		return NULL;
 	}
 
+	BUILD_BUG_ON(sizeof(struct rmt_rx_cb) >
+		     sizeof(((struct sk_buff *) 0)->cb));
+	/* None if steering is disabled, irati_rx_cpus is fixed at load time */
+	tmp->rx_queues = rx_steer_queue(0) < 0 ? 0 : irati_rx_cpus;
+	if (tmp->rx_queues) {
+		tmp->rx_backlog = rkzalloc(tmp->rx_queues *
+					   sizeof(*tmp->rx_backlog),
+					   GFP_KERNEL);
+		if (!tmp->rx_backlog) {
+			LOG_ERR("Failed to create RX backlogs");
+			rmt_destroy(tmp);
+			return NULL;
+		}
+	}
+	for (i = 0; i < tmp->rx_queues; i++) {
+		b = &tmp->rx_backlog[i];
+		skb_queue_head_init(&b->pdus);
+		INIT_WORK(&b->work, rmt_rx_backlog_worker);
+		b->rmt = tmp;
+	}
+
 	tasklet_init(&tmp->egress_tasklet,
 		     send_worker,
 		     (unsigned long) tmp);
@@ -56,6 +56,9 @@ struct rmt;
 
 #define RMT_PS_HASHSIZE 7
 
+/* Max PDUs handed at once to N-1 IPCPs that take batches */
+#define RMT_TX_BATCH 10
+
 /* FIXME: Hide these structs */
 enum flow_state {
 	N1_PORT_STATE_ENABLED = 0,
@@ -81,7 +84,9 @@ struct rmt_n1_port {
 	struct hlist_node	hlist;
 	enum flow_state		state;
 	atomic_t		refs_c;
-	struct du		*pending_du;
+	/* PDUs the N-1 IPCP could not take, in order */
+	struct du		*pending_dus[RMT_TX_BATCH];
+	unsigned int		npending;
 	struct sdup_port 	*sdup_port;
 	struct n1_port_stats	stats;
 	bool			wbusy;
@@ -102,6 +107,13 @@ int		   rmt_n1port_bind(struct rmt *instance,
 				   struct ipcp_instance *n1_ipcp);
 int		   rmt_n1port_unbind(struct rmt *instance,
 				     port_id_t id);
+/* Recomputes the room for the PCIs and SDU protection of the N-1 ports */
+void		   rmt_du_room_update(struct rmt *instance);
+void		   rmt_du_room(struct rmt *instance,
+			       size_t *headroom,
+			       size_t *tailroom);
+/* EFCP configuration of the IPCP, holding the QoS cubes of the DIF */
+struct efcp_config *rmt_efcp_config(struct rmt *instance);
 int		   rmt_pff_add(struct rmt *instance,
 			       struct mod_pff_entry *entry);
 int		   rmt_pff_remove(struct rmt *instance,
@@ -122,10 +134,18 @@ int		   rmt_send_port_id(struct rmt *instance,
 int		   rmt_receive(struct rmt *instance,
 			       struct du *du,
 			       port_id_t from);
+int		   rmt_receive_batch(struct rmt *instance,
+				     struct du **dus,
+				     int count,
+				     port_id_t from);
+/* Drops received PDUs from now on, to be called before EFCP goes away */
+void		   rmt_rx_flush(struct rmt *instance);
 int		   rmt_enable_port_id(struct rmt *instance,
 				      port_id_t id);
 int		   rmt_disable_port_id(struct rmt *instance,
 				       port_id_t id);
+void		   rmt_egress_schedule(struct rmt *instance);
+bool		   rmt_is_shaping(struct rmt *instance);
 int		   rmt_select_policy_set(struct rmt *rmt,
 					 const string_t *path,
 					 const string_t *name);
@@ -26,7 +26,10 @@
 #include <linux/crypto.h>
 #include <linux/scatterlist.h>
 #include <linux/random.h>
+#include <linux/percpu.h>
+#include <crypto/algapi.h>
 #include <crypto/hash.h>
+#include <crypto/aead.h>
 
 #define RINA_PREFIX "sdup-crypto-ps-default"
 
@@ -36,15 +39,42 @@
 #include "sdup-crypto-ps-default.h"
 #include "debug.h"
 
+/* AEAD nonce: random salt + counter, carried in clear ahead of the data */
+#define AEAD_SALT_LEN	4
+#define AEAD_NONCE_LEN	12
+#define AEAD_TAG_LEN	16
 
-struct sdup_crypto_ps_default_crypto_state {
+/* Largest digest of the supported MAC algorithms (SHA256) */
+#define MAX_MAC_DIGEST_LEN 32
+
+/*
+ * Transforms that keep per-request state (IV, compression stream) and the
+ * scratch buffers are per CPU, so a port can be (un)protected in parallel
+ */
+struct sdup_crypto_ps_default_pcpu {
 	struct crypto_blkcipher * blkcipher;
+	struct aead_request *     aead_req;
+	struct crypto_comp *      compress;
+	char *                    comp_scratch;
+};
+
+struct sdup_crypto_ps_default_crypto_state {
+	struct sdup_crypto_ps_default_pcpu __percpu * pcpu;
+
+	/* Block cipher + HMAC mode */
+	bool cipher;
+	unsigned int blk_size;
+	unsigned int iv_size;
 
 	struct crypto_shash * shash;
 
-	struct crypto_comp * compress;
+	/* AEAD mode, replaces the block cipher, HMAC and padding */
+	struct crypto_aead * aead;
+	char aead_salt[AEAD_SALT_LEN];
+	atomic64_t aead_seq;
+
+	bool compress;
 	unsigned int comp_scratch_size;
-	char * comp_scratch;
 
 	string_t * 	enc_alg;
 	string_t * 	mac_alg;
@@ -57,28 +87,40 @@ struct sdup_crypto_ps_default_data {
 	struct sdup_crypto_ps_default_crypto_state * next_rx_state;
 	struct sdup_crypto_ps_default_crypto_state * next_tx_state;
 
+	/* AEAD algorithm used instead of the CBC cipher, NULL if none */
+	const char * aead_alg;
+
 	/*next seq num to be used on tx*/
-	unsigned int    tx_seq_num;
+	atomic_t        tx_seq_num;
 	/*highest received seq number (most significant bit of bitmap)*/
 	unsigned int    rx_seq_num;
 	/*bitmap of received seq numbers*/
 	unsigned char * seq_bmap;
 	unsigned int seq_bmap_len;
 	unsigned int seq_win_size;
+	spinlock_t   rx_seq_lock;
 
 };
 
 static struct sdup_crypto_ps_default_crypto_state * crypto_state_create(void)
 {
 	struct sdup_crypto_ps_default_crypto_state * state =
-		rkmalloc(sizeof(*state), GFP_KERNEL);
+		rkzalloc(sizeof(*state), GFP_KERNEL);
 
-	state->blkcipher = NULL;
+	if (!state)
+		return NULL;
 
-	state->shash = NULL;
+	state->pcpu = alloc_percpu(struct sdup_crypto_ps_default_pcpu);
+	if (!state->pcpu) {
+		rkfree(state);
+		return NULL;
+	}
 
-	state->compress = NULL;
-	state->comp_scratch = NULL;
+	state->cipher = false;
+	state->shash = NULL;
+	state->aead = NULL;
+	atomic64_set(&state->aead_seq, 0);
+	state->compress = false;
 	state->comp_scratch_size = 0;
 
 	state->enc_alg = NULL;
@@ -90,17 +132,28 @@ static struct sdup_crypto_ps_default_crypto_state * crypto_state_create(void)
 
 static void crypto_state_destroy(struct sdup_crypto_ps_default_crypto_state * state)
 {
-	if (state->blkcipher)
-		crypto_free_blkcipher(state->blkcipher);
+	struct sdup_crypto_ps_default_pcpu * pcpu;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		pcpu = per_cpu_ptr(state->pcpu, cpu);
+		if (pcpu->blkcipher)
+			crypto_free_blkcipher(pcpu->blkcipher);
+		if (pcpu->aead_req)
+			aead_request_free(pcpu->aead_req);
+		if (pcpu->compress)
+			crypto_free_comp(pcpu->compress);
+		if (pcpu->comp_scratch)
+			rkfree(pcpu->comp_scratch);
+	}
+	free_percpu(state->pcpu);
+
+	if (state->aead)
+		crypto_free_aead(state->aead);
 
 	if (state->shash)
 		crypto_free_shash(state->shash);
 
-	if (state->compress)
-		crypto_free_comp(state->compress);
-	if (state->comp_scratch)
-		rkfree(state->comp_scratch);
-
 	if (state->compress_alg) {
 		rkfree(state->compress_alg);
 		state->compress_alg = NULL;
@@ -119,13 +172,155 @@ static void crypto_state_destroy(struct sdup_crypto_ps_default_crypto_state * st
 	rkfree(state);
 }
 
+/* Sequence numbers go with any kind of encryption */
+static bool crypto_state_encrypts(struct sdup_crypto_ps_default_crypto_state * state)
+{ return state->cipher || state->aead; }
+
+static int crypto_state_cipher_alloc(struct sdup_crypto_ps_default_crypto_state * state)
+{
+	struct sdup_crypto_ps_default_pcpu * pcpu;
+	struct crypto_blkcipher * tfm;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		tfm = crypto_alloc_blkcipher(state->enc_alg, 0, 0);
+		if (IS_ERR(tfm)) {
+			LOG_ERR("Could not allocate blkcipher handle for %s",
+				state->enc_alg);
+			return -1;
+		}
+		pcpu = per_cpu_ptr(state->pcpu, cpu);
+		pcpu->blkcipher = tfm;
+		state->blk_size = crypto_blkcipher_blocksize(tfm);
+		state->iv_size = crypto_blkcipher_ivsize(tfm);
+	}
+	state->cipher = true;
+
+	return 0;
+}
+
+static int crypto_state_aead_alloc(struct sdup_crypto_ps_default_crypto_state * state)
+{
+	struct sdup_crypto_ps_default_pcpu * pcpu;
+	struct aead_request * req;
+	int cpu;
+
+	/* Synchronous implementations only, PDUs are protected in softirq */
+	state->aead = crypto_alloc_aead(state->enc_alg, 0, CRYPTO_ALG_ASYNC);
+	if (IS_ERR(state->aead)) {
+		LOG_ERR("Could not allocate aead handle for %s",
+			state->enc_alg);
+		state->aead = NULL;
+		return -1;
+	}
+
+	if (crypto_aead_setauthsize(state->aead, AEAD_TAG_LEN) ||
+	    crypto_aead_ivsize(state->aead) != AEAD_NONCE_LEN) {
+		LOG_ERR("Unsupported tag or nonce size for %s",
+			state->enc_alg);
+		return -1;
+	}
+
+	/* The transform is shared, requests carry the per PDU state */
+	for_each_possible_cpu(cpu) {
+		req = aead_request_alloc(state->aead, GFP_KERNEL);
+		if (!req)
+			return -1;
+		aead_request_set_callback(req, 0, NULL, NULL);
+		pcpu = per_cpu_ptr(state->pcpu, cpu);
+		pcpu->aead_req = req;
+	}
+
+	get_random_bytes(state->aead_salt, AEAD_SALT_LEN);
+
+	return 0;
+}
+
+static int crypto_state_setkey(struct sdup_crypto_ps_default_crypto_state * state,
+			       const struct buffer * key)
+{
+	int cpu;
+
+	if (state->aead)
+		return crypto_aead_setkey(state->aead,
+					  buffer_data_ro(key),
+					  buffer_length(key));
+
+	if (!state->cipher)
+		return -1;
+
+	for_each_possible_cpu(cpu) {
+		if (crypto_blkcipher_setkey(per_cpu_ptr(state->pcpu,
+							cpu)->blkcipher,
+					    buffer_data_ro(key),
+					    buffer_length(key)))
+			return -1;
+	}
+
+	return 0;
+}
+
+/* Worst case overhead of the TX pipeline (compression aside) */
+static void crypto_state_room(struct sdup_crypto_ps_default_crypto_state * state,
+			      size_t * head_room,
+			      size_t * tail_room)
+{
+	*head_room = 0;
+	*tail_room = 0;
+
+	if (crypto_state_encrypts(state))
+		*head_room += sizeof(unsigned int);
+
+	if (state->aead) {
+		*head_room += AEAD_NONCE_LEN;
+		*tail_room += AEAD_TAG_LEN;
+		return;
+	}
+
+	if (state->shash)
+		*tail_room += crypto_shash_digestsize(state->shash);
+
+	if (state->cipher) {
+		*head_room += state->iv_size;
+		*tail_room += state->blk_size;
+	}
+}
+
+static int crypto_state_compress_alloc(struct sdup_crypto_ps_default_crypto_state * state,
+				       unsigned int scratch_size)
+{
+	struct sdup_crypto_ps_default_pcpu * pcpu;
+	int cpu;
+
+	state->comp_scratch_size = scratch_size;
+	for_each_possible_cpu(cpu) {
+		pcpu = per_cpu_ptr(state->pcpu, cpu);
+		pcpu->compress = crypto_alloc_comp(state->compress_alg, 0, 0);
+		if (IS_ERR(pcpu->compress)) {
+			LOG_ERR("Could not allocate compress handle for %s",
+				state->compress_alg);
+			pcpu->compress = NULL;
+			return -1;
+		}
+
+		pcpu->comp_scratch = rkzalloc(scratch_size, GFP_KERNEL);
+		if (!pcpu->comp_scratch) {
+			LOG_ERR("Could not allocate scratch space for compression");
+			return -1;
+		}
+	}
+	state->compress = true;
+
+	return 0;
+}
+
 static struct sdup_crypto_ps_default_data * priv_data_create(void);
 static void priv_data_destroy(struct sdup_crypto_ps_default_data * data);
 
 static struct sdup_crypto_ps_default_data * priv_data_create(void)
 {
 	struct sdup_crypto_ps_default_data * data =
-		rkmalloc(sizeof(*data), GFP_KERNEL);
+		rkzalloc(sizeof(*data), GFP_KERNEL);
 	if (!data)
 		return NULL;
 
@@ -153,11 +348,13 @@ static struct sdup_crypto_ps_default_data * priv_data_create(void)
 		return NULL;
 	}
 
-	data->tx_seq_num = 0;
+	data->aead_alg = NULL;
+	atomic_set(&data->tx_seq_num, 0);
 	data->rx_seq_num = 0;
 	data->seq_bmap = NULL;
 	data->seq_win_size = 0;
 	data->seq_bmap_len = 0;
+	spin_lock_init(&data->rx_seq_lock);
 
 	return data;
 }
@@ -205,12 +402,12 @@ static int add_padding(struct sdup_crypto_ps_default_data * priv_data,
 	state = priv_data->current_tx_state;
 
 	/* encryption and therefore padding is disabled */
-	if (!state->blkcipher)
+	if (!state->cipher)
 		return 0;
 
 	LOG_DBG("PADDING!");
 
-	blk_size = crypto_blkcipher_blocksize(state->blkcipher);
+	blk_size = state->blk_size;
 	buffer_size = du_len(du);
 	padded_size = (buffer_size/blk_size + 1) * blk_size;
 
@@ -245,7 +442,7 @@ static int remove_padding(struct sdup_crypto_ps_default_data * priv_data,
 	state = priv_data->current_rx_state;
 
 	/* decryption and therefore padding is disabled */
-	if (!state->blkcipher)
+	if (!state->cipher)
 		return 0;
 
 	LOG_DBG("UNPADDING!");
@@ -274,12 +471,14 @@ static int encrypt(struct sdup_crypto_ps_default_data * priv_data,
 		   struct du * du)
 {
 	struct sdup_crypto_ps_default_crypto_state * state;
+	struct sdup_crypto_ps_default_pcpu * pcpu;
 	struct blkcipher_desc	desc;
 	struct scatterlist	sg;
 	ssize_t			buffer_size;
 	void *			data;
 	char *                  iv;
 	unsigned int		ivsize;
+	int			ret;
 
 	if (!priv_data || !du || !priv_data->current_tx_state){
 		LOG_ERR("Encryption arguments not initialized!");
@@ -289,19 +488,18 @@ static int encrypt(struct sdup_crypto_ps_default_data * priv_data,
 	state = priv_data->current_tx_state;
 
 	/* encryption is disabled */
-	if (state->blkcipher == NULL)
+	if (!state->cipher)
 		return 0;
 
-	desc.flags = 0;
-	desc.tfm = state->blkcipher;
 	buffer_size = du_len(du);
 	data = du_buffer(du);
 
 	iv = NULL;
-	ivsize = crypto_blkcipher_ivsize(state->blkcipher);
+	ivsize = state->iv_size;
 	if (ivsize) {
 		if(du_head_grow(du, ivsize)){
 			LOG_ERR("IV allocation failed!");
+			return -1;
 		}
 		iv = du_buffer(du);
 		get_random_bytes(iv, ivsize);
@@ -309,10 +507,15 @@ static int encrypt(struct sdup_crypto_ps_default_data * priv_data,
 
 	sg_init_one(&sg, data, buffer_size);
 
+	pcpu = get_cpu_ptr(state->pcpu);
+	desc.flags = 0;
+	desc.tfm = pcpu->blkcipher;
 	if (iv)
-		crypto_blkcipher_set_iv(state->blkcipher, iv, ivsize);
+		crypto_blkcipher_set_iv(desc.tfm, iv, ivsize);
+	ret = crypto_blkcipher_encrypt(&desc, &sg, &sg, buffer_size);
+	put_cpu_ptr(state->pcpu);
 
-	if (crypto_blkcipher_encrypt(&desc, &sg, &sg, buffer_size)) {
+	if (ret) {
 		LOG_ERR("Encryption failed!");
 		if (iv)
 			du_head_shrink(du, ivsize);
@@ -326,12 +529,14 @@ static int decrypt(struct sdup_crypto_ps_default_data * priv_data,
 		   struct du * du)
 {
 	struct sdup_crypto_ps_default_crypto_state * state;
+	struct sdup_crypto_ps_default_pcpu * pcpu;
 	struct blkcipher_desc	desc;
 	struct scatterlist	sg;
 	unsigned int		buffer_size;
 	void *			data;
 	char *                  iv;
 	unsigned int		ivsize;
+	int			ret;
 
 	if (!priv_data || !du || !priv_data->current_rx_state){
 		LOG_ERR("Failed decryption");
@@ -341,7 +546,7 @@ static int decrypt(struct sdup_crypto_ps_default_data * priv_data,
 	state = priv_data->current_rx_state;
 
 	/* decryption is disabled */
-	if (state->blkcipher == NULL)
+	if (!state->cipher)
 		return 0;
 
 	buffer_size = du_len(du);
@@ -350,7 +555,7 @@ static int decrypt(struct sdup_crypto_ps_default_data * priv_data,
 	LOG_DBG("DECRYPT original buffer_size %d", buffer_size);
 
 	iv = NULL;
-	ivsize = crypto_blkcipher_ivsize(state->blkcipher);
+	ivsize = state->iv_size;
 	if (ivsize) {
 		iv = data;
 		if(du_head_shrink(du, ivsize)){
@@ -361,15 +566,17 @@ static int decrypt(struct sdup_crypto_ps_default_data * priv_data,
 		buffer_size = du_len(du);
 	}
 
-	desc.flags = 0;
-	desc.tfm = state->blkcipher;
-
 	sg_init_one(&sg, data, buffer_size);
 
+	pcpu = get_cpu_ptr(state->pcpu);
+	desc.flags = 0;
+	desc.tfm = pcpu->blkcipher;
 	if (iv)
-		crypto_blkcipher_set_iv(state->blkcipher, iv, ivsize);
+		crypto_blkcipher_set_iv(desc.tfm, iv, ivsize);
+	ret = crypto_blkcipher_decrypt(&desc, &sg, &sg, buffer_size);
+	put_cpu_ptr(state->pcpu);
 
-	if (crypto_blkcipher_decrypt(&desc, &sg, &sg, buffer_size)) {
+	if (ret) {
 		LOG_ERR("Decryption failed!");
 		return -1;
 	}
@@ -377,6 +584,121 @@ static int decrypt(struct sdup_crypto_ps_default_data * priv_data,
 	return 0;
 }
 
+/*
+ * One pass authenticated encryption:
+ * | salt + counter (AAD) | sequence number + data (encrypted) | tag |
+ */
+static int aead_encrypt(struct sdup_crypto_ps_default_data * priv_data,
+			struct du * du)
+{
+	struct sdup_crypto_ps_default_crypto_state * state;
+	struct aead_request *	req;
+	struct scatterlist	sg;
+	ssize_t			buffer_size;
+	char *			data;
+	char			iv[AEAD_NONCE_LEN];
+	u64			seq;
+	int			ret;
+
+	if (!priv_data || !du || !priv_data->current_tx_state){
+		LOG_ERR("Encryption arguments not initialized!");
+		return -1;
+	}
+
+	state = priv_data->current_tx_state;
+
+	/* AEAD is disabled */
+	if (!state->aead)
+		return 0;
+
+	buffer_size = du_len(du);
+	if (du_head_grow(du, AEAD_NONCE_LEN)) {
+		LOG_ERR("Failed to grow ser PDU for AEAD nonce");
+		return -1;
+	}
+	if (du_tail_grow(du, AEAD_TAG_LEN)) {
+		LOG_ERR("Failed to grow ser PDU for AEAD tag");
+		du_head_shrink(du, AEAD_NONCE_LEN);
+		return -1;
+	}
+
+	/* A nonce must never repeat under the same key */
+	seq = atomic64_inc_return(&state->aead_seq);
+	memcpy(iv, state->aead_salt, AEAD_SALT_LEN);
+	memcpy(iv + AEAD_SALT_LEN, &seq, sizeof(seq));
+
+	data = du_buffer(du);
+	memcpy(data, iv, AEAD_NONCE_LEN);
+	sg_init_one(&sg, data, AEAD_NONCE_LEN + buffer_size + AEAD_TAG_LEN);
+
+	req = get_cpu_ptr(state->pcpu)->aead_req;
+	aead_request_set_ad(req, AEAD_NONCE_LEN);
+	aead_request_set_crypt(req, &sg, &sg, buffer_size, iv);
+	ret = crypto_aead_encrypt(req);
+	put_cpu_ptr(state->pcpu);
+
+	if (ret) {
+		LOG_ERR("AEAD encryption failed (%d)!", ret);
+		du_head_shrink(du, AEAD_NONCE_LEN);
+		du_tail_shrink(du, AEAD_TAG_LEN);
+		return -1;
+	}
+
+	return 0;
+}
+
+static int aead_decrypt(struct sdup_crypto_ps_default_data * priv_data,
+			struct du * du)
+{
+	struct sdup_crypto_ps_default_crypto_state * state;
+	struct aead_request *	req;
+	struct scatterlist	sg;
+	ssize_t			buffer_size;
+	char *			data;
+	char			iv[AEAD_NONCE_LEN];
+	int			ret;
+
+	if (!priv_data || !du || !priv_data->current_rx_state){
+		LOG_ERR("Failed decryption");
+		return -1;
+	}
+
+	state = priv_data->current_rx_state;
+
+	/* AEAD is disabled */
+	if (!state->aead)
+		return 0;
+
+	buffer_size = du_len(du);
+	if (buffer_size < AEAD_NONCE_LEN + AEAD_TAG_LEN) {
+		LOG_ERR("PDU too short for AEAD (%zd bytes)", buffer_size);
+		return -1;
+	}
+
+	data = du_buffer(du);
+	memcpy(iv, data, AEAD_NONCE_LEN);
+	sg_init_one(&sg, data, buffer_size);
+
+	req = get_cpu_ptr(state->pcpu)->aead_req;
+	aead_request_set_ad(req, AEAD_NONCE_LEN);
+	aead_request_set_crypt(req, &sg, &sg, buffer_size - AEAD_NONCE_LEN, iv);
+	ret = crypto_aead_decrypt(req);
+	put_cpu_ptr(state->pcpu);
+
+	if (ret) {
+		LOG_ERR("AEAD decryption failed (%d)!", ret);
+		return -1;
+	}
+
+	if (du_head_shrink(du, AEAD_NONCE_LEN) ||
+	    du_tail_shrink(du, AEAD_TAG_LEN)) {
+		LOG_ERR("Failed to shrink ser PDU by AEAD nonce and tag");
+		return -1;
+	}
+
+	return 0;
+}
+
 static int add_hmac(struct sdup_crypto_ps_default_data * priv_data,
 		    struct du * du)
 {
@@ -424,7 +746,7 @@ static int check_hmac(struct sdup_crypto_ps_default_data * priv_data,
 	unsigned int		buffer_size;
 	void *			data;
 	unsigned int		digest_size;
-	char *			verify_digest;
+	char			verify_digest[MAX_MAC_DIGEST_LEN];
 	SHASH_DESC_ON_STACK(shash, priv_data->current_rx_state->shash);
 
 	if (!priv_data || !du){
@@ -442,9 +764,8 @@ static int check_hmac(struct sdup_crypto_ps_default_data * priv_data,
 	data = du_buffer(du);
 
 	digest_size = crypto_shash_digestsize(state->shash);
-	verify_digest = rkzalloc(digest_size, GFP_KERNEL);
-	if(!verify_digest){
-		LOG_ERR("HMAC allocation failed!");
+	if (digest_size > sizeof(verify_digest) || digest_size > buffer_size) {
+		LOG_ERR("Bogus HMAC digest size %u", digest_size);
 		return -1;
 	}
 
@@ -453,23 +774,20 @@ static int check_hmac(struct sdup_crypto_ps_default_data * priv_data,
 
 	if (crypto_shash_digest(shash, data, buffer_size-digest_size, verify_digest)) {
 		LOG_ERR("HMAC calculation failed!");
-		rkfree(verify_digest);
 		return -1;
 	}
 
-	if (memcmp(verify_digest, data+buffer_size-digest_size, digest_size)){
+	if (crypto_memneq(verify_digest, data+buffer_size-digest_size,
+			  digest_size)){
 		LOG_ERR("HMAC verification FAILED!");
-		rkfree(verify_digest);
 		return -1;
 	}
 
 	if (du_tail_shrink(du, digest_size)){
 		LOG_ERR("Failed to shrink serialized PDU");
-		rkfree(verify_digest);
 		return -1;
 	}
 
-	rkfree(verify_digest);
 	return 0;
 }
 
@@ -477,6 +795,7 @@ static int compress(struct sdup_crypto_ps_default_data * priv_data,
 		    struct du* du)
 {
 	struct sdup_crypto_ps_default_crypto_state * state;
+	struct sdup_crypto_ps_default_pcpu * pcpu;
 	unsigned int		buffer_size;
 	void *			data;
 	unsigned int		compressed_size;
@@ -491,20 +810,22 @@ static int compress(struct sdup_crypto_ps_default_data * priv_data,
 	state = priv_data->current_tx_state;
 
 	/* encryption is disabled so compression is disabled*/
-	if (state->compress == NULL)
+	if (!state->compress)
 		return 0;
 
 	buffer_size = du_len(du);
 	data = du_buffer(du);
 
+	pcpu = get_cpu_ptr(state->pcpu);
 	compressed_size = state->comp_scratch_size;
-	compressed_data = state->comp_scratch;
+	compressed_data = pcpu->comp_scratch;
 
-	err = crypto_comp_compress(state->compress,
+	err = crypto_comp_compress(pcpu->compress,
 				   data, buffer_size,
 				   compressed_data, &compressed_size);
 
 	if (err){
+		put_cpu_ptr(state->pcpu);
 		LOG_ERR("Failed compression!");
 		return -1;
 	}
@@ -513,22 +834,22 @@ static int compress(struct sdup_crypto_ps_default_data * priv_data,
 							compressed_size,
 							buffer_size);
 	if (buffer_size > compressed_size){
-		if (du_head_shrink(du, buffer_size -compressed_size)){
-			LOG_ERR("Failed to shrink PDU for compressed data!");
-			return -1;
-		}
+		err = du_head_shrink(du, buffer_size -compressed_size);
 	}else{
 		LOG_DBG("Compressed size (%d) is > than uncompressed size (%d) after compression",
 							compressed_size,
 							buffer_size);
-		if (du_head_grow(du, compressed_size - buffer_size)){
-			LOG_ERR("Failed to groe PDU for compressed data!");
-			return -1;
-		}
+		err = du_head_grow(du, compressed_size - buffer_size);
+	}
+	if (err) {
+		put_cpu_ptr(state->pcpu);
+		LOG_ERR("Failed to resize PDU for compressed data!");
+		return -1;
 	}
 	data = du_buffer(du);
 
 	memcpy(data, compressed_data, compressed_size);
+	put_cpu_ptr(state->pcpu);
 
 	return 0;
 }
@@ -538,6 +859,7 @@ static int decompress(struct sdup_crypto_ps_default_data * priv_data,
 		      struct du * du)
 {
 	struct sdup_crypto_ps_default_crypto_state * state;
+	struct sdup_crypto_ps_default_pcpu * pcpu;
 	unsigned int		buffer_size;
 	void *			data;
 	void *			decompressed_data;
@@ -552,26 +874,23 @@ static int decompress(struct sdup_crypto_ps_default_data * priv_data,
 	state = priv_data->current_rx_state;
 
 	/* decryption is disabled so decompression is disabled*/
-	if (state->compress == NULL)
+	if (!state->compress)
 		return 0;
 
 	buffer_size = du_len(du);
 	data = du_buffer(du);
 
-	decompressed_size = max_pdu_size;
-	decompressed_data = rkzalloc(decompressed_size, GFP_KERNEL);
-	if (!decompressed_data){
-		LOG_ERR("Failed to alloc data for compression");
-		return -1;
-	}
+	pcpu = get_cpu_ptr(state->pcpu);
+	decompressed_size = min(max_pdu_size, state->comp_scratch_size);
+	decompressed_data = pcpu->comp_scratch;
 
-	err = crypto_comp_decompress(state->compress,
+	err = crypto_comp_decompress(pcpu->compress,
 				     data, buffer_size,
 				     decompressed_data, &decompressed_size);
 
 	if (err){
+		put_cpu_ptr(state->pcpu);
 		LOG_ERR("Failed decompression!");
-		rkfree(decompressed_data);
 		return -1;
 	}
 
@@ -583,22 +902,19 @@ static int decompress(struct sdup_crypto_ps_default_data * priv_data,
 							buffer_size,
 							decompressed_size);
 
-		if (du_head_shrink(du, buffer_size - decompressed_size)){
-			LOG_ERR("Failed to shrink PDU header for uncompressed data!");
-			rkfree(decompressed_data);
-			return -1;
-		}
+		err = du_head_shrink(du, buffer_size - decompressed_size);
 	}else{
-		if (du_head_grow(du, decompressed_size - buffer_size)){
-			LOG_ERR("Failed to grow PDU header for uncompressed data!");
-			rkfree(decompressed_data);
-			return -1;
-		}
+		err = du_head_grow(du, decompressed_size - buffer_size);
+	}
+	if (err) {
+		put_cpu_ptr(state->pcpu);
+		LOG_ERR("Failed to resize PDU header for uncompressed data!");
+		return -1;
 	}
 	data = du_buffer(du);
 
 	memcpy(data, decompressed_data, decompressed_size);
-	rkfree(decompressed_data);
+	put_cpu_ptr(state->pcpu);
 
 	return 0;
 }
@@ -608,6 +924,7 @@ static int add_seq_num(struct sdup_crypto_ps_default_data * priv_data,
 {
 	struct sdup_crypto_ps_default_crypto_state * state;
 	char *		data;
+	unsigned int	seq_num;
 
 	if (!priv_data || !du || !priv_data->current_tx_state){
 		LOG_ERR("Encryption arguments not initialized!");
@@ -617,20 +934,19 @@ static int add_seq_num(struct sdup_crypto_ps_default_data * priv_data,
 	state = priv_data->current_tx_state;
 
 	/* encryption and therefore sequence numbers are disabled */
-	if (!state->blkcipher)
+	if (!crypto_state_encrypts(state))
 		return 0;
 
-	if (du_head_grow(du, sizeof(priv_data->tx_seq_num))){
+	if (du_head_grow(du, sizeof(seq_num))){
 		LOG_ERR("Failed to grow ser PDU");
 		return -1;
 	}
 
+	seq_num = (unsigned int) atomic_inc_return(&priv_data->tx_seq_num) - 1;
 	data = du_buffer(du);
-	memcpy(data, &priv_data->tx_seq_num, sizeof(priv_data->tx_seq_num));
-
-	LOG_DBG("Added sequence number %u", priv_data->tx_seq_num);
+	memcpy(data, &seq_num, sizeof(seq_num));
 
-	priv_data->tx_seq_num += 1;
+	LOG_DBG("Added sequence number %u", seq_num);
 
 	return 0;
 }
@@ -654,14 +970,14 @@ static int del_seq_num(struct sdup_crypto_ps_default_data * priv_data,
 	state = priv_data->current_rx_state;
 
 	/* decryption and therefore sequence numbers are disabled */
-	if (!state->blkcipher)
+	if (!crypto_state_encrypts(state))
 		return 0;
 
 	data = du_buffer(du);
 
 	memcpy(&seq_num, data, sizeof(priv_data->rx_seq_num));
 
-	if (du_head_shrink(du, sizeof(priv_data->tx_seq_num))){
+	if (du_head_shrink(du, sizeof(seq_num))){
 		LOG_ERR("Failed to grow ser PDU");
 		return -1;
 	}
@@ -671,8 +987,11 @@ static int del_seq_num(struct sdup_crypto_ps_default_data * priv_data,
 	if (priv_data->seq_win_size == 0)
 		return 0;
 
+	/* The window is shared by all the CPUs receiving on this port */
+	spin_lock_bh(&priv_data->rx_seq_lock);
 	min_seq_num = (long int)priv_data->rx_seq_num - priv_data->seq_win_size;
 	if (seq_num < min_seq_num){
+		spin_unlock_bh(&priv_data->rx_seq_lock);
 		LOG_ERR("Sequence number %u is too old", seq_num);
 		return -1;
 	} else {
@@ -698,11 +1017,13 @@ static int del_seq_num(struct sdup_crypto_ps_default_data * priv_data,
 
 		//check bitmap for duplicate sequence number
 		if (bmap[byte_pos] & (1 << bit_pos)){
+			spin_unlock_bh(&priv_data->rx_seq_lock);
 			LOG_ERR("Sequence number %u already received.",
 				seq_num);
 			return -1;
 		} else {
 			bmap[byte_pos] |= 1 << bit_pos;
+			spin_unlock_bh(&priv_data->rx_seq_lock);
 			return 0;
 		}
 	}
@@ -723,6 +1044,10 @@ int default_sdup_apply_crypto(struct sdup_crypto_ps * ps,
 	if (result)
 		return result;
 
+	/* AEAD authenticates and encrypts in a single pass */
+	if (priv_data->current_tx_state->aead)
+		return aead_encrypt(priv_data, du);
+
 	if (priv_data->current_tx_state->shash)
 		result = add_hmac(priv_data, du);
 	if (result)
@@ -748,18 +1073,24 @@ int default_sdup_remove_crypto(struct sdup_crypto_ps * ps,
 	struct sdup_port * port = ps->dm;
 	struct dt_cons * dt_cons = port->dt_cons;
 
-	result = decrypt(priv_data, du);
-	if (result)
-		return result;
-
-	result = remove_padding(priv_data, du);
-	if (result)
-		return result;
-
-	if (priv_data->current_rx_state->shash)
-		result = check_hmac(priv_data, du);
-	if (result)
-		return result;
+	if (priv_data->current_rx_state->aead) {
+		result = aead_decrypt(priv_data, du);
+		if (result)
+			return result;
+	} else {
+		result = decrypt(priv_data, du);
+		if (result)
+			return result;
+
+		result = remove_padding(priv_data, du);
+		if (result)
+			return result;
+
+		if (priv_data->current_rx_state->shash)
+			result = check_hmac(priv_data, du);
+		if (result)
+			return result;
+	}
 
 	result = del_seq_num(priv_data, du);
 	if (result)
@@ -781,6 +1112,9 @@ int default_sdup_update_crypto_state(struct sdup_crypto_ps * ps,
 	struct sdup_crypto_ps_default_crypto_state * next_tx_state;
 	struct sdup_crypto_ps_default_crypto_state * next_rx_state;
 	struct sdup_port * sdup_port;
+	const char * enc_alg;
+	bool aead = false;
+	unsigned int scratch_size;
 
 	if (!ps || !state) {
 		LOG_ERR("Bogus input parameters passed");
@@ -795,53 +1129,54 @@ int default_sdup_update_crypto_state(struct sdup_crypto_ps * ps,
 	if (state->enc_alg && string_cmp(state->enc_alg, "") != 0) {
 		if (string_cmp(state->enc_alg, "AES128") == 0 ||
 		    string_cmp(state->enc_alg, "AES256") == 0) {
-			if (string_dup("cbc(aes)",
-				       &next_tx_state->enc_alg)) {
-				LOG_ERR("Problems copying 'enc_alg' value");
-				return -1;
-			}
-			if (string_dup("cbc(aes)",
-				       &next_rx_state->enc_alg)) {
-				LOG_ERR("Problems copying 'enc_alg' value");
-				return -1;
-			}
-			LOG_DBG("TX encryption cipher is %s", next_tx_state->enc_alg);
-			LOG_DBG("RX encryption cipher is %s", next_rx_state->enc_alg);
+			/* The aeadMode policy parameter upgrades plain AES */
+			enc_alg = priv_data->aead_alg ? priv_data->aead_alg :
+				"cbc(aes)";
+			aead = priv_data->aead_alg != NULL;
+		} else if (string_cmp(state->enc_alg, "AES128-GCM") == 0 ||
+			   string_cmp(state->enc_alg, "AES256-GCM") == 0) {
+			enc_alg = "gcm(aes)";
+			aead = true;
+		} else if (string_cmp(state->enc_alg, "CHACHA20-POLY1305") == 0) {
+			enc_alg = "rfc7539(chacha20,poly1305)";
+			aead = true;
 		} else {
 			LOG_ERR("Unsupported encryption algorithm %s",
 				state->enc_alg);
 			return -1;
 		}
 
-		next_tx_state->blkcipher = crypto_alloc_blkcipher(next_tx_state->enc_alg,
-								  0,0);
-		next_rx_state->blkcipher = crypto_alloc_blkcipher(next_rx_state->enc_alg,
-								  0,0);
-		if (IS_ERR(next_tx_state->blkcipher)) {
-			LOG_ERR("could not allocate tx blkcipher handle for %s\n",
-				next_tx_state->enc_alg);
+		if (string_dup(enc_alg, &next_tx_state->enc_alg)) {
+			LOG_ERR("Problems copying 'enc_alg' value");
 			return -1;
 		}
-		if (IS_ERR(next_rx_state->blkcipher)) {
-			LOG_ERR("could not allocate rx blkcipher handle for %s\n",
-				next_rx_state->enc_alg);
+		if (string_dup(enc_alg, &next_rx_state->enc_alg)) {
+			LOG_ERR("Problems copying 'enc_alg' value");
 			return -1;
 		}
+		LOG_DBG("TX encryption cipher is %s", next_tx_state->enc_alg);
+		LOG_DBG("RX encryption cipher is %s", next_rx_state->enc_alg);
+
+		if (aead) {
+			if (crypto_state_aead_alloc(next_tx_state) ||
+			    crypto_state_aead_alloc(next_rx_state))
+				return -1;
+		} else {
+			if (crypto_state_cipher_alloc(next_tx_state) ||
+			    crypto_state_cipher_alloc(next_rx_state))
+				return -1;
+		}
 	}
 
 	if (state->encrypt_key_tx) {
-		if (crypto_blkcipher_setkey(next_tx_state->blkcipher,
-					    buffer_data_ro(state->encrypt_key_tx),
-					    buffer_length(state->encrypt_key_tx))) {
+		if (crypto_state_setkey(next_tx_state, state->encrypt_key_tx)) {
 			LOG_ERR("Could not set tx encryption key for N-1 port %d",
 				ps->dm->port_id);
 			return -1;
 		}
 	}
 	if (state->encrypt_key_rx) {
-		if (crypto_blkcipher_setkey(next_rx_state->blkcipher,
-					    buffer_data_ro(state->encrypt_key_rx),
-					    buffer_length(state->encrypt_key_rx))) {
+		if (crypto_state_setkey(next_rx_state, state->encrypt_key_rx)) {
 			LOG_ERR("Could not set rx encryption key for N-1 port %d",
 				ps->dm->port_id);
 			return -1;
@@ -926,39 +1261,11 @@ int default_sdup_update_crypto_state(struct sdup_crypto_ps * ps,
 			return -1;
 		}
 
-		next_tx_state->compress = crypto_alloc_comp(next_tx_state->compress_alg,
-							    0,0);
-		next_rx_state->compress = crypto_alloc_comp(next_tx_state->compress_alg,
-							    0,0);
-
-		if (IS_ERR(next_tx_state->compress)) {
-			LOG_ERR("Could not allocate tx compress handle for %s\n",
-				next_tx_state->compress_alg);
-			return -1;
-		}
-		if (IS_ERR(next_rx_state->compress)) {
-			LOG_ERR("Could not allocate rx compress handle for %s\n",
-				next_rx_state->compress_alg);
-			return -1;
-		}
-
-		next_tx_state->comp_scratch_size = sdup_port->dt_cons->max_pdu_size +
-			MAX_COMP_INFLATION;
-		next_tx_state->comp_scratch = rkzalloc(next_tx_state->comp_scratch_size,
-						       GFP_KERNEL);
-		if (!next_tx_state->comp_scratch) {
-			LOG_ERR("Could not allocate scratch space for tx compression");
-			return -1;
-		}
-
-		next_rx_state->comp_scratch_size = sdup_port->dt_cons->max_pdu_size +
+		scratch_size = sdup_port->dt_cons->max_pdu_size +
 			MAX_COMP_INFLATION;
-		next_rx_state->comp_scratch = rkzalloc(next_rx_state->comp_scratch_size,
-						       GFP_KERNEL);
-		if (!next_rx_state->comp_scratch) {
-			LOG_ERR("Could not allocate scratch space for rx compression");
+		if (crypto_state_compress_alloc(next_tx_state, scratch_size) ||
+		    crypto_state_compress_alloc(next_rx_state, scratch_size))
 			return -1;
-		}
 	}
 
 	if (state->enable_crypto_rx){
@@ -970,6 +1277,8 @@ int default_sdup_update_crypto_state(struct sdup_crypto_ps * ps,
 		crypto_state_destroy(priv_data->current_tx_state);
 		priv_data->current_tx_state = next_tx_state;
 		priv_data->next_tx_state = crypto_state_create();
+		crypto_state_room(priv_data->current_tx_state,
+				  &ps->head_room, &ps->tail_room);
 	}
 	return 0;
 }
@@ -1041,6 +1350,24 @@ struct ps_base * sdup_crypto_ps_default_create(struct rina_component * component
 			LOG_DBG("Sequence number window size is %d",
 				data->seq_win_size);
 		}
+
+		parameter = policy_param_find(conf->encrypt, "aeadMode");
+		if (parameter) {
+			aux = policy_param_value(parameter);
+			if (string_cmp(aux, "GCM") == 0) {
+				data->aead_alg = "gcm(aes)";
+			} else if (string_cmp(aux, "CHACHA20-POLY1305") == 0) {
+				data->aead_alg = "rfc7539(chacha20,poly1305)";
+			} else if (string_cmp(aux, "") != 0) {
+				LOG_ERR("Unsupported AEAD mode %s", aux);
+				rkfree(ps);
+				priv_data_destroy(data);
+				return NULL;
+			}
+
+			if (data->aead_alg)
+				LOG_DBG("AEAD mode is %s", data->aead_alg);
+		}
 	} else {
 		LOG_ERR("Bogus configuration passed");
 		rkfree(ps);
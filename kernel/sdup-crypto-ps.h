@@ -41,6 +41,10 @@ struct sdup_crypto_ps {
 	int (* sdup_update_crypto_state)(struct sdup_crypto_ps *,
 					 struct sdup_crypto_state *);
 
+	/* Worst case bytes added in front of and behind a PDU on TX */
+	size_t head_room;
+	size_t tail_room;
+
 	/* Reference used to access the SDUP data model. */
 	struct sdup_port * dm;
 
@@ -109,6 +109,7 @@ struct ps_base * sdup_errc_ps_default_create(struct rina_component * component)
 
 	ps->dm          = sdup_comp->parent;
         ps->priv        = NULL;
+	ps->tail_room   = sizeof(u32);
 
 	/* SDUP policy functions*/
 	ps->sdup_add_error_check_policy		= default_sdup_add_error_check_policy;
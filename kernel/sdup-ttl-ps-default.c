@@ -164,6 +164,8 @@ struct ps_base * sdup_ttl_ps_default_create(struct rina_component * component)
 			return NULL;
 		}
 		data->initial_ttl_value = aux;
+		if (data->initial_ttl_value > 0)
+			ps->head_room = sizeof(data->initial_ttl_value);
 
 		LOG_DBG("Initial TTL value is %u", data->initial_ttl_value);
 	} else {
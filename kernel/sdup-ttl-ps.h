@@ -39,6 +39,10 @@ struct sdup_ttl_ps {
 	int (* sdup_dec_check_lifetime_limit_policy)(struct sdup_ttl_ps *,
 						     struct du *);
 
+	/* Worst case bytes added in front of and behind a PDU on TX */
+	size_t head_room;
+	size_t tail_room;
+
 	/* Reference used to access the SDUP data model. */
 	struct sdup_port * dm;
 
@@ -315,7 +315,8 @@ static void sdup_port_destroy(struct sdup_port * instance)
 
 static struct sdup_port * sdup_port_create(port_id_t port_id,
 					   struct auth_sdup_profile * dup_conf,
-					   struct dt_cons * dt_cons)
+					   struct dt_cons * dt_cons,
+					   bool n1_integrity)
 {
 	struct sdup_port * tmp;
 	const string_t * crypto_ps_name;
@@ -337,6 +338,7 @@ static struct sdup_port * sdup_port_create(port_id_t port_id,
 	tmp->port_id = port_id;
 	tmp->conf = dup_conf;
 	tmp->dt_cons = dt_cons;
+	tmp->n1_integrity = n1_integrity;
 
 	if (dup_conf->encrypt && policy_name(dup_conf->encrypt)) {
 		crypto_ps_name = policy_name(dup_conf->encrypt);
@@ -658,9 +660,27 @@ int sdup_destroy(struct sdup * instance)
 }
 EXPORT_SYMBOL(sdup_destroy);
 
+/* Shims whose flows already discard corrupted frames or segments */
+bool sdup_n1_ipcp_integrity(struct ipcp_instance * n1_ipcp)
+{
+	const char * name;
+
+	if (!n1_ipcp || !n1_ipcp->factory || !n1_ipcp->factory->name)
+		return false;
+
+	name = n1_ipcp->factory->name;
+
+	return !strcmp(name, "shim-eth-vlan") ||
+	       !strcmp(name, "shim-wifi-sta") ||
+	       !strcmp(name, "shim-wifi-ap")  ||
+	       !strcmp(name, "shim-tcp-udp");
+}
+EXPORT_SYMBOL(sdup_n1_ipcp_integrity);
+
 struct sdup_port * sdup_init_port_config(struct sdup * instance,
 			  	         const struct name * n1_dif_name,
-			  	         port_id_t port_id)
+			  	         port_id_t port_id,
+			  	         bool n1_integrity)
 {
 	struct sdup_port *tmp;
 	struct auth_sdup_profile * dup_conf;
@@ -673,7 +693,8 @@ struct sdup_port * sdup_init_port_config(struct sdup * instance,
 		return NULL;
 	}
 
-	tmp = sdup_port_create(port_id, dup_conf, instance->dt_cons);
+	tmp = sdup_port_create(port_id, dup_conf, instance->dt_cons,
+			       n1_integrity);
 	if (!tmp) {
 		LOG_ERR("Problems creating SDUP port for port_id %d", port_id);
 		return NULL;
@@ -790,6 +811,48 @@ int sdup_unprotect_pdu(struct sdup_port * instance,
 }
 EXPORT_SYMBOL(sdup_unprotect_pdu);
 
+void sdup_port_room(struct sdup_port * instance,
+		    size_t *           head_room,
+		    size_t *           tail_room)
+{
+	struct sdup_crypto_ps * crypto_ps;
+	struct sdup_errc_ps * errc_ps;
+	struct sdup_ttl_ps * ttl_ps;
+
+	*head_room = 0;
+	*tail_room = 0;
+
+	if (!instance)
+		return;
+
+	rcu_read_lock();
+	if (instance->crypto) {
+		crypto_ps = container_of(rcu_dereference(instance->crypto->base.ps),
+				         struct sdup_crypto_ps,
+				         base);
+		*head_room += crypto_ps->head_room;
+		*tail_room += crypto_ps->tail_room;
+	}
+
+	if (instance->errc) {
+		errc_ps = container_of(rcu_dereference(instance->errc->base.ps),
+				       struct sdup_errc_ps,
+				       base);
+		*head_room += errc_ps->head_room;
+		*tail_room += errc_ps->tail_room;
+	}
+
+	if (instance->ttl) {
+		ttl_ps = container_of(rcu_dereference(instance->ttl->base.ps),
+				      struct sdup_ttl_ps,
+				      base);
+		*head_room += ttl_ps->head_room;
+		*tail_room += ttl_ps->tail_room;
+	}
+	rcu_read_unlock();
+}
+EXPORT_SYMBOL(sdup_port_room);
+
 int sdup_set_lifetime_limit(struct sdup_port * instance,
 			    struct du * du)
 {
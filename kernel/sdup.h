@@ -56,6 +56,9 @@ struct sdup_port {
 	/* Data transfer constants - needed to check max pdu size on RX */
 	struct dt_cons * dt_cons;
 
+	/* The N-1 flow already detects corrupted PDUs (Ethernet FCS, TCP) */
+	bool n1_integrity;
+
 	/* Link it to the main IPCP SDU Protection component */
 	struct list_head list;
 };
@@ -117,9 +120,12 @@ struct sdup * sdup_create(struct ipcp_instance *  parent);
 
 int           sdup_destroy(struct sdup * instance);
 
+bool sdup_n1_ipcp_integrity(struct ipcp_instance * n1_ipcp);
+
 struct sdup_port * sdup_init_port_config(struct sdup * instance,
 			  	  	 const struct name * n1_dif_name,
-			  	  	 port_id_t port_id);
+			  	  	 port_id_t port_id,
+			  	  	 bool n1_integrity);
 
 int sdup_destroy_port_config(struct sdup_port * instance);
 
@@ -129,6 +135,11 @@ int sdup_protect_pdu(struct sdup_port * instance,
 int sdup_unprotect_pdu(struct sdup_port * instance,
 		       struct du * du);
 
+/* Bytes the SDU protection of the port adds to the PDUs it sends */
+void sdup_port_room(struct sdup_port * instance,
+		    size_t *           head_room,
+		    size_t *           tail_room);
+
 int sdup_set_lifetime_limit(struct sdup_port * instance,
 			    struct du * du);
 
@@ -22,6 +22,8 @@
 #include <linux/kobject.h>
 #include <linux/export.h>
 #include <linux/uaccess.h>
+#include <linux/cpumask.h>
+#include <linux/kernel.h>
 
 /* For RWQ */
 #include <linux/workqueue.h>
@@ -37,6 +39,72 @@
 bool is_value_in_range(int value, int min_value, int max_value)
 { return ((value >= min_value || value <= max_value) ? true : false); }
 
+/*
+ * One ordered unbound workqueue per receive queue: the work of a queue runs
+ * one item at a time, on whatever CPU is online, and the queues run in
+ * parallel.
+ */
+static struct workqueue_struct ** rx_wqs;
+
+int rx_steer_init(void)
+{
+        unsigned int i;
+
+        if (!irati_rx_cpus)
+                return 0;
+
+        if (irati_rx_cpus > num_possible_cpus()) {
+                LOG_INFO("Only %u receive queues, one per possible CPU",
+                         num_possible_cpus());
+                irati_rx_cpus = num_possible_cpus();
+        }
+
+        rx_wqs = rkzalloc(irati_rx_cpus * sizeof(*rx_wqs), GFP_KERNEL);
+        if (!rx_wqs)
+                return -1;
+
+        for (i = 0; i < irati_rx_cpus; i++) {
+                rx_wqs[i] = alloc_ordered_workqueue("irati-rx%u",
+                                                    WQ_HIGHPRI |
+                                                    WQ_MEM_RECLAIM, i);
+                if (!rx_wqs[i]) {
+                        LOG_ERR("Cannot create receive queue %u", i);
+                        rx_steer_fini();
+                        return -1;
+                }
+        }
+
+        return 0;
+}
+
+void rx_steer_fini(void)
+{
+        unsigned int i;
+
+        if (!rx_wqs)
+                return;
+
+        for (i = 0; i < irati_rx_cpus; i++)
+                if (rx_wqs[i])
+                        destroy_workqueue(rx_wqs[i]);
+
+        rkfree(rx_wqs);
+        rx_wqs = NULL;
+}
+
+int rx_steer_queue(u32 hash)
+{
+        if (!rx_wqs)
+                return -1;
+
+        return hash % irati_rx_cpus;
+}
+EXPORT_SYMBOL(rx_steer_queue);
+
+bool rx_steer_work(int queue, struct work_struct * work)
+{ return queue_work(rx_wqs[queue], work); }
+EXPORT_SYMBOL(rx_steer_work);
+
 char * strdup_from_user(const char __user * src)
 {
         size_t size;
@@ -21,8 +21,27 @@
 #ifndef RINA_UTILS_H
 #define RINA_UTILS_H
 
+#include <linux/types.h>
+#include <linux/workqueue.h>
+
 bool    is_value_in_range(int value, int min_value, int max_value);
 
+/* Number of queues the receive work is steered over, 0 to keep it local */
+extern unsigned int irati_rx_cpus;
+
+int     rx_steer_init(void);
+void    rx_steer_fini(void);
+
+/*
+ * Receive queue the work of a flow with the given hash has to go through,
+ * the same for all the work of the flow to keep it ordered. -1 if steering
+ * is disabled and the work is done where it arrives.
+ */
+int     rx_steer_queue(u32 hash);
+
+/* Queues work on a receive queue, see queue_work() */
+bool    rx_steer_work(int queue, struct work_struct * work);
+
 /* Syscalls */
 char *  strdup_from_user(const char __user * src);
 
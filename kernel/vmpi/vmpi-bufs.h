@@ -21,9 +21,9 @@
 #ifndef __VMPI_BUFS_H__
 #define __VMPI_BUFS_H__
 
-#include "../sdu.h"
+#include "../du.h"
 
-#define vmpi_buf sdu
+#define vmpi_buf du
 
 struct vmpi_buf_node {
 	struct vmpi_buf *vb;
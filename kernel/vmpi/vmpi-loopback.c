@@ -0,0 +1,401 @@
+/*
+ * Loopback VMPI provider
+ *
+ * Creates pairs of VMPI instances, a HOST one and a GUEST one, that are
+ * connected back to back through software rings of VMPI_RING_SIZE
+ * entries living in the host kernel. It allows to run two shim-hv IPC
+ * processes (or vmpi-test) against each other without a hypervisor, to
+ * exercise and profile the VMPI data path.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/workqueue.h>
+#include <linux/proc_fs.h>
+#include <linux/seq_file.h>
+
+#include "vmpi.h"
+#include "vmpi-bufs.h"
+
+
+#define VMPI_LOOPBACK_MAX_PAIRS         16
+
+static unsigned int pairs = 1;
+module_param(pairs, uint, 0444);
+MODULE_PARM_DESC(pairs, "Number of HOST/GUEST instance pairs to create");
+
+struct vmpi_loopback_slot {
+        struct vmpi_buf *vb;
+        unsigned int channel;
+};
+
+struct vmpi_loopback_ep {
+        struct vmpi_loopback_ep *peer;
+        unsigned int provider;
+        unsigned int id;
+        bool registered;
+
+        /* Receive ring, filled by the peer and drained by rx_work. */
+        spinlock_t lock;
+        struct vmpi_loopback_slot ring[VMPI_RING_SIZE];
+        unsigned int head;
+        unsigned int tail;
+        /* The peer found the ring full and waits for a restart. */
+        bool restart;
+
+        vmpi_read_cb_t rcb;
+        vmpi_write_restart_cb_t wcb;
+        void *opaque;
+
+        struct work_struct rx_work;
+
+        /* Statistics, updated under lock. */
+        u64 tx_pkts;
+        u64 tx_bytes;
+        u64 tx_full;
+        u64 rx_pkts;
+        u64 rx_bytes;
+        u64 rx_drops;
+        u64 rx_runs;
+};
+
+struct vmpi_loopback_pair {
+        struct vmpi_loopback_ep ep[2];
+};
+
+static struct vmpi_loopback_pair *lb_pairs;
+static unsigned int lb_num_pairs;
+
+static inline unsigned int
+ring_used(const struct vmpi_loopback_ep *ep)
+{
+        return ep->head - ep->tail;
+}
+
+static void
+vmpi_loopback_rx_work(struct work_struct *work)
+{
+        struct vmpi_loopback_ep *ep = container_of(work,
+                                                   struct vmpi_loopback_ep,
+                                                   rx_work);
+        struct vmpi_loopback_ep *peer = ep->peer;
+        vmpi_write_restart_cb_t wcb = NULL;
+        void *wcb_opaque = NULL;
+        unsigned int budget = VMPI_RING_SIZE;
+        unsigned int freed = 0;
+        bool restart;
+
+        spin_lock_bh(&ep->lock);
+        ep->rx_runs++;
+        while (budget-- && ring_used(ep)) {
+                struct vmpi_loopback_slot slot;
+                vmpi_read_cb_t rcb = ep->rcb;
+                void *opaque = ep->opaque;
+
+                slot = ep->ring[ep->tail & VMPI_RING_SIZE_MASK];
+                ep->tail++;
+                freed++;
+                if (rcb) {
+                        ep->rx_pkts++;
+                        ep->rx_bytes += vmpi_buf_len(slot.vb);
+                } else {
+                        ep->rx_drops++;
+                }
+                spin_unlock_bh(&ep->lock);
+
+                /* Callbacks may sleep and may write to the peer. */
+                if (rcb)
+                        rcb(opaque, slot.channel, slot.vb);
+                else
+                        vmpi_buf_free(slot.vb);
+
+                spin_lock_bh(&ep->lock);
+        }
+
+        restart = freed && ep->restart;
+        if (restart)
+                ep->restart = false;
+
+        /* Out of budget: yield and continue in a new run. */
+        if (ring_used(ep))
+                schedule_work(&ep->rx_work);
+        spin_unlock_bh(&ep->lock);
+
+        if (!restart)
+                return;
+
+        /* Never nest the two locks, the peer drains in the other order. */
+        spin_lock_bh(&peer->lock);
+        wcb = peer->wcb;
+        wcb_opaque = peer->opaque;
+        spin_unlock_bh(&peer->lock);
+
+        if (wcb)
+                wcb(wcb_opaque);
+}
+
+static ssize_t
+vmpi_loopback_write(struct vmpi_ops *ops, unsigned int channel,
+                    struct vmpi_buf *vb)
+{
+        struct vmpi_loopback_ep *ep = ops->priv;
+        struct vmpi_loopback_ep *peer;
+        size_t len;
+
+        if (!ep)
+                return -EBADFD;
+
+        peer = ep->peer;
+        len = vmpi_buf_len(vb);
+
+        spin_lock_bh(&peer->lock);
+        if (unlikely(ring_used(peer) >= VMPI_RING_SIZE)) {
+                /* The caller keeps the buffer and retries on restart. */
+                peer->restart = true;
+                spin_unlock_bh(&peer->lock);
+
+                spin_lock_bh(&ep->lock);
+                ep->tx_full++;
+                spin_unlock_bh(&ep->lock);
+
+                return -EAGAIN;
+        }
+
+        peer->ring[peer->head & VMPI_RING_SIZE_MASK].vb = vb;
+        peer->ring[peer->head & VMPI_RING_SIZE_MASK].channel = channel;
+        peer->head++;
+        spin_unlock_bh(&peer->lock);
+
+        spin_lock_bh(&ep->lock);
+        ep->tx_pkts++;
+        ep->tx_bytes += len;
+        spin_unlock_bh(&ep->lock);
+
+        schedule_work(&peer->rx_work);
+
+        return len;
+}
+
+static int
+vmpi_loopback_register_cbs(struct vmpi_ops *ops, vmpi_read_cb_t rcb,
+                           vmpi_write_restart_cb_t wcb, void *opaque)
+{
+        struct vmpi_loopback_ep *ep = ops->priv;
+
+        spin_lock_bh(&ep->lock);
+        if (ep->rcb) {
+                spin_unlock_bh(&ep->lock);
+                return -EBUSY;
+        }
+        ep->rcb = rcb;
+        ep->wcb = wcb;
+        ep->opaque = opaque;
+        spin_unlock_bh(&ep->lock);
+
+        /* Deliver whatever the peer queued in the meanwhile. */
+        schedule_work(&ep->rx_work);
+
+        return 0;
+}
+
+static int
+vmpi_loopback_unregister_cbs(struct vmpi_ops *ops)
+{
+        struct vmpi_loopback_ep *ep = ops->priv;
+
+        spin_lock_bh(&ep->lock);
+        ep->rcb = NULL;
+        ep->wcb = NULL;
+        ep->opaque = NULL;
+        spin_unlock_bh(&ep->lock);
+
+        /* Wait for callbacks that may still be using the old opaque:
+         * our read callback runs in our rx_work, our write restart
+         * callback runs in the peer's one. */
+        flush_work(&ep->rx_work);
+        flush_work(&ep->peer->rx_work);
+
+        return 0;
+}
+
+static void
+vmpi_loopback_ep_init(struct vmpi_loopback_ep *ep,
+                      struct vmpi_loopback_ep *peer, unsigned int provider)
+{
+        ep->peer = peer;
+        ep->provider = provider;
+        spin_lock_init(&ep->lock);
+        INIT_WORK(&ep->rx_work, vmpi_loopback_rx_work);
+}
+
+static int
+vmpi_loopback_ep_register(struct vmpi_loopback_ep *ep)
+{
+        struct vmpi_ops ops;
+        int ret;
+
+        ops.priv = ep;
+        ops.write = vmpi_loopback_write;
+        ops.register_cbs = vmpi_loopback_register_cbs;
+        ops.unregister_cbs = vmpi_loopback_unregister_cbs;
+
+        ret = vmpi_provider_register(ep->provider, &ops, &ep->id);
+        if (ret == 0)
+                ep->registered = true;
+
+        return ret;
+}
+
+static void
+vmpi_loopback_ep_fini(struct vmpi_loopback_ep *ep)
+{
+        if (ep->registered) {
+                vmpi_provider_unregister(ep->provider, ep->id);
+                ep->registered = false;
+        }
+
+        cancel_work_sync(&ep->rx_work);
+
+        /* Nobody can write anymore: release what is left in the ring. */
+        while (ring_used(ep)) {
+                vmpi_buf_free(ep->ring[ep->tail & VMPI_RING_SIZE_MASK].vb);
+                ep->tail++;
+        }
+}
+
+static int
+vmpi_loopback_stats_show(struct seq_file *m, void *v)
+{
+        unsigned int i, j;
+
+        for (i = 0; i < lb_num_pairs; i++) {
+                for (j = 0; j < 2; j++) {
+                        struct vmpi_loopback_ep *ep = &lb_pairs[i].ep[j];
+
+                        spin_lock_bh(&ep->lock);
+                        seq_printf(m, "%s:%u peer[%u] ring[%u/%u] "
+                                   "tx[%llu pkts %llu bytes %llu full] "
+                                   "rx[%llu pkts %llu bytes %llu drops "
+                                   "%llu runs]\n",
+                                   ep->provider == VMPI_PROVIDER_HOST ?
+                                   "HOST" : "GUEST", ep->id, ep->peer->id,
+                                   ring_used(ep), VMPI_RING_SIZE,
+                                   ep->tx_pkts, ep->tx_bytes, ep->tx_full,
+                                   ep->rx_pkts, ep->rx_bytes, ep->rx_drops,
+                                   ep->rx_runs);
+                        spin_unlock_bh(&ep->lock);
+                }
+        }
+
+        return 0;
+}
+
+static int
+vmpi_loopback_stats_open(struct inode *inode, struct file *file)
+{
+        return single_open(file, vmpi_loopback_stats_show, NULL);
+}
+
+static const struct file_operations vmpi_loopback_stats_fops = {
+        .owner     = THIS_MODULE,
+        .open      = vmpi_loopback_stats_open,
+        .read      = seq_read,
+        .llseek    = seq_lseek,
+        .release   = single_release,
+};
+
+static void
+vmpi_loopback_destroy_pairs(void)
+{
+        unsigned int i;
+
+        for (i = 0; i < lb_num_pairs; i++) {
+                vmpi_loopback_ep_fini(&lb_pairs[i].ep[0]);
+                vmpi_loopback_ep_fini(&lb_pairs[i].ep[1]);
+        }
+        lb_num_pairs = 0;
+}
+
+static int __init
+vmpi_loopback_init(void)
+{
+        unsigned int i;
+        int ret;
+
+        if (pairs == 0 || pairs > VMPI_LOOPBACK_MAX_PAIRS) {
+                printk("%s: pairs must be in [1, %u]\n", __func__,
+                       VMPI_LOOPBACK_MAX_PAIRS);
+                return -EINVAL;
+        }
+
+        lb_pairs = kcalloc(pairs, sizeof(*lb_pairs), GFP_KERNEL);
+        if (!lb_pairs) {
+                printk("%s: Out of memory\n", __func__);
+                return -ENOMEM;
+        }
+
+        for (i = 0; i < pairs; i++) {
+                struct vmpi_loopback_pair *p = &lb_pairs[i];
+
+                vmpi_loopback_ep_init(&p->ep[0], &p->ep[1],
+                                      VMPI_PROVIDER_HOST);
+                vmpi_loopback_ep_init(&p->ep[1], &p->ep[0],
+                                      VMPI_PROVIDER_GUEST);
+                lb_num_pairs++;
+
+                ret = vmpi_loopback_ep_register(&p->ep[0]);
+                if (ret == 0)
+                        ret = vmpi_loopback_ep_register(&p->ep[1]);
+                if (ret) {
+                        printk("%s: Failed to register pair %u [%d]\n",
+                               __func__, i, ret);
+                        goto fail;
+                }
+
+                printk("%s: HOST:%u <--> GUEST:%u\n", __func__,
+                       p->ep[0].id, p->ep[1].id);
+        }
+
+        proc_create("vmpi-loopback", 0, NULL, &vmpi_loopback_stats_fops);
+
+        printk("vmpi_loopback_init completed\n");
+
+        return 0;
+fail:
+        vmpi_loopback_destroy_pairs();
+        kfree(lb_pairs);
+
+        return ret;
+}
+
+static void __exit
+vmpi_loopback_fini(void)
+{
+        remove_proc_entry("vmpi-loopback", NULL);
+        vmpi_loopback_destroy_pairs();
+        kfree(lb_pairs);
+
+        printk("vmpi_loopback_fini completed\n");
+}
+
+module_init(vmpi_loopback_init);
+module_exit(vmpi_loopback_fini);
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Loopback VMPI provider");
@@ -25,6 +25,10 @@
 #include <linux/moduleparam.h>
 #include <linux/uio.h>
 #include <linux/slab.h>
+#include <linux/ktime.h>
+#include <linux/completion.h>
+#include <linux/mutex.h>
+#include <linux/string.h>
 
 #include "vmpi.h"
 #include "vmpi-bufs.h"
@@ -77,7 +81,7 @@ vmpi_test_write_iter(struct kiocb *iocb, struct iov_iter *from)
                 printk("%s: Out of memory\n", __func__);
                 return -ENOMEM;
         }
-        copy_from_iter(vmpi_buf_data(vb), vmpi_buf_size(vb), from);
+        copy_from_iter(vmpi_buf_data(vb), len, from);
 
         add_wait_queue(&vt->write_wqh, &wait);
 
@@ -102,6 +106,11 @@ vmpi_test_write_iter(struct kiocb *iocb, struct iov_iter *from)
         current->state = TASK_RUNNING;
         remove_wait_queue(&vt->write_wqh, &wait);
 
+        if (unlikely(ret < 0)) {
+                vmpi_buf_free(vb);
+                return ret;
+        }
+
         IFV(printk("%s() --> %d\n", __func__, (int)len));
 
         return len;
@@ -190,7 +199,7 @@ vmpi_test_read_iter(struct kiocb *iocb,
                 }
 
                 vbn = list_first_entry(&queue->entries,
-                                      struct vmpi_buf, node);
+                                       struct vmpi_buf_node, node);
                 list_del(&vbn->node);
                 queue->len--;
 		vb = vbn->vb;
@@ -284,12 +293,13 @@ vmpi_test_release(struct inode *inode, struct file *f)
 
         /* Clean up queues. */
         for (i = 0; i < VMPI_MAX_CHANNELS; i++) {
-                struct vmpi_buf *vb, *tmp;
+                struct vmpi_buf_node *vbn, *tmp;
 
-                list_for_each_entry_safe(vb, tmp, &vt->readqueues[i].entries,
+                list_for_each_entry_safe(vbn, tmp, &vt->readqueues[i].entries,
                                          node) {
-                        list_del(&vb->node);
-                        vmpi_buf_free(vb);
+                        list_del(&vbn->node);
+                        vmpi_buf_free(vbn->vb);
+                        vmpi_buf_node_free(vbn);
                 }
         }
 
@@ -302,6 +312,300 @@ vmpi_test_release(struct inode *inode, struct file *f)
         return 0;
 }
 
+/*
+ * In-kernel benchmarks. Writing "throughput" or "latency" to the bench
+ * parameter (or passing it last at load time) sends bench_count buffers of
+ * bench_len bytes on write_channel from the bench_tx_id instance to the
+ * bench_rx_id one, e.g. the two ends of a vmpi-loopback pair. The
+ * latency test has the receiver bounce every buffer back and measures
+ * the round trip time. Both instances must be otherwise unused.
+ */
+static unsigned int bench_tx_id = 0;
+module_param(bench_tx_id, uint, 0644);
+
+static unsigned int bench_rx_id = 1;
+module_param(bench_rx_id, uint, 0644);
+
+static unsigned int bench_count = 100000;
+module_param(bench_count, uint, 0644);
+
+static unsigned int bench_len = 1400;
+module_param(bench_len, uint, 0644);
+
+#define VMPI_BENCH_TIMEOUT      (10 * HZ)
+#define VMPI_BENCH_RTT_TIMEOUT  HZ
+
+struct vmpi_bench {
+        struct vmpi_ops tx_ops;
+        struct vmpi_ops rx_ops;
+        unsigned int channel;
+        unsigned int count;
+        bool echo;
+
+        /* Throughput receiver state. */
+        atomic_t rx_pkts;
+        atomic64_t rx_bytes;
+        ktime_t rx_end;
+
+        /* Sequence number of the pong the latency sender waits for. */
+        u32 pong_seq;
+        struct completion done;
+
+        atomic_t restarts;
+        wait_queue_head_t wqh;
+};
+
+static DEFINE_MUTEX(bench_lock);
+
+static void
+bench_write_restart_callback(void *opaque)
+{
+        struct vmpi_bench *b = opaque;
+
+        atomic_inc(&b->restarts);
+        wake_up(&b->wqh);
+}
+
+static void
+bench_rx_callback(void *opaque, unsigned int channel, struct vmpi_buf *vb)
+{
+        struct vmpi_bench *b = opaque;
+
+        if (b->echo) {
+                /* A lost pong is accounted as a timeout by the sender. */
+                if (b->rx_ops.write(&b->rx_ops, channel, vb) < 0)
+                        vmpi_buf_free(vb);
+                return;
+        }
+
+        atomic64_add(vmpi_buf_len(vb), &b->rx_bytes);
+        vmpi_buf_free(vb);
+
+        if (atomic_inc_return(&b->rx_pkts) == b->count) {
+                b->rx_end = ktime_get();
+                complete(&b->done);
+        }
+}
+
+static void
+bench_tx_callback(void *opaque, unsigned int channel, struct vmpi_buf *vb)
+{
+        struct vmpi_bench *b = opaque;
+        u32 seq;
+
+        if (b->echo && vmpi_buf_len(vb) >= sizeof(seq)) {
+                memcpy(&seq, vmpi_buf_data(vb), sizeof(seq));
+                /* Late pongs of timed out pings are ignored. */
+                if (seq == READ_ONCE(b->pong_seq))
+                        complete(&b->done);
+        }
+
+        vmpi_buf_free(vb);
+}
+
+static int
+bench_send(struct vmpi_bench *b, u32 seq)
+{
+        struct vmpi_buf *vb;
+        ssize_t ret;
+        int restarts;
+
+        vb = vmpi_buf_alloc(bench_len, 0, GFP_KERNEL);
+        if (!vb)
+                return -ENOMEM;
+
+        memset(vmpi_buf_data(vb), 0, bench_len);
+        memcpy(vmpi_buf_data(vb), &seq, sizeof(seq));
+
+        for (;;) {
+                restarts = atomic_read(&b->restarts);
+                ret = b->tx_ops.write(&b->tx_ops, b->channel, vb);
+                if (likely(ret != -EAGAIN))
+                        break;
+
+                /* No room to write: wait for a restart, or poll again
+                 * after a while in case the restart was missed. */
+                wait_event_interruptible_timeout(b->wqh,
+                                atomic_read(&b->restarts) != restarts,
+                                msecs_to_jiffies(10));
+                if (signal_pending(current)) {
+                        ret = -EINTR;
+                        break;
+                }
+        }
+
+        if (ret < 0) {
+                vmpi_buf_free(vb);
+                return ret;
+        }
+
+        return 0;
+}
+
+static int
+bench_throughput(struct vmpi_bench *b)
+{
+        ktime_t start, end;
+        unsigned int i;
+        unsigned int rx;
+        u64 bytes;
+        u64 ns;
+        int ret = 0;
+
+        start = ktime_get();
+        for (i = 0; i < b->count; i++) {
+                ret = bench_send(b, i);
+                if (ret)
+                        break;
+        }
+
+        if (!ret && wait_for_completion_timeout(&b->done,
+                                                VMPI_BENCH_TIMEOUT))
+                end = b->rx_end;
+        else
+                end = ktime_get();
+
+        rx = atomic_read(&b->rx_pkts);
+        bytes = atomic64_read(&b->rx_bytes);
+        ns = ktime_to_ns(ktime_sub(end, start));
+        if (!ns)
+                ns = 1;
+
+        printk("vmpi-test: throughput %u/%u pkts of %u bytes in %llu us: "
+               "%llu pkts/s, %llu Mbps\n", rx, b->count, bench_len,
+               div_u64(ns, NSEC_PER_USEC),
+               div64_u64((u64)rx * NSEC_PER_SEC, ns),
+               div64_u64(bytes * 8 * 1000, ns));
+
+        return ret;
+}
+
+static int
+bench_latency(struct vmpi_bench *b)
+{
+        u64 rtt, min = U64_MAX, max = 0, sum = 0;
+        unsigned int received = 0;
+        unsigned int i;
+        ktime_t start;
+        int ret = 0;
+
+        for (i = 0; i < b->count; i++) {
+                WRITE_ONCE(b->pong_seq, i);
+                reinit_completion(&b->done);
+
+                start = ktime_get();
+                ret = bench_send(b, i);
+                if (ret)
+                        break;
+
+                if (!wait_for_completion_timeout(&b->done,
+                                                 VMPI_BENCH_RTT_TIMEOUT))
+                        continue;
+
+                rtt = ktime_to_ns(ktime_sub(ktime_get(), start));
+                min = min(min, rtt);
+                max = max(max, rtt);
+                sum += rtt;
+                received++;
+        }
+
+        if (!received) {
+                printk("vmpi-test: latency 0/%u pongs received\n", b->count);
+                return ret ? ret : -ETIMEDOUT;
+        }
+
+        printk("vmpi-test: latency %u/%u pongs of %u bytes: "
+               "rtt min %llu avg %llu max %llu ns\n", received, b->count,
+               bench_len, min, div_u64(sum, received), max);
+
+        return ret;
+}
+
+static int
+vmpi_bench_run(bool latency)
+{
+        struct vmpi_bench *b;
+        int ret;
+
+        if (bench_count == 0 || bench_len < sizeof(u32) ||
+                        bench_len > vmpi_get_max_payload_size() ||
+                        bench_tx_id == bench_rx_id) {
+                printk("%s: invalid benchmark parameters\n", __func__);
+                return -EINVAL;
+        }
+
+        b = kzalloc(sizeof(*b), GFP_KERNEL);
+        if (!b)
+                return -ENOMEM;
+
+        b->channel = write_channel;
+        b->count = bench_count;
+        b->echo = latency;
+        atomic_set(&b->rx_pkts, 0);
+        atomic64_set(&b->rx_bytes, 0);
+        atomic_set(&b->restarts, 0);
+        init_completion(&b->done);
+        init_waitqueue_head(&b->wqh);
+
+        mutex_lock(&bench_lock);
+
+        ret = vmpi_provider_find_instance(VMPI_PROVIDER_AUTO, bench_tx_id,
+                                          &b->tx_ops);
+        if (!ret)
+                ret = vmpi_provider_find_instance(VMPI_PROVIDER_AUTO,
+                                                  bench_rx_id, &b->rx_ops);
+        if (ret) {
+                printk("%s: VMPI instances %u/%u not found\n", __func__,
+                       bench_tx_id, bench_rx_id);
+                goto out;
+        }
+
+        ret = b->rx_ops.register_cbs(&b->rx_ops, bench_rx_callback,
+                                     bench_write_restart_callback, b);
+        if (ret) {
+                printk("%s: register_cbs(%u) failed [%d]\n", __func__,
+                       bench_rx_id, ret);
+                goto out;
+        }
+
+        ret = b->tx_ops.register_cbs(&b->tx_ops, bench_tx_callback,
+                                     bench_write_restart_callback, b);
+        if (ret) {
+                printk("%s: register_cbs(%u) failed [%d]\n", __func__,
+                       bench_tx_id, ret);
+                b->rx_ops.unregister_cbs(&b->rx_ops);
+                goto out;
+        }
+
+        ret = latency ? bench_latency(b) : bench_throughput(b);
+
+        b->tx_ops.unregister_cbs(&b->tx_ops);
+        b->rx_ops.unregister_cbs(&b->rx_ops);
+out:
+        mutex_unlock(&bench_lock);
+        kfree(b);
+
+        return ret;
+}
+
+static int
+vmpi_bench_set(const char *val, const struct kernel_param *kp)
+{
+        if (sysfs_streq(val, "throughput"))
+                return vmpi_bench_run(false);
+        if (sysfs_streq(val, "latency"))
+                return vmpi_bench_run(true);
+
+        return -EINVAL;
+}
+
+static const struct kernel_param_ops vmpi_bench_ops = {
+        .set = vmpi_bench_set,
+};
+
+module_param_cb(bench, &vmpi_bench_ops, NULL, 0200);
+MODULE_PARM_DESC(bench, "Run a benchmark: throughput or latency");
+
 static const struct file_operations vmpi_test_fops = {
         .owner          = THIS_MODULE,
         .release        = vmpi_test_release,
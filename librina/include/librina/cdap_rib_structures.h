@@ -104,7 +104,10 @@ typedef struct flags {
 	enum Flags {
 		NONE_FLAGS,
 		F_SYNC,
-		F_RD_INCOMPLETE
+		F_RD_INCOMPLETE,
+		/// Set on a scoped read to receive the objects in scope
+		/// packed in a few replies (see rib::BatchedReadResult)
+		F_RD_BATCH
 	};
 	/// flags (enm, int32), conditional, may be required by CDAP.
 	/// set_ of Boolean values that modify the meaning of a
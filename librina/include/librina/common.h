@@ -619,6 +619,12 @@ class IPCEventProducer {
 public:
 	/** Blocks until there is an event available */
 	IPCEvent * eventWait();
+
+	/**
+	 * Returns an event that has already been read from the control
+	 * file descriptor, or NULL without blocking if there is none
+	 */
+	IPCEvent * eventPoll();
 };
 
 /**
@@ -467,7 +467,9 @@ public:
          * (application registration, flow allocation, etc.), so that it
          * can be used with select(),poll(), etc.
          * In the current implementation, the file descriptor is associated
-         * to a netlink socket.
+         * to the IRATI control device, which hands out several events per
+         * read: when it becomes readable, call eventWait() once and then
+         * eventPoll() until it returns NULL.
          *
          * @return the regis
          */
@@ -26,6 +26,7 @@
 #include <string>
 #include <list>
 #include <map>
+#include <vector>
 #include <algorithm>
 
 #include "application.h"
@@ -962,6 +963,40 @@ public:
         std::string displayable_value_;
 };
 
+#ifndef SWIG
+/// Decodes the value of a reply to a scoped read issued with the
+/// F_RD_BATCH flag. Each reply packs several of the objects in scope (the
+/// ones that passed the filter); all the replies but the last one carry
+/// the F_RD_INCOMPLETE flag. Delegated subtrees are not part of a batched
+/// read: the delegation object itself is returned, and the objects below
+/// it have to be read with a separate read.
+class BatchedReadResult {
+public:
+	/// Throws an Exception if @value is not a batch of objects
+	BatchedReadResult(const ser_obj_t &value);
+
+	unsigned int size() const;
+	const std::string& get_class(unsigned int i) const;
+	const std::string& get_name(unsigned int i) const;
+	int64_t get_instance(unsigned int i) const;
+	cdap_rib::res_code_t get_result(unsigned int i) const;
+
+	/// Copy the serialized value of the i-th object into @value
+	void get_value(unsigned int i, ser_obj_t &value) const;
+
+private:
+	struct entry {
+		std::string class_;
+		std::string name_;
+		int64_t inst_;
+		int result_;
+		std::string value_;
+	};
+
+	std::vector<entry> entries;
+};
+#endif
+
 /// The RIB Daemon Application Entity
 class RIBDaemonAE : public ApplicationEntity {
 
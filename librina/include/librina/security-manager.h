@@ -24,7 +24,9 @@
 
 #ifdef __cplusplus
 
+#include <sys/types.h>
 #include <openssl/dh.h>
+#include <openssl/evp.h>
 #include <openssl/rsa.h>
 
 #include "librina/application.h"
@@ -266,7 +268,7 @@ class SSH2SecurityContext : public ISecurityContext {
 public:
 	SSH2SecurityContext(int session_id) : ISecurityContext(session_id, IAuthPolicySet::AUTH_SSH2),
 			state(BEGIN), dh_state(NULL), dh_peer_pub_key(NULL),
-			auth_keypair(NULL), auth_peer_pub_key(NULL),
+			ecdh_state(NULL), ecdh_peer_pub_key(NULL), auth_keypair(NULL), auth_peer_pub_key(NULL),
 			crypto_tx_enabled(false), crypto_rx_enabled (false),
 			timer_task(NULL) { };
 	SSH2SecurityContext(int session_id,
@@ -290,6 +292,7 @@ public:
 	static const std::string KEY;
 	static const std::string PUBLIC_KEY;
 	static const std::string KNOWN_IPCPS;
+	static const std::string KEY_EXCH_X25519;
 
         enum State {
         	BEGIN,
@@ -324,6 +327,12 @@ public:
 	///The EDH public key of the peer
 	BIGNUM * dh_peer_pub_key;
 
+	///Elliptic curve Diffie-Hellman key exchange state (X25519)
+	EVP_PKEY * ecdh_state;
+
+	///The ECDH public key of the peer
+	EVP_PKEY * ecdh_peer_pub_key;
+
 	///The shared secret, used to generate the encryption key
 	UcharArray shared_secret;
 
@@ -379,6 +388,77 @@ private:
 	bool enabled;
 };
 
+/// Ephemeral key pair for the SSH2 key exchange
+class SSH2KeyPair {
+public:
+	SSH2KeyPair() : dh(NULL), pkey(NULL) { };
+	~SSH2KeyPair();
+
+	/// Finite field Diffie-Hellman key pair (EDH)
+	DH * dh;
+
+	/// Elliptic curve key pair (X25519)
+	EVP_PKEY * pkey;
+};
+
+class SSH2KeyPairPool;
+
+class SSH2KeyPairWorker : public SimpleThread {
+public:
+	SSH2KeyPairWorker(ThreadAttributes * threadAttributes,
+			  SSH2KeyPairPool * pool);
+	~SSH2KeyPairWorker() throw() { };
+	int run();
+
+private:
+	SSH2KeyPairPool * pool;
+};
+
+/// Generates the ephemeral key pairs of the SSH2 key exchange ahead of
+/// time in a set of worker threads, so that enrollments do not wait for
+/// (each other's) key generation on the thread processing CDAP messages.
+/// Workers are started on first use and keep a few key pairs ready for
+/// every key exchange algorithm that has been asked for.
+class SSH2KeyPairPool : public ConditionVariable {
+public:
+	static const int DEFAULT_WORKERS;
+	static const int DEFAULT_DEPTH;
+
+	SSH2KeyPairPool();
+	~SSH2KeyPairPool() throw();
+
+	/// DH parameters (p, g) used to generate EDH key pairs
+	void set_dh_parameters(DH * params);
+	void set_workers(int workers);
+	void set_depth(int depth);
+
+	/// Get a key pair for the algorithm, taken from the pool if one is
+	/// ready or generated in the calling thread otherwise. Returns NULL
+	/// if the key pair cannot be generated.
+	SSH2KeyPair * take(const std::string& alg);
+
+	/// Generate a key pair for the algorithm in the calling thread
+	static SSH2KeyPair * generate(const std::string& alg, DH * params);
+
+	/// Main loop of the worker threads
+	void work();
+
+	/// Stop the workers and drop the key pairs not yet used
+	void stop();
+
+private:
+	void start();
+
+	DH * dh_parameters;
+	int workers;
+	int depth;
+	bool running;
+	bool stopping;
+	std::list<SSH2KeyPairWorker *> threads;
+	std::map<std::string, std::list<SSH2KeyPair *> > ready;
+	std::map<std::string, int> pending;
+};
+
 /// Authentication policy set that mimics SSH approach. It is associated to
 /// a cryptographic SDU protection policy, which is configured by this Authz policy.
 /// It uses the Open SSL crypto library to perform all its functions
@@ -395,6 +475,8 @@ public:
 	static const std::string CLIENT_CHALLENGE;
 	static const std::string CLIENT_CHALLENGE_REPLY;
 	static const std::string SERVER_CHALLENGE_REPLY;
+	static const std::string KEY_PAIR_WORKERS;
+	static const std::string KEY_PAIR_POOL_DEPTH;
 
 	AuthSSH2PolicySet(rib::RIBDaemonProxy * ribd, ISecurityManager * sm);
 	virtual ~AuthSSH2PolicySet();
@@ -425,13 +507,26 @@ private:
 	// Returns 0 if successful, -1 if there is a failure
 	int load_authentication_keys(SSH2SecurityContext * sc);
 
+	/// Get a reference to the RSA key stored in a keystore file, which is
+	/// only read again if the file has changed since it was cached.
+	/// The caller must release the reference with RSA_free
+	RSA * get_keystore_key(const std::string& path, bool private_key);
+
 	/// Initialize parameters (p, g) for DH key exchange
 	void edh_init_params();
 
-	/// Initialize keys for DH key exchange with own P and G params.
-	/// Returns 0 if successful -1 otherwise.
+	/// Initialize keys for the negotiated key exchange algorithm (DH with
+	/// own P and G params, or X25519). Returns 0 if successful -1 otherwise.
 	int edh_init_keys(SSH2SecurityContext * sc);
 
+	/// Serialize own public key. Returns 0 if successful, -1 otherwise
+	int edh_get_public_key(SSH2SecurityContext * sc, UcharArray& pub_key);
+
+	/// Store the public key sent by the peer. Returns 0 if successful,
+	/// -1 otherwise
+	int edh_set_peer_public_key(SSH2SecurityContext * sc,
+				    const UcharArray& pub_key);
+
 	/// Generate the shared secret using the peer's public key.
 	/// Returns 0 if successful, -1 otherwise
 	int edh_generate_shared_secret(SSH2SecurityContext * sc);
@@ -479,6 +574,21 @@ private:
 	DH * dh_parameters;
 	Timer timer;
 	int timeout;
+
+	/// Pre-generated ephemeral key pairs
+	SSH2KeyPairPool key_pairs;
+
+	/// RSA keys read from the keystore, by file path
+	struct KeystoreKey {
+		RSA * key;
+		bool private_key;
+		ino_t ino;
+		off_t size;
+		time_t mtime;
+		time_t ctime;
+	};
+	std::map<std::string, KeystoreKey> keystore_keys;
+	Lockable keystore_lock;
 };
 
 class ISecurityManager: public ApplicationEntity, public InternalEventListener {
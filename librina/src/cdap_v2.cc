@@ -21,6 +21,7 @@
  */
 #include <algorithm>
 #include <cerrno>
+#include <pthread.h>
 
 #define RINA_PREFIX "cdap"
 
@@ -615,7 +616,12 @@ class AppCDAPIOHandler : public CDAPIOHandler
         std::map<unsigned int, int> fds_map;
 };
 
-/// Google Protocol Buffers Wire Message Provider
+/// Google Protocol Buffers Wire Message Provider. The GPB messages are
+/// kept across calls and cleared before reuse, so that their strings and
+/// submessages keep their storage and (de)serializing a message does
+/// not hit the allocator for every field. Serializers are shared by all
+/// the sessions of a manager, so each thread gets its own messages and
+/// sessions (de)serialize concurrently.
 class GPBSerializer : public SerializerInterface
 {
  public:
@@ -623,6 +629,19 @@ class GPBSerializer : public SerializerInterface
 				cdap_m_t& result);
 	void serializeMessage(const cdap_m_t &cdapMessage,
 			      ser_obj_t& result);
+ private:
+	struct gpb_messages {
+		messages::CDAPMessage enc_msg;
+		messages::CDAPMessage dec_msg;
+	};
+
+	/// The messages of the calling thread, freed when it exits
+	static gpb_messages * thread_messages();
+	static void create_messages_key();
+	static void free_messages(void * messages);
+
+	static pthread_key_t messages_key;
+	static pthread_once_t messages_once;
 };
 
 // CLASS CDAPMessageFactory
@@ -2721,27 +2740,64 @@ cdap_rib::con_handle_t & CDAPSessionManager::get_con_handle(int port_id)
 }
 
 // CLASS GPBWireMessageProvider
+pthread_key_t GPBSerializer::messages_key;
+pthread_once_t GPBSerializer::messages_once = PTHREAD_ONCE_INIT;
+
+void GPBSerializer::create_messages_key()
+{
+	if (pthread_key_create(&messages_key, free_messages))
+		LOG_CRIT("Cannot create the key of the GPB messages");
+}
+
+void GPBSerializer::free_messages(void * msgs)
+{
+	delete static_cast<gpb_messages *>(msgs);
+}
+
+GPBSerializer::gpb_messages * GPBSerializer::thread_messages()
+{
+	gpb_messages * msgs;
+
+	pthread_once(&messages_once, create_messages_key);
+
+	msgs = static_cast<gpb_messages *>(pthread_getspecific(messages_key));
+	if (!msgs) {
+		msgs = new gpb_messages();
+		if (pthread_setspecific(messages_key, msgs)) {
+			delete msgs;
+			throw CDAPException("Cannot allocate the GPB messages");
+		}
+	}
+
+	return msgs;
+}
+
 void GPBSerializer::deserializeMessage(const ser_obj_t &message,
 				       cdap_m_t& result)
 {
-	messages::CDAPMessage gpfCDAPMessage;
+	messages::CDAPMessage &gpfCDAPMessage = thread_messages()->dec_msg;
 
-	gpfCDAPMessage.ParseFromArray(message.message_, message.size_);
+	// ParseFromArray() clears the message, but keeps its storage
+	if (!gpfCDAPMessage.ParseFromArray(message.message_, message.size_))
+		throw CDAPException("Deserializing Message: Malformed message");
 	// ABS_SYNTAX
 	if (gpfCDAPMessage.has_abssyntax())
 		result.abs_syntax_ = gpfCDAPMessage.abssyntax();
 	// AUTH_POLICY
-	result.auth_policy_.name = gpfCDAPMessage.authpolicy().name();
-	for(int i=0; i<gpfCDAPMessage.authpolicy().versions_size(); i++) {
+	const messages::authPolicy_t &gpb_auth_policy =
+			gpfCDAPMessage.authpolicy();
+	result.auth_policy_.name = gpb_auth_policy.name();
+	for(int i=0; i<gpb_auth_policy.versions_size(); i++) {
 		result.auth_policy_.versions.push_back(
-				gpfCDAPMessage.authpolicy().versions(i));
+				gpb_auth_policy.versions(i));
 	}
-	if (gpfCDAPMessage.authpolicy().has_options()) {
-		result.auth_policy_.options.message_ = new unsigned char[gpfCDAPMessage.authpolicy().options().size()];
-		result.auth_policy_.options.size_ = gpfCDAPMessage.authpolicy().options().size();
+	if (gpb_auth_policy.has_options()) {
+		const std::string &options = gpb_auth_policy.options();
+		result.auth_policy_.options.message_ = new unsigned char[options.size()];
+		result.auth_policy_.options.size_ = options.size();
 		memcpy(result.auth_policy_.options.message_,
-		       gpfCDAPMessage.authpolicy().options().data(),
-		       gpfCDAPMessage.authpolicy().options().size());
+		       options.data(),
+		       options.size());
 	}
 	// DEST_AE_INST
 	if (gpfCDAPMessage.has_destaeinst())
@@ -2780,15 +2836,14 @@ void GPBSerializer::deserializeMessage(const ser_obj_t &message,
 	// OBJ_NAME
 	if (gpfCDAPMessage.has_objname())
 		result.obj_name_ = gpfCDAPMessage.objname();
-	// OBJ_VALUE
+	// OBJ_VALUE, copied once straight from the parsed buffer
 	if (gpfCDAPMessage.has_objvalue()) {
-		messages::objVal_t obj_val_t = gpfCDAPMessage.objvalue();
-		char unsigned *byte_val = new
-				unsigned char[obj_val_t.byteval().size()];
-		memcpy(byte_val, obj_val_t.byteval().data(),
-		       obj_val_t.byteval().size());
-		result.obj_value_.message_ = byte_val;
-		result.obj_value_.size_ = obj_val_t.byteval().size();
+		const std::string &byte_val =
+				gpfCDAPMessage.objvalue().byteval();
+		result.obj_value_.message_ = new unsigned char[byte_val.size()];
+		result.obj_value_.size_ = byte_val.size();
+		memcpy(result.obj_value_.message_, byte_val.data(),
+		       byte_val.size());
 	}
 	// OP_CODE
 	if (gpfCDAPMessage.has_opcode()) {
@@ -2826,26 +2881,29 @@ void GPBSerializer::deserializeMessage(const ser_obj_t &message,
 void GPBSerializer::serializeMessage(const cdap_m_t &cdapMessage,
 				     ser_obj_t& result)
 {
-	messages::CDAPMessage gpfCDAPMessage;
+	// OP_CODE
+	if (!messages::opCode_t_IsValid(cdapMessage.op_code_)) {
+		throw CDAPException("Serializing Message: Not a valid OpCode");
+	}
+
+	messages::CDAPMessage &gpfCDAPMessage = thread_messages()->enc_msg;
+
+	gpfCDAPMessage.Clear();
 	// ABS_SYNTAX
 	gpfCDAPMessage.set_abssyntax(cdapMessage.abs_syntax_);
 	// AUTH_POLICY
-	messages::authPolicy_t *gpb_auth_policy = new messages::authPolicy_t();
+	messages::authPolicy_t *gpb_auth_policy =
+			gpfCDAPMessage.mutable_authpolicy();
 	gpb_auth_policy->set_name(cdapMessage.auth_policy_.name);
-	std::list<std::string> versions = cdapMessage.auth_policy_.versions;
-	for(std::list<std::string>::iterator it = versions.begin();
-		it != versions.end(); ++it) {
+	for(std::list<std::string>::const_iterator it =
+			cdapMessage.auth_policy_.versions.begin();
+		it != cdapMessage.auth_policy_.versions.end(); ++it) {
 		gpb_auth_policy->add_versions(*it);
 	}
 	if (cdapMessage.auth_policy_.options.size_ > 0) {
-		char * gpb_opts = new char[cdapMessage.auth_policy_.options.size_];
-		memcpy(gpb_opts,
-		       cdapMessage.auth_policy_.options.message_,
-		       cdapMessage.auth_policy_.options.size_);
-		gpb_auth_policy->set_options(gpb_opts,
+		gpb_auth_policy->set_options(cdapMessage.auth_policy_.options.message_,
 					     cdapMessage.auth_policy_.options.size_);
 	}
-	gpfCDAPMessage.set_allocated_authpolicy(gpb_auth_policy);
 	// DEST_AE_INST
 	gpfCDAPMessage.set_destaeinst(cdapMessage.dest_ae_inst_);
 	// DEST_AE_NAME
@@ -2875,19 +2933,11 @@ void GPBSerializer::serializeMessage(const cdap_m_t &cdapMessage,
 	gpfCDAPMessage.set_objname(cdapMessage.obj_name_);
 	// OBJ_VALUE
 	if (cdapMessage.obj_value_.size_ > 0) {
-		messages::objVal_t *gpb_obj_val = new messages::objVal_t();
-		char * gpb_val = new char[cdapMessage.obj_value_.size_];
-		memcpy(gpb_val,
-		       cdapMessage.obj_value_.message_,
-		       cdapMessage.obj_value_.size_);
-		gpb_obj_val->set_byteval(gpb_val,
-					 cdapMessage.obj_value_.size_);
-		gpfCDAPMessage.set_allocated_objvalue(gpb_obj_val);
+		gpfCDAPMessage.mutable_objvalue()->set_byteval(
+				cdapMessage.obj_value_.message_,
+				cdapMessage.obj_value_.size_);
 	}
 	// OP_CODE
-	if (!messages::opCode_t_IsValid(cdapMessage.op_code_)) {
-		throw CDAPException("Serializing Message: Not a valid OpCode");
-	}
 	gpfCDAPMessage.set_opcode((messages::opCode_t) cdapMessage.op_code_);
 	// RESULT
 	gpfCDAPMessage.set_result(cdapMessage.result_);
@@ -2906,10 +2956,15 @@ void GPBSerializer::serializeMessage(const cdap_m_t &cdapMessage,
 	// VERSION
 	gpfCDAPMessage.set_version(cdapMessage.version_);
 
+	// Serialize straight into the caller's buffer if it is big enough,
+	// reusing the sizes computed by ByteSize()
 	int size = gpfCDAPMessage.ByteSize();
-	result.message_ = new unsigned char[size];
+	if (!result.message_ || result.size_ < size) {
+		delete[] result.message_;
+		result.message_ = new unsigned char[size];
+	}
 	result.size_ = size;
-	gpfCDAPMessage.SerializeToArray(result.message_, size);
+	gpfCDAPMessage.SerializeWithCachedSizesToArray(result.message_);
 }
 
 class CDAPProvider : public CDAPProviderInterface
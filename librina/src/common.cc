@@ -858,6 +858,15 @@ IPCEvent * IPCEventProducer::eventWait()
 #endif
 }
 
+IPCEvent * IPCEventProducer::eventPoll()
+{
+#if STUB_API
+	return getIPCEvent();
+#else
+	return irati_ctrl_mgr->get_buffered_ctrl_msg();
+#endif
+}
+
 Singleton<IPCEventProducer> ipcEventProducer;
 
 /* CLASS IPC EXCEPTION */
@@ -22,6 +22,7 @@
 
 #include <sstream>
 #include <unistd.h>
+#include <string.h>
 
 #define RINA_PREFIX "librina.core"
 
@@ -55,6 +56,8 @@ IRATICtrlManager::IRATICtrlManager()
 	ctrl_port = 0;
 	cfd = 0;
 	next_seq_number = 1;
+	batched = false;
+	memset(&batch, 0, sizeof(batch));
 }
 
 void IRATICtrlManager::initialize()
@@ -70,6 +73,14 @@ void IRATICtrlManager::initialize()
 		exit(-1);
 	}
 
+	// Read several messages per syscall if the kernel supports it
+	if (irati_ctrl_batch_init(&batch, CTRL_BATCH_BUFFER_SIZE) == 0) {
+		if (irati_ctrl_set_batch(cfd, IRATI_CTRL_MODE_BATCH_READ) == 0)
+			batched = true;
+		else
+			irati_ctrl_batch_fini(&batch);
+	}
+
 	LOG_DBG("Initialized IRTI Ctrl Manager");
 }
 
@@ -96,6 +107,9 @@ IRATICtrlManager::~IRATICtrlManager()
 		LOG_ERR("Problems closing file descriptor %d in control device",
 			cfd);
 	}
+
+	if (batched)
+		irati_ctrl_batch_fini(&batch);
 }
 
 unsigned int IRATICtrlManager::get_next_seq_number()
@@ -661,15 +675,55 @@ IPCEvent * IRATICtrlManager::irati_ctrl_msg_to_ipc_event(struct irati_msg_base *
 IPCEvent * IRATICtrlManager::get_next_ctrl_msg()
 {
 	struct irati_msg_base * msg;
-	IPCEvent * event = 0;
 
-	msg = irati_read_next_msg(cfd);
+	if (batched) {
+		ScopedLock g(batch_lock);
+		msg = irati_read_next_msg_batch(cfd, &batch);
+	} else {
+		msg = irati_read_next_msg(cfd);
+	}
 	if (!msg) {
 		LOG_ERR("Could not retrieve next ctrl message for fd %d", cfd);
 		//TODO read errno
 		return 0;
 	}
 
+	return consume_ctrl_msg(msg);
+}
+
+IPCEvent * IRATICtrlManager::get_buffered_ctrl_msg()
+{
+	struct irati_msg_base * msg;
+
+	if (!batched)
+		return 0;
+
+	/* Another thread may be holding the lock while blocked reading the
+	 * next batch: in that case there is nothing buffered to return */
+	if (!batch_lock.trylock())
+		return 0;
+
+	if (!irati_ctrl_batch_pending(&batch)) {
+		batch_lock.unlock();
+		return 0;
+	}
+
+	/* Messages are pending, so this does not read from cfd */
+	msg = irati_read_next_msg_batch(cfd, &batch);
+	batch_lock.unlock();
+	if (!msg) {
+		LOG_ERR("Could not retrieve buffered ctrl message for fd %d",
+			cfd);
+		return 0;
+	}
+
+	return consume_ctrl_msg(msg);
+}
+
+IPCEvent * IRATICtrlManager::consume_ctrl_msg(struct irati_msg_base * msg)
+{
+	IPCEvent * event;
+
 	event = IRATICtrlManager::irati_ctrl_msg_to_ipc_event(msg);
 	if (event) {
 		LOG_DBG("Added event of type %s and sequence number %u to events queue",
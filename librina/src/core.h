@@ -31,9 +31,13 @@
 #include "librina/common.h"
 
 #include "irati/kernel-msg.h"
+#include "ctrl.h"
 
 #define WAIT_RESPONSE_TIMEOUT 10
 
+/** Initial size of the buffer for batched ctrl message reads */
+#define CTRL_BATCH_BUFFER_SIZE (64 * 1024)
+
 namespace rina {
 
 char * stringToCharArray(std::string s);
@@ -59,8 +63,20 @@ class IRATICtrlManager {
 	/** Linear sequence number generator */
 	unsigned int next_seq_number;
 
+	/** Messages read with a single syscall, not yet returned */
+	struct irati_ctrl_batch batch;
+
+	/** True if the control device hands out messages in batches */
+	bool batched;
+
+	/** The lock for the batch, held across blocking batch reads */
+	Lockable batch_lock;
+
 	unsigned int get_next_seq_number();
 
+	/** Converts msg to an event and frees it */
+	IPCEvent * consume_ctrl_msg(struct irati_msg_base * msg);
+
 public:
 	IRATICtrlManager();
 	~IRATICtrlManager();
@@ -77,6 +93,9 @@ public:
 
 	IPCEvent * get_next_ctrl_msg();
 
+	/** Returns an already read message, if any, without blocking */
+	IPCEvent * get_buffered_ctrl_msg();
+
 	static IPCEvent * irati_ctrl_msg_to_ipc_event(struct irati_msg_base *msg);
 
 	/**
@@ -40,10 +40,14 @@
 
 #define IRATI_MAX_CTRL_MSG_SIZE 1000000
 
+/* Messages up to this size are read without allocating a buffer */
+#define IRATI_CTRL_MSG_STACK_SIZE 8192
+
 struct irati_msg_base * irati_read_next_msg(int cfd)
 {
 	struct irati_msg_base *resp;
-	char * serbuf;
+	char stackbuf[IRATI_CTRL_MSG_STACK_SIZE];
+	char * serbuf = stackbuf;
 	uint32_t size;
 	int ret;
 
@@ -55,17 +59,20 @@ struct irati_msg_base * irati_read_next_msg(int cfd)
 
 	LOG_DBG("Trying to read ctrl msg of %u bytes", size);
 
-	serbuf = malloc(size);
-	if (!serbuf) {
-		LOG_ERR("Cannot allocate memory");
-		errno = ENOMEM;
-		return NULL;
+	if (size > sizeof(stackbuf)) {
+		serbuf = malloc(size);
+		if (!serbuf) {
+			LOG_ERR("Cannot allocate memory");
+			errno = ENOMEM;
+			return NULL;
+		}
 	}
 
 	ret = read(cfd, serbuf, size);
 	if (ret <= 0) {
 		LOG_ERR("read(cfd) returned %d", ret);
-		free(serbuf);
+		if (serbuf != stackbuf)
+			free(serbuf);
 		return NULL;
 	}
 
@@ -75,7 +82,8 @@ struct irati_msg_base * irati_read_next_msg(int cfd)
 	resp = (struct irati_msg_base *) deserialize_irati_msg(irati_ker_numtables,
 							       RINA_C_MAX,
 							       serbuf, ret);
-	free(serbuf);
+	if (serbuf != stackbuf)
+		free(serbuf);
 
 	if (!resp) {
 		LOG_ERR("Problems during deserialization [%d]\n", ret);
@@ -129,6 +137,185 @@ int irati_write_msg(int cfd, struct irati_msg_base *msg)
 	return ret;
 }
 
+int irati_ctrl_set_batch(int cfd, uint32_t flags)
+{
+	struct irati_ctrldev_mode mode;
+
+	mode.flags = flags;
+
+	return ioctl(cfd, IRATI_CTRL_MODE_SET, &mode);
+}
+
+int irati_ctrl_batch_init(struct irati_ctrl_batch *batch, size_t size)
+{
+	batch->buf = malloc(size);
+	if (!batch->buf) {
+		errno = ENOMEM;
+		return -1;
+	}
+
+	batch->size = size;
+	batch->len = 0;
+	batch->off = 0;
+
+	return 0;
+}
+
+void irati_ctrl_batch_fini(struct irati_ctrl_batch *batch)
+{
+	free(batch->buf);
+	batch->buf = NULL;
+	batch->size = batch->len = batch->off = 0;
+}
+
+/* Refills the batch with a single read(), growing the buffer if not
+ * even the first queued message fits in it. */
+static int irati_ctrl_batch_fill(int cfd, struct irati_ctrl_batch *batch)
+{
+	uint32_t size;
+	char *buf;
+	int ret;
+
+	for (;;) {
+		ret = read(cfd, batch->buf, batch->size);
+		if (ret > 0)
+			break;
+
+		if (ret == 0 || errno != ENOBUFS) {
+			LOG_ERR("read(cfd) returned %d", ret);
+			return -1;
+		}
+
+		ret = read(cfd, &size, 0);
+		if (ret <= 0) {
+			LOG_ERR("read(cfd) returned %d", ret);
+			return -1;
+		}
+
+		if (size > IRATI_MAX_CTRL_MSG_SIZE) {
+			LOG_ERR("Ctrl msg too long [%u]", size);
+			errno = EMSGSIZE;
+			return -1;
+		}
+
+		buf = realloc(batch->buf, size + sizeof(size));
+		if (!buf) {
+			LOG_ERR("Cannot allocate memory");
+			errno = ENOMEM;
+			return -1;
+		}
+		batch->buf = buf;
+		batch->size = size + sizeof(size);
+	}
+
+	LOG_DBG("Read ctrl msg batch of %d bytes from cfd %d", ret, cfd);
+
+	batch->len = ret;
+	batch->off = 0;
+
+	return 0;
+}
+
+struct irati_msg_base * irati_read_next_msg_batch(int cfd,
+						  struct irati_ctrl_batch *batch)
+{
+	struct irati_msg_base *resp;
+	uint32_t serlen;
+
+	if (batch->off >= batch->len && irati_ctrl_batch_fill(cfd, batch))
+		return NULL;
+
+	if (batch->len - batch->off < sizeof(serlen)) {
+		LOG_ERR("Truncated ctrl msg batch");
+		batch->off = batch->len;
+		errno = EPROTO;
+		return NULL;
+	}
+
+	memcpy(&serlen, batch->buf + batch->off, sizeof(serlen));
+	batch->off += sizeof(serlen);
+	if (serlen > batch->len - batch->off) {
+		LOG_ERR("Truncated ctrl msg in batch [%u]", serlen);
+		batch->off = batch->len;
+		errno = EPROTO;
+		return NULL;
+	}
+
+	resp = (struct irati_msg_base *) deserialize_irati_msg(irati_ker_numtables,
+							       RINA_C_MAX,
+							       batch->buf + batch->off,
+							       serlen);
+	batch->off += serlen;
+
+	if (!resp) {
+		LOG_ERR("Problems during deserialization [%u]\n", serlen);
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	return resp;
+}
+
+int irati_ctrl_batch_pending(const struct irati_ctrl_batch *batch)
+{
+	return batch->off < batch->len;
+}
+
+int irati_write_msgs(int cfd, struct irati_msg_base **msgs, unsigned int n)
+{
+	unsigned int i;
+	uint32_t serlen;
+	size_t total = 0;
+	size_t off = 0;
+	char * serbuf;
+	int ret;
+
+	for (i = 0; i < n; i++) {
+		serlen = irati_msg_serlen(irati_ker_numtables, RINA_C_MAX,
+					  msgs[i]);
+		if (serlen > IRATI_MAX_CTRL_MSG_SIZE) {
+			LOG_ERR("Serialized message would be too long [%u]\n",
+				serlen);
+			errno = EINVAL;
+			return -1;
+		}
+		total += sizeof(serlen) + serlen;
+	}
+
+	serbuf = malloc(total);
+	if (!serbuf) {
+		LOG_ERR("Cannot allocate memory");
+		errno = ENOMEM;
+		return -1;
+	}
+
+	for (i = 0; i < n; i++) {
+		serlen = serialize_irati_msg(irati_ker_numtables, RINA_C_MAX,
+					     serbuf + off + sizeof(serlen),
+					     msgs[i]);
+		memcpy(serbuf + off, &serlen, sizeof(serlen));
+		off += sizeof(serlen) + serlen;
+	}
+
+	ret = write(cfd, serbuf, off);
+	free(serbuf);
+	if (ret < 0) {
+		LOG_ERR("write(cfd)");
+		errno = EFAULT;
+	} else if (ret != off) {
+		/* The kernel stopped at a message it could not deliver */
+		LOG_ERR("Error: partial batch write [%d/%zu]\n", ret, off);
+		errno = EFAULT;
+		ret = -1;
+	} else {
+		ret = 0;
+	}
+
+	LOG_DBG("Wrote %u ctrl msgs, %zu bytes to cfd %d", n, off, cfd);
+
+	return ret;
+}
+
 int close_port(int cfd)
 {
 	return close(cfd);
@@ -25,12 +25,22 @@
 #ifndef LIBRINA_CTRL_H
 #define LIBRINA_CTRL_H
 
+#include <stddef.h>
+
 #include "irati/kucommon.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/* Serialized messages read from a control device in batch mode */
+struct irati_ctrl_batch {
+	char * buf;
+	size_t size;
+	size_t len;
+	size_t off;
+};
+
 struct irati_msg_base * irati_read_next_msg(int cfd);
 int irati_write_msg(int cfd, struct irati_msg_base *msg);
 int irati_open_ctrl_port(irati_msg_port_t port_id);
@@ -39,6 +49,16 @@ int close_port(int cfd);
 irati_msg_port_t get_app_ctrl_port_from_cfd(int cfd);
 int irati_open_io_port(int port_id);
 
+/* Batch modes, see IRATI_CTRL_MODE_BATCH_*. irati_read_next_msg() cannot
+ * be used in batch read mode, irati_write_msg() in batch write mode */
+int irati_ctrl_set_batch(int cfd, uint32_t flags);
+int irati_ctrl_batch_init(struct irati_ctrl_batch *batch, size_t size);
+void irati_ctrl_batch_fini(struct irati_ctrl_batch *batch);
+struct irati_msg_base * irati_read_next_msg_batch(int cfd,
+						  struct irati_ctrl_batch *batch);
+int irati_ctrl_batch_pending(const struct irati_ctrl_batch *batch);
+int irati_write_msgs(int cfd, struct irati_msg_base **msgs, unsigned int n);
+
 #ifdef __cplusplus
 }
 #endif
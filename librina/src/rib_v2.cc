@@ -25,9 +25,11 @@
 #include <inttypes.h>
 #include <stdbool.h>
 #include <unistd.h>
+#include <fnmatch.h>
 
 #include <algorithm>
 #include <map>
+#include <vector>
 #define RINA_PREFIX "rib"
 #include <librina/logs.h>
 //FIXME iostream is only for debuging purposes
@@ -37,6 +39,8 @@
 #include "librina/cdap_v2.h"
 #include "librina/security-manager.h"
 
+#include "CDAP.pb.h"
+
 namespace rina {
 namespace rib {
 
@@ -265,6 +269,393 @@ create_cb_t RIBSchema::get_create_callback(const std::string& class_,
 //fwd decl
 class RIBDaemon;
 
+/// Filter of the objects a scoped operation applies to. A filter is a
+/// list of predicates separated by ';', all of which must hold:
+///
+///     predicate := attribute ('=' | '!=') pattern
+///     attribute := "class" | "name"
+///
+/// where pattern is a shell wildcard pattern (fnmatch(3)) matched against
+/// the object class or fully qualified name, e.g.
+/// "class=Flow;name=/fa/flows/*"
+class RIBFilter {
+public:
+	RIBFilter() {};
+
+	/// Parse a filter expression, returns false if it is not valid
+	bool parse(const char* filter);
+
+	/// True if an object with class @class_name and name @fqn passes
+	/// the filter
+	bool matches(const std::string& class_name,
+		     const std::string& fqn) const;
+
+private:
+	struct predicate {
+		bool on_class;
+		bool negate;
+		std::string pattern;
+	};
+
+	std::list<predicate> predicates;
+};
+
+bool RIBFilter::parse(const char* filter)
+{
+	std::string expr;
+	std::string::size_type start = 0, end, op;
+
+	predicates.clear();
+	if (!filter)
+		return true;
+
+	expr = filter;
+	while (start < expr.size()) {
+		predicate pred;
+		std::string attr;
+
+		end = expr.find(';', start);
+		if (end == std::string::npos)
+			end = expr.size();
+
+		op = expr.find('=', start);
+		if (op == std::string::npos || op >= end || op == start)
+			return false;
+
+		pred.negate = (expr[op - 1] == '!');
+		attr = expr.substr(start, op - start - (pred.negate ? 1 : 0));
+		if (attr == "class")
+			pred.on_class = true;
+		else if (attr == "name")
+			pred.on_class = false;
+		else
+			return false;
+
+		pred.pattern = expr.substr(op + 1, end - op - 1);
+		predicates.push_back(pred);
+		start = end + 1;
+	}
+
+	return true;
+}
+
+bool RIBFilter::matches(const std::string& class_name,
+			const std::string& fqn) const
+{
+	std::list<predicate>::const_iterator it;
+	const std::string* value;
+
+	for (it = predicates.begin(); it != predicates.end(); ++it) {
+		value = it->on_class ? &class_name : &fqn;
+		if ((fnmatch(it->pattern.c_str(), value->c_str(), 0) == 0)
+				== it->negate)
+			return false;
+	}
+
+	return true;
+}
+
+/// Maximum size of the object values packed in a single reply to a
+/// batched read (F_RD_BATCH); the objects in scope are spread over as
+/// many replies as needed
+#define RIB_BATCHED_READ_MAX_SIZE 8192
+
+/// Storage of the objects of a RIB. The object records live in a single
+/// slab and are linked to their parent and siblings through slab indices,
+/// so no allocation is needed per object besides the object itself. Two
+/// open-addressing (linear probing) hash tables map fully qualified names
+/// and instance ids to slab indices.
+/// Not thread-safe: the RIB serializes accesses with its rwlock.
+class RIBObjStore {
+public:
+	RIBObjStore();
+
+	/// Add @obj, named @fqn and with instance id @id, as the last child
+	/// of the object @parent_id (-1 for the root object)
+	void add(RIBObj* obj, const std::string& fqn, int64_t id,
+		 int64_t parent_id);
+
+	/// Unlink the object with instance id @id (which must not have
+	/// children) and return it, or NULL if it does not exist
+	RIBObj* remove(int64_t id);
+
+	RIBObj* find(int64_t id) const;
+
+	/// Instance id of the object named @fqn, or -1
+	int64_t find_id(const std::string& fqn) const;
+
+	/// Name of the object with instance id @id, or NULL
+	const std::string* find_fqn(int64_t id) const;
+
+	bool has_children(int64_t id) const;
+
+	/// Slab traversal. Slot indices are -1 when there is no such slot;
+	/// free slots have a NULL object
+	int slot(int64_t id) const { return lookup_id(id); };
+	int first_child(int slot) const { return slab[slot].first_child; };
+	int next_sibling(int slot) const { return slab[slot].next_sibling; };
+	int64_t id_at(int slot) const { return slab[slot].id; };
+	RIBObj* obj_at(int slot) const { return slab[slot].obj; };
+	int slots() const { return slab.size(); };
+
+	unsigned int size() const { return count; };
+
+private:
+	struct record {
+		RIBObj* obj;
+		int64_t id;
+		std::string fqn;
+		uint64_t hash;
+		int parent;
+		int first_child;
+		int last_child;
+		int prev_sibling;
+		//Also used to chain free slots
+		int next_sibling;
+	};
+
+	enum { EMPTY = -1, TOMBSTONE = -2 };
+
+	std::vector<record> slab;
+	int free_head;
+	unsigned int count;
+
+	//Both indices hold the same slots and share their size, but
+	//tombstones are reused differently in each, so their number of
+	//used (live or tombstone) buckets is tracked separately
+	std::vector<int> name_index;
+	std::vector<int> id_index;
+	unsigned int name_used;
+	unsigned int id_used;
+
+	static uint64_t hash_name(const std::string& fqn);
+	static uint64_t hash_id(int64_t id);
+	int lookup_name(const std::string& fqn) const;
+	int lookup_id(int64_t id) const;
+	void index_insert(int slot);
+	void index_erase(int slot);
+	void rehash();
+};
+
+RIBObjStore::RIBObjStore() : free_head(-1), count(0), name_used(0),
+			     id_used(0)
+{
+	name_index.resize(64, EMPTY);
+	id_index.resize(64, EMPTY);
+}
+
+uint64_t RIBObjStore::hash_name(const std::string& fqn)
+{
+	//FNV-1a
+	uint64_t h = 14695981039346656037ULL;
+
+	for (std::string::size_type i = 0; i < fqn.size(); i++) {
+		h ^= (unsigned char) fqn[i];
+		h *= 1099511628211ULL;
+	}
+
+	return h;
+}
+
+uint64_t RIBObjStore::hash_id(int64_t id)
+{
+	//splitmix64 finalizer, ids are mostly consecutive
+	uint64_t h = (uint64_t) id;
+
+	h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+
+	return h ^ (h >> 31);
+}
+
+int RIBObjStore::lookup_name(const std::string& fqn) const
+{
+	uint64_t hash = hash_name(fqn);
+	size_t mask = name_index.size() - 1;
+	size_t i = hash & mask;
+	int s;
+
+	while ((s = name_index[i]) != EMPTY) {
+		if (s >= 0 && slab[s].hash == hash && slab[s].fqn == fqn)
+			return s;
+		i = (i + 1) & mask;
+	}
+
+	return -1;
+}
+
+int RIBObjStore::lookup_id(int64_t id) const
+{
+	size_t mask = id_index.size() - 1;
+	size_t i = hash_id(id) & mask;
+	int s;
+
+	while ((s = id_index[i]) != EMPTY) {
+		if (s >= 0 && slab[s].id == id)
+			return s;
+		i = (i + 1) & mask;
+	}
+
+	return -1;
+}
+
+void RIBObjStore::index_insert(int slot)
+{
+	size_t mask = name_index.size() - 1;
+	size_t i;
+
+	i = slab[slot].hash & mask;
+	while (name_index[i] >= 0)
+		i = (i + 1) & mask;
+	if (name_index[i] == EMPTY)
+		name_used++;
+	name_index[i] = slot;
+
+	i = hash_id(slab[slot].id) & mask;
+	while (id_index[i] >= 0)
+		i = (i + 1) & mask;
+	if (id_index[i] == EMPTY)
+		id_used++;
+	id_index[i] = slot;
+}
+
+void RIBObjStore::index_erase(int slot)
+{
+	size_t mask = name_index.size() - 1;
+	size_t i;
+
+	i = slab[slot].hash & mask;
+	while (name_index[i] != slot)
+		i = (i + 1) & mask;
+	name_index[i] = TOMBSTONE;
+
+	i = hash_id(slab[slot].id) & mask;
+	while (id_index[i] != slot)
+		i = (i + 1) & mask;
+	id_index[i] = TOMBSTONE;
+}
+
+void RIBObjStore::rehash()
+{
+	size_t capacity = name_index.size();
+
+	//Keep the load factor (tombstones excluded) below 1/2
+	while ((count + 1) * 2 > capacity)
+		capacity *= 2;
+
+	name_index.assign(capacity, EMPTY);
+	id_index.assign(capacity, EMPTY);
+	name_used = id_used = 0;
+	for (int s = 0; s < (int) slab.size(); s++) {
+		if (slab[s].obj)
+			index_insert(s);
+	}
+}
+
+void RIBObjStore::add(RIBObj* obj, const std::string& fqn, int64_t id,
+		      int64_t parent_id)
+{
+	int parent = parent_id < 0 ? -1 : lookup_id(parent_id);
+	int s;
+
+	//Tombstones count too, or lookups would never hit an EMPTY
+	//bucket after enough add/remove churn. Rehash before the new slot
+	//is filled in, so that it is only indexed once
+	if ((std::max(name_used, id_used) + 1) * 2 > name_index.size())
+		rehash();
+
+	if (free_head != -1) {
+		s = free_head;
+		free_head = slab[s].next_sibling;
+	} else {
+		s = slab.size();
+		slab.push_back(record());
+	}
+
+	record& r = slab[s];
+	r.obj = obj;
+	r.id = id;
+	r.fqn = fqn;
+	r.hash = hash_name(fqn);
+	r.parent = parent;
+	r.first_child = r.last_child = -1;
+	r.next_sibling = -1;
+	r.prev_sibling = -1;
+
+	if (parent != -1) {
+		r.prev_sibling = slab[parent].last_child;
+		if (r.prev_sibling != -1)
+			slab[r.prev_sibling].next_sibling = s;
+		else
+			slab[parent].first_child = s;
+		slab[parent].last_child = s;
+	}
+
+	index_insert(s);
+	count++;
+}
+
+RIBObj* RIBObjStore::remove(int64_t id)
+{
+	int s = lookup_id(id);
+	RIBObj* obj;
+
+	if (s < 0)
+		return NULL;
+
+	record& r = slab[s];
+	if (r.parent != -1) {
+		if (r.prev_sibling != -1)
+			slab[r.prev_sibling].next_sibling = r.next_sibling;
+		else
+			slab[r.parent].first_child = r.next_sibling;
+		if (r.next_sibling != -1)
+			slab[r.next_sibling].prev_sibling = r.prev_sibling;
+		else
+			slab[r.parent].last_child = r.prev_sibling;
+	}
+
+	index_erase(s);
+	obj = r.obj;
+	r.obj = NULL;
+	r.id = -1;
+	r.hash = 0;
+	r.fqn.clear();
+	r.next_sibling = free_head;
+	free_head = s;
+	count--;
+
+	return obj;
+}
+
+RIBObj* RIBObjStore::find(int64_t id) const
+{
+	int s = lookup_id(id);
+
+	return s < 0 ? NULL : slab[s].obj;
+}
+
+int64_t RIBObjStore::find_id(const std::string& fqn) const
+{
+	int s = lookup_name(fqn);
+
+	return s < 0 ? -1 : slab[s].id;
+}
+
+const std::string* RIBObjStore::find_fqn(int64_t id) const
+{
+	int s = lookup_id(id);
+
+	return s < 0 ? NULL : &slab[s].fqn;
+}
+
+bool RIBObjStore::has_children(int64_t id) const
+{
+	int s = lookup_id(id);
+
+	return s >= 0 && slab[s].first_child != -1;
+}
+
 /// A simple RIB implementation, based on a hashtable of RIB objects
 /// indexed by object name
 class RIB {
@@ -414,20 +805,8 @@ protected:
 			const int invoke_id);
 private:
 
-	// fqn <-> obj
-	std::map<std::string, RIBObj*> obj_name_map;
-
-	// instance id <-> obj
-	std::map<int64_t, RIBObj*> obj_inst_map;
-
-	// instance id <-> fqn
-	std::map<int64_t, std::string> inst_name_map;
-
-	// fqn <-> instance id
-	std::map<std::string, int64_t> name_inst_map;
-
-	// Children map instance id <-> std<int64_t> children
-	std::map<int64_t, std::list<int64_t>*> obj_inst_child_map;
+	// Objects, indexed by fqn and instance id
+	RIBObjStore objs;
 
 	// delegation cache: fqn <-> inst id
 	std::map<std::string, int64_t> deleg_cache;
@@ -455,10 +834,16 @@ private:
 
 	void get_objects_to_operate(const int64_t object_id,
 				    int scope,
-				    char* filter,
+				    const RIBFilter& filter,
 				    std::list<std::pair<int, RIBObj*> >
 	                            &objects);
 
+	void send_read_batch(const cdap_rib::con_handle_t &con,
+			     const cdap_rib::obj_info_t &obj,
+			     messages::objList_t &batch,
+			     cdap_rib::flags_t::Flags flags,
+			     const int invoke_id);
+
 	//return 0 if operation is allowed, negative number otherwise
 	void check_operation_allowed(const cdap_rib::auth_policy_t & auth,
 				     const cdap_rib::con_handle_t & con,
@@ -516,28 +901,21 @@ RIB::RIB(const rib_handle_t& handle_,
 	root_fqn << schema->get_root_name() << schema->get_separator();
 
 	// Fill in the stuf
-	obj_name_map[root_fqn.str()] = root;
-	obj_inst_map[RIB_ROOT_INST_ID] = root;
-	inst_name_map[RIB_ROOT_INST_ID] = root_fqn.str();
-	name_inst_map[root_fqn.str()] = RIB_ROOT_INST_ID;
-	std::list<int64_t>* child_list = new std::list<int64_t>();
-	obj_inst_child_map[RIB_ROOT_INST_ID] = child_list;
+	objs.add(root, root_fqn.str(), RIB_ROOT_INST_ID, -1);
 	security_m = sec_man;
 }
 
 RIB::~RIB() {
-	std::list<int64_t> *child_list;
-	int64_t inst_id;
 	RIBObj* obj;
-	std::map<int64_t, RIBObj*>::iterator it;
 
 	//Mutual exclusion
 	WriteScopedLock wlock(rwlock);
 
 	//Remove objects
-	for(it = obj_inst_map.begin(); it != obj_inst_map.end(); it++){
-		inst_id = it->first;
-		obj = it->second;
+	for (int s = 0; s < objs.slots(); s++) {
+		obj = objs.obj_at(s);
+		if (!obj)
+			continue;
 
 		//If there, remove from the cache
 		if(obj->delegates){
@@ -545,17 +923,6 @@ RIB::~RIB() {
 			deleg_cache.clear();
 			num_of_deleg--;
 		}
-		try{
-			child_list = obj_inst_child_map[inst_id];
-		}catch(...){
-			LOG_ERR("Unable to recover the children list/parent"
-				"children list for object '" PRId64 "';"
-				"corrupted internal state!",inst_id);
-			continue;
-		}
-		if (child_list != NULL){
-			delete child_list;
-		}
 		delete obj;
 	}
 
@@ -815,6 +1182,12 @@ void RIB::read_request(const cdap_rib::con_handle_t &con,
 	cdap_rib::res_info_t res;
 	std::list<std::pair <int, RIBObj*> > objects;
         RIBObj* rib_obj = NULL;
+	RIBFilter filter;
+	bool batch = (flags.flags_ == cdap_rib::flags_t::F_RD_BATCH &&
+		      invoke_id != 0);
+	messages::objList_t batch_objs;
+	int batch_size = 0;
+	std::vector<int64_t> batch_ids;
 
 	check_operation_allowed(auth,
 			        con,
@@ -822,6 +1195,12 @@ void RIB::read_request(const cdap_rib::con_handle_t &con,
 				obj.name_,
 				res);
 
+	if (res.code_ == cdap_rib::CDAP_SUCCESS &&
+			!filter.parse(filt.filter_)) {
+		res.code_ = cdap_rib::CDAP_ERROR;
+		res.reason_ = "Invalid filter";
+	}
+
 	if (res.code_ != cdap_rib::CDAP_SUCCESS) {
 		try {
 			cdap_provider->send_read_result(con,
@@ -848,13 +1227,30 @@ void RIB::read_request(const cdap_rib::con_handle_t &con,
 		//Get all objects affected by the operation
 		get_objects_to_operate(id,
 				       filt.scope_,
-				       filt.filter_,
+				       filter,
 				       objects);
+
+		//Batch entries carry the instance id of each object
+		if (batch) {
+			std::list<std::pair<int, RIBObj*> >::iterator oit;
+			for (oit = objects.begin(); oit != objects.end(); ++oit)
+				batch_ids.push_back(
+					objs.find_id(oit->second->fqn));
+		}
 	} //RAII
 
 	if(objects.size() == 0){
-		if (invoke_id != 0) {
-			res.code_ = cdap_rib::CDAP_INVALID_OBJ;
+		if (batch && rib_obj) {
+			//Nothing matched the filter: an empty last batch
+			send_read_batch(con,
+					obj,
+					batch_objs,
+					cdap_rib::flags_t::NONE_FLAGS,
+					invoke_id);
+		} else if (invoke_id != 0) {
+			//Only an error if the base object does not exist
+			if (!rib_obj)
+				res.code_ = cdap_rib::CDAP_INVALID_OBJ;
 
 			try {
 				cdap_provider->send_read_result(con,
@@ -881,6 +1277,15 @@ void RIB::read_request(const cdap_rib::con_handle_t &con,
 		//Mutual exclusion
 		ReadScopedLock rlock(rib_obj->rwlock, false);
 
+		if (batch) {
+			//Do not carry over results of the previous object
+			res.code_ = cdap_rib::CDAP_SUCCESS;
+			res.reason_.clear();
+			delete[] obj_reply.value_.message_;
+			obj_reply.value_.message_ = NULL;
+			obj_reply.value_.size_ = 0;
+		}
+
 		rib_obj->read(con,
 			      obj.name_,
 			      obj.class_,
@@ -892,9 +1297,11 @@ void RIB::read_request(const cdap_rib::con_handle_t &con,
 		if (res.code_ == cdap_rib::CDAP_PENDING || invoke_id == 0)
 			continue;
 
-		// If the object is delegated
+		// If the object is delegated. Batched reads do not descend
+		// into delegated subtrees: the delegation object is returned
+		// like any other, and its subtree has to be read separately
 		int delegate = false;
-		if(rib_obj->delegates)
+		if(rib_obj->delegates && !batch)
 		{
 		        int rem_scope = filt.scope_ - it->first;
 		        delegate = true;
@@ -937,7 +1344,30 @@ void RIB::read_request(const cdap_rib::con_handle_t &con,
 		        }
 		}
 
-		if(!delegate)
+		if (!delegate && batch) {
+			messages::objListEntry_t *entry =
+					batch_objs.add_objects();
+
+			entry->set_objclass(rib_obj->get_class());
+			entry->set_objname(rib_obj->fqn);
+			entry->set_objinst(batch_ids[count - 1]);
+			entry->set_result(res.code_);
+			if (obj_reply.value_.size_ > 0) {
+				entry->set_objvalue(obj_reply.value_.message_,
+						    obj_reply.value_.size_);
+				batch_size += obj_reply.value_.size_;
+			}
+			batch_size += rib_obj->fqn.size();
+
+			if (batch_size >= RIB_BATCHED_READ_MAX_SIZE) {
+				send_read_batch(con,
+						obj,
+						batch_objs,
+						cdap_rib::flags_t::F_RD_INCOMPLETE,
+						invoke_id);
+				batch_size = 0;
+			}
+		} else if(!delegate)
 		{
 			if (count == objects.size())
 			{
@@ -968,11 +1398,20 @@ void RIB::read_request(const cdap_rib::con_handle_t &con,
 					invoke_id,
 					e.what());
 			}
-		} else
+		} else if (delegate)
 		{
 				delegated_objs.push_back((DelegationObj*) rib_obj);
 		}
 	}
+
+	if (batch) {
+		//Close the read with the last batch (possibly empty)
+		send_read_batch(con,
+				obj,
+				batch_objs,
+				cdap_rib::flags_t::NONE_FLAGS,
+				invoke_id);
+	}
 }
 
 void RIB::cancel_read_request(const cdap_rib::con_handle_t &con,
@@ -1297,51 +1736,83 @@ void RIB::stop_request(const cdap_rib::con_handle_t &con,
 
 void RIB::get_objects_to_operate(const int64_t object_id,
 			         int scope,
-			         char * filter,
+			         const RIBFilter& filter,
 			         std::list<std::pair<int, RIBObj*> >
 			         &objects)
 {
-	std::list<int64_t> *child_list = NULL;
 	RIBObj *rib_obj = NULL;
+	int slot;
 
-	rib_obj = get_obj(object_id);
-	if (!rib_obj)
+	slot = objs.slot(object_id);
+	if (slot < 0)
 		return;
-	//TODO apply filter
+	rib_obj = objs.obj_at(slot);
 
-	//Acquire the read lock over the object (make sure it is not
-	//deleted while we process the operation)
-	rib_obj->rwlock.readlock();
-	std::pair<int, RIBObj*> pair (scope, rib_obj);
-	objects.push_back(pair);
+	//Objects filtered out are skipped, but their children are still
+	//part of the scope
+	if (filter.matches(rib_obj->get_class(), rib_obj->fqn)) {
+		//Acquire the read lock over the object (make sure it is not
+		//deleted while we process the operation)
+		rib_obj->rwlock.readlock();
+		std::pair<int, RIBObj*> pair (scope, rib_obj);
+		objects.push_back(pair);
+	}
 
 	if (scope == 0)
 		return;
 
-	child_list = obj_inst_child_map[object_id];
-	if (!child_list || child_list->size() == 0)
-		return;
-
-	std::list<int64_t>::const_iterator it;
-	for(it = child_list->begin(); it != child_list->end(); ++it)
-		get_objects_to_operate(*it,
+	for (int c = objs.first_child(slot); c != -1; c = objs.next_sibling(c))
+		get_objects_to_operate(objs.id_at(c),
 				       scope - 1,
 				       filter,
 				       objects);
 }
 
+void RIB::send_read_batch(const cdap_rib::con_handle_t &con,
+			  const cdap_rib::obj_info_t &obj,
+			  messages::objList_t &batch,
+			  cdap_rib::flags_t::Flags flags,
+			  const int invoke_id)
+{
+	cdap_rib::obj_info_t obj_reply;
+	cdap_rib::flags_t flags_r;
+	cdap_rib::res_info_t res;
+
+	obj_reply.name_ = obj.name_;
+	obj_reply.class_ = obj.class_;
+	obj_reply.inst_ = obj.inst_;
+	obj_reply.value_.size_ = batch.ByteSize();
+	obj_reply.value_.message_ = new unsigned char[obj_reply.value_.size_];
+	batch.SerializeToArray(obj_reply.value_.message_,
+			       obj_reply.value_.size_);
+	flags_r.flags_ = flags;
+
+	try {
+		LOG_DBG("Sending batched read result for object %s with "
+			"%d objects and flags %d",
+			obj.name_.c_str(),
+			batch.objects_size(),
+			flags);
+		cdap_provider->send_read_result(con,
+						obj_reply,
+						flags_r,
+						res,
+						invoke_id);
+	} catch (Exception &e) {
+		LOG_ERR("Unable to send response for invoke id %d, problem was: %s",
+			invoke_id,
+			e.what());
+	}
+
+	batch.Clear();
+}
+
 RIBObj* RIB::get_obj(int64_t inst_id){
-	if(obj_inst_map.find(inst_id) != obj_inst_map.end())
-		return obj_inst_map[inst_id];
-	else
-		return NULL;
+	return objs.find(inst_id);
 }
 
 int64_t RIB::__get_obj_inst_id(const std::string& fqn){
-	int64_t id = -1;
-
-	if(name_inst_map.find(fqn) != name_inst_map.end())
-		id = name_inst_map[fqn];
+	int64_t id = objs.find_id(fqn);
 
 	//If there are delegated objects
 	//Note: this block of code is specially polluted by RAII
@@ -1366,8 +1837,7 @@ int64_t RIB::__get_obj_inst_id(const std::string& fqn){
 		std::string root_name = __get_obj_fqn(0);
 		do{
 			tmp = get_parent_fqn(tmp);
-			if(name_inst_map.find(tmp) != name_inst_map.end())
-				id = name_inst_map[tmp];
+			id = objs.find_id(tmp);
 			if(id >= 0 || tmp == root_name)
 				break;
 		}while(1);
@@ -1396,12 +1866,9 @@ int64_t RIB::__get_obj_inst_id(const std::string& fqn){
 }
 
 std::string RIB::__get_obj_fqn(const int64_t inst_id) {
-	std::string fqn("");
+	const std::string* fqn = objs.find_fqn(inst_id);
 
-	if(inst_name_map.find(inst_id) != inst_name_map.end())
-		fqn = inst_name_map[inst_id];
-
-	return fqn;
+	return fqn ? *fqn : std::string("");
 }
 
 int64_t RIB::get_new_inst_id(){
@@ -1417,7 +1884,7 @@ int64_t RIB::get_new_inst_id(){
 		if(curr < 0)
 			curr = next_inst_id;
 
-		if(obj_inst_map.find(next_inst_id) == obj_inst_map.end())
+		if(!objs.find(next_inst_id))
 			break;
 	}
 	return next_inst_id;
@@ -1497,19 +1964,12 @@ int64_t RIB::add_obj(const std::string& fqn, RIBObj** obj_) {
 		throw eObjExists();
 	}
 
-	//Allocate space
-	std::list<int64_t>* child_list = new std::list<int64_t>();
-
 	//get a (free) instance id
 	id = get_new_inst_id();
 	obj->parent_inst_id = parent_id;
 
-	//Add it and return
-	obj_name_map[fqn] = obj;
-	obj_inst_map[id] = obj;
-	inst_name_map[id] = fqn;
-	name_inst_map[fqn] = id;
-	obj_inst_child_map[id] = child_list;
+	//Add it (as the last of the parent's children) and return
+	objs.add(obj, fqn, id, parent_id);
 
 	if(obj->delegates){
 		//Increase counter number of num_of_deleg
@@ -1518,20 +1978,6 @@ int64_t RIB::add_obj(const std::string& fqn, RIBObj** obj_) {
 		deleg_cache.clear();
 	}
 
-	//Recover parent's children list  and add ourselves
-	std::list<int64_t>* parent_child_list;
-	try{
-		parent_child_list = obj_inst_child_map[parent_id];
-		if(parent_child_list == NULL)
-			throw Exception();
-	}catch(...){
-		LOG_ERR("Unable to recover the children list for object '" PRId64  "'; corrupted internal state!",
-						parent_id);
-		assert(0);
-		throw Exception("Corrupted internal state");
-	}
-	parent_child_list->push_back(id);
-
 	LOG_DBG("Add object operation over RIB(%p), of object(%p) with fqn: '%s', succeeded. Instance id: '%" PRId64 "'",
 								this,
 								obj,
@@ -1547,9 +1993,6 @@ int64_t RIB::add_obj(const std::string& fqn, RIBObj** obj_) {
 void RIB::__remove_obj(int64_t inst_id) {
 
 	RIBObj* obj;
-	std::list<int64_t> *child_list = NULL, *parent_child_list = NULL;
-	std::list<int64_t>::iterator it;
-	int64_t parent_inst_id;
 
 	//Mutual exclusion
 	WriteScopedLock wlock(rwlock);
@@ -1569,53 +2012,21 @@ void RIB::__remove_obj(int64_t inst_id) {
 
 
 
-	parent_inst_id = obj->parent_inst_id;
-
 	//Check first if it has children
-	try{
-		child_list = obj_inst_child_map[inst_id];
-		if(child_list == NULL)
-			throw Exception();
-		parent_child_list = obj_inst_child_map[parent_inst_id];
-		if(parent_child_list == NULL)
-			throw Exception();
-	}catch(...){
-		LOG_ERR("Unable to recover the children list/parent children list for object '" PRId64  "'; corrupted internal state!",
-							inst_id);
-		assert(0);
-		throw Exception("Corrupted internal state");
-	}
-
-	if(child_list->size() > 0){
+	if(objs.has_children(inst_id)){
 		LOG_ERR("Unable to remove object '" PRId64  "'; the object has children",
 							inst_id);
 		throw eObjHasChildren();
 	}
 
-	//Check if we are in the parent's child list
-	it = std::find(parent_child_list->begin(), parent_child_list->end(),
-								inst_id);
-	if(it == parent_child_list->end()){
-		LOG_ERR("Parent's children list does not contain object '" PRId64  "'; corrupted internal state!",
-							inst_id);
-		throw Exception("Corrupted internal state");
-	}
-
-	//Remove from the maps
+	//Remove from the store (and from the parent's children)
 	std::string fqn = __get_obj_fqn(inst_id);
 
 	LOG_DBG("Removing object over RIB(%p) instance id: '%" PRId64 "' fqn: '%s'",
 								this,
 								inst_id,
 								fqn.c_str());
-	obj_inst_map.erase(inst_id);
-	inst_name_map.erase(inst_id);
-	name_inst_map.erase(fqn);
-	obj_name_map.erase(fqn);
-	obj_inst_child_map.erase(inst_id);
-
-	//Remove ourselves from the parent's children list
-	parent_child_list->erase(it);
+	objs.remove(inst_id);
 
 	//If there Remove from the cache
 	if(obj->delegates){
@@ -1632,7 +2043,6 @@ void RIB::__remove_obj(int64_t inst_id) {
 
 	//Delete object
 	delete obj;
-	delete child_list;
 }
 
 char RIB::get_separator() const {
@@ -1675,6 +2085,12 @@ const cdap_rib::vers_info_t& RIB::get_version() const {
 	return schema->get_version();
 }
 
+static bool compare_object_data_name(const RIBObjectData& a,
+				     const RIBObjectData& b)
+{
+	return a.name_ < b.name_;
+}
+
 std::list<RIBObjectData> RIB::get_all_rib_objects_data(
 		const std::string& class_,
 		const std::string& name)
@@ -1683,19 +2099,24 @@ std::list<RIBObjectData> RIB::get_all_rib_objects_data(
 	RIBObjectData data;
 	unsigned n = name.size();
 
-	for (std::map<std::string, RIBObj*>::iterator it = obj_name_map.begin();
-			it != obj_name_map.end(); ++it) {
-		data = it->second->get_object_data();
+	ReadScopedLock rlock(rwlock);
+
+	for (int s = 0; s < objs.slots(); s++) {
+		if (!objs.obj_at(s))
+			continue;
+		data = objs.obj_at(s)->get_object_data();
 		if (class_.size() && class_ != data.class_)
 			continue;
 		if (n && (name[n-1] == '/' ? data.name_.compare(0, n, name)
 					   : data.name_ != name))
 			continue;
-		if (it->first != "/")
-			data.instance_ = __get_obj_inst_id(data.name_);
+		data.instance_ = objs.id_at(s);
 		result.push_back(data);
 	}
 
+	//Slab order is not meaningful, return the objects sorted by name
+	result.sort(compare_object_data_name);
+
 	return result;
 }
 
@@ -3728,6 +4149,61 @@ void RIBOpsRespHandler::operation_not_supported() {
 	LOG_WARN("Operation not supported");
 }
 
+/* Class BatchedReadResult */
+BatchedReadResult::BatchedReadResult(const ser_obj_t &value)
+{
+	messages::objList_t batch;
+
+	if (!batch.ParseFromArray(value.message_, value.size_))
+		throw Exception("Not a batched read result");
+
+	entries.resize(batch.objects_size());
+	for (int i = 0; i < batch.objects_size(); i++) {
+		const messages::objListEntry_t &gpb = batch.objects(i);
+
+		entries[i].class_ = gpb.objclass();
+		entries[i].name_ = gpb.objname();
+		entries[i].inst_ = gpb.objinst();
+		entries[i].result_ = gpb.result();
+		entries[i].value_ = gpb.objvalue();
+	}
+}
+
+unsigned int BatchedReadResult::size() const
+{
+	return entries.size();
+}
+
+const std::string& BatchedReadResult::get_class(unsigned int i) const
+{
+	return entries.at(i).class_;
+}
+
+const std::string& BatchedReadResult::get_name(unsigned int i) const
+{
+	return entries.at(i).name_;
+}
+
+int64_t BatchedReadResult::get_instance(unsigned int i) const
+{
+	return entries.at(i).inst_;
+}
+
+cdap_rib::res_code_t BatchedReadResult::get_result(unsigned int i) const
+{
+	return (cdap_rib::res_code_t) entries.at(i).result_;
+}
+
+void BatchedReadResult::get_value(unsigned int i, ser_obj_t &value) const
+{
+	const std::string &bytes = entries.at(i).value_;
+
+	delete[] value.message_;
+	value.size_ = bytes.size();
+	value.message_ = new unsigned char[value.size_];
+	memcpy(value.message_, bytes.data(), value.size_);
+}
+
 /* Class RIBObjectData*/
 RIBObjectData::RIBObjectData(){
         instance_ = 0;
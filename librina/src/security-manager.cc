@@ -20,14 +20,21 @@
 //
 
 #include <cstdlib>
+#include <sys/stat.h>
 #include <openssl/bio.h>
 #include <openssl/err.h>
+#include <openssl/evp.h>
 #include <openssl/md5.h>
 #include <openssl/pem.h>
 #include <openssl/rand.h>
 #include <openssl/sha.h>
 #include <openssl/ssl.h>
 
+// X25519 needs the raw public key API introduced in OpenSSL 1.1.1
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L
+#define SSH2_HAVE_X25519
+#endif
+
 #define RINA_PREFIX "librina.security-manager"
 
 #include "librina/logs.h"
@@ -710,6 +717,7 @@ const std::string SSH2SecurityContext::KEYSTORE_PASSWORD = "keystorePass";
 const std::string SSH2SecurityContext::KEY = "key";
 const std::string SSH2SecurityContext::PUBLIC_KEY = "public_key";
 const std::string SSH2SecurityContext::KNOWN_IPCPS = "known_ipcps";
+const std::string SSH2SecurityContext::KEY_EXCH_X25519 = "X25519";
 
 SSH2SecurityContext::~SSH2SecurityContext()
 {
@@ -723,6 +731,16 @@ SSH2SecurityContext::~SSH2SecurityContext()
 		dh_peer_pub_key = NULL;
 	}
 
+	if (ecdh_state) {
+		EVP_PKEY_free(ecdh_state);
+		ecdh_state = NULL;
+	}
+
+	if (ecdh_peer_pub_key) {
+		EVP_PKEY_free(ecdh_peer_pub_key);
+		ecdh_peer_pub_key = NULL;
+	}
+
 	if (auth_keypair) {
 		RSA_free(auth_keypair);
 		auth_keypair = NULL;
@@ -768,6 +786,9 @@ SSH2SecurityContext::SSH2SecurityContext(int session_id,
 		: ISecurityContext(session_id, IAuthPolicySet::AUTH_SSH2)
 {
 	key_exch_alg = profile.authPolicy.get_param_value_as_string(KEY_EXCHANGE_ALGORITHM);
+	if (key_exch_alg == std::string()) {
+		key_exch_alg = SSL_TXT_EDH;
+	}
 	encrypt_alg = profile.encryptPolicy.get_param_value_as_string(ENCRYPTION_ALGORITHM);
 	mac_alg = profile.encryptPolicy.get_param_value_as_string(MAC_ALGORITHM);
 	compress_alg = profile.encryptPolicy.get_param_value_as_string(COMPRESSION_ALGORITHM);
@@ -786,6 +807,8 @@ SSH2SecurityContext::SSH2SecurityContext(int session_id,
 
 	dh_peer_pub_key = NULL;
 	dh_state = NULL;
+	ecdh_peer_pub_key = NULL;
+	ecdh_state = NULL;
 	auth_keypair = NULL;
 	auth_peer_pub_key = NULL;
 	timer_task = NULL;
@@ -800,7 +823,11 @@ SSH2SecurityContext::SSH2SecurityContext(int session_id,
 		: ISecurityContext(session_id, IAuthPolicySet::AUTH_SSH2)
 {
 	std::string option = options->key_exch_algs.front();
+#ifdef SSH2_HAVE_X25519
+	if (option != SSL_TXT_EDH && option != KEY_EXCH_X25519) {
+#else
 	if (option != SSL_TXT_EDH) {
+#endif
 		LOG_ERR("Unsupported key exchange algorithm: %s",
 			option.c_str());
 		throw Exception();
@@ -852,6 +879,8 @@ SSH2SecurityContext::SSH2SecurityContext(int session_id,
 
 	dh_peer_pub_key = NULL;
 	dh_state = NULL;
+	ecdh_peer_pub_key = NULL;
+	ecdh_state = NULL;
 	auth_keypair = NULL;
 	auth_peer_pub_key = NULL;
 	timer_task = NULL;
@@ -893,6 +922,296 @@ void DH_get0_pqg(const DH *dh, const BIGNUM **p,
 }
 #endif
 
+//Class SSH2KeyPair
+SSH2KeyPair::~SSH2KeyPair()
+{
+	if (dh) {
+		DH_free(dh);
+		dh = NULL;
+	}
+
+	if (pkey) {
+		EVP_PKEY_free(pkey);
+		pkey = NULL;
+	}
+}
+
+//Class SSH2KeyPairWorker
+SSH2KeyPairWorker::SSH2KeyPairWorker(ThreadAttributes * threadAttributes,
+				     SSH2KeyPairPool * pool_)
+	: SimpleThread(threadAttributes)
+{
+	pool = pool_;
+}
+
+int SSH2KeyPairWorker::run()
+{
+	pool->work();
+	return 0;
+}
+
+//Class SSH2KeyPairPool
+//Older OpenSSL versions are not thread safe unless the application
+//installs locking callbacks, so key pairs are generated on demand there
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+const int SSH2KeyPairPool::DEFAULT_WORKERS = 2;
+#else
+const int SSH2KeyPairPool::DEFAULT_WORKERS = 0;
+#endif
+const int SSH2KeyPairPool::DEFAULT_DEPTH = 4;
+
+SSH2KeyPairPool::SSH2KeyPairPool() : ConditionVariable()
+{
+	dh_parameters = NULL;
+	workers = DEFAULT_WORKERS;
+	depth = DEFAULT_DEPTH;
+	running = false;
+	stopping = false;
+}
+
+SSH2KeyPairPool::~SSH2KeyPairPool() throw()
+{
+	stop();
+}
+
+void SSH2KeyPairPool::set_dh_parameters(DH * params)
+{
+	lock();
+	dh_parameters = params;
+	unlock();
+}
+
+void SSH2KeyPairPool::set_workers(int w)
+{
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+	if (w > 0) {
+		LOG_WARN("OpenSSL version too old for key pair workers, "
+			 "key pairs will be generated on demand");
+		w = 0;
+	}
+#endif
+	//Workers are restarted with the new setting on next use
+	stop();
+	lock();
+	workers = w;
+	unlock();
+}
+
+void SSH2KeyPairPool::set_depth(int d)
+{
+	lock();
+	depth = d;
+	broadcast();
+	unlock();
+}
+
+//Called with the lock held
+void SSH2KeyPairPool::start()
+{
+	ThreadAttributes thread_attrs;
+	SSH2KeyPairWorker * worker;
+
+	running = true;
+	thread_attrs.setJoinable();
+	for (int i = 0; i < workers; i++) {
+		worker = new SSH2KeyPairWorker(&thread_attrs, this);
+		try {
+			worker->start();
+		} catch (ConcurrentException &e) {
+			LOG_ERR("Problems starting key pair worker: %s",
+				e.what());
+			delete worker;
+			break;
+		}
+		threads.push_back(worker);
+	}
+
+	LOG_DBG("Started %d key pair workers", (int) threads.size());
+}
+
+void SSH2KeyPairPool::stop()
+{
+	std::list<SSH2KeyPairWorker *> to_join;
+	std::map<std::string, std::list<SSH2KeyPair *> >::iterator it;
+	std::list<SSH2KeyPair *>::iterator kp;
+	void * status;
+
+	lock();
+	if (!running) {
+		unlock();
+		return;
+	}
+	stopping = true;
+	to_join = threads;
+	threads.clear();
+	broadcast();
+	unlock();
+
+	for (std::list<SSH2KeyPairWorker *>::iterator w = to_join.begin();
+			w != to_join.end(); ++w) {
+		(*w)->join(&status);
+		delete *w;
+	}
+
+	lock();
+	for (it = ready.begin(); it != ready.end(); ++it) {
+		for (kp = it->second.begin(); kp != it->second.end(); ++kp) {
+			delete *kp;
+		}
+	}
+	ready.clear();
+	pending.clear();
+	stopping = false;
+	running = false;
+	unlock();
+}
+
+SSH2KeyPair * SSH2KeyPairPool::take(const std::string& alg)
+{
+	SSH2KeyPair * kp = NULL;
+	DH * params;
+
+	lock();
+	if (!running && workers > 0) {
+		start();
+	}
+
+	if (!threads.empty()) {
+		//Asking for an algorithm makes the workers keep key pairs
+		//ready for it
+		std::list<SSH2KeyPair *>& queue = ready[alg];
+		if (!queue.empty()) {
+			kp = queue.front();
+			queue.pop_front();
+		}
+		broadcast();
+	}
+	params = dh_parameters;
+	unlock();
+
+	if (kp) {
+		return kp;
+	}
+
+	return generate(alg, params);
+}
+
+SSH2KeyPair * SSH2KeyPairPool::generate(const std::string& alg, DH * params)
+{
+	SSH2KeyPair * kp;
+	const BIGNUM *p, *g;
+
+	if (alg == SSL_TXT_EDH) {
+		if (!params) {
+			LOG_ERR("Diffie-Hellman parameters not yet initialized");
+			return NULL;
+		}
+
+		kp = new SSH2KeyPair();
+		if ((kp->dh = DH_new()) == NULL) {
+			LOG_ERR("Error initializing Diffie-Hellman state");
+			delete kp;
+			return NULL;
+		}
+
+		// Set P and G (re-use defaults or use the ones sent by the peer)
+		DH_get0_pqg(params, &p, NULL, &g);
+		DH_set0_pqg(kp->dh, BN_dup(p), NULL, BN_dup(g));
+
+		// Generate the public and private key pair
+		if (DH_generate_key(kp->dh) != 1) {
+			LOG_ERR("Error generating public and private key pair: %s",
+				ERR_error_string(ERR_get_error(), NULL));
+			delete kp;
+			return NULL;
+		}
+
+		return kp;
+	}
+
+#ifdef SSH2_HAVE_X25519
+	if (alg == SSH2SecurityContext::KEY_EXCH_X25519) {
+		EVP_PKEY_CTX * ctx;
+
+		ctx = EVP_PKEY_CTX_new_id(EVP_PKEY_X25519, NULL);
+		if (!ctx) {
+			LOG_ERR("Error initializing X25519 state");
+			return NULL;
+		}
+
+		kp = new SSH2KeyPair();
+		if (EVP_PKEY_keygen_init(ctx) != 1 ||
+				EVP_PKEY_keygen(ctx, &kp->pkey) != 1) {
+			LOG_ERR("Error generating X25519 key pair: %s",
+				ERR_error_string(ERR_get_error(), NULL));
+			EVP_PKEY_CTX_free(ctx);
+			delete kp;
+			return NULL;
+		}
+
+		EVP_PKEY_CTX_free(ctx);
+		return kp;
+	}
+#endif
+
+	LOG_ERR("Unsupported key exchange algorithm: %s", alg.c_str());
+	return NULL;
+}
+
+void SSH2KeyPairPool::work()
+{
+	std::map<std::string, std::list<SSH2KeyPair *> >::iterator it;
+	std::string alg;
+	SSH2KeyPair * kp;
+	DH * params;
+
+	lock();
+	while (!stopping) {
+		alg.clear();
+		for (it = ready.begin(); it != ready.end(); ++it) {
+			if ((int) it->second.size() + pending[it->first] < depth) {
+				alg = it->first;
+				break;
+			}
+		}
+
+		if (alg.empty()) {
+			doWait();
+			continue;
+		}
+
+		pending[alg]++;
+		params = dh_parameters;
+		unlock();
+
+		kp = generate(alg, params);
+
+		lock();
+		pending[alg]--;
+		if (stopping) {
+			delete kp;
+			break;
+		}
+
+		if (kp) {
+			ready[alg].push_back(kp);
+		} else {
+			//Stop producing key pairs for this algorithm until
+			//it is asked for again
+			it = ready.find(alg);
+			if (it == ready.end()) {
+				continue;
+			}
+			for (std::list<SSH2KeyPair *>::iterator kpit = it->second.begin();
+					kpit != it->second.end(); ++kpit) {
+				delete *kpit;
+			}
+			ready.erase(it);
+		}
+	}
+	unlock();
+}
+
 //Class AuthSSH2
 const int AuthSSH2PolicySet::DEFAULT_TIMEOUT = 10000;
 const std::string AuthSSH2PolicySet::EDH_EXCHANGE = "Ephemeral Diffie-Hellman exchange";
@@ -900,6 +1219,8 @@ const int AuthSSH2PolicySet::MIN_RSA_KEY_PAIR_LENGTH = 256;
 const std::string AuthSSH2PolicySet::CLIENT_CHALLENGE = "Client challenge";
 const std::string AuthSSH2PolicySet::CLIENT_CHALLENGE_REPLY = "Client challenge reply and server challenge";
 const std::string AuthSSH2PolicySet::SERVER_CHALLENGE_REPLY = "Server challenge reply";
+const std::string AuthSSH2PolicySet::KEY_PAIR_WORKERS = "keyPairWorkers";
+const std::string AuthSSH2PolicySet::KEY_PAIR_POOL_DEPTH = "keyPairPoolDepth";
 
 AuthSSH2PolicySet::AuthSSH2PolicySet(rib::RIBDaemonProxy * ribd, ISecurityManager * sm) :
 		IAuthPolicySet(IAuthPolicySet::AUTH_SSH2)
@@ -914,10 +1235,20 @@ AuthSSH2PolicySet::AuthSSH2PolicySet(rib::RIBDaemonProxy * ribd, ISecurityManage
 	if (!dh_parameters) {
 		LOG_ERR("Error initializing DH parameters");
 	}
+	key_pairs.set_dh_parameters(dh_parameters);
 }
 
 AuthSSH2PolicySet::~AuthSSH2PolicySet()
 {
+	std::map<std::string, KeystoreKey>::iterator it;
+
+	key_pairs.stop();
+
+	for (it = keystore_keys.begin(); it != keystore_keys.end(); ++it) {
+		RSA_free(it->second.key);
+	}
+	keystore_keys.clear();
+
 	if (dh_parameters) {
 		DH_free(dh_parameters);
 		dh_parameters = NULL;
@@ -966,6 +1297,7 @@ void AuthSSH2PolicySet::edh_init_params()
 	if (p == NULL) {
 		LOG_ERR("Problems converting P to big number");
 		DH_free(dh_parameters);
+		dh_parameters = NULL;
 		return;
 	}
 
@@ -973,6 +1305,7 @@ void AuthSSH2PolicySet::edh_init_params()
 	if (g == NULL) {
 		LOG_ERR("Problems converting G to big number");
 		DH_free(dh_parameters);
+		dh_parameters = NULL;
 		BN_free(p);
 		return;
 	}
@@ -980,6 +1313,7 @@ void AuthSSH2PolicySet::edh_init_params()
 	if (DH_set0_pqg(dh_parameters, p, NULL, g) != 1) {
 		LOG_ERR("Problems setting P and G");
 		DH_free(dh_parameters);
+		dh_parameters = NULL;
 		BN_free(p);
 		BN_free(g);
 		return;
@@ -988,6 +1322,7 @@ void AuthSSH2PolicySet::edh_init_params()
 	if (DH_check(dh_parameters, &codes) != 1) {
 		LOG_ERR("Error checking parameters");
 		DH_free(dh_parameters);
+		dh_parameters = NULL;
 		return;
 	}
 
@@ -995,6 +1330,7 @@ void AuthSSH2PolicySet::edh_init_params()
 	{
 		LOG_ERR("Diffie-Hellman check has failed");
 		DH_free(dh_parameters);
+		dh_parameters = NULL;
 		return;
 	}
 }
@@ -1014,8 +1350,6 @@ cdap_rib::auth_policy_t AuthSSH2PolicySet::get_auth_policy(int session_id,
 							   const cdap_rib::ep_info_t& peer_ap,
 					            	   const AuthSDUProtectionProfile& profile)
 {
-	const BIGNUM *pub_key;
-
 	if (profile.authPolicy.name_ != type) {
 		LOG_ERR("Wrong policy name: %s, expected: %s",
 				profile.authPolicy.name_.c_str(),
@@ -1056,11 +1390,7 @@ cdap_rib::auth_policy_t AuthSSH2PolicySet::get_auth_policy(int session_id,
 	options.encrypt_algs.push_back(sc->encrypt_alg);
 	options.mac_algs.push_back(sc->mac_alg);
 	options.compress_algs.push_back(sc->compress_alg);
-	DH_get0_key(sc->dh_state, &pub_key, NULL);
-	options.dh_public_key.length = BN_num_bytes(pub_key);
-	options.dh_public_key.data = new unsigned char[options.dh_public_key.length];
-	if (BN_bn2bin(pub_key, options.dh_public_key.data) <= 0 ) {
-		LOG_ERR("Error transforming big number to binary");
+	if (edh_get_public_key(sc, options.dh_public_key) != 0) {
 		delete sc;
 		throw Exception();
 	}
@@ -1077,95 +1407,199 @@ cdap_rib::auth_policy_t AuthSSH2PolicySet::get_auth_policy(int session_id,
 
 int AuthSSH2PolicySet::load_authentication_keys(SSH2SecurityContext * sc)
 {
-	BIO * keystore;
 	std::stringstream ss;
 
 	ss << sc->keystore_path << "/" << SSH2SecurityContext::KEY;
-	keystore =  BIO_new_file(ss.str().c_str(), "r");
-	if (!keystore) {
-		LOG_ERR("Problems opening keystore file at: %s",
-			ss.str().c_str());
+	sc->auth_keypair = get_keystore_key(ss.str(), true);
+	if (!sc->auth_keypair) {
 		return -1;
 	}
 
-	//TODO fix problems with reading private keys from encrypted repos
-	//we should use sc->keystore_pass.c_str() as the last argument
-	sc->auth_keypair = PEM_read_bio_RSAPrivateKey(keystore, NULL, 0, NULL);
+	//Read peer public key from keystore
 	ss.str(std::string());
 	ss.clear();
-	BIO_free(keystore);
+	ss << sc->keystore_path << "/" << sc->peer_ap_name;
+	sc->auth_peer_pub_key = get_keystore_key(ss.str(), false);
+	if (!sc->auth_peer_pub_key) {
+		return -1;
+	}
 
-	if (!sc->auth_keypair) {
-		LOG_ERR("Problems reading RSA key pair from keystore: %s",
-			ERR_error_string(ERR_get_error(), NULL));
+	int rsa_size = RSA_size(sc->auth_keypair);
+	if (rsa_size < MIN_RSA_KEY_PAIR_LENGTH) {
+		LOG_ERR("RSA keypair size is too low. Minimum: %d, actual: %d",
+				MIN_RSA_KEY_PAIR_LENGTH, rsa_size);
+		RSA_free(sc->auth_keypair);
+		sc->auth_keypair = NULL;
 		return -1;
 	}
 
-	//Read peer public key from keystore
-	ss << sc->keystore_path << "/" << sc->peer_ap_name;
-	keystore =  BIO_new_file(ss.str().c_str(), "r");
+	//Since we'll use RSA encryption with RSA_PKCS1_OAEP_PADDING padding, the
+	//maximum length of the data to be encrypted must be less than RSA_size(rsa) - 41
+	sc->challenge.length = rsa_size - 42;
+
+	return 0;
+}
+
+RSA * AuthSSH2PolicySet::get_keystore_key(const std::string& path,
+					  bool private_key)
+{
+	std::map<std::string, KeystoreKey>::iterator it;
+	KeystoreKey entry;
+	struct stat st;
+	BIO * keystore;
+
+	ScopedLock g(keystore_lock);
+
+	it = keystore_keys.find(path);
+	if (stat(path.c_str(), &st) != 0) {
+		LOG_ERR("Problems opening keystore file at: %s",
+			path.c_str());
+		if (it != keystore_keys.end()) {
+			RSA_free(it->second.key);
+			keystore_keys.erase(it);
+		}
+		return NULL;
+	}
+
+	if (it != keystore_keys.end()) {
+		if (it->second.private_key == private_key &&
+				it->second.ino == st.st_ino &&
+				it->second.size == st.st_size &&
+				it->second.mtime == st.st_mtime &&
+				it->second.ctime == st.st_ctime) {
+			RSA_up_ref(it->second.key);
+			return it->second.key;
+		}
+
+		//The file has changed, contexts using the old key keep
+		//their own reference to it
+		RSA_free(it->second.key);
+		keystore_keys.erase(it);
+	}
+
+	keystore =  BIO_new_file(path.c_str(), "r");
 	if (!keystore) {
 		LOG_ERR("Problems opening keystore file at: %s",
-			ss.str().c_str());
-		return -1;
+			path.c_str());
+		return NULL;
 	}
 
 	//TODO fix problems with reading private keys from encrypted repos
 	//we should use sc->keystore_pass.c_str() as the last argument
-	sc->auth_peer_pub_key = PEM_read_bio_RSA_PUBKEY(keystore, NULL, 0, NULL);
+	if (private_key) {
+		entry.key = PEM_read_bio_RSAPrivateKey(keystore, NULL, 0, NULL);
+	} else {
+		entry.key = PEM_read_bio_RSA_PUBKEY(keystore, NULL, 0, NULL);
+	}
 	BIO_free(keystore);
 
-	if (!sc->auth_peer_pub_key) {
-		LOG_ERR("Problems reading RSA public key from keystore: %s",
+	if (!entry.key) {
+		LOG_ERR("Problems reading RSA %s from keystore: %s",
+			private_key ? "key pair" : "public key",
 			ERR_error_string(ERR_get_error(), NULL));
-		return -1;
+		return NULL;
 	}
 
-	int rsa_size = RSA_size(sc->auth_keypair);
-	if (rsa_size < MIN_RSA_KEY_PAIR_LENGTH) {
-		LOG_ERR("RSA keypair size is too low. Minimum: %d, actual: %d",
-				MIN_RSA_KEY_PAIR_LENGTH, sc->challenge.length);
-		RSA_free(sc->auth_keypair);
+	entry.private_key = private_key;
+	entry.ino = st.st_ino;
+	entry.size = st.st_size;
+	entry.mtime = st.st_mtime;
+	entry.ctime = st.st_ctime;
+	keystore_keys[path] = entry;
+
+	LOG_DBG("Read RSA %s from keystore file %s",
+		private_key ? "key pair" : "public key", path.c_str());
+
+	//One reference for the cache, one for the caller
+	RSA_up_ref(entry.key);
+	return entry.key;
+}
+
+int AuthSSH2PolicySet::edh_init_keys(SSH2SecurityContext * sc)
+{
+	SSH2KeyPair * kp;
+
+	kp = key_pairs.take(sc->key_exch_alg);
+	if (!kp) {
 		return -1;
 	}
 
-	//Since we'll use RSA encryption with RSA_PKCS1_OAEP_PADDING padding, the
-	//maximum length of the data to be encrypted must be less than RSA_size(rsa) - 41
-	sc->challenge.length = rsa_size - 42;
+	sc->dh_state = kp->dh;
+	sc->ecdh_state = kp->pkey;
+	kp->dh = NULL;
+	kp->pkey = NULL;
+	delete kp;
 
-	LOG_DBG("Read RSA keys from keystore");
 	return 0;
 }
 
-int AuthSSH2PolicySet::edh_init_keys(SSH2SecurityContext * sc)
+int AuthSSH2PolicySet::edh_get_public_key(SSH2SecurityContext * sc,
+					  UcharArray& pub_key)
 {
-	DH *dh_state;
-	const BIGNUM *p, *g;
+	const BIGNUM *dh_pub_key;
 
-	// Init own parameters
-	if (!dh_parameters) {
-		LOG_ERR("Diffie-Hellman parameters not yet initialized");
+#ifdef SSH2_HAVE_X25519
+	if (sc->ecdh_state) {
+		size_t length;
+
+		if (EVP_PKEY_get_raw_public_key(sc->ecdh_state, NULL, &length) != 1) {
+			LOG_ERR("Error getting X25519 public key length");
+			return -1;
+		}
+
+		pub_key.data = new unsigned char[length];
+		pub_key.length = length;
+		if (EVP_PKEY_get_raw_public_key(sc->ecdh_state, pub_key.data,
+						&length) != 1) {
+			LOG_ERR("Error getting X25519 public key: %s",
+				ERR_error_string(ERR_get_error(), NULL));
+			return -1;
+		}
+
+		return 0;
+	}
+#endif
+
+	if (!sc->dh_state) {
+		LOG_ERR("Key exchange state not initialized");
 		return -1;
 	}
 
-	if ((dh_state = DH_new()) == NULL) {
-		LOG_ERR("Error initializing Diffie-Hellman state");
+	DH_get0_key(sc->dh_state, &dh_pub_key, NULL);
+	pub_key.length = BN_num_bytes(dh_pub_key);
+	pub_key.data = new unsigned char[pub_key.length];
+	if (BN_bn2bin(dh_pub_key, pub_key.data) <= 0 ) {
+		LOG_ERR("Error transforming big number to binary");
 		return -1;
 	}
 
-	// Set P and G (re-use defaults or use the ones sent by the peer)
-	DH_get0_pqg(dh_parameters, &p, NULL, &g);
-	DH_set0_pqg(dh_state, BN_dup(p), NULL, BN_dup(g));
+	return 0;
+}
 
-	// Generate the public and private key pair
-	if (DH_generate_key(dh_state) != 1) {
-		LOG_ERR("Error generating public and private key pair: %s",
-			ERR_error_string(ERR_get_error(), NULL));
-		DH_free(dh_state);
-		return -1;
+int AuthSSH2PolicySet::edh_set_peer_public_key(SSH2SecurityContext * sc,
+					       const UcharArray& pub_key)
+{
+#ifdef SSH2_HAVE_X25519
+	if (sc->key_exch_alg == SSH2SecurityContext::KEY_EXCH_X25519) {
+		sc->ecdh_peer_pub_key = EVP_PKEY_new_raw_public_key(EVP_PKEY_X25519,
+								    NULL,
+								    pub_key.data,
+								    pub_key.length);
+		if (!sc->ecdh_peer_pub_key) {
+			LOG_ERR("Error converting public key to X25519 key: %s",
+				ERR_error_string(ERR_get_error(), NULL));
+			return -1;
+		}
+
+		return 0;
 	}
+#endif
 
-	sc->dh_state = dh_state;
+	sc->dh_peer_pub_key = BN_bin2bn(pub_key.data, pub_key.length, NULL);
+	if (!sc->dh_peer_pub_key) {
+		LOG_ERR("Error converting public key to a BIGNUM");
+		return -1;
+	}
 
 	return 0;
 }
@@ -1220,11 +1654,7 @@ IAuthPolicySet::AuthStatus AuthSSH2PolicySet::initiate_authentication(const cdap
 	}
 
 	//Add peer public key to security context
-	sc->dh_peer_pub_key = BN_bin2bn(options.dh_public_key.data,
-			       	        options.dh_public_key.length,
-			       	        NULL);
-	if (!sc->dh_peer_pub_key) {
-		LOG_ERR("Error converting public key to a BIGNUM");
+	if (edh_set_peer_public_key(sc, options.dh_public_key) != 0) {
 		delete sc;
 		return IAuthPolicySet::FAILED;
 	}
@@ -1254,17 +1684,50 @@ IAuthPolicySet::AuthStatus AuthSSH2PolicySet::initiate_authentication(const cdap
 
 int AuthSSH2PolicySet::edh_generate_shared_secret(SSH2SecurityContext * sc)
 {
-	if((sc->shared_secret.data =
-			(unsigned char*) OPENSSL_malloc(sizeof(unsigned char) * (DH_size(sc->dh_state)))) == NULL) {
-		LOG_ERR("Error allocating memory for shared secret");
-		return -1;
-	}
+#ifdef SSH2_HAVE_X25519
+	if (sc->ecdh_state) {
+		EVP_PKEY_CTX * ctx;
+		size_t length;
 
-	if((sc->shared_secret.length =
-			DH_compute_key(sc->shared_secret.data, sc->dh_peer_pub_key, sc->dh_state)) < 0) {
-		LOG_ERR("Error computing shared secret: %s",
-			ERR_error_string(ERR_get_error(), NULL));
-		return -1;
+		if (!sc->ecdh_peer_pub_key) {
+			LOG_ERR("Missing peer X25519 public key");
+			return -1;
+		}
+
+		ctx = EVP_PKEY_CTX_new(sc->ecdh_state, NULL);
+		if (!ctx) {
+			LOG_ERR("Error initializing X25519 key derivation");
+			return -1;
+		}
+
+		if (EVP_PKEY_derive_init(ctx) != 1 ||
+				EVP_PKEY_derive_set_peer(ctx, sc->ecdh_peer_pub_key) != 1 ||
+				EVP_PKEY_derive(ctx, NULL, &length) != 1) {
+			LOG_ERR("Error computing shared secret: %s",
+				ERR_error_string(ERR_get_error(), NULL));
+			EVP_PKEY_CTX_free(ctx);
+			return -1;
+		}
+
+		sc->shared_secret.data = new unsigned char[length];
+		if (EVP_PKEY_derive(ctx, sc->shared_secret.data, &length) != 1) {
+			LOG_ERR("Error computing shared secret: %s",
+				ERR_error_string(ERR_get_error(), NULL));
+			EVP_PKEY_CTX_free(ctx);
+			return -1;
+		}
+		sc->shared_secret.length = length;
+		EVP_PKEY_CTX_free(ctx);
+	} else
+#endif
+	{
+		sc->shared_secret.data = new unsigned char[DH_size(sc->dh_state)];
+		if((sc->shared_secret.length =
+				DH_compute_key(sc->shared_secret.data, sc->dh_peer_pub_key, sc->dh_state)) < 0) {
+			LOG_ERR("Error computing shared secret: %s",
+				ERR_error_string(ERR_get_error(), NULL));
+			return -1;
+		}
 	}
 
 	std::string hash_base;
@@ -1372,8 +1835,6 @@ IAuthPolicySet::AuthStatus AuthSSH2PolicySet::crypto_state_updated(int port_id)
 
 IAuthPolicySet::AuthStatus AuthSSH2PolicySet::decryption_enabled_server(SSH2SecurityContext * sc)
 {
-	const BIGNUM *pub_key;
-
 	if (sc->state != SSH2SecurityContext::REQUESTED_ENABLE_DECRYPTION_SERVER) {
 		LOG_ERR("Wrong state of policy");
 		sec_man->destroy_security_context(sc->id);
@@ -1389,13 +1850,9 @@ IAuthPolicySet::AuthStatus AuthSSH2PolicySet::decryption_enabled_server(SSH2Secu
 	auth_options.encrypt_algs.push_back(sc->encrypt_alg);
 	auth_options.mac_algs.push_back(sc->mac_alg);
 	auth_options.compress_algs.push_back(sc->compress_alg);
-	DH_get0_key(sc->dh_state, &pub_key, NULL);
-	auth_options.dh_public_key.length = BN_num_bytes(pub_key);
-	auth_options.dh_public_key.data = new unsigned char[auth_options.dh_public_key.length];
-	if (BN_bn2bin(pub_key, auth_options.dh_public_key.data) <= 0 ) {
-		LOG_ERR("Error transforming big number to binary");
-		delete sc;
-		throw Exception();
+	if (edh_get_public_key(sc, auth_options.dh_public_key) != 0) {
+		sec_man->destroy_security_context(sc->id);
+		return IAuthPolicySet::FAILED;
 	}
 
 	//Send message to peer with selected algorithms and public key
@@ -1510,18 +1967,14 @@ int AuthSSH2PolicySet::process_edh_exchange_message(const cdap::CDAPMessage& mes
 	}
 
 	//Add peer public key to security context
-	sc->dh_peer_pub_key = BN_bin2bn(options.dh_public_key.data,
-			       	        options.dh_public_key.length,
-			       	        NULL);
-	if (!sc->dh_peer_pub_key) {
-		LOG_ERR("Error converting public key to a BIGNUM");
-		delete sc;
+	if (edh_set_peer_public_key(sc, options.dh_public_key) != 0) {
+		sec_man->destroy_security_context(sc->id);
 		return rina::IAuthPolicySet::FAILED;
 	}
 
 	//Generate the shared secret
 	if (edh_generate_shared_secret(sc) != 0) {
-		delete sc;
+		sec_man->destroy_security_context(sc->id);
 		return rina::IAuthPolicySet::FAILED;
 	}
 
@@ -1880,9 +2333,27 @@ int AuthSSH2PolicySet::process_server_challenge_reply_message(const cdap::CDAPMe
 int AuthSSH2PolicySet::set_policy_set_param(const std::string& name,
                          	 	      const std::string& value)
 {
-        LOG_DBG("No policy-set-specific parameters to set (%s, %s)",
-                        name.c_str(), value.c_str());
-        return -1;
+	int ival;
+
+	if (name != KEY_PAIR_WORKERS && name != KEY_PAIR_POOL_DEPTH) {
+		LOG_DBG("Unknown policy-set-specific parameters to set (%s, %s)",
+				name.c_str(), value.c_str());
+		return -1;
+	}
+
+	if (string2int(value, ival) != 0 || ival < 0) {
+		LOG_ERR("Invalid value for %s: %s", name.c_str(), value.c_str());
+		return -1;
+	}
+
+	if (name == KEY_PAIR_WORKERS) {
+		key_pairs.set_workers(ival);
+	} else {
+		key_pairs.set_depth(ival);
+	}
+
+	LOG_DBG("Set %s to %d", name.c_str(), ival);
+	return 0;
 }
 
 //Class ISecurity Manager
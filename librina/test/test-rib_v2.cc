@@ -19,6 +19,10 @@
 // MA  02110-1301  USA
 //
 #include <iostream>
+#include <map>
+#include <sstream>
+#include <vector>
+#include <stdio.h>
 #include <stdlib.h>
 
 #include <cppunit/extensions/TestFactoryRegistry.h>
@@ -76,6 +80,7 @@ class ribBasicOps : public CppUnit::TestFixture {
 	CPPUNIT_TEST( testAddObj );
 	CPPUNIT_TEST( testConnect );
 	CPPUNIT_TEST( testOperations);
+	CPPUNIT_TEST( testScalability );
 	CPPUNIT_TEST( testDisconnect );
 	CPPUNIT_TEST( testRemoveObj );
 	CPPUNIT_TEST( testDeassociation );
@@ -98,6 +103,7 @@ public:
 	void testAddObj();
 	void testConnect();
 	void testOperations();
+	void testScalability();
 	void testDisconnect();
 	void testRemoveObj();
 	void testDeassociation();
@@ -161,6 +167,15 @@ public:
 
 static class AppHandlers app_handlers;
 
+//Replies to the batched read: number of replies, objects returned (by
+//name, with their instance ids) and whether the final one was received
+static int batched_reads = 0;
+static std::map<std::string, int64_t> batched_objs;
+static bool batched_read_done = false;
+//Replies to the reads that match no object
+static int empty_reads = 0;
+static int deleg_read_operations = 0;
+
 //CDAP provider mockup
 class CDAPProviderMockup : public CDAPProviderInterface {
 
@@ -252,6 +267,65 @@ public:
 				CPPUNIT_ASSERT_MESSAGE("READ result for invoke id 4 != SUCCESS",
 						       res.code_ == cdap_rib::CDAP_SUCCESS);
 				break;
+			case 13:
+			{
+				//Filtered and batched scoped read
+				BatchedReadResult batch(obj.value_);
+
+				CPPUNIT_ASSERT_MESSAGE("Batched READ result != SUCCESS",
+						       res.code_ == cdap_rib::CDAP_SUCCESS);
+				CPPUNIT_ASSERT_MESSAGE("Batched READ reply after the final one",
+						       !batched_read_done);
+				CPPUNIT_ASSERT_MESSAGE("Batched READ reply with an invalid flag",
+						       flags.flags_ == cdap_rib::flags_t::NONE_FLAGS ||
+						       flags.flags_ == cdap_rib::flags_t::F_RD_INCOMPLETE);
+				batched_read_done =
+					(flags.flags_ == cdap_rib::flags_t::NONE_FLAGS);
+				for (unsigned int i = 0; i < batch.size(); i++) {
+					CPPUNIT_ASSERT_MESSAGE("Batched READ returned an object of a filtered class",
+							       batch.get_class(i) != "OtherObj");
+					CPPUNIT_ASSERT_MESSAGE("Batched READ returned a filtered object",
+							       batch.get_name(i) != name1);
+					CPPUNIT_ASSERT_MESSAGE("Batched READ returned an object twice",
+							       batched_objs.find(batch.get_name(i)) == batched_objs.end());
+					CPPUNIT_ASSERT_MESSAGE("Batched READ object failed",
+							       batch.get_class(i) != "MyObj" ||
+							       batch.get_result(i) == cdap_rib::CDAP_SUCCESS);
+					batched_objs[batch.get_name(i)] =
+						batch.get_instance(i);
+				}
+				batched_reads++;
+				break;
+			}
+			case 14:
+				CPPUNIT_ASSERT_MESSAGE("READ with an invalid filter succeeded",
+						       res.code_ == cdap_rib::CDAP_ERROR);
+				break;
+			case 15:
+			{
+				//Batched read matching no object
+				BatchedReadResult batch(obj.value_);
+
+				CPPUNIT_ASSERT_MESSAGE("Empty batched READ result != SUCCESS",
+						       res.code_ == cdap_rib::CDAP_SUCCESS);
+				CPPUNIT_ASSERT_MESSAGE("Empty batched READ reply not final",
+						       flags.flags_ == cdap_rib::flags_t::NONE_FLAGS);
+				CPPUNIT_ASSERT_MESSAGE("Empty batched READ returned objects",
+						       batch.size() == 0);
+				empty_reads++;
+				break;
+			}
+			case 16:
+				CPPUNIT_ASSERT_MESSAGE("Filtered READ matching no object != SUCCESS",
+						       res.code_ == cdap_rib::CDAP_SUCCESS);
+				CPPUNIT_ASSERT_MESSAGE("Filtered READ matching no object not final",
+						       flags.flags_ == cdap_rib::flags_t::NONE_FLAGS);
+				empty_reads++;
+				break;
+			case 17:
+				CPPUNIT_ASSERT_MESSAGE("READ of a non existing object != INVALID_OBJ",
+						       res.code_ == cdap_rib::CDAP_INVALID_OBJ);
+				break;
 
 			default:
 				CPPUNIT_ASSERT_MESSAGE("READ result for an invalid invoke id", 0);
@@ -376,7 +450,10 @@ public:
                             const ser_obj_t &obj_value,
                             const rina::cdap_rib::flags_t &flags,
                             const rina::cdap_rib::filt_info_t &filt,
-                            int invoke_id) {};
+                            int invoke_id) {
+		if (op_code == rina::cdap::cdap_m_t::M_READ)
+			deleg_read_operations++;
+	};
         void forwarded_object_response(rina::cdap::cdap_m_t *msg){};
 
 	const std::string& get_class() const{
@@ -1123,9 +1200,202 @@ void ribBasicOps::testOperations(){
 	}catch(...){
 		CPPUNIT_ASSERT_MESSAGE("Exception thrown during valid delete_req", 0);
 	}
+
+	//Issue a filtered scoped read, with the objects in batches; there
+	//are enough of them to fill several replies
+	const int n_batched = 2000;
+	std::map<std::string, int64_t> batched_ids;
+	std::map<std::string, int64_t>::iterator bit;
+	try{
+		for (int i = 0; i < n_batched; i++) {
+			std::stringstream ss;
+			MyObj* bobj = new MyObj();
+
+			ss << name1 << "/batched" << i;
+			batched_ids[ss.str()] = ribd->addObjRIB(handle,
+								ss.str(),
+								&bobj);
+		}
+	}catch(...){
+		CPPUNIT_ASSERT_MESSAGE("Exception thrown while adding the batched objects", 0);
+	}
+	batched_ids[name_delegated] = inst_deleg;
+
+	invoke_id = 13;
+	obj_info1.name_ = name1;
+	obj_info1.class_ = MyObj::class_;
+	filter.scope_ = 10;
+	filter.filter_ = (char*) "class!=OtherObj;name!=/x";
+	flags.flags_ = cdap_rib::flags_t::F_RD_BATCH;
+	try{
+		(*message) = PREFIX_MESSAGE | invoke_id;
+		rib_provider->read_request(con_ok, obj_info1, filter, flags, auth, invoke_id);
+	}catch(...){
+		CPPUNIT_ASSERT_MESSAGE("Exception thrown during batched read_req", 0);
+	}
+	CPPUNIT_ASSERT_MESSAGE("Batched read not split in several replies",
+			       batched_reads > 1);
+	CPPUNIT_ASSERT_MESSAGE("Batched read not closed by a final reply",
+			       batched_read_done);
+	CPPUNIT_ASSERT_MESSAGE("Batched read did not return the objects in scope",
+			       batched_objs == batched_ids);
+	CPPUNIT_ASSERT_MESSAGE("Batched read descended into a delegated subtree",
+			       deleg_read_operations == 0);
+
+	try{
+		for (bit = batched_ids.begin(); bit != batched_ids.end(); ++bit)
+			if (bit->first != name_delegated)
+				ribd->removeObjRIB(handle, bit->second);
+	}catch(...){
+		CPPUNIT_ASSERT_MESSAGE("Exception thrown while removing the batched objects", 0);
+	}
+
+	//Issue a read with an invalid filter
+	invoke_id = 14;
+	filter.filter_ = (char*) "color=blue";
+	try{
+		(*message) = PREFIX_MESSAGE | invoke_id;
+		rib_provider->read_request(con_ok, obj_info1, filter, flags, auth, invoke_id);
+	}catch(...){
+		CPPUNIT_ASSERT_MESSAGE("Exception thrown during read_req with invalid filter", 0);
+	}
+
+	//Issue filtered reads that match no object, batched and not; they
+	//have to succeed with a single, final reply
+	invoke_id = 15;
+	filter.filter_ = (char*) "name=/none";
+	try{
+		(*message) = PREFIX_MESSAGE | invoke_id;
+		rib_provider->read_request(con_ok, obj_info1, filter, flags, auth, invoke_id);
+	}catch(...){
+		CPPUNIT_ASSERT_MESSAGE("Exception thrown during batched read_req matching no object", 0);
+	}
+
+	invoke_id = 16;
+	flags.flags_ = cdap_rib::flags_t::NONE_FLAGS;
+	try{
+		(*message) = PREFIX_MESSAGE | invoke_id;
+		rib_provider->read_request(con_ok, obj_info1, filter, flags, auth, invoke_id);
+	}catch(...){
+		CPPUNIT_ASSERT_MESSAGE("Exception thrown during read_req matching no object", 0);
+	}
+	CPPUNIT_ASSERT_MESSAGE("Reads matching no object not replied once each",
+			       empty_reads == 2);
+
+	//Issue a read of an object that does not exist
+	invoke_id = 17;
+	obj_info1.name_ = "/x/y/z";
+	filter.filter_ = 0;
+	try{
+		(*message) = PREFIX_MESSAGE | invoke_id;
+		rib_provider->read_request(con_ok, obj_info1, filter, flags, auth, invoke_id);
+	}catch(...){
+		CPPUNIT_ASSERT_MESSAGE("Exception thrown during read_req of a non existing object", 0);
+	}
+	filter.filter_ = 0;
 }
 
 
+//Scalability of the RIB object store: many objects, lookups by name and
+//by instance id, removals from the middle and add/remove churn
+void ribBasicOps::testScalability(){
+
+	const int n_objs = 100000;
+	std::string base = "/bench";
+	std::vector<int64_t> ids(n_objs);
+	std::stringstream ss;
+	MyObj* obj;
+	int64_t base_id = -1;
+	int i;
+
+	try{
+		obj = new MyObj();
+		base_id = ribd->addObjRIB(handle, base, &obj);
+
+		for(i = 0; i < n_objs; i++){
+			ss.str("");
+			ss << base << "/obj" << i;
+			obj = new MyObj();
+			ids[i] = ribd->addObjRIB(handle, ss.str(), &obj);
+		}
+
+		for(i = 0; i < n_objs; i++){
+			ss.str("");
+			ss << base << "/obj" << i;
+			CPPUNIT_ASSERT_MESSAGE("Lookup by name returned an invalid instance id",
+					ribd->getObjInstId(handle, ss.str()) == ids[i]);
+		}
+
+		for(i = 0; i < n_objs; i++)
+			CPPUNIT_ASSERT_MESSAGE("Lookup by instance id returned an invalid parent",
+					ribd->getObjParentFqn(handle,
+						ribd->getObjFqn(handle, ids[i])) == base);
+	}catch(...){
+		CPPUNIT_ASSERT_MESSAGE("Exception thrown while populating the RIB", 0);
+	}
+
+	//The parent cannot go while it has children
+	try{
+		ribd->removeObjRIB(handle, base_id);
+		CPPUNIT_ASSERT_MESSAGE("Remove object with children succeeded", 0);
+	}catch(eObjHasChildren& e){
+
+	}catch(...){
+		CPPUNIT_ASSERT_MESSAGE("Invalid exception thrown during remove obj with children", 0);
+	}
+
+	try{
+		//Remove every other object first, so that the rest are
+		//removed from the middle of the children list
+		for(i = 0; i < n_objs; i += 2)
+			ribd->removeObjRIB(handle, ids[i]);
+		for(i = 1; i < n_objs; i += 2)
+			ribd->removeObjRIB(handle, ids[i]);
+
+		ribd->removeObjRIB(handle, base_id);
+	}catch(...){
+		CPPUNIT_ASSERT_MESSAGE("Exception thrown while depopulating the RIB", 0);
+	}
+
+	try{
+		ribd->getObjInstId(handle, base + "/obj0");
+		CPPUNIT_ASSERT_MESSAGE("Removed object still found", 0);
+	}catch(eObjDoesNotExist& e){
+
+	}catch(...){
+		CPPUNIT_ASSERT_MESSAGE("Invalid exception thrown during getObjInstId()", 0);
+	}
+
+	//Add/remove churn, every object gets a new instance id so the
+	//removals leave tombstones behind in the indices
+	try{
+		const int n_cycles = 10000;
+		int64_t id;
+
+		obj = new MyObj();
+		base_id = ribd->addObjRIB(handle, base, &obj);
+
+		for(i = 0; i < n_cycles; i++){
+			ss.str("");
+			ss << base << "/churn" << i;
+			obj = new MyObj();
+			id = ribd->addObjRIB(handle, ss.str(), &obj);
+			CPPUNIT_ASSERT_MESSAGE("Lookup by name of a churned object failed",
+					ribd->getObjInstId(handle, ss.str()) == id);
+			ribd->removeObjRIB(handle, id);
+			try{
+				ribd->getObjFqn(handle, id);
+				CPPUNIT_ASSERT_MESSAGE("Lookup by instance id of a removed object succeeded", 0);
+			}catch(eObjDoesNotExist& e){
+			}
+		}
+
+		ribd->removeObjRIB(handle, base_id);
+	}catch(...){
+		CPPUNIT_ASSERT_MESSAGE("Exception thrown during add/remove churn", 0);
+	}
+}
+
 void ribBasicOps::testDisconnect(){
 	//TODO
 }
@@ -0,0 +1,745 @@
+/*
+ * CoDel RMT policy set
+ *
+ * Active queue management driven by the sojourn time of the PDUs in the
+ * N-1 port queues rather than by their length (RFC 8289). PDUs are hashed
+ * on their connection (addresses, cep-ids and QoS id) into sub-queues
+ * served by Deficit Round Robin, giving priority to newly active flows,
+ * and CoDel runs on every sub-queue, as in FQ-CoDel (RFC 8290). With a
+ * single sub-queue it behaves as plain CoDel. Data transfer PDUs are
+ * marked with the explicit congestion flag instead of being dropped,
+ * unless ECN is disabled.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <linux/export.h>
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/string.h>
+#include <linux/jhash.h>
+#include <linux/ktime.h>
+#include <linux/skbuff.h>
+
+#define RINA_PREFIX "codel-plugin"
+
+#include "logs.h"
+#include "rds/rmem.h"
+#include "rds/robjects.h"
+#include "rmt-ps.h"
+#include "policies.h"
+
+#define RINA_CODEL_PS_NAME "codel-ps"
+
+#define DEFAULT_Q_MAX       1000
+#define DEFAULT_TARGET_US   5000
+#define DEFAULT_INTERVAL_US 100000
+#define DEFAULT_FLOWS       64
+#define DEFAULT_QUANTUM     1500
+#define CODEL_MAX_FLOWS     1024
+
+struct codel_ps_data {
+	/* Max number of PDUs queued in a N-1 port */
+	unsigned int q_max;
+	/* Acceptable standing queue delay */
+	unsigned int target_us;
+	/* Window the delay has to stay above target before acting */
+	unsigned int interval_us;
+	/* Number of sub-queues PDUs are hashed into, 1 for plain CoDel */
+	unsigned int flows;
+	/* Bytes served per round by each sub-queue */
+	unsigned int quantum;
+	/* Mark data transfer PDUs instead of dropping them */
+	unsigned int ecn;
+};
+
+/* Kept in the sk_buff of the PDU while it is queued */
+struct codel_skb_cb {
+	struct du * du;
+	ktime_t     enqueued;
+};
+
+#define CODEL_SKB_CB(skb) ((struct codel_skb_cb *) (skb)->cb)
+
+struct codel_vars {
+	/* PDUs dropped or marked since entering the dropping state */
+	u32     count;
+	u32     lastcount;
+	bool    dropping;
+	/* When the sojourn time went above target, 0 if below */
+	ktime_t first_above_time;
+	ktime_t drop_next;
+};
+
+struct codel_flow {
+	struct sk_buff_head pdus;
+	unsigned int        bytes;
+	int                 deficit;
+	/* In the new or old flows list while it is scheduled */
+	struct list_head    flowchain;
+	struct codel_vars   vars;
+};
+
+struct codel_queue {
+	struct rmt_n1_port * n1_port;
+	struct codel_flow *  flows;
+	unsigned int         nflows;
+	/* Management PDUs, served first and never dropped */
+	struct sk_buff_head  mgmt;
+	struct list_head     new_flows;
+	struct list_head     old_flows;
+	unsigned int         qlen;
+	/* Largest PDU seen, a queue holding less is never dropped from */
+	unsigned int         maxpdu;
+
+	unsigned long        tx_pdus;
+	unsigned long        drop_pdus;
+	unsigned long        codel_drops;
+	unsigned long        ecn_marks;
+	u64                  sojourn_us;
+	unsigned int         max_sojourn_us;
+	struct robject       robj;
+};
+
+static ssize_t codel_queue_flow_stats(struct codel_queue * q, char * buf)
+{
+	struct codel_flow * f;
+	ssize_t             len;
+	unsigned int        i;
+
+	len = scnprintf(buf, PAGE_SIZE, "flow qlen bytes count dropping\n");
+	for (i = 0; i < q->nflows; i++) {
+		f = &q->flows[i];
+		if (skb_queue_empty(&f->pdus) && !f->vars.dropping)
+			continue;
+		len += scnprintf(buf + len, PAGE_SIZE - len,
+				 "%u %u %u %u %d\n", i,
+				 skb_queue_len(&f->pdus), f->bytes,
+				 f->vars.count, f->vars.dropping);
+	}
+
+	return len;
+}
+
+static ssize_t codel_queue_attr_show(struct robject *        robj,
+				     struct robj_attribute * attr,
+				     char *                  buf)
+{
+	struct codel_queue * q;
+	ssize_t              ret = 0;
+
+	q = container_of(robj, struct codel_queue, robj);
+	if (!q)
+		return 0;
+
+	spin_lock_bh(&q->n1_port->lock);
+	if (strcmp(robject_attr_name(attr), "queued_pdus") == 0)
+		ret = sprintf(buf, "%u\n", q->qlen);
+	else if (strcmp(robject_attr_name(attr), "tx_pdus") == 0)
+		ret = sprintf(buf, "%lu\n", q->tx_pdus);
+	else if (strcmp(robject_attr_name(attr), "drop_pdus") == 0)
+		ret = sprintf(buf, "%lu\n", q->drop_pdus);
+	else if (strcmp(robject_attr_name(attr), "codel_drops") == 0)
+		ret = sprintf(buf, "%lu\n", q->codel_drops);
+	else if (strcmp(robject_attr_name(attr), "ecn_marks") == 0)
+		ret = sprintf(buf, "%lu\n", q->ecn_marks);
+	else if (strcmp(robject_attr_name(attr), "avg_sojourn_us") == 0)
+		ret = sprintf(buf, "%llu\n", q->tx_pdus ?
+			      div_u64(q->sojourn_us, q->tx_pdus) : 0);
+	else if (strcmp(robject_attr_name(attr), "max_sojourn_us") == 0)
+		ret = sprintf(buf, "%u\n", q->max_sojourn_us);
+	else if (strcmp(robject_attr_name(attr), "flow_stats") == 0)
+		ret = codel_queue_flow_stats(q, buf);
+	spin_unlock_bh(&q->n1_port->lock);
+
+	return ret;
+}
+RINA_SYSFS_OPS(codel_queue);
+RINA_ATTRS(codel_queue, queued_pdus, tx_pdus, drop_pdus, codel_drops,
+	   ecn_marks, avg_sojourn_us, max_sojourn_us, flow_stats);
+RINA_KTYPE(codel_queue);
+
+/* Next drop time, interval / sqrt(count) after t */
+static ktime_t codel_control_law(ktime_t t, unsigned int interval_us, u32 count)
+{
+	u64 ns = (u64) interval_us * NSEC_PER_USEC;
+
+	count = min_t(u32, count, 0xffff);
+
+	return ktime_add_ns(t, div_u64(ns << 8,
+				       int_sqrt((unsigned long) count << 16)));
+}
+
+static unsigned int codel_flow_hash(struct codel_queue * q,
+				    const struct du *    du)
+{
+	u32 key[4];
+
+	if (q->nflows == 1)
+		return 0;
+
+	key[0] = pci_source(&du->pci);
+	key[1] = pci_destination(&du->pci);
+	key[2] = ((u32) (u16) pci_cep_source(&du->pci) << 16) |
+		 (u16) pci_cep_destination(&du->pci);
+	key[3] = (u16) pci_qos_id(&du->pci);
+
+	return reciprocal_scale(jhash2(key, ARRAY_SIZE(key), 0), q->nflows);
+}
+
+static void codel_skbs_destroy(struct sk_buff_head * pdus)
+{
+	struct sk_buff * skb;
+
+	while ((skb = __skb_dequeue(pdus)) != NULL)
+		du_destroy(CODEL_SKB_CB(skb)->du);
+}
+
+static int codel_queue_destroy(struct codel_queue * q)
+{
+	unsigned int i;
+
+	if (!q)
+		return -1;
+
+	codel_skbs_destroy(&q->mgmt);
+	if (q->flows) {
+		for (i = 0; i < q->nflows; i++)
+			codel_skbs_destroy(&q->flows[i].pdus);
+		rkfree(q->flows);
+	}
+	robject_del(&q->robj);
+	rkfree(q);
+
+	return 0;
+}
+
+static void * codel_rmt_q_create_policy(struct rmt_ps *      ps,
+					struct rmt_n1_port * n1_port)
+{
+	struct codel_ps_data * data;
+	struct codel_queue *   q;
+	unsigned int           i;
+
+	if (!ps || !n1_port || !ps->priv) {
+		LOG_ERR("Wrong input parameters for CoDel q create policy");
+		return NULL;
+	}
+
+	data = ps->priv;
+	q    = rkzalloc(sizeof(*q), GFP_ATOMIC);
+	if (!q) {
+		LOG_ERR("Could not create queue for n1_port %d",
+			n1_port->port_id);
+		return NULL;
+	}
+
+	/* Sub-queues changed later apply to the N-1 ports bound afterwards */
+	q->nflows = clamp_t(unsigned int, data->flows, 1, CODEL_MAX_FLOWS);
+	q->flows  = rkzalloc(q->nflows * sizeof(*q->flows), GFP_ATOMIC);
+	if (!q->flows) {
+		LOG_ERR("Could not create %u sub-queues for n1_port %d",
+			q->nflows, n1_port->port_id);
+		rkfree(q);
+		return NULL;
+	}
+
+	for (i = 0; i < q->nflows; i++) {
+		__skb_queue_head_init(&q->flows[i].pdus);
+		INIT_LIST_HEAD(&q->flows[i].flowchain);
+	}
+	__skb_queue_head_init(&q->mgmt);
+	INIT_LIST_HEAD(&q->new_flows);
+	INIT_LIST_HEAD(&q->old_flows);
+	q->n1_port = n1_port;
+
+	if (robject_init_and_add(&q->robj, &codel_queue_rtype,
+				 &n1_port->robj, "codel")) {
+		LOG_ERR("Failed to create CoDel queue sysfs entry");
+		rkfree(q->flows);
+		rkfree(q);
+		return NULL;
+	}
+
+	return q;
+}
+
+static int codel_rmt_q_destroy_policy(struct rmt_ps *      ps,
+				      struct rmt_n1_port * n1_port)
+{
+	struct codel_queue * q;
+
+	if (!ps || !n1_port) {
+		LOG_ERR("Wrong input parameters for CoDel q destroy policy");
+		return -1;
+	}
+
+	q = n1_port->rmt_ps_queues;
+	n1_port->rmt_ps_queues = NULL;
+
+	return codel_queue_destroy(q);
+}
+
+static int codel_rmt_enqueue_policy(struct rmt_ps *      ps,
+				    struct rmt_n1_port * n1_port,
+				    struct du *          du)
+{
+	struct codel_ps_data * data;
+	struct codel_queue *   q;
+	struct codel_flow *    f;
+	struct sk_buff *       skb;
+	unsigned int           len;
+
+	BUILD_BUG_ON(sizeof(struct codel_skb_cb) >
+		     sizeof(((struct sk_buff *) 0)->cb));
+
+	if (!ps || !n1_port || !du || !du->skb || !ps->priv) {
+		LOG_ERR("Wrong input parameters for CoDel enqueue policy");
+		if (du)
+			du_destroy(du);
+		return RMT_PS_ENQ_ERR;
+	}
+
+	data = ps->priv;
+	q    = n1_port->rmt_ps_queues;
+	if (!q) {
+		LOG_ERR("Could not find queue for n1_port %d",
+			n1_port->port_id);
+		du_destroy(du);
+		return RMT_PS_ENQ_ERR;
+	}
+
+	skb = du->skb;
+	CODEL_SKB_CB(skb)->du       = du;
+	CODEL_SKB_CB(skb)->enqueued = ktime_get();
+
+	if (pci_type(&du->pci) == PDU_TYPE_MGMT) {
+		__skb_queue_tail(&q->mgmt, skb);
+		q->qlen++;
+		return RMT_PS_ENQ_SCHED;
+	}
+
+	/* CoDel keeps the queue short, this only bounds bursts */
+	if (q->qlen >= data->q_max) {
+		LOG_DBG("PDU dropped, q_max reached in n1_port %d",
+			n1_port->port_id);
+		q->drop_pdus++;
+		du_destroy(du);
+		return RMT_PS_ENQ_DROP;
+	}
+
+	len = du_len(du);
+	if (len > q->maxpdu)
+		q->maxpdu = len;
+
+	f = &q->flows[codel_flow_hash(q, du)];
+	__skb_queue_tail(&f->pdus, skb);
+	f->bytes += len;
+	q->qlen++;
+
+	if (list_empty(&f->flowchain)) {
+		f->deficit = data->quantum;
+		list_add_tail(&f->flowchain, &q->new_flows);
+	}
+
+	return RMT_PS_ENQ_SCHED;
+}
+
+static struct sk_buff * codel_skb_pop(struct codel_queue * q,
+				      struct codel_flow *  f)
+{
+	struct sk_buff * skb;
+
+	skb = __skb_dequeue(&f->pdus);
+	if (skb) {
+		f->bytes -= du_len(CODEL_SKB_CB(skb)->du);
+		q->qlen--;
+	}
+
+	return skb;
+}
+
+/*
+ * Pops the head of the sub-queue, telling if its sojourn time has been
+ * above target for at least an interval
+ */
+static struct sk_buff * codel_do_dequeue(struct codel_ps_data * data,
+					 struct codel_queue *   q,
+					 struct codel_flow *    f,
+					 ktime_t                now,
+					 bool *                 ok_to_drop)
+{
+	struct codel_vars * vars = &f->vars;
+	struct sk_buff *    skb;
+	s64                 sojourn_us;
+
+	*ok_to_drop = false;
+
+	skb = codel_skb_pop(q, f);
+	if (!skb) {
+		vars->first_above_time = ktime_set(0, 0);
+		return NULL;
+	}
+
+	sojourn_us = ktime_us_delta(now, CODEL_SKB_CB(skb)->enqueued);
+	if (sojourn_us < data->target_us || f->bytes <= q->maxpdu) {
+		vars->first_above_time = ktime_set(0, 0);
+	} else if (!ktime_to_ns(vars->first_above_time)) {
+		vars->first_above_time = ktime_add_us(now, data->interval_us);
+	} else if (ktime_compare(now, vars->first_above_time) >= 0) {
+		*ok_to_drop = true;
+	}
+
+	return skb;
+}
+
+/* Marks the PDU if possible, otherwise drops it and returns false */
+static bool codel_mark_or_drop(struct codel_ps_data * data,
+			       struct codel_queue *   q,
+			       struct sk_buff *       skb)
+{
+	struct du * du = CODEL_SKB_CB(skb)->du;
+
+	if (data->ecn && pci_type(&du->pci) == PDU_TYPE_DT) {
+		pci_flags_set(&du->pci, pci_flags_get(&du->pci) |
+			      PDU_FLAGS_EXPLICIT_CONGESTION);
+		q->ecn_marks++;
+		return true;
+	}
+
+	/* The policy is called with the n1_port lock taken */
+	q->n1_port->stats.plen--;
+	q->n1_port->stats.drop_pdus++;
+	q->codel_drops++;
+	du_destroy(du);
+
+	return false;
+}
+
+static struct sk_buff * codel_dequeue(struct codel_ps_data * data,
+				      struct codel_queue *   q,
+				      struct codel_flow *    f)
+{
+	struct codel_vars * vars = &f->vars;
+	struct sk_buff *    skb;
+	ktime_t             now;
+	bool                ok_to_drop;
+	u32                 delta;
+
+	now = ktime_get();
+	skb = codel_do_dequeue(data, q, f, now, &ok_to_drop);
+	if (!skb) {
+		vars->dropping = false;
+		return NULL;
+	}
+
+	if (vars->dropping) {
+		if (!ok_to_drop) {
+			vars->dropping = false;
+			return skb;
+		}
+		while (vars->dropping &&
+		       ktime_compare(now, vars->drop_next) >= 0) {
+			vars->count++;
+			if (codel_mark_or_drop(data, q, skb)) {
+				vars->drop_next =
+					codel_control_law(vars->drop_next,
+							  data->interval_us,
+							  vars->count);
+				return skb;
+			}
+			skb = codel_do_dequeue(data, q, f, now, &ok_to_drop);
+			if (!skb || !ok_to_drop) {
+				vars->dropping = false;
+				return skb;
+			}
+			vars->drop_next = codel_control_law(vars->drop_next,
+							    data->interval_us,
+							    vars->count);
+		}
+		return skb;
+	}
+
+	if (!ok_to_drop)
+		return skb;
+
+	/* Entering the dropping state, recall the last drop rate if recent */
+	delta = vars->count - vars->lastcount;
+	if (delta > 1 &&
+	    ktime_us_delta(now, vars->drop_next) <
+	    16 * (s64) data->interval_us)
+		vars->count = delta;
+	else
+		vars->count = 1;
+	vars->lastcount = vars->count;
+	vars->dropping  = true;
+	vars->drop_next = codel_control_law(now, data->interval_us,
+					    vars->count);
+
+	if (!codel_mark_or_drop(data, q, skb))
+		skb = codel_do_dequeue(data, q, f, now, &ok_to_drop);
+
+	return skb;
+}
+
+static struct du * codel_rmt_dequeue_policy(struct rmt_ps *      ps,
+					    struct rmt_n1_port * n1_port)
+{
+	struct codel_ps_data * data;
+	struct codel_queue *   q;
+	struct codel_flow *    f;
+	struct list_head *     head;
+	struct sk_buff *       skb;
+	unsigned int           sojourn;
+
+	if (!ps || !n1_port || !ps->priv) {
+		LOG_ERR("Wrong input parameters for CoDel dequeue policy");
+		return NULL;
+	}
+
+	data = ps->priv;
+	q    = n1_port->rmt_ps_queues;
+	if (!q) {
+		LOG_ERR("Could not find queue for n1_port %d",
+			n1_port->port_id);
+		return NULL;
+	}
+
+	skb = __skb_dequeue(&q->mgmt);
+	if (skb) {
+		q->qlen--;
+		goto out;
+	}
+
+	for (;;) {
+		head = &q->new_flows;
+		if (list_empty(head)) {
+			head = &q->old_flows;
+			if (list_empty(head))
+				return NULL;
+		}
+
+		f = list_first_entry(head, struct codel_flow, flowchain);
+		if (f->deficit <= 0) {
+			f->deficit += data->quantum;
+			list_move_tail(&f->flowchain, &q->old_flows);
+			continue;
+		}
+
+		skb = codel_dequeue(data, q, f);
+		if (skb)
+			break;
+
+		/* Give new flows that just emptied a turn as old ones */
+		if (head == &q->new_flows && !list_empty(&q->old_flows))
+			list_move_tail(&f->flowchain, &q->old_flows);
+		else
+			list_del_init(&f->flowchain);
+	}
+	f->deficit -= du_len(CODEL_SKB_CB(skb)->du);
+
+ out:
+	sojourn = ktime_us_delta(ktime_get(), CODEL_SKB_CB(skb)->enqueued);
+	q->sojourn_us += sojourn;
+	if (sojourn > q->max_sojourn_us)
+		q->max_sojourn_us = sojourn;
+	q->tx_pdus++;
+
+	return CODEL_SKB_CB(skb)->du;
+}
+
+static int codel_ps_set_policy_set_param_priv(struct codel_ps_data * data,
+					      const char *           name,
+					      const char *           value)
+{
+	unsigned int uval;
+
+	if (!name) {
+		LOG_ERR("Null parameter name");
+		return -1;
+	}
+
+	if (!value) {
+		LOG_ERR("Null parameter value");
+		return -1;
+	}
+
+	if (kstrtouint(value, 10, &uval)) {
+		LOG_ERR("Could not parse value '%s' of parameter %s",
+			value, name);
+		return -1;
+	}
+
+	if (strcmp(name, "q_max") == 0) {
+		data->q_max = uval;
+		return 0;
+	}
+
+	if (strcmp(name, "target_us") == 0) {
+		data->target_us = uval;
+		return 0;
+	}
+
+	if (strcmp(name, "interval_us") == 0) {
+		if (!uval) {
+			LOG_ERR("The CoDel interval cannot be 0");
+			return -1;
+		}
+		data->interval_us = uval;
+		return 0;
+	}
+
+	if (strcmp(name, "flows") == 0) {
+		if (!uval || uval > CODEL_MAX_FLOWS) {
+			LOG_ERR("Sub-queues %u out of range [1, %d]",
+				uval, CODEL_MAX_FLOWS);
+			return -1;
+		}
+		data->flows = uval;
+		return 0;
+	}
+
+	if (strcmp(name, "quantum") == 0) {
+		if (!uval) {
+			LOG_ERR("The quantum cannot be 0");
+			return -1;
+		}
+		data->quantum = uval;
+		return 0;
+	}
+
+	if (strcmp(name, "ecn") == 0) {
+		data->ecn = uval;
+		return 0;
+	}
+
+	LOG_ERR("No such parameter to set");
+
+	return -1;
+}
+
+static int rmt_config_apply(struct policy_parm * param, void * data)
+{
+	return codel_ps_set_policy_set_param_priv(data,
+			policy_param_name(param),
+			policy_param_value(param));
+}
+
+static int codel_ps_set_policy_set_param(struct ps_base * bps,
+					 const char *     name,
+					 const char *     value)
+{
+	struct rmt_ps * ps = container_of(bps, struct rmt_ps, base);
+
+	return codel_ps_set_policy_set_param_priv(ps->priv, name, value);
+}
+
+static struct ps_base *
+rmt_ps_codel_create(struct rina_component * component)
+{
+	struct rmt *           rmt = rmt_from_component(component);
+	struct rmt_ps *        ps;
+	struct codel_ps_data * data;
+	struct rmt_config *    rmt_cfg;
+
+	ps = rkzalloc(sizeof(*ps), GFP_KERNEL);
+	if (!ps)
+		return NULL;
+
+	data = rkzalloc(sizeof(*data), GFP_KERNEL);
+	if (!data) {
+		rkfree(ps);
+		return NULL;
+	}
+
+	data->q_max       = DEFAULT_Q_MAX;
+	data->target_us   = DEFAULT_TARGET_US;
+	data->interval_us = DEFAULT_INTERVAL_US;
+	data->flows       = DEFAULT_FLOWS;
+	data->quantum     = DEFAULT_QUANTUM;
+	data->ecn         = 1;
+
+	ps->base.set_policy_set_param = codel_ps_set_policy_set_param;
+	ps->dm    = rmt;
+	ps->priv  = data;
+
+	rmt_cfg = rmt_config_get(rmt);
+	if (rmt_cfg)
+		policy_for_each(rmt_cfg->policy_set, data, rmt_config_apply);
+
+	ps->rmt_dequeue_policy   = codel_rmt_dequeue_policy;
+	ps->rmt_enqueue_policy   = codel_rmt_enqueue_policy;
+	ps->rmt_q_create_policy  = codel_rmt_q_create_policy;
+	ps->rmt_q_destroy_policy = codel_rmt_q_destroy_policy;
+
+	LOG_INFO("CoDel RMT PS loaded, q_max = %u, target = %u us, "
+		 "interval = %u us, flows = %u, ecn = %u", data->q_max,
+		 data->target_us, data->interval_us, data->flows, data->ecn);
+
+	return &ps->base;
+}
+
+static void rmt_ps_codel_destroy(struct ps_base * bps)
+{
+	struct rmt_ps * ps = container_of(bps, struct rmt_ps, base);
+
+	if (bps) {
+		if (ps->priv)
+			rkfree(ps->priv);
+		rkfree(ps);
+	}
+}
+
+static struct ps_factory codel_factory = {
+	.owner   = THIS_MODULE,
+	.create  = rmt_ps_codel_create,
+	.destroy = rmt_ps_codel_destroy,
+};
+
+static int __init mod_init(void)
+{
+	int ret;
+
+	strcpy(codel_factory.name, RINA_CODEL_PS_NAME);
+
+	ret = rmt_ps_publish(&codel_factory);
+	if (ret) {
+		LOG_ERR("Failed to publish policy set factory");
+		return -1;
+	}
+
+	LOG_INFO("RMT CoDel policy set loaded successfully");
+
+	return 0;
+}
+
+static void __exit mod_exit(void)
+{
+	int ret = rmt_ps_unpublish(RINA_CODEL_PS_NAME);
+
+	if (ret) {
+		LOG_ERR("Failed to unpublish policy set factory");
+		return;
+	}
+
+	LOG_INFO("RMT CoDel policy set unloaded successfully");
+}
+
+module_init(mod_init);
+module_exit(mod_exit);
+
+MODULE_DESCRIPTION("RMT CoDel policy set");
+
+MODULE_LICENSE("GPL");
@@ -0,0 +1,289 @@
+/*
+ * CRC32C policy set for SDUP Error check
+ *
+ * Uses the CRC32C (Castagnoli) implementation of the kernel crypto API,
+ * which is hardware accelerated where available (SSE4.2, PCLMULQDQ, ARMv8
+ * CRC instructions), and walks the fragments of the sk_buff instead of
+ * requiring a linear PDU. Verification can be skipped on N-1 ports whose
+ * flows already discard corrupted PDUs (Ethernet FCS, TCP).
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <linux/export.h>
+#include <linux/module.h>
+#include <linux/string.h>
+#include <linux/skbuff.h>
+#include <linux/crc32.h>
+#include <linux/crc32c.h>
+
+#define RINA_PREFIX "crc32c-plugin"
+
+#include "logs.h"
+#include "rds/rmem.h"
+#include "sdup-errc-ps.h"
+#include "policies.h"
+#include "debug.h"
+
+#define CRC32C_PS_NAME "CRC32C"
+
+/* When to verify the CRC of incoming PDUs */
+enum crc32c_rx_check {
+	/* Always verify */
+	CRC32C_RX_ALWAYS = 0,
+	/* Only if the N-1 flow does not guarantee integrity already */
+	CRC32C_RX_AUTO,
+	/* Never verify, just strip the CRC */
+	CRC32C_RX_NEVER,
+};
+
+struct crc32c_ps_priv {
+	bool verify;
+};
+
+static __wsum crc32c_csum_update(const void * buff, int len, __wsum sum)
+{
+	return (__force __wsum) crc32c((__force u32) sum, buff, len);
+}
+
+static __wsum crc32c_csum_combine(__wsum csum, __wsum csum2,
+				  int offset, int len)
+{
+	return (__force __wsum) __crc32c_le_combine((__force u32) csum,
+						    (__force u32) csum2, len);
+}
+
+static const struct skb_checksum_ops crc32c_csum_ops = {
+	.update  = crc32c_csum_update,
+	.combine = crc32c_csum_combine,
+};
+
+/* CRC32C of the first len bytes of the PDU, following skb fragments */
+static __le32 crc32c_du(struct du * du, int len)
+{
+	u32 crc;
+
+	crc = (__force u32) __skb_checksum(du->skb, 0, len, (__force __wsum) ~0,
+					   &crc32c_csum_ops);
+
+	return cpu_to_le32(~crc);
+}
+
+static int crc32c_sdup_add_error_check_policy(struct sdup_errc_ps * ps,
+					      struct du * du)
+{
+	struct sk_buff * trailer;
+	__le32           crc;
+	int              len;
+
+	if (!ps || !du){
+		LOG_ERR("Error check arguments not initialized!");
+		return -1;
+	}
+
+	len = du_len(du);
+	crc = crc32c_du(du, len);
+
+	if (!skb_is_nonlinear(du->skb)) {
+		if (du_tail_grow(du, sizeof(crc))) {
+			LOG_ERR("Failed to grow ser PDU");
+			return -1;
+		}
+		memcpy(du_buffer(du) + len, &crc, sizeof(crc));
+		return 0;
+	}
+
+	/* Append to the last fragment, unsharing it if needed */
+	if (skb_cow_data(du->skb, sizeof(crc), &trailer) < 0) {
+		LOG_ERR("Failed to make room for the CRC");
+		return -1;
+	}
+	if (du->pci.h != NULL)
+		du->pci.h = du->skb->data;
+
+	pskb_put(du->skb, trailer, sizeof(crc));
+	if (skb_store_bits(du->skb, len, &crc, sizeof(crc))) {
+		LOG_ERR("Failed to store the CRC");
+		return -1;
+	}
+
+	return 0;
+}
+
+static int crc32c_sdup_check_error_check_policy(struct sdup_errc_ps * ps,
+						struct du * du)
+{
+	struct crc32c_ps_priv * priv;
+	__le32                  crc;
+	__le32                  pdu_crc;
+	int                     len;
+
+	if (!ps || !du){
+		LOG_ERR("Error check arguments not initialized!");
+		return -1;
+	}
+
+	priv = ps->priv;
+	if (du_len(du) < sizeof(crc)) {
+		LOG_ERR("PDU too short to carry a CRC");
+		return -1;
+	}
+	len = du_len(du) - sizeof(crc);
+
+	if (priv->verify) {
+		crc = crc32c_du(du, len);
+
+		if (skb_copy_bits(du->skb, len, &pdu_crc, sizeof(pdu_crc)))
+			return -1;
+
+		if (crc != pdu_crc)
+			return -1;
+	}
+
+	/* skb_trim() leaves nonlinear skbs untouched */
+	if (pskb_trim(du->skb, len)) {
+		LOG_ERR("Failed to shrink ser PDU");
+		return -1;
+	}
+	if (du->pci.h != NULL)
+		du->pci.h = du->skb->data;
+
+	return 0;
+}
+
+static int crc32c_rx_check_parse(const string_t * value,
+				 enum crc32c_rx_check * check)
+{
+	if (!strcmp(value, "always"))
+		*check = CRC32C_RX_ALWAYS;
+	else if (!strcmp(value, "auto"))
+		*check = CRC32C_RX_AUTO;
+	else if (!strcmp(value, "never"))
+		*check = CRC32C_RX_NEVER;
+	else
+		return -1;
+
+	return 0;
+}
+
+static struct ps_base *
+sdup_errc_ps_crc32c_create(struct rina_component * component)
+{
+	struct sdup_comp *      sdup_comp;
+	struct sdup_port *      sdup_port;
+	struct sdup_errc_ps *   ps;
+	struct crc32c_ps_priv * priv;
+	struct policy_parm *    parameter;
+	enum crc32c_rx_check    check;
+
+	sdup_comp = sdup_comp_from_component(component);
+	if (!sdup_comp)
+		return NULL;
+
+	sdup_port = sdup_comp->parent;
+	if (!sdup_port)
+		return NULL;
+
+	check = CRC32C_RX_AUTO;
+	if (sdup_port->conf && sdup_port->conf->crc) {
+		parameter = policy_param_find(sdup_port->conf->crc, "rxCheck");
+		if (parameter &&
+		    crc32c_rx_check_parse(policy_param_value(parameter),
+					  &check)) {
+			LOG_ERR("Invalid rxCheck value '%s'",
+				policy_param_value(parameter));
+			return NULL;
+		}
+	}
+
+	ps = rkzalloc(sizeof(*ps), GFP_KERNEL);
+	if (!ps)
+		return NULL;
+
+	priv = rkzalloc(sizeof(*priv), GFP_KERNEL);
+	if (!priv) {
+		rkfree(ps);
+		return NULL;
+	}
+
+	priv->verify = check == CRC32C_RX_ALWAYS ||
+		(check == CRC32C_RX_AUTO && !sdup_port->n1_integrity);
+
+	LOG_DBG("CRC32C on N-1 port %d, verification %s",
+		sdup_port->port_id, priv->verify ? "enabled" : "skipped");
+
+	ps->dm          = sdup_port;
+	ps->priv        = priv;
+	ps->tail_room   = sizeof(__le32);
+
+	/* SDUP policy functions*/
+	ps->sdup_add_error_check_policy		= crc32c_sdup_add_error_check_policy;
+	ps->sdup_check_error_check_policy	= crc32c_sdup_check_error_check_policy;
+
+	return &ps->base;
+}
+
+static void sdup_errc_ps_crc32c_destroy(struct ps_base * bps)
+{
+	struct sdup_errc_ps *ps = container_of(bps, struct sdup_errc_ps, base);
+
+	if (bps) {
+		if (ps->priv)
+			rkfree(ps->priv);
+		rkfree(ps);
+	}
+}
+
+static struct ps_factory crc32c_factory = {
+	.owner   = THIS_MODULE,
+	.create  = sdup_errc_ps_crc32c_create,
+	.destroy = sdup_errc_ps_crc32c_destroy,
+};
+
+static int __init mod_init(void)
+{
+	int ret;
+
+	strcpy(crc32c_factory.name, CRC32C_PS_NAME);
+
+	ret = sdup_errc_ps_publish(&crc32c_factory);
+	if (ret) {
+		LOG_ERR("Failed to publish policy set factory");
+		return -1;
+	}
+
+	LOG_INFO("SDUP CRC32C error check policy set loaded successfully");
+
+	return 0;
+}
+
+static void __exit mod_exit(void)
+{
+	int ret = sdup_errc_ps_unpublish(CRC32C_PS_NAME);
+
+	if (ret) {
+		LOG_ERR("Failed to unpublish policy set factory");
+		return;
+	}
+
+	LOG_INFO("SDUP CRC32C error check policy set unloaded successfully");
+}
+
+module_init(mod_init);
+module_exit(mod_exit);
+
+MODULE_DESCRIPTION("SDUP CRC32C error check policy set");
+
+MODULE_LICENSE("GPL");
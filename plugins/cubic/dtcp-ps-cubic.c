@@ -0,0 +1,542 @@
+/*
+ * CUBIC Policy Set for DTCP
+ *
+ * Receiver driven congestion control: the credit granted to the sender
+ * follows the CUBIC window growth function (RFC 8312), and is cut by beta
+ * when PDUs arrive marked with the explicit congestion flag or after a
+ * sequence number gap, at most once per window of PDUs. For rate based
+ * flows the receiver also estimates the delivery rate of the connection
+ * and advertises a sending rate derived from it, probing for more
+ * bandwidth in cycles as BBR does, which DTP turns into pacing.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <linux/export.h>
+#include <linux/module.h>
+#include <linux/string.h>
+#include <linux/ktime.h>
+
+#define RINA_PREFIX "cubic-dtcp-ps"
+
+#include "logs.h"
+#include "rds/rmem.h"
+#include "dtcp-ps.h"
+#include "dtcp-conf-utils.h"
+#include "policies.h"
+
+#define RINA_CUBIC_PS_NAME "cubic-ps"
+
+/* beta and C are scaled by 1024, as in tcp_cubic */
+#define CUBIC_BETA_DEFAULT        717
+#define CUBIC_C_DEFAULT           410
+#define CUBIC_C_MAX               2047
+#define CUBIC_MIN_CREDIT          2U
+#define CUBIC_MAX_CREDIT          (1U << 20)
+/* Keeps the cube of the time since K within 64 bits */
+#define CUBIC_MAX_T_MS            (1U << 17)
+#define CUBIC_RATE_SAMPLE_US      10000
+/* Delivery rate samples the bandwidth estimate is the max of */
+#define CUBIC_BW_WIN              10
+/* Pacing gains, scaled by 256 */
+#define CUBIC_STARTUP_GAIN        739
+#define CUBIC_CYCLE_LEN           8
+#define CUBIC_FULL_BW_SAMPLES     3
+
+static const unsigned int cubic_pacing_gain[CUBIC_CYCLE_LEN] = {
+        320, 192, 256, 256, 256, 256, 256, 256
+};
+
+struct cubic_dtcp_ps_data {
+        /* Window, in PDUs, granted to the sender */
+        uint_t    cwnd;
+        uint_t    cwnd_cnt;
+        uint_t    ssthresh;
+        /* Window before the last reduction */
+        uint_t    w_max;
+        /* Time to grow back to w_max, in ms */
+        uint_t    k_ms;
+        ktime_t   epoch_start;
+        seq_num_t last_seq;
+        bool      have_seq;
+        /* PDUs received since the last reduction, and how many to wait */
+        uint_t    since_event;
+        uint_t    event_gate;
+        unsigned long events;
+
+        /* Delivery rate estimation, in bytes per DTCP time unit */
+        ktime_t   sample_start;
+        uint_t    sample_bytes;
+        uint_t    bw[CUBIC_BW_WIN];
+        uint_t    bw_idx;
+        uint_t    full_bw;
+        uint_t    full_bw_cnt;
+        uint_t    cycle;
+
+        /* Parameters */
+        uint_t    beta;
+        uint_t    c;
+        uint_t    fast_convergence;
+        uint_t    rate_sample_us;
+};
+
+/* Integer cube root */
+static u32 cubic_cbrt(u64 a)
+{
+        u64 lo = 0, hi = 1 << 21, mid;
+
+        while (lo < hi) {
+                mid = (lo + hi + 1) >> 1;
+                if (mid * mid * mid <= a)
+                        lo = mid;
+                else
+                        hi = mid - 1;
+        }
+
+        return (u32) lo;
+}
+
+/* W(t) = C * (t - K)^3 + W_max, t in seconds since the epoch started */
+static uint_t cubic_target(struct cubic_dtcp_ps_data * data, ktime_t now)
+{
+        u64 t, d, delta;
+
+        t = ktime_ms_delta(now, data->epoch_start);
+        d = t > data->k_ms ? t - data->k_ms : data->k_ms - t;
+        d = min_t(u64, d, CUBIC_MAX_T_MS);
+        delta = div_u64(data->c * d * d * d, 1024 * (u64) NSEC_PER_SEC);
+
+        if (t > data->k_ms)
+                return min_t(u64, data->w_max + delta, CUBIC_MAX_CREDIT);
+
+        return data->w_max > delta ? data->w_max - delta : CUBIC_MIN_CREDIT;
+}
+
+static void cubic_epoch_start(struct cubic_dtcp_ps_data * data, ktime_t now)
+{
+        data->epoch_start = now;
+        data->cwnd_cnt    = 0;
+
+        if (data->w_max <= data->cwnd) {
+                data->w_max = data->cwnd;
+                data->k_ms  = 0;
+                return;
+        }
+
+        /* K = cbrt((W_max - cwnd) / C) */
+        data->k_ms = cubic_cbrt(div_u64((u64) (data->w_max - data->cwnd) *
+                                        NSEC_PER_SEC * 1024, data->c));
+}
+
+static void cubic_grow(struct cubic_dtcp_ps_data * data, ktime_t now)
+{
+        uint_t target, cnt;
+
+        if (data->cwnd < data->ssthresh) {
+                if (data->cwnd < CUBIC_MAX_CREDIT)
+                        data->cwnd++;
+                return;
+        }
+
+        if (!ktime_to_ns(data->epoch_start))
+                cubic_epoch_start(data, now);
+
+        /* PDUs to receive before growing the window by one */
+        target = cubic_target(data, now);
+        if (target > data->cwnd)
+                cnt = max_t(uint_t, data->cwnd / (target - data->cwnd), 1);
+        else
+                cnt = 100 * data->cwnd;
+
+        if (++data->cwnd_cnt >= cnt) {
+                data->cwnd_cnt = 0;
+                if (data->cwnd < CUBIC_MAX_CREDIT)
+                        data->cwnd++;
+        }
+}
+
+static void cubic_reduce(struct cubic_dtcp_ps_data * data)
+{
+        int i;
+
+        /* Release bandwidth faster to new flows if still shrinking */
+        if (data->fast_convergence && data->cwnd < data->w_max)
+                data->w_max = (data->cwnd * (1024 + data->beta)) >> 11;
+        else
+                data->w_max = data->cwnd;
+
+        data->cwnd        = max_t(uint_t, (data->cwnd * data->beta) >> 10,
+                                  CUBIC_MIN_CREDIT);
+        data->ssthresh    = data->cwnd;
+        data->cwnd_cnt    = 0;
+        data->epoch_start = ktime_set(0, 0);
+        data->event_gate  = data->w_max;
+        data->since_event = 0;
+        data->events++;
+
+        for (i = 0; i < CUBIC_BW_WIN; i++)
+                data->bw[i] = ((u64) data->bw[i] * data->beta) >> 10;
+        data->full_bw_cnt = CUBIC_FULL_BW_SAMPLES;
+
+        LOG_DBG("CUBIC reduction: cwnd %u, w_max %u",
+                data->cwnd, data->w_max);
+}
+
+/* Runs once per received DT PDU, with the DTP sv_lock taken */
+static void cubic_update(struct cubic_dtcp_ps_data * data,
+                         const struct pci *          pci)
+{
+        seq_num_t seq;
+        bool      congested;
+        ktime_t   now = ktime_get();
+
+        seq       = pci_sequence_number_get(pci);
+        congested = pci_flags_get(pci) & PDU_FLAGS_EXPLICIT_CONGESTION;
+        if (data->have_seq && seq > data->last_seq + 1)
+                congested = true;
+        if (!data->have_seq || seq > data->last_seq)
+                data->last_seq = seq;
+        data->have_seq = true;
+
+        data->since_event++;
+        if (congested && data->since_event >= data->event_gate)
+                cubic_reduce(data);
+        else
+                cubic_grow(data, now);
+}
+
+static uint_t cubic_max_bw(struct cubic_dtcp_ps_data * data)
+{
+        uint_t bw = 0;
+        int    i;
+
+        for (i = 0; i < CUBIC_BW_WIN; i++)
+                bw = max(bw, data->bw[i]);
+
+        return bw;
+}
+
+/*
+ * Takes a delivery rate sample every rate_sample_us and returns the rate
+ * to advertise to the sender, 0 if it should not change
+ */
+static uint_t cubic_pacing_rate(struct dtcp *                dtcp,
+                                struct cubic_dtcp_ps_data * data,
+                                uint_t                      time_unit)
+{
+        ktime_t now = ktime_get();
+        uint_t  bytes, bw, gain;
+        s64     elapsed;
+
+        if (!ktime_to_ns(data->sample_start)) {
+                data->sample_start = now;
+                data->sample_bytes = dtcp->parent->sv->stats.rx_bytes;
+                return 0;
+        }
+
+        elapsed = ktime_us_delta(now, data->sample_start);
+        if (elapsed < data->rate_sample_us || elapsed <= 0)
+                return 0;
+
+        bytes = dtcp->parent->sv->stats.rx_bytes - data->sample_bytes;
+        data->sample_start = now;
+        data->sample_bytes = dtcp->parent->sv->stats.rx_bytes;
+
+        data->bw[data->bw_idx] = min_t(u64, div64_u64((u64) bytes * time_unit *
+                                                      USEC_PER_MSEC, elapsed),
+                                       UINT_MAX);
+        data->bw_idx = (data->bw_idx + 1) % CUBIC_BW_WIN;
+        data->cycle  = (data->cycle + 1) % CUBIC_CYCLE_LEN;
+
+        bw = cubic_max_bw(data);
+        if (!bw)
+                return 0;
+
+        /* Start up until the bandwidth stops growing by 25% */
+        if (data->full_bw_cnt < CUBIC_FULL_BW_SAMPLES) {
+                if (bw >= data->full_bw + (data->full_bw >> 2)) {
+                        data->full_bw     = bw;
+                        data->full_bw_cnt = 0;
+                } else {
+                        data->full_bw_cnt++;
+                }
+        }
+
+        gain = data->full_bw_cnt < CUBIC_FULL_BW_SAMPLES ?
+                CUBIC_STARTUP_GAIN : cubic_pacing_gain[data->cycle];
+
+        return max_t(u64, ((u64) bw * gain) >> 8, 1);
+}
+
+static int cubic_rcvr_flow_control(struct dtcp_ps * ps, const struct pci * pci)
+{
+        struct dtcp *               dtcp = ps->dm;
+        struct cubic_dtcp_ps_data * data = ps->priv;
+        seq_num_t                   LWE;
+        uint_t                      credit;
+
+        if (!dtcp || !data || !pci) {
+                LOG_ERR("Wrong input parameters, cannot run policy");
+                return -1;
+        }
+
+        spin_lock_bh(&dtcp->parent->sv_lock);
+        cubic_update(data, pci);
+        dtcp->sv->rcvr_credit = data->cwnd;
+        spin_unlock_bh(&dtcp->parent->sv_lock);
+
+        /* The credit is clamped while the reader lags behind */
+        credit = dtcp_rcvr_credit(dtcp);
+
+        spin_lock_bh(&dtcp->parent->sv_lock);
+        LWE = dtcp->parent->sv->rcv_left_window_edge;
+        /* Never shrink the window */
+        if (LWE + credit > dtcp->sv->rcvr_rt_wind_edge)
+                dtcp->sv->rcvr_rt_wind_edge = LWE + credit;
+        spin_unlock_bh(&dtcp->parent->sv_lock);
+
+        return 0;
+}
+
+static int cubic_rate_reduction(struct dtcp_ps * ps, const struct pci * pci)
+{
+        struct dtcp *               dtcp = ps->dm;
+        struct cubic_dtcp_ps_data * data = ps->priv;
+        uint_t                      rate;
+
+        if (!dtcp || !data || !pci) {
+                LOG_ERR("Wrong input parameters, cannot run policy");
+                return -1;
+        }
+
+        spin_lock_bh(&dtcp->parent->sv_lock);
+        /* Window based flows already ran the model */
+        if (!ps->flowctrl.window_based)
+                cubic_update(data, pci);
+
+        if (dtcp->sv->time_unit) {
+                rate = cubic_pacing_rate(dtcp, data, dtcp->sv->time_unit);
+                if (rate) {
+                        dtcp->sv->sndr_rate = rate;
+                        dtcp->sv->rcvr_rate = rate;
+                }
+        }
+        spin_unlock_bh(&dtcp->parent->sv_lock);
+
+        return 0;
+}
+
+static int cubic_ps_set_policy_set_param_priv(struct cubic_dtcp_ps_data * data,
+                                              const char *                name,
+                                              const char *                value)
+{
+        unsigned int uval;
+
+        if (!name) {
+                LOG_ERR("Null parameter name");
+                return -1;
+        }
+
+        if (!value) {
+                LOG_ERR("Null parameter value");
+                return -1;
+        }
+
+        if (kstrtouint(value, 10, &uval)) {
+                LOG_ERR("Could not parse value '%s' of parameter %s",
+                        value, name);
+                return -1;
+        }
+
+        if (strcmp(name, "beta") == 0) {
+                if (!uval || uval >= 1024) {
+                        LOG_ERR("beta must be in (0, 1024)");
+                        return -1;
+                }
+                data->beta = uval;
+                return 0;
+        }
+
+        if (strcmp(name, "c") == 0) {
+                if (!uval || uval > CUBIC_C_MAX) {
+                        LOG_ERR("c must be in (0, %d]", CUBIC_C_MAX);
+                        return -1;
+                }
+                data->c = uval;
+                return 0;
+        }
+
+        if (strcmp(name, "fast_convergence") == 0) {
+                data->fast_convergence = uval;
+                return 0;
+        }
+
+        if (strcmp(name, "rate_sample_us") == 0) {
+                if (!uval) {
+                        LOG_ERR("rate_sample_us cannot be 0");
+                        return -1;
+                }
+                data->rate_sample_us = uval;
+                return 0;
+        }
+
+        LOG_ERR("No such parameter to set");
+
+        return -1;
+}
+
+static int cubic_ps_set_policy_set_param(struct ps_base * bps,
+                                         const char *     name,
+                                         const char *     value)
+{
+        struct dtcp_ps * ps = container_of(bps, struct dtcp_ps, base);
+
+        return cubic_ps_set_policy_set_param_priv(ps->priv, name, value);
+}
+
+/* The DTCP policy set configuration also carries "rtx.*" parameters */
+static void cubic_config_apply(struct cubic_dtcp_ps_data * data,
+                               struct policy *             ps_conf)
+{
+        static const char * const names[] = {
+                "beta", "c", "fast_convergence", "rate_sample_us"
+        };
+        struct policy_parm * parm;
+        int                  i;
+
+        if (!ps_conf)
+                return;
+
+        for (i = 0; i < ARRAY_SIZE(names); i++) {
+                parm = policy_param_find(ps_conf, names[i]);
+                if (parm)
+                        cubic_ps_set_policy_set_param_priv(data,
+                                        policy_param_name(parm),
+                                        policy_param_value(parm));
+        }
+}
+
+static struct ps_base *
+dtcp_ps_cubic_create(struct rina_component * component)
+{
+        struct dtcp *               dtcp = dtcp_from_component(component);
+        struct dtcp_ps *            ps;
+        struct cubic_dtcp_ps_data * data;
+
+        if (!dtcp)
+                return NULL;
+
+        ps = rkzalloc(sizeof(*ps), GFP_KERNEL);
+        if (!ps)
+                return NULL;
+
+        data = rkzalloc(sizeof(*data), GFP_KERNEL);
+        if (!data) {
+                rkfree(ps);
+                return NULL;
+        }
+
+        data->beta             = CUBIC_BETA_DEFAULT;
+        data->c                = CUBIC_C_DEFAULT;
+        data->fast_convergence = 1;
+        data->rate_sample_us   = CUBIC_RATE_SAMPLE_US;
+        data->ssthresh         = CUBIC_MAX_CREDIT;
+        data->cwnd             = max_t(uint_t,
+                                       dtcp_initial_credit(dtcp->cfg),
+                                       CUBIC_MIN_CREDIT);
+        data->epoch_start      = ktime_set(0, 0);
+        data->sample_start     = ktime_set(0, 0);
+
+        cubic_config_apply(data, dtcp->cfg->dtcp_ps);
+
+        ps->base.set_policy_set_param   = cubic_ps_set_policy_set_param;
+        ps->dm                          = dtcp;
+        ps->priv                        = data;
+        ps->flow_init                   = NULL;
+        ps->lost_control_pdu            = NULL;
+        ps->rtt_estimator               = NULL;
+        ps->retransmission_timer_expiry = NULL;
+        ps->received_retransmission     = NULL;
+        ps->sender_ack                  = NULL;
+        ps->sending_ack                 = NULL;
+        ps->receiving_ack_list          = NULL;
+        ps->initial_rate                = NULL;
+        ps->receiving_flow_control      = NULL;
+        ps->update_credit               = NULL;
+        ps->rcvr_ack                    = NULL;
+        ps->rcvr_flow_control           = cubic_rcvr_flow_control;
+        ps->rate_reduction              = cubic_rate_reduction;
+        ps->rcvr_control_ack            = NULL;
+        ps->no_rate_slow_down           = NULL;
+        ps->no_override_default_peak    = NULL;
+
+        LOG_INFO("CUBIC DTCP policy created, beta %u, c %u, credit %u",
+                 data->beta, data->c, data->cwnd);
+
+        return &ps->base;
+}
+
+static void dtcp_ps_cubic_destroy(struct ps_base * bps)
+{
+        struct dtcp_ps * ps = container_of(bps, struct dtcp_ps, base);
+
+        if (bps) {
+                if (ps->priv)
+                        rkfree(ps->priv);
+                rkfree(ps);
+        }
+}
+
+static struct ps_factory cubic_factory = {
+        .owner   = THIS_MODULE,
+        .create  = dtcp_ps_cubic_create,
+        .destroy = dtcp_ps_cubic_destroy,
+};
+
+static int __init mod_init(void)
+{
+        int ret;
+
+        strcpy(cubic_factory.name, RINA_CUBIC_PS_NAME);
+
+        ret = dtcp_ps_publish(&cubic_factory);
+        if (ret) {
+                LOG_ERR("Failed to publish policy set factory");
+                return -1;
+        }
+
+        LOG_INFO("DTCP CUBIC policy set loaded successfully");
+
+        return 0;
+}
+
+static void __exit mod_exit(void)
+{
+        int ret = dtcp_ps_unpublish(RINA_CUBIC_PS_NAME);
+
+        if (ret) {
+                LOG_ERR("Failed to unpublish policy set factory");
+                return;
+        }
+
+        LOG_INFO("DTCP CUBIC policy set unloaded successfully");
+}
+
+module_init(mod_init);
+module_exit(mod_exit);
+
+MODULE_DESCRIPTION("DTCP CUBIC policy set");
+
+MODULE_LICENSE("GPL");
@@ -0,0 +1,693 @@
+/*
+ * DRR RMT policy set
+ *
+ * Per QoS cube scheduling: every N-1 port keeps one queue per QoS cube of
+ * the DIF, plus one for management PDUs and a default one for unknown QoS
+ * ids. Queues are served in strict priority order and, within a priority
+ * level, with Deficit Round Robin, with quanta weighted by the average
+ * bandwidth of the cubes. PDUs are queued through their sk_buff, so
+ * enqueue and dequeue are O(1) and do not allocate.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <linux/export.h>
+#include <linux/module.h>
+#include <linux/string.h>
+#include <linux/bitops.h>
+#include <linux/ktime.h>
+#include <linux/skbuff.h>
+
+#define RINA_PREFIX "drr-plugin"
+
+#include "logs.h"
+#include "rds/rmem.h"
+#include "rds/robjects.h"
+#include "rmt-ps.h"
+#include "policies.h"
+
+#define RINA_DRR_PS_NAME "drr-ps"
+
+#define DEFAULT_Q_MAX      1000
+#define DEFAULT_QUANTUM    1500
+/* Priority levels, 0 is the highest one and is used by management PDUs */
+#define DRR_PRIOS          8
+#define DRR_DEFAULT_PRIO   1
+/* QoS ids above this one are served by the default queue */
+#define DRR_MAX_QOS_ID     255
+/* Cap of the quantum of a cube relative to the slowest one */
+#define DRR_MAX_WEIGHT     64
+
+/* Per QoS id configuration, 0 (or -1 for prio) if not set */
+struct drr_qos_conf {
+	int          prio;
+	unsigned int quantum;
+	unsigned int q_max;
+};
+
+struct drr_ps_data {
+	/* Max number of PDUs queued in each queue of a N-1 port */
+	unsigned int        q_max;
+	/* Bytes served per round by the slowest QoS cube */
+	unsigned int        quantum;
+	/* Set through "<qos_id>.<param>" parameters */
+	struct drr_qos_conf qos[DRR_MAX_QOS_ID + 1];
+};
+
+/* Kept in the sk_buff of the PDU while it is queued */
+struct drr_skb_cb {
+	struct du * du;
+	ktime_t     enqueued;
+};
+
+#define DRR_SKB_CB(skb) ((struct drr_skb_cb *) (skb)->cb)
+
+struct drr_queue;
+
+struct drr_class {
+	struct drr_queue *  q;
+	qos_id_t            qos_id;
+	unsigned int        prio;
+	unsigned int        quantum;
+	int                 deficit;
+	unsigned int        q_max;
+	bool                mgmt;
+	struct sk_buff_head pdus;
+	unsigned int        bytes;
+	/* In the active list of its priority while it has PDUs */
+	struct list_head    alist;
+	struct list_head    list;
+
+	unsigned long       tx_pdus;
+	unsigned long       tx_bytes;
+	unsigned long       drop_pdus;
+	u64                 sojourn_us;
+	unsigned int        max_sojourn_us;
+	struct robject      robj;
+};
+
+struct drr_queue {
+	struct rmt_n1_port * n1_port;
+	struct list_head     classes;
+	struct drr_class *   mgmt;
+	struct drr_class *   dflt;
+	struct drr_class *   by_qos[DRR_MAX_QOS_ID + 1];
+	struct list_head     active[DRR_PRIOS];
+	/* Priorities with a non empty active list */
+	unsigned long        active_prios;
+	unsigned int         qlen;
+
+	unsigned long        tx_pdus;
+	unsigned long        drop_pdus;
+	struct robject       robj;
+};
+
+static ssize_t drr_class_attr_show(struct robject *        robj,
+				   struct robj_attribute * attr,
+				   char *                  buf)
+{
+	struct drr_class * c;
+	ssize_t            ret = 0;
+
+	c = container_of(robj, struct drr_class, robj);
+	if (!c)
+		return 0;
+
+	spin_lock_bh(&c->q->n1_port->lock);
+	if (strcmp(robject_attr_name(attr), "qos_id") == 0)
+		ret = sprintf(buf, "%d\n", c->qos_id);
+	else if (strcmp(robject_attr_name(attr), "priority") == 0)
+		ret = sprintf(buf, "%u\n", c->prio);
+	else if (strcmp(robject_attr_name(attr), "quantum") == 0)
+		ret = sprintf(buf, "%u\n", c->quantum);
+	else if (strcmp(robject_attr_name(attr), "q_max") == 0)
+		ret = sprintf(buf, "%u\n", c->q_max);
+	else if (strcmp(robject_attr_name(attr), "queued_pdus") == 0)
+		ret = sprintf(buf, "%u\n", skb_queue_len(&c->pdus));
+	else if (strcmp(robject_attr_name(attr), "queued_bytes") == 0)
+		ret = sprintf(buf, "%u\n", c->bytes);
+	else if (strcmp(robject_attr_name(attr), "tx_pdus") == 0)
+		ret = sprintf(buf, "%lu\n", c->tx_pdus);
+	else if (strcmp(robject_attr_name(attr), "tx_bytes") == 0)
+		ret = sprintf(buf, "%lu\n", c->tx_bytes);
+	else if (strcmp(robject_attr_name(attr), "drop_pdus") == 0)
+		ret = sprintf(buf, "%lu\n", c->drop_pdus);
+	else if (strcmp(robject_attr_name(attr), "avg_sojourn_us") == 0)
+		ret = sprintf(buf, "%llu\n", c->tx_pdus ?
+			      div_u64(c->sojourn_us, c->tx_pdus) : 0);
+	else if (strcmp(robject_attr_name(attr), "max_sojourn_us") == 0)
+		ret = sprintf(buf, "%u\n", c->max_sojourn_us);
+	spin_unlock_bh(&c->q->n1_port->lock);
+
+	return ret;
+}
+RINA_SYSFS_OPS(drr_class);
+RINA_ATTRS(drr_class, qos_id, priority, quantum, q_max, queued_pdus,
+	   queued_bytes, tx_pdus, tx_bytes, drop_pdus, avg_sojourn_us,
+	   max_sojourn_us);
+RINA_KTYPE(drr_class);
+
+static ssize_t drr_queue_attr_show(struct robject *        robj,
+				   struct robj_attribute * attr,
+				   char *                  buf)
+{
+	struct drr_queue * q;
+	ssize_t            ret = 0;
+
+	q = container_of(robj, struct drr_queue, robj);
+	if (!q)
+		return 0;
+
+	spin_lock_bh(&q->n1_port->lock);
+	if (strcmp(robject_attr_name(attr), "queued_pdus") == 0)
+		ret = sprintf(buf, "%u\n", q->qlen);
+	else if (strcmp(robject_attr_name(attr), "tx_pdus") == 0)
+		ret = sprintf(buf, "%lu\n", q->tx_pdus);
+	else if (strcmp(robject_attr_name(attr), "drop_pdus") == 0)
+		ret = sprintf(buf, "%lu\n", q->drop_pdus);
+	spin_unlock_bh(&q->n1_port->lock);
+
+	return ret;
+}
+RINA_SYSFS_OPS(drr_queue);
+RINA_ATTRS(drr_queue, queued_pdus, tx_pdus, drop_pdus);
+RINA_KTYPE(drr_queue);
+
+static struct drr_class * drr_class_create(struct drr_queue * q,
+					   qos_id_t           qos_id,
+					   unsigned int       prio,
+					   unsigned int       quantum,
+					   unsigned int       q_max,
+					   const char *       name)
+{
+	struct drr_class * tmp;
+
+	tmp = rkzalloc(sizeof(*tmp), GFP_ATOMIC);
+	if (!tmp)
+		return NULL;
+
+	tmp->q       = q;
+	tmp->qos_id  = qos_id;
+	tmp->prio    = prio;
+	tmp->quantum = quantum;
+	tmp->q_max   = q_max;
+	__skb_queue_head_init(&tmp->pdus);
+	INIT_LIST_HEAD(&tmp->alist);
+
+	if (robject_init_and_add(&tmp->robj, &drr_class_rtype, &q->robj,
+				 "%s", name)) {
+		LOG_ERR("Failed to create DRR queue sysfs entry %s", name);
+		rkfree(tmp);
+		return NULL;
+	}
+
+	list_add_tail(&tmp->list, &q->classes);
+
+	return tmp;
+}
+
+static void drr_class_destroy(struct drr_queue * q,
+			      struct drr_class * c)
+{
+	struct sk_buff * skb;
+
+	q->qlen -= skb_queue_len(&c->pdus);
+	while ((skb = __skb_dequeue(&c->pdus)) != NULL)
+		du_destroy(DRR_SKB_CB(skb)->du);
+
+	list_del(&c->alist);
+	list_del(&c->list);
+	robject_del(&c->robj);
+	rkfree(c);
+}
+
+static int drr_queue_destroy(struct drr_queue * q)
+{
+	struct drr_class * c, * n;
+
+	if (!q)
+		return -1;
+
+	list_for_each_entry_safe(c, n, &q->classes, list)
+		drr_class_destroy(q, c);
+	robject_del(&q->robj);
+	rkfree(q);
+
+	return 0;
+}
+
+/* Weight of a cube, relative to the cube with the lowest average bandwidth */
+static unsigned int drr_cube_weight(const struct qos_cube * cube,
+				    uint32_t                min_bw)
+{
+	if (!cube->avg_bw || !min_bw)
+		return 1;
+
+	return min_t(uint32_t, cube->avg_bw / min_bw, DRR_MAX_WEIGHT);
+}
+
+static int drr_classes_create(struct drr_queue *   q,
+			      struct drr_ps_data * data,
+			      struct efcp_config * cfg)
+{
+	struct qos_cube_entry *     entry;
+	const struct drr_qos_conf * conf;
+	struct drr_class *          c;
+	uint32_t                    min_bw = 0;
+	char                        name[16];
+
+	q->mgmt = drr_class_create(q, -1, 0, data->quantum, data->q_max,
+				   "mgmt");
+	if (!q->mgmt)
+		return -1;
+	q->mgmt->mgmt = true;
+
+	q->dflt = drr_class_create(q, -1, DRR_DEFAULT_PRIO, data->quantum,
+				   data->q_max, "default");
+	if (!q->dflt)
+		return -1;
+
+	if (!cfg)
+		return 0;
+
+	list_for_each_entry(entry, &cfg->qos_cubes, next) {
+		if (entry->entry->avg_bw &&
+		    (!min_bw || entry->entry->avg_bw < min_bw))
+			min_bw = entry->entry->avg_bw;
+	}
+
+	list_for_each_entry(entry, &cfg->qos_cubes, next) {
+		if (entry->entry->id > DRR_MAX_QOS_ID) {
+			LOG_WARN("QoS cube %u served by the default queue",
+				 entry->entry->id);
+			continue;
+		}
+		if (q->by_qos[entry->entry->id])
+			continue;
+
+		conf = &data->qos[entry->entry->id];
+		snprintf(name, sizeof(name), "qos-%u", entry->entry->id);
+		c = drr_class_create(q, entry->entry->id,
+				     conf->prio >= 0 ? conf->prio :
+				     DRR_DEFAULT_PRIO,
+				     conf->quantum ? conf->quantum :
+				     data->quantum *
+				     drr_cube_weight(entry->entry, min_bw),
+				     conf->q_max ? conf->q_max : data->q_max,
+				     name);
+		if (!c)
+			return -1;
+
+		q->by_qos[entry->entry->id] = c;
+	}
+
+	return 0;
+}
+
+static void * drr_rmt_q_create_policy(struct rmt_ps *      ps,
+				      struct rmt_n1_port * n1_port)
+{
+	struct drr_queue * q;
+	int                i;
+
+	if (!ps || !n1_port || !ps->priv) {
+		LOG_ERR("Wrong input parameters for DRR q create policy");
+		return NULL;
+	}
+
+	q = rkzalloc(sizeof(*q), GFP_ATOMIC);
+	if (!q) {
+		LOG_ERR("Could not create queue for n1_port %d",
+			n1_port->port_id);
+		return NULL;
+	}
+
+	q->n1_port = n1_port;
+	INIT_LIST_HEAD(&q->classes);
+	for (i = 0; i < DRR_PRIOS; i++)
+		INIT_LIST_HEAD(&q->active[i]);
+
+	if (robject_init_and_add(&q->robj, &drr_queue_rtype,
+				 &n1_port->robj, "drr")) {
+		LOG_ERR("Failed to create DRR queue sysfs entry");
+		rkfree(q);
+		return NULL;
+	}
+
+	/* Parameters changed later apply to the N-1 ports bound afterwards */
+	if (drr_classes_create(q, ps->priv, rmt_efcp_config(ps->dm))) {
+		LOG_ERR("Could not create DRR queues for n1_port %d",
+			n1_port->port_id);
+		drr_queue_destroy(q);
+		return NULL;
+	}
+
+	return q;
+}
+
+static int drr_rmt_q_destroy_policy(struct rmt_ps *      ps,
+				    struct rmt_n1_port * n1_port)
+{
+	struct drr_queue * q;
+
+	if (!ps || !n1_port) {
+		LOG_ERR("Wrong input parameters for DRR q destroy policy");
+		return -1;
+	}
+
+	q = n1_port->rmt_ps_queues;
+	n1_port->rmt_ps_queues = NULL;
+
+	return drr_queue_destroy(q);
+}
+
+static struct drr_class * drr_classify(struct drr_queue * q,
+				       const struct du *  du)
+{
+	qos_id_t qos_id;
+
+	if (pci_type(&du->pci) == PDU_TYPE_MGMT)
+		return q->mgmt;
+
+	qos_id = pci_qos_id(&du->pci);
+	if (qos_id >= 0 && qos_id <= DRR_MAX_QOS_ID && q->by_qos[qos_id])
+		return q->by_qos[qos_id];
+
+	return q->dflt;
+}
+
+static int drr_rmt_enqueue_policy(struct rmt_ps *      ps,
+				  struct rmt_n1_port * n1_port,
+				  struct du *          du)
+{
+	struct drr_queue * q;
+	struct drr_class * c;
+	struct sk_buff *   skb;
+
+	BUILD_BUG_ON(sizeof(struct drr_skb_cb) >
+		     sizeof(((struct sk_buff *) 0)->cb));
+
+	if (!ps || !n1_port || !du || !du->skb) {
+		LOG_ERR("Wrong input parameters for DRR enqueue policy");
+		if (du)
+			du_destroy(du);
+		return RMT_PS_ENQ_ERR;
+	}
+
+	q = n1_port->rmt_ps_queues;
+	if (!q) {
+		LOG_ERR("Could not find queue for n1_port %d",
+			n1_port->port_id);
+		du_destroy(du);
+		return RMT_PS_ENQ_ERR;
+	}
+
+	c = drr_classify(q, du);
+	if (skb_queue_len(&c->pdus) >= c->q_max && !c->mgmt) {
+		LOG_DBG("PDU dropped, q_max reached in n1_port %d, qos %d",
+			n1_port->port_id, c->qos_id);
+		c->drop_pdus++;
+		q->drop_pdus++;
+		du_destroy(du);
+		return RMT_PS_ENQ_DROP;
+	}
+
+	skb = du->skb;
+	DRR_SKB_CB(skb)->du       = du;
+	DRR_SKB_CB(skb)->enqueued = ktime_get();
+	__skb_queue_tail(&c->pdus, skb);
+	c->bytes += du_len(du);
+	q->qlen++;
+
+	if (list_empty(&c->alist)) {
+		c->deficit = c->quantum;
+		list_add_tail(&c->alist, &q->active[c->prio]);
+		__set_bit(c->prio, &q->active_prios);
+	}
+
+	return RMT_PS_ENQ_SCHED;
+}
+
+static struct du * drr_rmt_dequeue_policy(struct rmt_ps *      ps,
+					  struct rmt_n1_port * n1_port)
+{
+	struct drr_queue * q;
+	struct drr_class * c;
+	struct sk_buff *   skb;
+	struct du *        du;
+	unsigned int       prio;
+	unsigned int       sojourn;
+	ssize_t            len;
+
+	if (!ps || !n1_port) {
+		LOG_ERR("Wrong input parameters for DRR dequeue policy");
+		return NULL;
+	}
+
+	q = n1_port->rmt_ps_queues;
+	if (!q) {
+		LOG_ERR("Could not find queue for n1_port %d",
+			n1_port->port_id);
+		return NULL;
+	}
+
+	if (!q->active_prios)
+		return NULL;
+
+	prio = __ffs(q->active_prios);
+	for (;;) {
+		c   = list_first_entry(&q->active[prio], struct drr_class,
+				       alist);
+		skb = skb_peek(&c->pdus);
+		len = du_len(DRR_SKB_CB(skb)->du);
+		if (len <= c->deficit)
+			break;
+
+		c->deficit += c->quantum;
+		list_move_tail(&c->alist, &q->active[prio]);
+	}
+
+	__skb_unlink(skb, &c->pdus);
+	du = DRR_SKB_CB(skb)->du;
+	sojourn = ktime_us_delta(ktime_get(), DRR_SKB_CB(skb)->enqueued);
+	c->deficit -= len;
+	c->bytes   -= len;
+	q->qlen--;
+
+	if (skb_queue_empty(&c->pdus)) {
+		list_del_init(&c->alist);
+		if (list_empty(&q->active[prio]))
+			__clear_bit(prio, &q->active_prios);
+	}
+
+	c->tx_pdus++;
+	c->tx_bytes   += len;
+	c->sojourn_us += sojourn;
+	if (sojourn > c->max_sojourn_us)
+		c->max_sojourn_us = sojourn;
+	q->tx_pdus++;
+
+	return du;
+}
+
+/* Parameters are either global or "<qos_id>.<name>" for a QoS cube */
+static int drr_ps_set_policy_set_param_priv(struct drr_ps_data * data,
+					    const char *         name,
+					    const char *         value)
+{
+	struct drr_qos_conf * conf = NULL;
+	unsigned int          uval;
+	unsigned int          qos_id;
+	const char *          dot;
+	char                  id[8];
+
+	if (!name) {
+		LOG_ERR("Null parameter name");
+		return -1;
+	}
+
+	if (!value) {
+		LOG_ERR("Null parameter value");
+		return -1;
+	}
+
+	if (kstrtouint(value, 10, &uval)) {
+		LOG_ERR("Could not parse value '%s' of parameter %s",
+			value, name);
+		return -1;
+	}
+
+	dot = strchr(name, '.');
+	if (dot) {
+		if (dot - name >= (ptrdiff_t) sizeof(id)) {
+			LOG_ERR("Invalid QoS id in parameter %s", name);
+			return -1;
+		}
+		memcpy(id, name, dot - name);
+		id[dot - name] = '\0';
+		if (kstrtouint(id, 10, &qos_id) || qos_id > DRR_MAX_QOS_ID) {
+			LOG_ERR("Invalid QoS id in parameter %s", name);
+			return -1;
+		}
+		conf = &data->qos[qos_id];
+		name = dot + 1;
+	}
+
+	if (strcmp(name, "q_max") == 0) {
+		if (conf)
+			conf->q_max = uval;
+		else
+			data->q_max = uval;
+		return 0;
+	}
+
+	if (strcmp(name, "quantum") == 0) {
+		if (!uval) {
+			LOG_ERR("The DRR quantum cannot be 0");
+			return -1;
+		}
+		if (conf)
+			conf->quantum = uval;
+		else
+			data->quantum = uval;
+		return 0;
+	}
+
+	if (conf && strcmp(name, "priority") == 0) {
+		if (uval >= DRR_PRIOS) {
+			LOG_ERR("Priority %u out of range [0, %d)",
+				uval, DRR_PRIOS);
+			return -1;
+		}
+		conf->prio = uval;
+		return 0;
+	}
+
+	LOG_ERR("No such parameter to set");
+
+	return -1;
+}
+
+static int rmt_config_apply(struct policy_parm * param, void * data)
+{
+	return drr_ps_set_policy_set_param_priv(data,
+			policy_param_name(param),
+			policy_param_value(param));
+}
+
+static int drr_ps_set_policy_set_param(struct ps_base * bps,
+				       const char *     name,
+				       const char *     value)
+{
+	struct rmt_ps * ps = container_of(bps, struct rmt_ps, base);
+
+	return drr_ps_set_policy_set_param_priv(ps->priv, name, value);
+}
+
+static struct ps_base *
+rmt_ps_drr_create(struct rina_component * component)
+{
+	struct rmt *         rmt = rmt_from_component(component);
+	struct rmt_ps *      ps;
+	struct drr_ps_data * data;
+	struct rmt_config *  rmt_cfg;
+	int                  i;
+
+	ps = rkzalloc(sizeof(*ps), GFP_KERNEL);
+	if (!ps)
+		return NULL;
+
+	data = rkzalloc(sizeof(*data), GFP_KERNEL);
+	if (!data) {
+		rkfree(ps);
+		return NULL;
+	}
+
+	data->q_max   = DEFAULT_Q_MAX;
+	data->quantum = DEFAULT_QUANTUM;
+	for (i = 0; i <= DRR_MAX_QOS_ID; i++)
+		data->qos[i].prio = -1;
+
+	ps->base.set_policy_set_param = drr_ps_set_policy_set_param;
+	ps->dm    = rmt;
+	ps->priv  = data;
+
+	rmt_cfg = rmt_config_get(rmt);
+	if (rmt_cfg)
+		policy_for_each(rmt_cfg->policy_set, data, rmt_config_apply);
+
+	ps->rmt_dequeue_policy   = drr_rmt_dequeue_policy;
+	ps->rmt_enqueue_policy   = drr_rmt_enqueue_policy;
+	ps->rmt_q_create_policy  = drr_rmt_q_create_policy;
+	ps->rmt_q_destroy_policy = drr_rmt_q_destroy_policy;
+
+	LOG_INFO("DRR RMT PS loaded, q_max = %u, quantum = %u",
+		 data->q_max, data->quantum);
+
+	return &ps->base;
+}
+
+static void rmt_ps_drr_destroy(struct ps_base * bps)
+{
+	struct rmt_ps * ps = container_of(bps, struct rmt_ps, base);
+
+	if (bps) {
+		if (ps->priv)
+			rkfree(ps->priv);
+		rkfree(ps);
+	}
+}
+
+static struct ps_factory drr_factory = {
+	.owner   = THIS_MODULE,
+	.create  = rmt_ps_drr_create,
+	.destroy = rmt_ps_drr_destroy,
+};
+
+static int __init mod_init(void)
+{
+	int ret;
+
+	strcpy(drr_factory.name, RINA_DRR_PS_NAME);
+
+	ret = rmt_ps_publish(&drr_factory);
+	if (ret) {
+		LOG_ERR("Failed to publish policy set factory");
+		return -1;
+	}
+
+	LOG_INFO("RMT DRR policy set loaded successfully");
+
+	return 0;
+}
+
+static void __exit mod_exit(void)
+{
+	int ret = rmt_ps_unpublish(RINA_DRR_PS_NAME);
+
+	if (ret) {
+		LOG_ERR("Failed to unpublish policy set factory");
+		return;
+	}
+
+	LOG_INFO("RMT DRR policy set unloaded successfully");
+}
+
+module_init(mod_init);
+module_exit(mod_exit);
+
+MODULE_DESCRIPTION("RMT DRR policy set");
+
+MODULE_LICENSE("GPL");
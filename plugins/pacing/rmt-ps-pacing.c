@@ -0,0 +1,616 @@
+/*
+ * Pacing RMT policy set
+ *
+ * Earliest departure time (EDT) pacing: every PDU gets a departure time
+ * when it is enqueued, computed from the rate of its flow (configured, or
+ * stamped by DTP for rate based flow controlled connections), and the N-1
+ * port releases PDUs in departure time order, no faster than the port rate.
+ * A high resolution timer kicks the RMT when the next PDU becomes due.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <linux/export.h>
+#include <linux/module.h>
+#include <linux/string.h>
+#include <linux/hashtable.h>
+#include <linux/hrtimer.h>
+#include <linux/jhash.h>
+#include <linux/ktime.h>
+
+#define RINA_PREFIX "pacing-plugin"
+
+#include "logs.h"
+#include "rds/rmem.h"
+#include "rds/rfifo.h"
+#include "rds/robjects.h"
+#include "rmt-ps.h"
+#include "policies.h"
+
+#define RINA_PACING_PS_NAME "pacing-ps"
+
+#define DEFAULT_Q_MAX      1000
+#define PACING_FLOW_BITS   6
+/* Idle flows looked at for reclaiming each time a new flow shows up */
+#define PACING_FLOW_GC_MAX 8
+
+struct pacing_ps_data {
+	/* Max number of PDUs queued in a N-1 port */
+	unsigned int q_max;
+	/* Rate of each N-1 port, 0 if not paced */
+	unsigned int port_rate_kbps;
+	/* Rate of each flow, 0 if only DTP stamped flows are paced */
+	unsigned int flow_rate_kbps;
+};
+
+struct pacing_flow_key {
+	address_t src;
+	address_t dst;
+	cep_id_t  src_cep;
+	cep_id_t  dst_cep;
+	qos_id_t  qos_id;
+};
+
+struct pacing_flow {
+	struct pacing_flow_key key;
+	struct hlist_node      hlist;
+	/* In the active list while it has PDUs, in the idle one otherwise */
+	struct list_head       list;
+	struct rfifo *         queue;
+	unsigned int           qlen;
+	/* Departure time of the next PDU of the flow */
+	ktime_t                next;
+
+	unsigned long          tx_pdus;
+	unsigned long          tx_bytes;
+	unsigned long          delayed_pdus;
+	u64                    delay_us;
+	unsigned long          drop_pdus;
+};
+
+struct pacing_queue {
+	struct rmt *         rmt;
+	struct rmt_n1_port * n1_port;
+	DECLARE_HASHTABLE(flows, PACING_FLOW_BITS);
+	struct list_head     active;
+	struct list_head     idle;
+	unsigned int         nflows;
+	unsigned int         qlen;
+	/* Departure time of the next PDU of the port */
+	ktime_t              next;
+	struct hrtimer       timer;
+
+	unsigned long        tx_pdus;
+	unsigned long        drop_pdus;
+	unsigned long        holds;
+	struct robject       robj;
+};
+
+static ssize_t pacing_queue_flow_stats(struct pacing_queue * q, char * buf)
+{
+	struct pacing_flow * f;
+	ssize_t              len;
+	int                  bucket;
+
+	len = scnprintf(buf, PAGE_SIZE, "src dst qos_id src_cep dst_cep qlen "
+			"tx_pdus tx_bytes delayed_pdus avg_delay_us "
+			"drop_pdus\n");
+	hash_for_each(q->flows, bucket, f, hlist) {
+		len += scnprintf(buf + len, PAGE_SIZE - len,
+				 "%u %u %d %d %d %u %lu %lu %lu %llu %lu\n",
+				 f->key.src, f->key.dst, f->key.qos_id,
+				 f->key.src_cep, f->key.dst_cep, f->qlen,
+				 f->tx_pdus, f->tx_bytes, f->delayed_pdus,
+				 f->delayed_pdus ?
+				 div_u64(f->delay_us, f->delayed_pdus) : 0,
+				 f->drop_pdus);
+	}
+
+	return len;
+}
+
+static ssize_t pacing_queue_attr_show(struct robject *        robj,
+				      struct robj_attribute * attr,
+				      char *                  buf)
+{
+	struct pacing_queue * q;
+	ssize_t               ret = 0;
+
+	q = container_of(robj, struct pacing_queue, robj);
+	if (!q)
+		return 0;
+
+	spin_lock_bh(&q->n1_port->lock);
+	if (strcmp(robject_attr_name(attr), "flows") == 0)
+		ret = sprintf(buf, "%u\n", q->nflows);
+	else if (strcmp(robject_attr_name(attr), "queued_pdus") == 0)
+		ret = sprintf(buf, "%u\n", q->qlen);
+	else if (strcmp(robject_attr_name(attr), "tx_pdus") == 0)
+		ret = sprintf(buf, "%lu\n", q->tx_pdus);
+	else if (strcmp(robject_attr_name(attr), "drop_pdus") == 0)
+		ret = sprintf(buf, "%lu\n", q->drop_pdus);
+	else if (strcmp(robject_attr_name(attr), "holds") == 0)
+		ret = sprintf(buf, "%lu\n", q->holds);
+	else if (strcmp(robject_attr_name(attr), "flow_stats") == 0)
+		ret = pacing_queue_flow_stats(q, buf);
+	spin_unlock_bh(&q->n1_port->lock);
+
+	return ret;
+}
+RINA_SYSFS_OPS(pacing_queue);
+RINA_ATTRS(pacing_queue, flows, queued_pdus, tx_pdus, drop_pdus, holds,
+	   flow_stats);
+RINA_KTYPE(pacing_queue);
+
+/* Time it takes to send len bytes at rate_kbps */
+static u64 pacing_len_ns(ssize_t len, unsigned int rate_kbps)
+{ return div_u64((u64) len * 8 * NSEC_PER_MSEC, rate_kbps); }
+
+static void pacing_flow_key_get(struct pacing_flow_key * key,
+				const struct du *        du)
+{
+	memset(key, 0, sizeof(*key));
+	key->src     = pci_source(&du->pci);
+	key->dst     = pci_destination(&du->pci);
+	key->src_cep = pci_cep_source(&du->pci);
+	key->dst_cep = pci_cep_destination(&du->pci);
+	key->qos_id  = pci_qos_id(&du->pci);
+}
+
+static struct pacing_flow * pacing_flow_find(struct pacing_queue *          q,
+					     const struct pacing_flow_key * key,
+					     u32                            hash)
+{
+	struct pacing_flow * f;
+
+	hash_for_each_possible(q->flows, f, hlist, hash) {
+		if (!memcmp(&f->key, key, sizeof(*key)))
+			return f;
+	}
+
+	return NULL;
+}
+
+static struct pacing_flow * pacing_flow_create(struct pacing_queue *          q,
+					       const struct pacing_flow_key * key,
+					       u32                            hash)
+{
+	struct pacing_flow * tmp;
+
+	tmp = rkzalloc(sizeof(*tmp), GFP_ATOMIC);
+	if (!tmp)
+		return NULL;
+
+	tmp->queue = rfifo_create_ni();
+	if (!tmp->queue) {
+		rkfree(tmp);
+		return NULL;
+	}
+
+	tmp->key  = *key;
+	tmp->next = ktime_set(0, 0);
+	INIT_LIST_HEAD(&tmp->list);
+	list_add_tail(&tmp->list, &q->idle);
+	hash_add(q->flows, &tmp->hlist, hash);
+	q->nflows++;
+
+	return tmp;
+}
+
+static void pacing_flow_destroy(struct pacing_queue * q,
+				struct pacing_flow *  f)
+{
+	hash_del(&f->hlist);
+	list_del(&f->list);
+	q->qlen -= f->qlen;
+	q->nflows--;
+	rfifo_destroy(f->queue, (void (*)(void *)) du_destroy);
+	rkfree(f);
+}
+
+/* Oldest idle flows first, keeping those that still owe time to their rate */
+static void pacing_flows_gc(struct pacing_queue * q, ktime_t now)
+{
+	struct pacing_flow * f, * n;
+	int                  i = 0;
+
+	list_for_each_entry_safe(f, n, &q->idle, list) {
+		if (i++ >= PACING_FLOW_GC_MAX)
+			break;
+		if (ktime_compare(f->next, now) > 0)
+			continue;
+		pacing_flow_destroy(q, f);
+	}
+}
+
+static enum hrtimer_restart pacing_timer_expired(struct hrtimer * timer)
+{
+	struct pacing_queue * q = container_of(timer, struct pacing_queue,
+					       timer);
+
+	rmt_egress_schedule(q->rmt);
+
+	return HRTIMER_NORESTART;
+}
+
+static int pacing_queue_destroy(struct pacing_queue * q)
+{
+	struct pacing_flow * f;
+	struct hlist_node *  n;
+	int                  bucket;
+
+	if (!q)
+		return -1;
+
+	hrtimer_cancel(&q->timer);
+	hash_for_each_safe(q->flows, bucket, n, f, hlist)
+		pacing_flow_destroy(q, f);
+	robject_del(&q->robj);
+	rkfree(q);
+
+	return 0;
+}
+
+static void * pacing_rmt_q_create_policy(struct rmt_ps *      ps,
+					 struct rmt_n1_port * n1_port)
+{
+	struct pacing_queue * q;
+
+	if (!ps || !n1_port) {
+		LOG_ERR("Wrong input parameters for pacing q create policy");
+		return NULL;
+	}
+
+	q = rkzalloc(sizeof(*q), GFP_ATOMIC);
+	if (!q) {
+		LOG_ERR("Could not create queue for n1_port %d",
+			n1_port->port_id);
+		return NULL;
+	}
+
+	q->rmt     = ps->dm;
+	q->n1_port = n1_port;
+	q->next    = ktime_set(0, 0);
+	hash_init(q->flows);
+	INIT_LIST_HEAD(&q->active);
+	INIT_LIST_HEAD(&q->idle);
+	hrtimer_init(&q->timer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS);
+	q->timer.function = pacing_timer_expired;
+
+	if (robject_init_and_add(&q->robj, &pacing_queue_rtype,
+				 &n1_port->robj, "pacing")) {
+		LOG_ERR("Failed to create pacing queue sysfs entry");
+		rkfree(q);
+		return NULL;
+	}
+
+	return q;
+}
+
+static int pacing_rmt_q_destroy_policy(struct rmt_ps *      ps,
+				       struct rmt_n1_port * n1_port)
+{
+	struct pacing_queue * q;
+
+	if (!ps || !n1_port) {
+		LOG_ERR("Wrong input parameters for pacing q destroy policy");
+		return -1;
+	}
+
+	q = n1_port->rmt_ps_queues;
+	n1_port->rmt_ps_queues = NULL;
+
+	return pacing_queue_destroy(q);
+}
+
+static int pacing_rmt_enqueue_policy(struct rmt_ps *      ps,
+				     struct rmt_n1_port * n1_port,
+				     struct du *          du)
+{
+	struct pacing_ps_data * data;
+	struct pacing_queue *   q;
+	struct pacing_flow *    f;
+	struct pacing_flow_key  key;
+	ktime_t                 now, edt;
+	ssize_t                 len;
+	u32                     hash;
+
+	if (!ps || !n1_port || !du || !ps->priv) {
+		LOG_ERR("Wrong input parameters for pacing enqueue policy");
+		if (du)
+			du_destroy(du);
+		return RMT_PS_ENQ_ERR;
+	}
+
+	data = ps->priv;
+	q    = n1_port->rmt_ps_queues;
+	if (!q) {
+		LOG_ERR("Could not find queue for n1_port %d",
+			n1_port->port_id);
+		du_destroy(du);
+		return RMT_PS_ENQ_ERR;
+	}
+
+	now = ktime_get();
+	pacing_flow_key_get(&key, du);
+	hash = jhash(&key, sizeof(key), 0);
+	f = pacing_flow_find(q, &key, hash);
+	if (!f) {
+		pacing_flows_gc(q, now);
+		f = pacing_flow_create(q, &key, hash);
+		if (!f) {
+			LOG_ERR("Could not create flow in n1_port %d",
+				n1_port->port_id);
+			du_destroy(du);
+			return RMT_PS_ENQ_ERR;
+		}
+	}
+
+	if (q->qlen >= data->q_max && pci_type(&du->pci) != PDU_TYPE_MGMT) {
+		LOG_DBG("PDU dropped, q_max reached in n1_port %d",
+			n1_port->port_id);
+		f->drop_pdus++;
+		q->drop_pdus++;
+		du_destroy(du);
+		return RMT_PS_ENQ_DROP;
+	}
+
+	/* Not before the flow is due, nor before DTP wants it out */
+	edt = ktime_compare(f->next, now) > 0 ? f->next : now;
+	if (ktime_compare(du->tx_time, edt) > 0)
+		edt = du->tx_time;
+
+	len     = du_len(du);
+	f->next = edt;
+	if (data->flow_rate_kbps && len > 0 &&
+	    pci_type(&du->pci) != PDU_TYPE_MGMT)
+		f->next = ktime_add_ns(edt,
+				       pacing_len_ns(len, data->flow_rate_kbps));
+
+	du->tx_time = edt;
+	if (rfifo_push_ni(f->queue, du)) {
+		LOG_ERR("Could not enqueue PDU in n1_port %d",
+			n1_port->port_id);
+		du_destroy(du);
+		return RMT_PS_ENQ_ERR;
+	}
+
+	if (ktime_compare(edt, now) > 0) {
+		f->delayed_pdus++;
+		f->delay_us += ktime_us_delta(edt, now);
+	}
+
+	if (!f->qlen)
+		list_move_tail(&f->list, &q->active);
+	f->qlen++;
+	q->qlen++;
+
+	return RMT_PS_ENQ_SCHED;
+}
+
+static struct du * pacing_rmt_dequeue_policy(struct rmt_ps *      ps,
+					     struct rmt_n1_port * n1_port)
+{
+	struct pacing_ps_data * data;
+	struct pacing_queue *   q;
+	struct pacing_flow *    f, * best = NULL;
+	struct du *             du;
+	ktime_t                 now, due = ktime_set(0, 0);
+	ssize_t                 len;
+
+	if (!ps || !n1_port || !ps->priv) {
+		LOG_ERR("Wrong input parameters for pacing dequeue policy");
+		return NULL;
+	}
+
+	data = ps->priv;
+	q    = n1_port->rmt_ps_queues;
+	if (!q) {
+		LOG_ERR("Could not find queue for n1_port %d",
+			n1_port->port_id);
+		return NULL;
+	}
+
+	/* Heads of the flows are their earliest PDUs, pick the earliest */
+	list_for_each_entry(f, &q->active, list) {
+		du = rfifo_peek(f->queue);
+		if (du && (!best || ktime_compare(du->tx_time, due) < 0)) {
+			best = f;
+			due  = du->tx_time;
+		}
+	}
+	if (!best)
+		return NULL;
+
+	now = ktime_get();
+	if (ktime_compare(q->next, due) > 0)
+		due = q->next;
+	if (ktime_compare(due, now) > 0) {
+		q->holds++;
+		hrtimer_start(&q->timer, due, HRTIMER_MODE_ABS);
+		return NULL;
+	}
+
+	du = rfifo_pop(best->queue);
+	best->qlen--;
+	q->qlen--;
+	if (!best->qlen)
+		list_move_tail(&best->list, &q->idle);
+
+	len     = du_len(du);
+	q->next = ktime_compare(q->next, now) > 0 ? q->next : now;
+	if (data->port_rate_kbps && len > 0)
+		q->next = ktime_add_ns(q->next,
+				       pacing_len_ns(len, data->port_rate_kbps));
+
+	best->tx_pdus++;
+	best->tx_bytes += len;
+	q->tx_pdus++;
+	du->tx_time = ktime_set(0, 0);
+
+	return du;
+}
+
+static int pacing_ps_set_policy_set_param_priv(struct pacing_ps_data * data,
+					       const char *            name,
+					       const char *            value)
+{
+	unsigned int uval;
+
+	if (!name) {
+		LOG_ERR("Null parameter name");
+		return -1;
+	}
+
+	if (!value) {
+		LOG_ERR("Null parameter value");
+		return -1;
+	}
+
+	if (kstrtouint(value, 10, &uval)) {
+		LOG_ERR("Could not parse value '%s' of parameter %s",
+			value, name);
+		return -1;
+	}
+
+	if (strcmp(name, "q_max") == 0) {
+		data->q_max = uval;
+		return 0;
+	}
+
+	if (strcmp(name, "port_rate_kbps") == 0) {
+		data->port_rate_kbps = uval;
+		return 0;
+	}
+
+	if (strcmp(name, "flow_rate_kbps") == 0) {
+		data->flow_rate_kbps = uval;
+		return 0;
+	}
+
+	LOG_ERR("No such parameter to set");
+
+	return -1;
+}
+
+static int rmt_config_apply(struct policy_parm * param, void * data)
+{
+	return pacing_ps_set_policy_set_param_priv(data,
+			policy_param_name(param),
+			policy_param_value(param));
+}
+
+static int pacing_ps_set_policy_set_param(struct ps_base * bps,
+					  const char *     name,
+					  const char *     value)
+{
+	struct rmt_ps * ps = container_of(bps, struct rmt_ps, base);
+
+	return pacing_ps_set_policy_set_param_priv(ps->priv, name, value);
+}
+
+static struct ps_base *
+rmt_ps_pacing_create(struct rina_component * component)
+{
+	struct rmt *            rmt = rmt_from_component(component);
+	struct rmt_ps *         ps;
+	struct pacing_ps_data * data;
+	struct rmt_config *     rmt_cfg;
+
+	ps = rkzalloc(sizeof(*ps), GFP_KERNEL);
+	if (!ps)
+		return NULL;
+
+	data = rkzalloc(sizeof(*data), GFP_KERNEL);
+	if (!data) {
+		rkfree(ps);
+		return NULL;
+	}
+
+	data->q_max = DEFAULT_Q_MAX;
+
+	ps->base.set_policy_set_param = pacing_ps_set_policy_set_param;
+	ps->dm    = rmt;
+	ps->priv  = data;
+	ps->shaping = true;
+
+	rmt_cfg = rmt_config_get(rmt);
+	if (rmt_cfg)
+		policy_for_each(rmt_cfg->policy_set, data, rmt_config_apply);
+
+	ps->rmt_dequeue_policy   = pacing_rmt_dequeue_policy;
+	ps->rmt_enqueue_policy   = pacing_rmt_enqueue_policy;
+	ps->rmt_q_create_policy  = pacing_rmt_q_create_policy;
+	ps->rmt_q_destroy_policy = pacing_rmt_q_destroy_policy;
+
+	LOG_INFO("Pacing RMT PS loaded, q_max = %u, port_rate = %u kbps, "
+		 "flow_rate = %u kbps", data->q_max, data->port_rate_kbps,
+		 data->flow_rate_kbps);
+
+	return &ps->base;
+}
+
+static void rmt_ps_pacing_destroy(struct ps_base * bps)
+{
+	struct rmt_ps * ps = container_of(bps, struct rmt_ps, base);
+
+	if (bps) {
+		if (ps->priv)
+			rkfree(ps->priv);
+		rkfree(ps);
+	}
+}
+
+static struct ps_factory pacing_factory = {
+	.owner   = THIS_MODULE,
+	.create  = rmt_ps_pacing_create,
+	.destroy = rmt_ps_pacing_destroy,
+};
+
+static int __init mod_init(void)
+{
+	int ret;
+
+	strcpy(pacing_factory.name, RINA_PACING_PS_NAME);
+
+	ret = rmt_ps_publish(&pacing_factory);
+	if (ret) {
+		LOG_ERR("Failed to publish policy set factory");
+		return -1;
+	}
+
+	LOG_INFO("RMT pacing policy set loaded successfully");
+
+	return 0;
+}
+
+static void __exit mod_exit(void)
+{
+	int ret = rmt_ps_unpublish(RINA_PACING_PS_NAME);
+
+	if (ret) {
+		LOG_ERR("Failed to unpublish policy set factory");
+		return;
+	}
+
+	LOG_INFO("RMT pacing policy set unloaded successfully");
+}
+
+module_init(mod_init);
+module_exit(mod_exit);
+
+MODULE_DESCRIPTION("RMT pacing policy set");
+
+MODULE_LICENSE("GPL");
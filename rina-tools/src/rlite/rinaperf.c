@@ -53,11 +53,21 @@
 #define RP_OPCODE_RR 1
 #define RP_OPCODE_PERF 2
 #define RP_OPCODE_DATAFLOW 3
-#define RP_OPCODE_STOP 4 /* must be the last */
+#define RP_OPCODE_STOP 4
+#define RP_OPCODE_BPERF 5
 
 #define CLI_FA_TIMEOUT_MSECS 5000
 #define CLI_RESULT_TIMEOUT_MSECS 5000
 #define RP_DATA_WAIT_MSECS 10000
+#define RP_FA_WINDOW_MAX 1024
+
+/* Log-linear latency histogram: values below RP_HISTO_SUB are recorded
+ * exactly, larger values fall in one of RP_HISTO_SUB linear sub-buckets
+ * of their power-of-two range, so that the relative error is bounded by
+ * 1/RP_HISTO_SUB (about 6%) over the whole 64 bit range. */
+#define RP_HISTO_SUB_BITS 4
+#define RP_HISTO_SUB (1U << RP_HISTO_SUB_BITS)
+#define RP_HISTO_BUCKETS (64 * RP_HISTO_SUB)
 
 struct rinaperf;
 struct worker;
@@ -83,9 +93,39 @@ struct rp_result_msg {
     uint64_t latency; /* in nanoseconds */
 } __attribute__((packed));
 
+struct rp_histo {
+    uint64_t cnt;
+    uint64_t sum;
+    uint64_t min;
+    uint64_t max;
+    uint64_t buckets[RP_HISTO_BUCKETS];
+};
+
+/* Flow allocation test statistics, in nanoseconds. The phases are the
+ * ones the client can observe: the stack does not export per-stage
+ * timestamps, so the time spent in the IPC Manager, in the IPCP flow
+ * allocator and in kernel connection creation is not broken down. */
+struct rp_fa_stats {
+    /* Time taken by rina_flow_alloc() to write the request to the
+     * kernel control device. */
+    struct rp_histo submit;
+    /* Time the client waits for the allocation result, with all the
+     * stack stages and the remote peer lumped together. */
+    struct rp_histo wait;
+    /* Time taken to bind the I/O device to the new port. */
+    struct rp_histo ioport;
+    /* End-to-end allocation latency (submit + wait + ioport). */
+    struct rp_histo total;
+    /* Time taken by close() to release the flow. */
+    struct rp_histo dealloc;
+    uint64_t failed;
+    uint64_t timedout;
+    uint64_t ns; /* test duration */
+};
+
 typedef int (*perf_fn_t)(struct worker *);
-typedef void (*report_fn_t)(struct rp_result_msg *snd,
-                            struct rp_result_msg *rcv);
+typedef void (*report_fn_t)(struct worker *);
+typedef void (*aggregate_fn_t)(struct worker *workers, int n);
 
 struct worker {
     pthread_t th;
@@ -93,6 +133,9 @@ struct worker {
     struct worker *next; /* next worker */
     struct rp_config_msg test_config;
     struct rp_result_msg result;
+    struct rp_result_msg srv_result; /* result received from the server */
+    struct rp_result_msg rev_result; /* server to client direction of the
+                                      * bidirectional test */
     uint32_t ticket;       /* ticket to be sent to the client */
     sem_t data_flow_ready; /* to wait for dfd */
     unsigned int interval;
@@ -102,6 +145,8 @@ struct worker {
     int cfd; /* control file descriptor */
     int dfd; /* data file descriptor */
     int retcode;
+    struct rp_fa_stats *fa; /* flow allocation test only */
+    struct rp_histo *lat;   /* ping and rr tests only */
 };
 
 struct rinaperf {
@@ -113,7 +158,9 @@ struct rinaperf {
     int parallel;     /* num of parallel clients */
     int duration;     /* duration of client test (secs) */
     int use_mss_size; /* use flow MSS as packet size */
+    int fa_window;    /* max pending flow allocations per client */
     int verbose;
+    int json; /* report results in JSON */
     int stop_pipe[2];       /* to stop client threads */
     int cli_stop;           /* another way to stop client threads */
     int cli_flow_allocated; /* client flows allocated ? */
@@ -139,6 +186,156 @@ struct rinaperf {
 
 static struct rinaperf _rp;
 
+static inline unsigned long long
+ts_diff_ns(const struct timespec *a, const struct timespec *b)
+{
+    return 1000000000ULL * (b->tv_sec - a->tv_sec) + (b->tv_nsec - a->tv_nsec);
+}
+
+static void
+rp_histo_init(struct rp_histo *h)
+{
+    memset(h, 0, sizeof(*h));
+    h->min = UINT64_MAX;
+}
+
+static unsigned int
+rp_histo_index(uint64_t v)
+{
+    unsigned int e;
+
+    if (v < RP_HISTO_SUB) {
+        return v;
+    }
+    e = 63 - __builtin_clzll(v);
+
+    return (e - RP_HISTO_SUB_BITS + 1) * RP_HISTO_SUB +
+           ((v >> (e - RP_HISTO_SUB_BITS)) & (RP_HISTO_SUB - 1));
+}
+
+/* Lowest value mapped to bucket 'idx'. */
+static uint64_t
+rp_histo_value(unsigned int idx)
+{
+    unsigned int e;
+
+    if (idx < RP_HISTO_SUB) {
+        return idx;
+    }
+    e = idx / RP_HISTO_SUB - 1 + RP_HISTO_SUB_BITS;
+
+    return ((uint64_t)(RP_HISTO_SUB + idx % RP_HISTO_SUB))
+           << (e - RP_HISTO_SUB_BITS);
+}
+
+static void
+rp_histo_add(struct rp_histo *h, uint64_t v)
+{
+    h->buckets[rp_histo_index(v)]++;
+    h->cnt++;
+    h->sum += v;
+    if (v < h->min) {
+        h->min = v;
+    }
+    if (v > h->max) {
+        h->max = v;
+    }
+}
+
+static void
+rp_histo_merge(struct rp_histo *dst, const struct rp_histo *src)
+{
+    unsigned int i;
+
+    for (i = 0; i < RP_HISTO_BUCKETS; i++) {
+        dst->buckets[i] += src->buckets[i];
+    }
+    dst->cnt += src->cnt;
+    dst->sum += src->sum;
+    if (src->min < dst->min) {
+        dst->min = src->min;
+    }
+    if (src->max > dst->max) {
+        dst->max = src->max;
+    }
+}
+
+/* Return the value below which 'pct' percent of the samples fall. */
+static uint64_t
+rp_histo_percentile(const struct rp_histo *h, double pct)
+{
+    uint64_t target;
+    uint64_t acc = 0;
+    unsigned int i;
+
+    if (!h->cnt) {
+        return 0;
+    }
+
+    target = (uint64_t)((pct / 100.0) * h->cnt + 0.5);
+    if (target == 0) {
+        target = 1;
+    }
+
+    for (i = 0; i < RP_HISTO_BUCKETS; i++) {
+        acc += h->buckets[i];
+        if (acc >= target) {
+            uint64_t v = rp_histo_value(i);
+
+            return v < h->min ? h->min : (v > h->max ? h->max : v);
+        }
+    }
+
+    return h->max;
+}
+
+static void
+rp_histo_print_header(const char *what)
+{
+    PRINTF("%-10s %10s %10s %10s %10s %10s %10s %10s\n", what, "Samples",
+           "Min (us)", "Avg (us)", "p50 (us)", "p99 (us)", "p99.9 (us)",
+           "Max (us)");
+}
+
+static void
+rp_histo_print(const char *name, const struct rp_histo *h)
+{
+    if (!h->cnt) {
+        PRINTF("%-10s %10d %10s %10s %10s %10s %10s %10s\n", name, 0, "-",
+               "-", "-", "-", "-", "-");
+        return;
+    }
+
+    PRINTF("%-10s %10lu %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f\n", name,
+           (unsigned long)h->cnt, (double)h->min / 1000.0,
+           (double)h->sum / h->cnt / 1000.0,
+           (double)rp_histo_percentile(h, 50.0) / 1000.0,
+           (double)rp_histo_percentile(h, 99.0) / 1000.0,
+           (double)rp_histo_percentile(h, 99.9) / 1000.0,
+           (double)h->max / 1000.0);
+}
+
+static void
+rp_histo_json(const char *name, const struct rp_histo *h)
+{
+    PRINTF("\"%s\": {\"samples\": %lu, \"min\": %lu, \"avg\": %lu, "
+           "\"p50\": %lu, \"p99\": %lu, \"p99.9\": %lu, \"max\": %lu}",
+           name, (unsigned long)h->cnt, (unsigned long)(h->cnt ? h->min : 0),
+           (unsigned long)(h->cnt ? h->sum / h->cnt : 0),
+           (unsigned long)rp_histo_percentile(h, 50.0),
+           (unsigned long)rp_histo_percentile(h, 99.0),
+           (unsigned long)rp_histo_percentile(h, 99.9),
+           (unsigned long)h->max);
+}
+
+static void
+rp_result_json(const char *name, const struct rp_result_msg *r)
+{
+    PRINTF("\"%s\": {\"packets\": %lu, \"pps\": %lu, \"bps\": %lu}", name,
+           (unsigned long)r->cnt, (unsigned long)r->pps,
+           (unsigned long)r->bps);
+}
+
 static void
 worker_init(struct worker *w, struct rinaperf *rp)
 {
@@ -197,6 +394,13 @@ ping_client(struct worker *w)
     struct pollfd pfd[2];
     int ret = 0;
 
+    w->lat = calloc(1, sizeof(*w->lat));
+    if (!w->lat) {
+        PRINTF("Out of memory\n");
+        return -1;
+    }
+    rp_histo_init(w->lat);
+
     pfd[0].fd     = w->dfd;
     pfd[1].fd     = w->rp->stop_pipe[0];
     pfd[0].events = pfd[1].events = POLLIN;
@@ -206,9 +410,7 @@ ping_client(struct worker *w)
     clock_gettime(CLOCK_MONOTONIC, &t_start);
 
     for (i = 0; !limit || i < limit; i++, expected++) {
-        if (ping) {
-            clock_gettime(CLOCK_MONOTONIC, &t1);
-        }
+        clock_gettime(CLOCK_MONOTONIC, &t1);
 
         *seqnum = (uint16_t)expected;
 
@@ -228,9 +430,11 @@ ping_client(struct worker *w)
         }
 
         if (ret == 0) {
-            PRINTF("Timeout: %d bytes lost\n", size);
+            /* Diagnostics go to stderr, not to mix with JSON output. */
+            fprintf(stderr, "Timeout: %d bytes lost\n", size);
             if (++timeouts > 8) {
-                PRINTF("Stopping after %u consecutive timeouts\n", timeouts);
+                fprintf(stderr, "Stopping after %u consecutive timeouts\n",
+                        timeouts);
                 break;
             }
         } else if (pfd[1].revents & POLLIN) {
@@ -246,21 +450,26 @@ ping_client(struct worker *w)
                 break;
             }
 
+            clock_gettime(CLOCK_MONOTONIC, &t2);
             if (ping) {
                 if (*seqnum == expected) {
-                    clock_gettime(CLOCK_MONOTONIC, &t2);
-                    ns = 1000000000 * (t2.tv_sec - t1.tv_sec) +
-                         (t2.tv_nsec - t1.tv_nsec);
-                    PRINTF("%d bytes from server: rtt = %.3f ms\n", ret,
-                           ((float)ns) / 1000000.0);
+                    ns = ts_diff_ns(&t1, &t2);
+                    rp_histo_add(w->lat, ns);
+                    if (!w->rp->json) {
+                        PRINTF("%d bytes from server: rtt = %.3f ms\n", ret,
+                               ((float)ns) / 1000000.0);
+                    }
                 } else {
-                    PRINTF("Packet lost or out of order: got %u, "
-                           "expected %u\n",
-                           *seqnum, expected);
+                    fprintf(stderr,
+                            "Packet lost or out of order: got %u, "
+                            "expected %u\n",
+                            *seqnum, expected);
                     if (*seqnum < expected) {
                         goto repoll;
                     }
                 }
+            } else {
+                rp_histo_add(w->lat, ts_diff_ns(&t1, &t2));
             }
         }
 
@@ -348,8 +557,10 @@ ping_server(struct worker *w)
 }
 
 static void
-ping_report(struct rp_result_msg *snd, struct rp_result_msg *rcv)
+ping_report(struct worker *w)
 {
+    struct rp_result_msg *snd = &w->result;
+
     PRINTF("%10s %15s %10s %10s %15s\n", "", "Transactions", "Kpps", "Mbps",
            "Latency (ns)");
     PRINTF("%-10s %15lu %10.3f %10.3f %15lu\n", "Sender", snd->cnt,
@@ -357,15 +568,22 @@ ping_report(struct rp_result_msg *snd, struct rp_result_msg *rcv)
            snd->latency);
 #if 0
     PRINTF("%-10s %15lu %10.3f %10.3f %15lu\n",
-            "Receiver", rcv->cnt, (double)rcv->pps/1000.0,
-                (double)rcv->bps/1000000.0, rcv->latency);
+            "Receiver", w->srv_result.cnt, (double)w->srv_result.pps/1000.0,
+                (double)w->srv_result.bps/1000000.0, w->srv_result.latency);
 #endif
+    if (w->lat) {
+        rp_histo_print_header("");
+        rp_histo_print("RTT", w->lat);
+    }
 }
 
+/* Send 'limit' packets (0 means no limit) on the data flow, stopping
+ * earlier if '*stop' is set or 'stopfd' becomes readable while waiting
+ * for a non-blocking flow to accept more data. */
 static int
-perf_client(struct worker *w)
+perf_send(struct worker *w, unsigned int limit, volatile int *stop, int stopfd,
+          struct rp_result_msg *res)
 {
-    unsigned limit        = w->test_config.cnt;
     int size              = w->test_config.size;
     unsigned int interval = w->interval;
     unsigned int burst    = w->burst;
@@ -375,15 +593,33 @@ perf_client(struct worker *w)
     struct timespec w1, w2;
     char buf[SDU_SIZE_MAX];
     unsigned long long ns;
+    struct pollfd pfd[2];
     unsigned int i = 0;
     int ret;
 
     memset(buf, 'x', size);
 
+    pfd[0].fd     = w->dfd;
+    pfd[0].events = POLLOUT;
+    pfd[1].fd     = stopfd;
+    pfd[1].events = POLLIN;
+
     clock_gettime(CLOCK_MONOTONIC, &t_start);
 
-    for (i = 0; !rp->cli_stop && (!limit || i < limit); i++) {
+    for (i = 0; !*stop && (!limit || i < limit); i++) {
+    again:
         ret = write(w->dfd, buf, size);
+        if (ret < 0 && errno == EAGAIN) {
+            /* The flow is shared with a receiver, and so non-blocking. */
+            ret = poll(pfd, 2, RP_DATA_WAIT_MSECS);
+            if (ret < 0) {
+                perror("poll(flow)");
+            }
+            if (ret <= 0 || (pfd[1].revents & POLLIN)) {
+                break;
+            }
+            goto again;
+        }
         if (ret != size) {
             if (ret < 0) {
                 perror("write(buf)");
@@ -416,16 +652,23 @@ perf_client(struct worker *w)
          (t_end.tv_nsec - t_start.tv_nsec);
 
     if (ns) {
-        w->result.cnt = i;
-        w->result.pps = 1000000000ULL;
-        w->result.pps *= i;
-        w->result.pps /= ns;
-        w->result.bps = w->result.pps * 8 * size;
+        res->cnt = i;
+        res->pps = 1000000000ULL;
+        res->pps *= i;
+        res->pps /= ns;
+        res->bps = res->pps * 8 * size;
     }
 
     return 0;
 }
 
+static int
+perf_client(struct worker *w)
+{
+    return perf_send(w, w->test_config.cnt, &w->rp->cli_stop,
+                     w->rp->stop_pipe[0], &w->result);
+}
+
 static void
 rate_print(unsigned long long *bytes, unsigned long long *cnt,
            unsigned long long *bytes_limit, struct timespec *ts,
@@ -465,10 +708,12 @@ rate_print(unsigned long long *bytes, unsigned long long *cnt,
     }
 }
 
+/* Receive 'limit' packets (0 means no limit) from the data flow, stopping
+ * earlier if 'stopfd' becomes readable or nothing arrives for a while. */
 static int
-perf_server(struct worker *w)
+perf_recv(struct worker *w, unsigned int limit, int stopfd,
+          struct rp_result_msg *res)
 {
-    unsigned limit                      = w->test_config.cnt;
     unsigned long long rate_cnt         = 0;
     unsigned long long rate_bytes_limit = 1000;
     unsigned long long rate_bytes       = 0;
@@ -488,7 +733,7 @@ perf_server(struct worker *w)
     }
 
     pfd[0].fd     = w->dfd;
-    pfd[1].fd     = w->cfd;
+    pfd[1].fd     = stopfd;
     pfd[0].events = pfd[1].events = POLLIN;
 
     clock_gettime(CLOCK_MONOTONIC, &rate_ts);
@@ -547,7 +792,7 @@ perf_server(struct worker *w)
 
         if (rate_bytes >= rate_bytes_limit && verb) {
             rate_print(&rate_bytes, &rate_cnt, &rate_bytes_limit, &rate_ts,
-                       &w->result);
+                       res);
         }
     }
 
@@ -563,11 +808,11 @@ perf_server(struct worker *w)
         }
     }
 
-    w->result.pps = 1000000000ULL;
-    w->result.pps *= i;
-    w->result.pps /= ns;
-    w->result.bps = w->result.pps * 8 * w->test_config.size;
-    w->result.cnt = i;
+    res->pps = 1000000000ULL;
+    res->pps *= i;
+    res->pps /= ns;
+    res->bps = res->pps * 8 * w->test_config.size;
+    res->cnt = i;
 
     if (verb) {
         PRINTF("Received %u PDUs out of %u\n", i, limit);
@@ -576,9 +821,18 @@ perf_server(struct worker *w)
     return 0;
 }
 
+static int
+perf_server(struct worker *w)
+{
+    return perf_recv(w, w->test_config.cnt, w->cfd, &w->result);
+}
+
 static void
-perf_report(struct rp_result_msg *snd, struct rp_result_msg *rcv)
+perf_report(struct worker *w)
 {
+    struct rp_result_msg *snd = &w->result;
+    struct rp_result_msg *rcv = &w->srv_result;
+
     PRINTF("%10s %12s %10s %10s\n", "", "Packets", "Kpps", "Mbps");
     PRINTF("%-10s %12lu %10.3f %10.3f\n", "Sender", snd->cnt,
            (double)snd->pps / 1000.0, (double)snd->bps / 1000000.0);
@@ -586,6 +840,354 @@ perf_report(struct rp_result_msg *snd, struct rp_result_msg *rcv)
            (double)rcv->pps / 1000.0, (double)rcv->bps / 1000000.0);
 }
 
+/* Arguments of the second direction of the bidirectional test, which
+ * runs in its own thread. */
+struct rp_perf_args {
+    struct worker *w;
+    volatile int *stop;
+    int stopfd;
+    struct rp_result_msg *res;
+    int ret;
+};
+
+static void *
+perf_send_thread(void *opaque)
+{
+    struct rp_perf_args *a = opaque;
+
+    a->ret = perf_send(a->w, 0, a->stop, a->stopfd, a->res);
+
+    return NULL;
+}
+
+static void *
+perf_recv_thread(void *opaque)
+{
+    struct rp_perf_args *a = opaque;
+
+    a->ret = perf_recv(a->w, 0, a->stopfd, a->res);
+
+    return NULL;
+}
+
+/* Bidirectional throughput test: the client runs the perf test towards
+ * the server, while receiving what the server sends back as fast as it
+ * can on the same flow. */
+static int
+bperf_client(struct worker *w)
+{
+    struct rp_perf_args rx;
+    int stop_pipe[2];
+    uint8_t x = 0;
+    pthread_t th;
+    int ret;
+
+    if (fcntl(w->dfd, F_SETFL, O_NONBLOCK)) {
+        perror("fcntl(F_SETFL)");
+        return -1;
+    }
+
+    if (pipe(stop_pipe)) {
+        perror("pipe()");
+        return -1;
+    }
+
+    memset(&rx, 0, sizeof(rx));
+    rx.w      = w;
+    rx.stopfd = stop_pipe[0];
+    rx.res    = &w->rev_result;
+    ret       = pthread_create(&th, NULL, perf_recv_thread, &rx);
+    if (ret) {
+        PRINTF("pthread_create() failed: %s\n", strerror(ret));
+        close(stop_pipe[0]);
+        close(stop_pipe[1]);
+        return -1;
+    }
+
+    ret = perf_client(w);
+
+    if (write(stop_pipe[1], &x, sizeof(x)) != sizeof(x)) {
+        perror("write(stop_pipe)");
+    }
+    pthread_join(th, NULL);
+    close(stop_pipe[0]);
+    close(stop_pipe[1]);
+
+    return ret ? ret : rx.ret;
+}
+
+static int
+bperf_server(struct worker *w)
+{
+    struct rp_perf_args tx;
+    volatile int stop = 0;
+    pthread_t th;
+    int ret;
+
+    if (fcntl(w->dfd, F_SETFL, O_NONBLOCK)) {
+        perror("fcntl(F_SETFL)");
+        return -1;
+    }
+
+    /* Send until the client stops the test on the control flow. */
+    memset(&tx, 0, sizeof(tx));
+    tx.w      = w;
+    tx.stop   = &stop;
+    tx.stopfd = w->cfd;
+    tx.res    = &w->rev_result;
+    ret       = pthread_create(&th, NULL, perf_send_thread, &tx);
+    if (ret) {
+        PRINTF("pthread_create() failed: %s\n", strerror(ret));
+        return -1;
+    }
+
+    ret  = perf_server(w);
+    stop = 1;
+    pthread_join(th, NULL);
+
+    if (w->rp->verbose) {
+        PRINTF("Sent %lu PDUs\n", (unsigned long)w->rev_result.cnt);
+    }
+
+    return ret ? ret : tx.ret;
+}
+
+static void
+bperf_report(struct worker *w)
+{
+    struct rp_result_msg *rev = &w->rev_result;
+
+    perf_report(w);
+    PRINTF("%-10s %12lu %10.3f %10.3f\n", "Reverse", rev->cnt,
+           (double)rev->pps / 1000.0, (double)rev->bps / 1000000.0);
+}
+
+struct rp_fa_pending {
+    int wfd;
+    struct timespec t_req;    /* before rina_flow_alloc() */
+    struct timespec t_submit; /* after rina_flow_alloc() */
+};
+
+/* Flow allocation test: keep up to rp->fa_window flow allocation requests
+ * in flight, and deallocate each flow as soon as it is allocated. No data
+ * is exchanged with the server, which just accepts and releases flows. */
+static int
+fa_client(struct worker *w)
+{
+    unsigned int limit  = w->test_config.cnt;
+    struct rinaperf *rp = w->rp;
+    int window          = rp->fa_window;
+    struct rp_fa_pending *pend;
+    struct rp_fa_stats *st;
+    struct timespec t_start, t_end, t_rsp, t_io, t_close;
+    struct pollfd *pfd;
+    unsigned int issued = 0;
+    int npend           = 0;
+    int stop            = 0;
+    int ret             = 0;
+    int i;
+
+    st   = calloc(1, sizeof(*st));
+    pend = calloc(window, sizeof(*pend));
+    pfd  = calloc(window + 1, sizeof(*pfd));
+    if (!st || !pend || !pfd) {
+        PRINTF("Out of memory\n");
+        free(st);
+        free(pend);
+        free(pfd);
+        return -1;
+    }
+    rp_histo_init(&st->submit);
+    rp_histo_init(&st->wait);
+    rp_histo_init(&st->ioport);
+    rp_histo_init(&st->total);
+    rp_histo_init(&st->dealloc);
+    w->fa                  = st;
+    rp->cli_flow_allocated = 1;
+
+    clock_gettime(CLOCK_MONOTONIC, &t_start);
+
+    while (!stop || npend) {
+        /* Refill the window of pending allocations. */
+        while (!stop && !rp->cli_stop && npend < window &&
+               (!limit || issued < limit)) {
+            struct rp_fa_pending *p = pend + npend;
+
+            clock_gettime(CLOCK_MONOTONIC, &p->t_req);
+            p->wfd = rina_flow_alloc(rp->dif_name, rp->cli_appl_name,
+                                     rp->srv_appl_name, &rp->flowspec,
+                                     RINA_F_NOWAIT);
+            clock_gettime(CLOCK_MONOTONIC, &p->t_submit);
+            if (p->wfd < 0) {
+                perror("rina_flow_alloc()");
+                stop = 1;
+                ret  = -1;
+                break;
+            }
+            issued++;
+            npend++;
+        }
+
+        if (rp->cli_stop || (limit && issued >= limit)) {
+            stop = 1;
+        }
+
+        if (!npend) {
+            break;
+        }
+
+        for (i = 0; i < npend; i++) {
+            pfd[i].fd     = pend[i].wfd;
+            pfd[i].events = POLLIN;
+        }
+        pfd[npend].fd     = rp->stop_pipe[0];
+        pfd[npend].events = POLLIN;
+
+        if (poll(pfd, npend + 1, CLI_FA_TIMEOUT_MSECS) < 0) {
+            perror("poll(fa)");
+            ret = -1;
+            break;
+        }
+
+        if (pfd[npend].revents & POLLIN) {
+            /* Stopped, drop all the pending requests. */
+            break;
+        }
+
+        /* Walk backwards so that completed entries can be replaced
+         * by the last one. Each reply is timestamped when it is picked
+         * up, so that replies handled later in the walk do not get the
+         * time of the poll() wakeup. */
+        for (i = npend - 1; i >= 0; i--) {
+            struct rp_fa_pending *p = pend + i;
+            int fd;
+
+            clock_gettime(CLOCK_MONOTONIC, &t_rsp);
+            if (!(pfd[i].revents & (POLLIN | POLLERR | POLLHUP))) {
+                if (ts_diff_ns(&p->t_req, &t_rsp) >=
+                    CLI_FA_TIMEOUT_MSECS * 1000000ULL) {
+                    close(p->wfd);
+                    st->timedout++;
+                    pend[i] = pend[--npend];
+                }
+                continue;
+            }
+
+            fd = rina_flow_alloc_wait(p->wfd);
+            clock_gettime(CLOCK_MONOTONIC, &t_io);
+            if (fd < 0) {
+                if (errno == EAGAIN) {
+                    /* No reply after all; wfd is left open in this case. */
+                    close(p->wfd);
+                }
+                st->failed++;
+                if (rp->verbose) {
+                    perror("rina_flow_alloc_wait()");
+                }
+            } else {
+                close(fd);
+                clock_gettime(CLOCK_MONOTONIC, &t_close);
+                rp_histo_add(&st->submit, ts_diff_ns(&p->t_req, &p->t_submit));
+                rp_histo_add(&st->wait, ts_diff_ns(&p->t_submit, &t_rsp));
+                rp_histo_add(&st->ioport, ts_diff_ns(&t_rsp, &t_io));
+                rp_histo_add(&st->total, ts_diff_ns(&p->t_req, &t_io));
+                rp_histo_add(&st->dealloc, ts_diff_ns(&t_io, &t_close));
+            }
+            pend[i] = pend[--npend];
+        }
+    }
+
+    for (i = 0; i < npend; i++) {
+        close(pend[i].wfd);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t_end);
+    st->ns = ts_diff_ns(&t_start, &t_end);
+
+    w->result.cnt = st->total.cnt;
+    w->result.pps = st->ns ? (1000000000ULL * st->total.cnt) / st->ns : 0;
+    w->result.latency =
+        st->total.cnt ? st->total.sum / st->total.cnt : 0;
+
+    free(pfd);
+    free(pend);
+
+    return ret;
+}
+
+static void
+fa_aggregate(struct worker *workers, int n)
+{
+    struct rp_fa_stats *tot;
+    uint64_t ns = 0;
+    int i;
+
+    tot = calloc(1, sizeof(*tot));
+    if (!tot) {
+        PRINTF("Out of memory\n");
+        return;
+    }
+    rp_histo_init(&tot->submit);
+    rp_histo_init(&tot->wait);
+    rp_histo_init(&tot->ioport);
+    rp_histo_init(&tot->total);
+    rp_histo_init(&tot->dealloc);
+
+    for (i = 0; i < n; i++) {
+        struct rp_fa_stats *st = workers[i].fa;
+
+        if (!st) {
+            continue;
+        }
+        rp_histo_merge(&tot->submit, &st->submit);
+        rp_histo_merge(&tot->wait, &st->wait);
+        rp_histo_merge(&tot->ioport, &st->ioport);
+        rp_histo_merge(&tot->total, &st->total);
+        rp_histo_merge(&tot->dealloc, &st->dealloc);
+        tot->failed += st->failed;
+        tot->timedout += st->timedout;
+        if (st->ns > ns) {
+            ns = st->ns;
+        }
+        free(st);
+        workers[i].fa = NULL;
+    }
+
+    if (workers->rp->json) {
+        PRINTF("{\"test\": \"fa\", \"flows\": %lu, \"failed\": %lu, "
+               "\"timedout\": %lu, \"rate\": %.1f, \"latency_ns\": {",
+               (unsigned long)tot->total.cnt, (unsigned long)tot->failed,
+               (unsigned long)tot->timedout,
+               ns ? (double)tot->total.cnt * 1000000000.0 / ns : 0.0);
+        rp_histo_json("submit", &tot->submit);
+        PRINTF(", ");
+        rp_histo_json("wait", &tot->wait);
+        PRINTF(", ");
+        rp_histo_json("ioport", &tot->ioport);
+        PRINTF(", ");
+        rp_histo_json("total", &tot->total);
+        PRINTF(", ");
+        rp_histo_json("dealloc", &tot->dealloc);
+        PRINTF("}}\n");
+        free(tot);
+        return;
+    }
+
+    PRINTF("Flows allocated: %lu, failed: %lu, timed out: %lu, "
+           "rate: %.1f flows/s\n",
+           (unsigned long)tot->total.cnt, (unsigned long)tot->failed,
+           (unsigned long)tot->timedout,
+           ns ? (double)tot->total.cnt * 1000000000.0 / ns : 0.0);
+    rp_histo_print_header("Phase");
+    rp_histo_print("submit", &tot->submit);
+    rp_histo_print("wait", &tot->wait);
+    rp_histo_print("ioport", &tot->ioport);
+    rp_histo_print("total", &tot->total);
+    rp_histo_print("dealloc", &tot->dealloc);
+
+    free(tot);
+}
+
 struct rp_test_desc {
     const char *name;
     const char *description;
@@ -593,6 +1195,10 @@ struct rp_test_desc {
     perf_fn_t client_fn;
     perf_fn_t server_fn;
     report_fn_t report_fn;
+    /* If set, the client function is run directly by the worker, without
+     * negotiating control and data flows with the server, and this
+     * function is called to report the results of all the workers. */
+    aggregate_fn_t aggregate_fn;
 };
 
 static struct rp_test_desc descs[] = {
@@ -619,8 +1225,141 @@ static struct rp_test_desc descs[] = {
         .server_fn   = perf_server,
         .report_fn   = perf_report,
     },
+    {
+        .name         = "fa",
+        .description  = "flow allocation latency and rate test "
+                        "(client-side phases only)",
+        .client_fn    = fa_client,
+        .aggregate_fn = fa_aggregate,
+    },
+    {
+        .name        = "bperf",
+        .description = "bidirectional throughput test",
+        .opcode      = RP_OPCODE_BPERF,
+        .client_fn   = bperf_client,
+        .server_fn   = bperf_server,
+        .report_fn   = bperf_report,
+    },
 };
 
+static struct rp_test_desc *
+rp_desc_by_opcode(unsigned int opcode)
+{
+    unsigned int i;
+
+    for (i = 0; i < sizeof(descs) / sizeof(descs[0]); i++) {
+        if (descs[i].server_fn && descs[i].opcode == opcode) {
+            return descs + i;
+        }
+    }
+
+    return NULL;
+}
+
+static void
+rp_result_add(struct rp_result_msg *dst, const struct rp_result_msg *src)
+{
+    dst->cnt += src->cnt;
+    dst->pps += src->pps;
+    dst->bps += src->bps;
+}
+
+static void
+rp_worker_json(struct worker *w)
+{
+    rp_result_json("sender", &w->result);
+    if (!w->ping) {
+        PRINTF(", ");
+        rp_result_json("receiver", &w->srv_result);
+    }
+    if (w->desc->opcode == RP_OPCODE_BPERF) {
+        PRINTF(", ");
+        rp_result_json("reverse", &w->rev_result);
+    }
+    if (w->lat) {
+        PRINTF(", ");
+        rp_histo_json("latency_ns", w->lat);
+    }
+}
+
+/* Report the results of each flow, and their aggregate if there is more
+ * than one. The aggregate packet and bit rates are the sum of the ones of
+ * the flows, as they run in parallel. */
+static void
+rp_report(struct worker *workers, int n)
+{
+    struct rinaperf *rp = workers->rp;
+    unsigned long long latency = 0;
+    struct worker tot;
+    int nok = 0;
+    int i;
+
+    memset(&tot, 0, sizeof(tot));
+    tot.rp          = rp;
+    tot.desc        = workers->desc;
+    tot.ping        = workers->ping;
+    tot.test_config = workers->test_config;
+    tot.retcode     = -1;
+
+    for (i = 0; i < n; i++) {
+        struct worker *w = workers + i;
+
+        if (w->retcode) {
+            continue;
+        }
+        nok++;
+        rp_result_add(&tot.result, &w->result);
+        rp_result_add(&tot.srv_result, &w->srv_result);
+        rp_result_add(&tot.rev_result, &w->rev_result);
+        latency += w->result.latency * w->result.cnt;
+        if (w->lat) {
+            if (!tot.lat) {
+                tot.lat = calloc(1, sizeof(*tot.lat));
+                if (!tot.lat) {
+                    PRINTF("Out of memory\n");
+                    return;
+                }
+                rp_histo_init(tot.lat);
+            }
+            rp_histo_merge(tot.lat, w->lat);
+        }
+    }
+    tot.result.latency = tot.result.cnt ? latency / tot.result.cnt : 0;
+
+    if (rp->json) {
+        PRINTF("{\"test\": \"%s\", \"size\": %u, \"flows\": [",
+               tot.desc->name, tot.test_config.size);
+        for (i = 0; i < n; i++) {
+            PRINTF("%s{\"flow\": %d, ", i ? ", " : "", i);
+            if (workers[i].retcode) {
+                PRINTF("\"failed\": true}");
+                continue;
+            }
+            rp_worker_json(workers + i);
+            PRINTF("}");
+        }
+        PRINTF("], \"aggregate\": {\"flows\": %d, ", nok);
+        rp_worker_json(&tot);
+        PRINTF("}}\n");
+    } else {
+        for (i = 0; i < n; i++) {
+            if (workers[i].retcode) {
+                continue;
+            }
+            if (n > 1) {
+                PRINTF("Flow #%d:\n", i);
+            }
+            tot.desc->report_fn(workers + i);
+        }
+        if (nok > 1) {
+            PRINTF("Aggregate of %d flows:\n", nok);
+            tot.desc->report_fn(&tot);
+        }
+    }
+
+    free(tot.lat);
+}
+
 static void *
 client_worker_function(void *opaque)
 {
@@ -634,6 +1373,12 @@ client_worker_function(void *opaque)
 
     w->retcode = -1; /* set to 0 only if everything goes well */
 
+    if (w->desc->aggregate_fn) {
+        /* Standalone test, no control flow needed. */
+        w->retcode = w->desc->client_fn(w);
+        goto out;
+    }
+
     /* Allocate the control flow to be used for test configuration and
      * to receive test result.
      * We should always use reliable flows. */
@@ -756,7 +1501,7 @@ client_worker_function(void *opaque)
         w->test_config.size = SDU_SIZE_MAX;
     }
 
-    if (!w->ping) {
+    if (!w->ping && !rp->json) {
         char countbuf[64];
         char durbuf[64];
 
@@ -827,12 +1572,10 @@ client_worker_function(void *opaque)
             goto out;
         }
 
-        rmsg.cnt     = le64toh(rmsg.cnt);
-        rmsg.pps     = le64toh(rmsg.pps);
-        rmsg.bps     = le64toh(rmsg.bps);
-        rmsg.latency = le64toh(rmsg.latency);
-
-        w->desc->report_fn(&w->result, &rmsg);
+        w->srv_result.cnt     = le64toh(rmsg.cnt);
+        w->srv_result.pps     = le64toh(rmsg.pps);
+        w->srv_result.bps     = le64toh(rmsg.bps);
+        w->srv_result.latency = le64toh(rmsg.latency);
     }
 
     w->retcode = 0;
@@ -875,6 +1618,12 @@ server_worker_function(void *opaque)
     if (ret != sizeof(cfg)) {
         if (ret < 0) {
             perror("read(cfg)");
+        } else if (ret == 0) {
+            /* Flow released by the client without a configuration,
+             * as it happens with the flow allocation test. */
+            if (rp->verbose) {
+                PRINTF("Flow deallocated before configuration\n");
+            }
         } else {
             PRINTF("Error reading test configuration: wrong length %d "
                    "(should be %lu)\n",
@@ -888,7 +1637,7 @@ server_worker_function(void *opaque)
     cfg.cnt    = le64toh(cfg.cnt);
     cfg.size   = le32toh(cfg.size);
 
-    if (cfg.opcode >= RP_OPCODE_STOP) {
+    if (cfg.opcode != RP_OPCODE_DATAFLOW && !rp_desc_by_opcode(cfg.opcode)) {
         PRINTF("Invalid test configuration: test type %u is invalid\n",
                cfg.opcode);
         goto out;
@@ -921,6 +1670,8 @@ server_worker_function(void *opaque)
             goto out;
         }
 
+        w->desc = rp_desc_by_opcode(cfg.opcode);
+
         /* Allocate a ticket for the client. */
         {
             pthread_mutex_lock(&rp->ticket_lock);
@@ -981,8 +1732,6 @@ server_worker_function(void *opaque)
 
         /* Serve the client on the flow file descriptor. */
         w->test_config = cfg;
-        w->desc        = descs + cfg.opcode;
-        assert(w->desc);
         w->desc->server_fn(w);
 
         /* Write the result back to the client on the control file descriptor.
@@ -1207,7 +1956,7 @@ usage(void)
         "   -h : show this help\n"
         "   -l : run in server mode (listen)\n"
         "   -t TEST : specify the type of the test to be performed "
-        "(ping, perf, rr)\n"
+        "(ping, perf, rr, fa, bperf)\n"
         "   -d DIF : name of DIF to which register or ask to allocate a flow\n"
         "   -c NUM : number of SDUs to send during the test\n"
         "   -s NUM : size of the SDUs that are sent during the test\n"
@@ -1222,7 +1971,10 @@ usage(void)
         "   -z APNAME : application process name and instance of the rinaperf "
         "server\n"
         "   -p NUM : clients run NUM parallel instances, using NUM threads\n"
+        "   -W NUM : max number of concurrent flow allocations per client "
+        "thread, for the fa test (default 16)\n"
         "   -w : server runs in background\n"
+        "   -j : report results in JSON\n"
         "   -v : be verbose\n");
 }
 
@@ -1255,6 +2007,7 @@ main(int argc, char **argv)
     rp->parallel      = 1;
     rp->duration      = 0;
     rp->use_mss_size  = 1;
+    rp->fa_window     = 16;
     rp->verbose       = 0;
     rp->cfd           = -1;
     rp->stop_pipe[0] = rp->stop_pipe[1] = -1;
@@ -1266,7 +2019,7 @@ main(int argc, char **argv)
     /* Start with a default flow configuration (unreliable flow). */
     rina_flow_spec_unreliable(&rp->flowspec);
 
-    while ((opt = getopt(argc, argv, "hlt:d:c:s:i:B:g:b:a:z:p:D:wv")) != -1) {
+    while ((opt = getopt(argc, argv, "hlt:d:c:s:i:B:g:b:a:z:p:W:D:wjv")) != -1) {
         switch (opt) {
         case 'h':
             usage();
@@ -1343,6 +2096,14 @@ main(int argc, char **argv)
             }
             break;
 
+        case 'W':
+            rp->fa_window = atoi(optarg);
+            if (rp->fa_window <= 0 || rp->fa_window > RP_FA_WINDOW_MAX) {
+                PRINTF("    Invalid 'window' %d\n", rp->fa_window);
+                return -1;
+            }
+            break;
+
         case 'D':
             rp->duration = atoi(optarg);
             if (rp->duration < 0) {
@@ -1355,6 +2116,10 @@ main(int argc, char **argv)
             background = 1;
             break;
 
+        case 'j':
+            rp->json = 1;
+            break;
+
         case 'v':
             rp->verbose = 1;
             break;
@@ -1394,8 +2159,8 @@ main(int argc, char **argv)
         }
     }
 
-    if (strcmp(type, "perf") != 0) {
-        rp->use_mss_size = 0; /* default MTU size only for perf */
+    if (strcmp(type, "perf") != 0 && strcmp(type, "bperf") != 0) {
+        rp->use_mss_size = 0; /* default MTU size only for perf tests */
     }
 
     /* Set defaults. */
@@ -1508,6 +2273,14 @@ main(int argc, char **argv)
             }
             retcode |= workers[i].retcode;
         }
+        if (wt.desc->aggregate_fn) {
+            wt.desc->aggregate_fn(workers, rp->parallel);
+        } else {
+            rp_report(workers, rp->parallel);
+        }
+        for (i = 0; i < rp->parallel; i++) {
+            free(workers[i].lat);
+        }
         free(workers);
         return retcode;
     }
@@ -38,7 +38,11 @@ class EnrollmentInformationRequest {
  public:
         EnrollmentInformationRequest()
                         : address_(0),
-                          allowed_to_start_early_(false)
+                          allowed_to_start_early_(false),
+                          dft_epoch_(0),
+                          dft_version_(0),
+                          dft_full_(false),
+                          accepts_compressed_(false)
         {
         }
         ;
@@ -49,6 +53,19 @@ class EnrollmentInformationRequest {
         std::list<rina::ApplicationProcessNamingInformation> supporting_difs_;
         bool allowed_to_start_early_;
         std::string token;
+
+        /// Version of the enroller's DFT, so that members enrolling again
+        /// only get the entries that changed. The epoch identifies the DFT
+        /// instance the version refers to (0 if unknown)
+        unsigned long long dft_epoch_;
+        unsigned long long dft_version_;
+
+        /// True if the enroller sent its whole DFT rather than the changes
+        /// since dft_version_, so entries it did not send are stale
+        bool dft_full_;
+
+        /// True if the enrollee can decode compressed DIF state
+        bool accepts_compressed_;
 };
 
 /// Encapsulates all the information required to manage a Flow
@@ -21,6 +21,8 @@
  */
 
 #include <cstring>
+#include <vector>
+#include <zlib.h>
 #include <google/protobuf/io/zero_copy_stream_impl_lite.h>
 
 #define RINA_PREFIX "rinad.encoder"
@@ -267,6 +269,71 @@ void DFTEListEncoder::decode(const rina::ser_obj_t &serobj,
 	}
 }
 
+// CLASS CompressedDFTEListEncoder
+void CompressedDFTEListEncoder::encode(
+	const std::list<rina::DirectoryForwardingTableEntry> &obj,
+	rina::ser_obj_t& serobj)
+{
+	rina::messages::directoryForwardingTableEntrySet_t gpb;
+	rina::messages::compressedDirectoryForwardingTableEntrySet_t gpb_c;
+	std::string raw;
+	uLongf length;
+
+	for (std::list<rina::DirectoryForwardingTableEntry>::const_iterator
+		it = obj.begin(); it != obj.end(); ++it) {
+			rina::messages::directoryForwardingTableEntry_t *gpb_dft;
+			gpb_dft = gpb.add_directoryforwardingtableentry();
+			dft_helpers::toGPB((*it), *gpb_dft);
+	}
+	gpb.SerializeToString(&raw);
+
+	length = compressBound(raw.size());
+	std::vector<Bytef> compressed(length);
+	if (compress2(&compressed[0], &length, (const Bytef *) raw.data(),
+		      raw.size(), Z_BEST_SPEED) != Z_OK) {
+		throw rina::Exception("Problems compressing DFT entries");
+	}
+
+	gpb_c.set_length(raw.size());
+	gpb_c.set_data(&compressed[0], length);
+
+	serobj.size_ = gpb_c.ByteSize();
+	serobj.message_ = new unsigned char[serobj.size_];
+	gpb_c.SerializeToArray(serobj.message_, serobj.size_);
+}
+
+void CompressedDFTEListEncoder::decode(const rina::ser_obj_t &serobj,
+	std::list<rina::DirectoryForwardingTableEntry> &des_obj)
+{
+	rina::messages::compressedDirectoryForwardingTableEntrySet_t gpb_c;
+	rina::messages::directoryForwardingTableEntrySet_t gpb;
+	uLongf length;
+
+	if (!gpb_c.ParseFromArray(serobj.message_, serobj.size_) ||
+			gpb_c.length() > MAX_UNCOMPRESSED_LENGTH) {
+		throw rina::Exception("Malformed compressed DFT entries");
+	}
+
+	length = gpb_c.length();
+	std::vector<Bytef> raw(length + 1);
+	if (uncompress(&raw[0], &length, (const Bytef *) gpb_c.data().data(),
+		       gpb_c.data().size()) != Z_OK ||
+			length != gpb_c.length()) {
+		throw rina::Exception("Problems decompressing DFT entries");
+	}
+
+	if (!gpb.ParseFromArray(&raw[0], length)) {
+		throw rina::Exception("Malformed decompressed DFT entries");
+	}
+
+	for (int i = 0; i < gpb.directoryforwardingtableentry_size(); i++)
+	{
+		rina::DirectoryForwardingTableEntry dfte;
+		dft_helpers::toModel(gpb.directoryforwardingtableentry(i), dfte);
+		des_obj.push_back(dfte);
+	}
+}
+
 namespace dif_alloc_helpers {
 void toGPB(const AppToDIFMapping &obj,
            rina::messages::app_name_to_dif_mapping_t &gpb)
@@ -934,6 +1001,10 @@ void EnrollmentInformationRequestEncoder::encode(
         gpb.set_address(obj.address_);
         gpb.set_startearly(obj.allowed_to_start_early_);
         gpb.set_token(obj.token);
+        gpb.set_dftepoch(obj.dft_epoch_);
+        gpb.set_dftversion(obj.dft_version_);
+        gpb.set_dftfull(obj.dft_full_);
+        gpb.set_acceptscompressed(obj.accepts_compressed_);
 
         for (std::list<rina::ApplicationProcessNamingInformation>::const_iterator it =
                         obj.supporting_difs_.begin();
@@ -957,6 +1028,10 @@ void EnrollmentInformationRequestEncoder::decode(
         des_obj.address_ = gpb.address();
         des_obj.allowed_to_start_early_ = gpb.startearly();
         des_obj.token = gpb.token();
+        des_obj.dft_epoch_ = gpb.dftepoch();
+        des_obj.dft_version_ = gpb.dftversion();
+        des_obj.dft_full_ = gpb.dftfull();
+        des_obj.accepts_compressed_ = gpb.acceptscompressed();
 
         for (int i = 0; i < gpb.supportingdifs_size(); ++i)
         {
@@ -64,6 +64,20 @@ public:
                     std::list<rina::DirectoryForwardingTableEntry> &des_obj);
 };
 
+/// Encoder of DirectoryForwardingTableEntryList objects compressed with
+/// zlib, used to transfer large parts of the DFT during enrollment
+class CompressedDFTEListEncoder : public rina::Encoder<
+                std::list<rina::DirectoryForwardingTableEntry> > {
+public:
+        /// Upper bound of the uncompressed size accepted when decoding
+        static const unsigned int MAX_UNCOMPRESSED_LENGTH = 64 * 1024 * 1024;
+
+        void encode(const std::list<rina::DirectoryForwardingTableEntry> &obj,
+                    rina::ser_obj_t& serobj);
+        void decode(const rina::ser_obj_t &serobj,
+                    std::list<rina::DirectoryForwardingTableEntry> &des_obj);
+};
+
 /// Encoder of AppDIFMapping object
 class AppDIFMappingEncoder : public rina::Encoder<AppToDIFMapping> {
 public:
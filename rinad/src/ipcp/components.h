@@ -302,6 +302,35 @@ public:
 
 	virtual std::list<rina::DirectoryForwardingTableEntry> getDFTEntries() = 0;
 
+	/// Update the address of an existing entry if @entry has a higher
+	/// sequence number. Returns true if the entry was updated
+	virtual bool updateDFTEntry(const rina::DirectoryForwardingTableEntry& entry) = 0;
+
+	/// Get a snapshot of the entries added or modified after @version of the
+	/// DFT identified by @epoch. It has all the entries, and @full is set,
+	/// if @epoch does not identify the current DFT or entries were removed
+	/// after @version. On return @epoch and @version identify the snapshot
+	virtual std::list<rina::DirectoryForwardingTableEntry> getDFTEntriesSince(unsigned long long& epoch,
+										  unsigned long long& version,
+										  bool& full) = 0;
+
+	/// Number of entries removed from the DFT so far. What a neighbor
+	/// learnt about our DFT may be stale once this changes
+	virtual unsigned long long getDFTRemovals() = 0;
+
+	/// Start recording the keys of the DFT entries received from the
+	/// neighbor at @port_id, which is about to send us its DFT
+	virtual void startDFTResync(int port_id) = 0;
+
+	/// Record DFT entries received from the neighbor at @port_id, if a
+	/// resync with it is in progress
+	virtual void recordDFTResync(int port_id,
+				     const std::list<rina::DirectoryForwardingTableEntry>& entries) = 0;
+
+	/// Stop recording. If @full, the neighbor sent its whole DFT: the
+	/// entries it did not send (other than ours) are stale and removed
+	virtual void finishDFTResync(int port_id, bool full) = 0;
+
 	/// Remove an entry from the directory forwarding table
 	/// @param apNamingInfo
 	virtual void removeDFTEntry(const std::string& key,
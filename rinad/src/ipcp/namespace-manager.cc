@@ -21,7 +21,10 @@
 //
 
 #include <assert.h>
+#include <fstream>
 #include <sstream>
+#include <unistd.h>
+#include <sys/time.h>
 
 #define IPCP_MODULE "namespace-manager"
 #include "ipcp-logging.h"
@@ -158,6 +161,7 @@ void DFTEntryRIBObj::read(const rina::cdap_rib::con_handle_t &con,
 
 // Class DirectoryForwardingTableEntry Set RIB Object
 const std::string DFTRIBObj::class_name = "DirectoryForwardingTable";
+const std::string DFTRIBObj::compressed_class_name = "CompressedDirectoryForwardingTable";
 const std::string DFTRIBObj::object_name = "/difManagement/nsm/dft";
 
 DFTRIBObj::DFTRIBObj(IPCProcess * ipc_process):
@@ -234,10 +238,23 @@ void DFTRIBObj::create(const rina::cdap_rib::con_handle_t &con_handle,
 	std::list<rina::DirectoryForwardingTableEntry> entriesToCreate;
 	std::list<rina::DirectoryForwardingTableEntry> entriesToUpdate;
 	rina::DirectoryForwardingTableEntry * entry;
-	encoders::DFTEListEncoder encoder;
+	//1 Decode list of names (compressed when sent in bulk during enrollment)
+	try {
+		if (class_ == compressed_class_name) {
+			encoders::CompressedDFTEListEncoder encoder;
+			encoder.decode(obj_req, entriesToCreateOrUpdate);
+		} else {
+			encoders::DFTEListEncoder encoder;
+			encoder.decode(obj_req, entriesToCreateOrUpdate);
+		}
+	} catch (rina::Exception &e) {
+		LOG_IPCP_ERR("Problems decoding DFT entries: %s", e.what());
+		res.code_ = rina::cdap_rib::CDAP_ERROR;
+		return;
+	}
 
-	//1 Decode list of names
-	encoder.decode(obj_req, entriesToCreateOrUpdate);
+	namespace_manager_->recordDFTResync(con_handle.port_id,
+					    entriesToCreateOrUpdate);
 
 	//2 Iterate list and create or update entries
 	std::list<rina::DirectoryForwardingTableEntry>::iterator it;
@@ -245,9 +262,7 @@ void DFTRIBObj::create(const rina::cdap_rib::con_handle_t &con_handle,
 		entry = namespace_manager_->getDFTEntry(it->getKey());
 		if (!entry) {
 			entriesToCreate.push_back(*it);
-		} else if (it->seqnum_ > entry->seqnum_){
-			entry->address_ = it->address_;
-			entry->seqnum_ = it->seqnum_;
+		} else if (namespace_manager_->updateDFTEntry(*it)) {
 			LOG_IPCP_INFO("Updated application %s IPCP address to %d",
 				       it->getKey().c_str(),
 				       it->address_);
@@ -286,11 +301,245 @@ void AddressChangeTimerTask::run()
 						  old_address);
 }
 
+//Class PropagateDFTUpdatesTimerTask
+PropagateDFTUpdatesTimerTask::PropagateDFTUpdatesTimerTask(INamespaceManager * nsm)
+{
+	namespace_manager = nsm;
+}
+
+void PropagateDFTUpdatesTimerTask::run()
+{
+	NamespaceManager * nsm = dynamic_cast<NamespaceManager *>(namespace_manager);
+	if (nsm)
+		nsm->propagate_pending_dft_updates();
+}
+
+//Class DirectoryForwardingTable
+/// Epochs must differ across restarts of the IPCP (and across IPCPs), or
+/// a member could be sent just the changes to a table it has never seen
+static unsigned long long random_dft_epoch()
+{
+	unsigned long long epoch = 0;
+	std::ifstream urandom("/dev/urandom", std::ios::in | std::ios::binary);
+	struct timeval now;
+
+	if (urandom.read((char *) &epoch, sizeof(epoch)) && epoch)
+		return epoch;
+
+	LOG_IPCP_WARN("Could not read /dev/urandom, deriving the DFT epoch from the clock");
+	gettimeofday(&now, 0);
+	epoch = ((unsigned long long) now.tv_sec << 32) ^
+		((unsigned long long) now.tv_usec << 12) ^
+		(unsigned long long) getpid();
+
+	return epoch ? epoch : 1;
+}
+
+DirectoryForwardingTable::DirectoryForwardingTable()
+{
+	epoch = random_dft_epoch();
+	version = 0;
+	removals = 0;
+	removed_version = 0;
+}
+
+bool DirectoryForwardingTable::put(rina::DirectoryForwardingTableEntry * entry)
+{
+	std::string key = entry->getKey();
+
+	rina::WriteScopedLock g(lock);
+
+	if (entries.find(key) != entries.end())
+		return false;
+
+	entries[key] = entry;
+	pn_index[entry->ap_naming_info_.processName][key] = entry;
+	versions[key] = ++version;
+
+	return true;
+}
+
+rina::DirectoryForwardingTableEntry * DirectoryForwardingTable::find(const std::string& key)
+{
+	entries_t::iterator it;
+
+	rina::ReadScopedLock g(lock);
+
+	it = entries.find(key);
+	if (it == entries.end())
+		return 0;
+
+	return it->second;
+}
+
+unsigned int DirectoryForwardingTable::find_address(const std::string& key)
+{
+	entries_t::iterator it;
+
+	rina::ReadScopedLock g(lock);
+
+	it = entries.find(key);
+	if (it == entries.end())
+		return 0;
+
+	return it->second->address_;
+}
+
+rina::DirectoryForwardingTableEntry * DirectoryForwardingTable::erase(const std::string& key)
+{
+	rina::DirectoryForwardingTableEntry * entry;
+	std::map<std::string, entries_t>::iterator pit;
+	entries_t::iterator it;
+
+	rina::WriteScopedLock g(lock);
+
+	it = entries.find(key);
+	if (it == entries.end())
+		return 0;
+
+	entry = it->second;
+	entries.erase(it);
+	versions.erase(key);
+	removals++;
+	removed_version = ++version;
+
+	pit = pn_index.find(entry->ap_naming_info_.processName);
+	if (pit != pn_index.end()) {
+		pit->second.erase(key);
+		if (pit->second.empty())
+			pn_index.erase(pit);
+	}
+
+	return entry;
+}
+
+unsigned int DirectoryForwardingTable::find_by_process_name(const std::string& name,
+							    unsigned int exclude_address,
+							    std::string& instance)
+{
+	std::map<std::string, entries_t>::iterator pit;
+	entries_t::iterator it;
+
+	rina::ReadScopedLock g(lock);
+
+	pit = pn_index.find(name);
+	if (pit == pn_index.end())
+		return 0;
+
+	for (it = pit->second.begin(); it != pit->second.end(); ++it) {
+		if (it->second->address_ != exclude_address) {
+			instance = it->second->ap_naming_info_.processInstance;
+			return it->second->address_;
+		}
+	}
+
+	return 0;
+}
+
+std::list<std::string> DirectoryForwardingTable::get_keys_by_address(unsigned int address)
+{
+	std::list<std::string> result;
+	entries_t::iterator it;
+
+	rina::ReadScopedLock g(lock);
+
+	for (it = entries.begin(); it != entries.end(); ++it) {
+		if (it->second->address_ == address)
+			result.push_back(it->first);
+	}
+
+	return result;
+}
+
+void DirectoryForwardingTable::change_address(unsigned int old_address,
+					      unsigned int new_address,
+					      std::list<rina::DirectoryForwardingTableEntry>& modified)
+{
+	entries_t::iterator it;
+
+	rina::WriteScopedLock g(lock);
+
+	version++;
+	for (it = entries.begin(); it != entries.end(); ++it) {
+		if (it->second->address_ == old_address) {
+			it->second->address_ = new_address;
+			it->second->seqnum_ = it->second->seqnum_ + 1;
+			versions[it->first] = version;
+			modified.push_back(*(it->second));
+		}
+	}
+}
+
+std::list<rina::DirectoryForwardingTableEntry> DirectoryForwardingTable::getCopyofentries()
+{
+	std::list<rina::DirectoryForwardingTableEntry> result;
+	entries_t::iterator it;
+
+	rina::ReadScopedLock g(lock);
+
+	for (it = entries.begin(); it != entries.end(); ++it)
+		result.push_back(*(it->second));
+
+	return result;
+}
+
+bool DirectoryForwardingTable::update(const rina::DirectoryForwardingTableEntry& entry)
+{
+	entries_t::iterator it;
+
+	rina::WriteScopedLock g(lock);
+
+	it = entries.find(entry.getKey());
+	if (it == entries.end() || entry.seqnum_ <= it->second->seqnum_)
+		return false;
+
+	it->second->address_ = entry.address_;
+	it->second->seqnum_ = entry.seqnum_;
+	versions[it->first] = ++version;
+
+	return true;
+}
+
+std::list<rina::DirectoryForwardingTableEntry>
+DirectoryForwardingTable::get_entries_since(unsigned long long& epoch_,
+					    unsigned long long& version_,
+					    bool& full)
+{
+	std::list<rina::DirectoryForwardingTableEntry> result;
+	std::map<std::string, unsigned long long>::iterator vit;
+	unsigned long long since;
+	entries_t::iterator it;
+
+	rina::ReadScopedLock g(lock);
+
+	//Deltas cannot carry removals
+	full = epoch_ != epoch || version_ < removed_version;
+	since = full ? 0 : version_;
+	for (it = entries.begin(); it != entries.end(); ++it) {
+		vit = versions.find(it->first);
+		if (vit == versions.end() || vit->second > since)
+			result.push_back(*(it->second));
+	}
+
+	epoch_ = epoch;
+	version_ = version;
+
+	return result;
+}
+
+unsigned long long DirectoryForwardingTable::get_removals()
+{
+	rina::ReadScopedLock g(lock);
+
+	return removals;
+}
+
 //Class Namespace Manager
 NamespaceManager::NamespaceManager() : INamespaceManager()
 {
 	rib_daemon_ = 0;
 	event_manager_ = 0;
+	propagation_scheduled = false;
 }
 
 NamespaceManager::~NamespaceManager()
@@ -351,6 +600,8 @@ void NamespaceManager::subscribeToEvents()
 {
 	event_manager_->subscribeToEvent(rina::InternalEvent::ADDRESS_CHANGE,
 					 this);
+	event_manager_->subscribeToEvent(rina::InternalEvent::APP_N_MINUS_1_FLOW_DEALLOCATED,
+					 this);
 }
 
 void NamespaceManager::eventHappened(rina::InternalEvent * event)
@@ -359,6 +610,11 @@ void NamespaceManager::eventHappened(rina::InternalEvent * event)
 		rina::AddressChangeEvent * addrEvent =
 				(rina::AddressChangeEvent *) event;
 		addressChange(addrEvent);
+	} else if (event->type == rina::InternalEvent::APP_N_MINUS_1_FLOW_DEALLOCATED) {
+		//Enrollment over the flow, if any, did not complete
+		rina::NMinusOneFlowDeallocatedEvent * flowEvent =
+				(rina::NMinusOneFlowDeallocatedEvent *) event;
+		finishDFTResync(flowEvent->port_id_, false);
 	}
 }
 
@@ -376,21 +632,11 @@ void NamespaceManager::addressChangeUpdateDFT(unsigned int new_address,
 			    	    	      unsigned int old_address)
 {
 	std::list<rina::DirectoryForwardingTableEntry> mod_entries;
-	rina::DirectoryForwardingTableEntry * entry;
 	std::vector<int> session_ids;
 
 	rina::ScopedLock g(lock);
 
-	std::list<std::string> keys = dft_.getKeys();
-	for(std::list<std::string>::iterator it = keys.begin();
-			it != keys.end(); ++it) {
-		entry = dft_.find(*it);
-		if (entry->address_ == old_address) {
-			entry->address_ = new_address;
-			entry->seqnum_ = entry->seqnum_ + 1;
-			mod_entries.push_back(*entry);
-		}
-	}
+	dft_.change_address(old_address, new_address, mod_entries);
 
 	if (mod_entries.size() == 0)
 		return;
@@ -421,34 +667,26 @@ void NamespaceManager::addressChangeUpdateDFT(unsigned int new_address,
 
 unsigned int NamespaceManager::getDFTNextHop(rina::ApplicationProcessNamingInformation& apNamingInfo)
 {
-	rina::DirectoryForwardingTableEntry * nextHop = 0;
-	std::list<rina::DirectoryForwardingTableEntry *> entries;
-	std::list<rina::DirectoryForwardingTableEntry *>::iterator it;
-	unsigned int my_address = 0;
+	std::string instance;
+	unsigned int address = 0;
 
-	rina::ScopedLock g(lock);
-
-	// Searching for a DAP name (specific DAF member)
-	nextHop = dft_.find(apNamingInfo.getEncodedString());
-	if (nextHop) {
-		return nextHop->get_address();
-	}
+	// Searching for a DAP name (specific DAF member). The table copies
+	// the address under its own lock, as entries may go concurrently
+	address = dft_.find_address(apNamingInfo.getEncodedString());
+	if (address != 0)
+		return address;
 
 	if (apNamingInfo.processInstance == "" &&
 			apNamingInfo.entityName == "" &&
 			apNamingInfo.entityInstance == "") {
 		//Searching for a DAF name
-		my_address = ipcp->get_active_address();
-		entries = dft_.getEntries();
-		for (it = entries.begin(); it != entries.end(); ++it) {
-			if ((*it)->ap_naming_info_.processName == apNamingInfo.processName &&
-					(*it)->address_ != my_address) {
-				apNamingInfo.processInstance = (*it)->ap_naming_info_.processInstance;
-				return (*it)->address_;
-			}
-		}
+		address = dft_.find_by_process_name(apNamingInfo.processName,
+						    ipcp->get_active_address(),
+						    instance);
+		if (address != 0)
+			apNamingInfo.processInstance = instance;
 
-		return 0;
+		return address;
 	}
 
 	return 0;
@@ -483,12 +721,49 @@ void NamespaceManager::addDFTEntries(const std::list<rina::DirectoryForwardingTa
 					e.what());
 		}
 
-		dft_.put(entry->getKey(), entry);
+		dft_.put(entry);
 		LOG_IPCP_DBG("Added entry to DFT: %s",
 			     entry->toString().c_str());
 	}
 
-	notify_neighbors_add(entries, neighs_to_exclude);
+	if (!notify_neighs)
+		return;
+
+	if (neighs_to_exclude.size() > 0) {
+		// Updates received from a neighbor already come in batches
+		notify_neighbors_add(entries, neighs_to_exclude);
+		return;
+	}
+
+	// Coalesce local updates (e.g. registration storms) in one message
+	rina::ScopedLock p(pending_lock);
+	pending_dft_adds.insert(pending_dft_adds.end(),
+				entries.begin(),
+				entries.end());
+	if (!propagation_scheduled) {
+		propagation_scheduled = true;
+		timer.scheduleTask(new PropagateDFTUpdatesTimerTask(this),
+				   DFT_PROPAGATION_DELAY_MS);
+	}
+}
+
+void NamespaceManager::propagate_pending_dft_updates()
+{
+	std::list<rina::DirectoryForwardingTableEntry> entries;
+	std::list<int> exc_neighs;
+
+	pending_lock.lock();
+	entries.swap(pending_dft_adds);
+	propagation_scheduled = false;
+	pending_lock.unlock();
+
+	if (entries.size() == 0)
+		return;
+
+	LOG_IPCP_DBG("Propagating %d DFT entries to neighbors",
+		     (int) entries.size());
+
+	notify_neighbors_add(entries, exc_neighs);
 }
 
 void NamespaceManager::notify_neighbors_add(const std::list<rina::DirectoryForwardingTableEntry>& entries,
@@ -533,6 +808,82 @@ std::list<rina::DirectoryForwardingTableEntry> NamespaceManager::getDFTEntries()
 	return dft_.getCopyofentries();
 }
 
+bool NamespaceManager::updateDFTEntry(const rina::DirectoryForwardingTableEntry& entry)
+{
+	return dft_.update(entry);
+}
+
+std::list<rina::DirectoryForwardingTableEntry> NamespaceManager::getDFTEntriesSince(unsigned long long& epoch,
+										    unsigned long long& version,
+										    bool& full)
+{
+	return dft_.get_entries_since(epoch, version, full);
+}
+
+unsigned long long NamespaceManager::getDFTRemovals()
+{
+	return dft_.get_removals();
+}
+
+void NamespaceManager::startDFTResync(int port_id)
+{
+	rina::ScopedLock g(resync_lock);
+
+	dft_resyncs[port_id].clear();
+}
+
+void NamespaceManager::recordDFTResync(int port_id,
+				       const std::list<rina::DirectoryForwardingTableEntry>& entries)
+{
+	std::map<int, std::set<std::string> >::iterator rit;
+	std::list<rina::DirectoryForwardingTableEntry>::const_iterator it;
+
+	rina::ScopedLock g(resync_lock);
+
+	rit = dft_resyncs.find(port_id);
+	if (rit == dft_resyncs.end())
+		return;
+
+	for (it = entries.begin(); it != entries.end(); ++it)
+		rit->second.insert(it->getKey());
+}
+
+void NamespaceManager::finishDFTResync(int port_id, bool full)
+{
+	std::map<int, std::set<std::string> >::iterator rit;
+	std::list<rina::DirectoryForwardingTableEntry> entries;
+	std::list<rina::DirectoryForwardingTableEntry>::iterator it;
+	std::set<std::string> received;
+	std::list<int> exc_neighs;
+
+	{
+		rina::ScopedLock g(resync_lock);
+
+		rit = dft_resyncs.find(port_id);
+		if (rit == dft_resyncs.end())
+			return;
+
+		received.swap(rit->second);
+		dft_resyncs.erase(rit);
+	}
+
+	if (!full)
+		return;
+
+	//Whatever the neighbor did not send was removed from its DFT
+	exc_neighs.push_back(port_id);
+	entries = dft_.getCopyofentries();
+	for (it = entries.begin(); it != entries.end(); ++it) {
+		if (it->address_ == ipcp->get_address() ||
+				received.find(it->getKey()) != received.end())
+			continue;
+
+		LOG_IPCP_DBG("Removing stale DFT entry %s",
+			     it->getKey().c_str());
+		removeDFTEntry(it->getKey(), true, true, exc_neighs);
+	}
+}
+
 void NamespaceManager::removeDFTEntry(const std::string& key,
 			 	      bool notify_neighs,
 			 	      bool remove_from_rib,
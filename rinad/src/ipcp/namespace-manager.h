@@ -23,6 +23,8 @@
 #ifndef IPCP_NAMESPACE_MANAGER_HH
 #define IPCP_NAMESPACE_MANAGER_HH
 
+#include <set>
+
 #include <librina/ipc-process.h>
 #include <librina/internal-events.h>
 
@@ -143,6 +145,9 @@ public:
 	const static std::string class_name;
 	const static std::string object_name;
 
+	/// Class of the CDAP objects carrying compressed DFT entries
+	const static std::string compressed_class_name;
+
 private:
 	rina::Lockable lock;
 	rina::Timer timer;
@@ -162,6 +167,103 @@ public:
 	unsigned int old_address;
 };
 
+/// The directory forwarding table. Entries are indexed by their key (the
+/// encoded application name) and by application process name, so that
+/// DAF names can be resolved without walking the whole table. Lookups
+/// only take the table lock for reading.
+/// Every addition or modification bumps the version of the table and is
+/// tagged with it, so that members enrolling again can be sent only the
+/// entries that changed since the version they already know. Removals
+/// bump it too: members that know a version older than the last removal
+/// get the whole table instead.
+class DirectoryForwardingTable {
+public:
+	DirectoryForwardingTable();
+
+	/// Add an entry, returns false if an entry with the same key exists
+	bool put(rina::DirectoryForwardingTableEntry * entry);
+	rina::DirectoryForwardingTableEntry * find(const std::string& key);
+
+	/// Returns the address of the entry with key @key, or 0 if there is
+	/// none. Unlike find(), safe against concurrent removals
+	unsigned int find_address(const std::string& key);
+
+	/// Remove an entry, returns 0 if the key is unknown or the removed
+	/// entry (to be deleted by the caller) otherwise
+	rina::DirectoryForwardingTableEntry * erase(const std::string& key);
+
+	/// Returns the address of the first entry whose application process
+	/// name is @name and whose address is not @exclude_address (0 if
+	/// there is none), and sets @instance to its process instance
+	unsigned int find_by_process_name(const std::string& name,
+					  unsigned int exclude_address,
+					  std::string& instance);
+
+	/// Returns the keys of the entries pointing to @address
+	std::list<std::string> get_keys_by_address(unsigned int address);
+
+	/// Moves all the entries pointing to @old_address to @new_address,
+	/// bumping their sequence number. Modified entries are appended to
+	/// @modified
+	void change_address(unsigned int old_address,
+			    unsigned int new_address,
+			    std::list<rina::DirectoryForwardingTableEntry>& modified);
+
+	std::list<rina::DirectoryForwardingTableEntry> getCopyofentries();
+
+	/// Updates the address of the entry with the same key as @entry if
+	/// its sequence number is higher. Returns true if it was updated
+	bool update(const rina::DirectoryForwardingTableEntry& entry);
+
+	/// Returns a copy of the entries added or modified after @version, or
+	/// of all the entries if @epoch is not the one of this table or
+	/// entries were removed after @version (@full is set then). Sets
+	/// @epoch and @version to the ones of the copy
+	std::list<rina::DirectoryForwardingTableEntry> get_entries_since(unsigned long long& epoch,
+									 unsigned long long& version,
+									 bool& full);
+
+	/// Number of entries erased from the table
+	unsigned long long get_removals();
+
+private:
+	typedef std::map<std::string, rina::DirectoryForwardingTableEntry *> entries_t;
+
+	rina::ReadWriteLockable lock;
+
+	/// Identifies this instance of the table, versions are only
+	/// meaningful within an epoch
+	unsigned long long epoch;
+
+	/// Current version of the table
+	unsigned long long version;
+
+	/// Number of entries erased
+	unsigned long long removals;
+
+	/// Version of the table when the last entry was erased
+	unsigned long long removed_version;
+
+	/// Version at which each entry was last added or modified, by key
+	std::map<std::string, unsigned long long> versions;
+
+	/// Entries by key
+	entries_t entries;
+
+	/// Entries by application process name, then by key
+	std::map<std::string, entries_t> pn_index;
+};
+
+class PropagateDFTUpdatesTimerTask: public rina::TimerTask {
+public:
+	PropagateDFTUpdatesTimerTask(INamespaceManager * nsm);
+	~PropagateDFTUpdatesTimerTask() throw() {};
+	void run();
+
+private:
+	INamespaceManager * namespace_manager;
+};
+
 class NamespaceManager: public INamespaceManager, public rina::InternalEventListener {
 public:
 	NamespaceManager();
@@ -175,6 +277,15 @@ public:
 			   std::list<int>& neighs_to_exclude);
 	rina::DirectoryForwardingTableEntry * getDFTEntry(const std::string& key);
 	std::list<rina::DirectoryForwardingTableEntry> getDFTEntries();
+	bool updateDFTEntry(const rina::DirectoryForwardingTableEntry& entry);
+	std::list<rina::DirectoryForwardingTableEntry> getDFTEntriesSince(unsigned long long& epoch,
+									  unsigned long long& version,
+									  bool& full);
+	unsigned long long getDFTRemovals();
+	void startDFTResync(int port_id);
+	void recordDFTResync(int port_id,
+			     const std::list<rina::DirectoryForwardingTableEntry>& entries);
+	void finishDFTResync(int port_id, bool full);
 	void removeDFTEntry(const std::string& key,
 			    bool notify_neighs,
 			    bool remove_from_rib,
@@ -196,11 +307,28 @@ public:
 	void notify_neighbors_add(const std::list<rina::DirectoryForwardingTableEntry>& entries,
 			          std::list<int>& neighs_to_exclude);
 
+	/// Send the DFT entries added since the last call to all the neighbors
+	void propagate_pending_dft_updates();
+
+	/// Locally originated DFT additions are accumulated during this period
+	/// and then sent to the neighbors in a single CDAP message
+	static const int DFT_PROPAGATION_DELAY_MS = 50;
+
 private:
 	rina::Lockable lock;
 
 	/// The directory forwarding table
-	rina::ThreadSafeMapOfPointers<std::string, rina::DirectoryForwardingTableEntry> dft_;
+	DirectoryForwardingTable dft_;
+
+	/// Keys of the DFT entries received from the neighbors enrolling us,
+	/// by port id
+	rina::Lockable resync_lock;
+	std::map<int, std::set<std::string> > dft_resyncs;
+
+	/// DFT entries waiting to be propagated to all the neighbors
+	rina::Lockable pending_lock;
+	std::list<rina::DirectoryForwardingTableEntry> pending_dft_adds;
+	bool propagation_scheduled;
 
 	/// Applications registered in this IPC Process
 	rina::ThreadSafeMapOfPointers<std::string, rina::ApplicationRegistrationInformation> registrations_;
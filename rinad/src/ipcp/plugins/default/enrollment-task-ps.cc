@@ -23,7 +23,9 @@
 #define IPCP_MODULE "enrollment-task-ps-default"
 #include "../../ipcp-logging.h"
 #include <string>
+#include <map>
 #include <climits>
+#include <cstdlib>
 #include <assert.h>
 
 #include "ipcp/ipc-process.h"
@@ -34,6 +36,92 @@
 
 namespace rinad {
 
+/// Remembers up to which version of the DFT of each neighbor we got
+/// during enrollment, so that re-enrolling with it only transfers the
+/// entries that changed, and holds the parameters of the transfer
+class DIFStateTransfer {
+public:
+	static const unsigned int DEFAULT_DFT_CHUNK_ENTRIES;
+	static const unsigned int COMPRESS_MIN_ENTRIES;
+	static const std::string DFT_CHUNK_ENTRIES;
+	static const std::string COMPRESS_ENROLLMENT_STATE;
+
+	DIFStateTransfer();
+
+	/// Gets the epoch and version of the DFT of @peer we are up to date
+	/// with. Returns false if there is none, or if our DFT lost entries
+	/// since then (@removals changed)
+	bool get_dft_version(const std::string& peer,
+			     unsigned long long removals,
+			     unsigned long long& epoch,
+			     unsigned long long& version);
+	void set_dft_version(const std::string& peer,
+			     unsigned long long removals,
+			     unsigned long long epoch,
+			     unsigned long long version);
+
+	/// Maximum number of DFT entries per M_CREATE message
+	unsigned int dft_chunk_entries;
+
+	/// Compress DFT chunks if the peer accepts it
+	bool compress;
+
+private:
+	struct DFTVersion {
+		unsigned long long removals;
+		unsigned long long epoch;
+		unsigned long long version;
+	};
+
+	rina::Lockable lock;
+	std::map<std::string, DFTVersion> dft_versions;
+};
+
+const unsigned int DIFStateTransfer::DEFAULT_DFT_CHUNK_ENTRIES = 256;
+const unsigned int DIFStateTransfer::COMPRESS_MIN_ENTRIES = 16;
+const std::string DIFStateTransfer::DFT_CHUNK_ENTRIES = "dftChunkEntries";
+const std::string DIFStateTransfer::COMPRESS_ENROLLMENT_STATE = "compressEnrollmentState";
+
+DIFStateTransfer::DIFStateTransfer()
+{
+	dft_chunk_entries = DEFAULT_DFT_CHUNK_ENTRIES;
+	compress = true;
+}
+
+bool DIFStateTransfer::get_dft_version(const std::string& peer,
+				       unsigned long long removals,
+				       unsigned long long& epoch,
+				       unsigned long long& version)
+{
+	std::map<std::string, DFTVersion>::iterator it;
+
+	rina::ScopedLock g(lock);
+
+	it = dft_versions.find(peer);
+	if (it == dft_versions.end() || it->second.removals != removals)
+		return false;
+
+	epoch = it->second.epoch;
+	version = it->second.version;
+
+	return true;
+}
+
+void DIFStateTransfer::set_dft_version(const std::string& peer,
+				       unsigned long long removals,
+				       unsigned long long epoch,
+				       unsigned long long version)
+{
+	DFTVersion dft_version;
+
+	rina::ScopedLock g(lock);
+
+	dft_version.removals = removals;
+	dft_version.epoch = epoch;
+	dft_version.version = version;
+	dft_versions[peer] = dft_version;
+}
+
 /// The base class that contains the common aspects of both
 /// enrollment state machines: the enroller side and the enrolle
 /// side
@@ -78,16 +166,31 @@ protected:
 	BaseEnrollmentStateMachine(IPCProcess * ipc_process,
 				   const rina::ApplicationProcessNamingInformation& remote_naming_info,
 				   int timeout,
-				   const rina::ApplicationProcessNamingInformation& supporting_dif_name);
-
-	/// Sends all the DIF dynamic information
-	void sendDIFDynamicInformation();
-
-	/// Send the entries in the DFT (if any)
-	void sendDFTEntries();
+				   const rina::ApplicationProcessNamingInformation& supporting_dif_name,
+				   DIFStateTransfer * state_transfer);
+
+	/// Sends all the DIF dynamic information the peer does not have yet,
+	/// according to the DFT epoch and version in @eiRequest. Updates them
+	/// to the ones of the information sent
+	void sendDIFDynamicInformation(configs::EnrollmentInformationRequest& eiRequest);
+
+	/// Send the entries in the DFT added or modified after @version of
+	/// @epoch, in chunks. All of them are sent, and @full is set, if
+	/// @epoch is not the one of our DFT or entries were removed since
+	/// @version. On return @epoch and @version identify what was sent
+	void sendDFTEntries(unsigned long long& epoch,
+			    unsigned long long& version,
+			    bool& full,
+			    bool compress);
+
+	/// Send a chunk of @size DFT entries with a single M_CREATE
+	void sendDFTChunk(const std::list<rina::DirectoryForwardingTableEntry>& entries,
+			  unsigned int size,
+			  bool compress);
 
 	IPCProcess * ipc_process_;
 	IPCPSecurityManager * sec_man_;
+	DIFStateTransfer * state_transfer_;
 	std::string token;
 };
 
@@ -157,12 +260,14 @@ const std::string BaseEnrollmentStateMachine::STATE_WAIT_START_RESPONSE =
 BaseEnrollmentStateMachine::BaseEnrollmentStateMachine(IPCProcess * ipc_process,
 						       const rina::ApplicationProcessNamingInformation& remote_naming_info,
 						       int timeout,
-						       const rina::ApplicationProcessNamingInformation& supporting_dif_name) :
+						       const rina::ApplicationProcessNamingInformation& supporting_dif_name,
+						       DIFStateTransfer * state_transfer) :
 				IEnrollmentStateMachine(ipc_process, remote_naming_info,
 						timeout, supporting_dif_name)
 {
 	ipc_process_ = ipc_process;
 	sec_man_ = ipc_process->security_manager_;
+	state_transfer_ = state_transfer;
 }
 
 void BaseEnrollmentStateMachine::operational_status_start(int invoke_id,
@@ -170,31 +275,81 @@ void BaseEnrollmentStateMachine::operational_status_start(int invoke_id,
 {
 }
 
-void BaseEnrollmentStateMachine::sendDIFDynamicInformation()
+void BaseEnrollmentStateMachine::sendDIFDynamicInformation(configs::EnrollmentInformationRequest& eiRequest)
 {
 	//Send DirectoryForwardingTableEntries
-	sendDFTEntries();
+	sendDFTEntries(eiRequest.dft_epoch_,
+		       eiRequest.dft_version_,
+		       eiRequest.dft_full_,
+		       eiRequest.accepts_compressed_);
 
 	//Send neighbors (including myself)
 	sendNeighbors();
 }
 
-void BaseEnrollmentStateMachine::sendDFTEntries()
+void BaseEnrollmentStateMachine::sendDFTEntries(unsigned long long& epoch,
+						unsigned long long& version,
+						bool& full,
+						bool compress)
 {
-	std::list<rina::DirectoryForwardingTableEntry> dftEntries =
-			ipc_process_->namespace_manager_->getDFTEntries();
+	std::list<rina::DirectoryForwardingTableEntry> dftEntries;
+	std::list<rina::DirectoryForwardingTableEntry> chunk;
+	std::list<rina::DirectoryForwardingTableEntry>::const_iterator it;
+	unsigned long long peer_epoch = epoch;
+	unsigned long long peer_version = version;
+	unsigned int chunk_size = 0;
+
+	dftEntries = ipc_process_->namespace_manager_->getDFTEntriesSince(epoch,
+									  version,
+									  full);
 
 	if (dftEntries.size() == 0) {
 		LOG_IPCP_DBG("No DFT entries to be sent");
 		return;
 	}
 
+	if (!full) {
+		LOG_IPCP_DBG("Sending DFT entries modified after version %llu",
+			     peer_version);
+	} else if (epoch == peer_epoch) {
+		LOG_IPCP_DBG("Sending all the DFT entries, some were removed "
+			     "after version %llu", peer_version);
+	} else {
+		LOG_IPCP_DBG("Sending all the DFT entries");
+	}
+
+	compress = compress && state_transfer_->compress;
+	for (it = dftEntries.begin(); it != dftEntries.end(); ++it) {
+		chunk.push_back(*it);
+		chunk_size++;
+		if (chunk_size == state_transfer_->dft_chunk_entries) {
+			sendDFTChunk(chunk, chunk_size, compress);
+			chunk.clear();
+			chunk_size = 0;
+		}
+	}
+
+	if (chunk_size > 0) {
+		sendDFTChunk(chunk, chunk_size, compress);
+	}
+}
+
+void BaseEnrollmentStateMachine::sendDFTChunk(const std::list<rina::DirectoryForwardingTableEntry>& entries,
+					      unsigned int size,
+					      bool compress)
+{
 	try {
-		encoders::DFTEListEncoder encoder;
 		rina::cdap_rib::obj_info_t obj;
-		obj.class_ = DFTRIBObj::class_name;
 		obj.name_ = DFTRIBObj::object_name;
-		encoder.encode(dftEntries, obj.value_);
+		if (compress && size >= DIFStateTransfer::COMPRESS_MIN_ENTRIES) {
+			encoders::CompressedDFTEListEncoder encoder;
+			obj.class_ = DFTRIBObj::compressed_class_name;
+			encoder.encode(entries, obj.value_);
+		} else {
+			encoders::DFTEListEncoder encoder;
+			obj.class_ = DFTRIBObj::class_name;
+			encoder.encode(entries, obj.value_);
+		}
 		rina::cdap_rib::filt_info_t filt;
 		rina::cdap_rib::flags_t flags;
 
@@ -250,7 +405,8 @@ class EnrolleeStateMachine: public BaseEnrollmentStateMachine {
 public:
 	EnrolleeStateMachine(IPCProcess * ipc_process,
 			    const rina::ApplicationProcessNamingInformation& remote_naming_info,
-			    int timeout);
+			    int timeout,
+			    DIFStateTransfer * state_transfer);
 	~EnrolleeStateMachine() { };
 
 	/// Called by the DIFMembersSetObject to initiate the enrollment sequence
@@ -321,22 +477,38 @@ private:
 	bool allowed_to_start_early_;
 	int stop_request_invoke_id_;
 	int start_request_invoke_id;
+
+	/// Removals from our DFT when the enrollment started
+	unsigned long long dft_removals_;
+
+	/// Epoch and version of the DFT of the enroller we got
+	unsigned long long peer_dft_epoch_;
+	unsigned long long peer_dft_version_;
+
+	/// The enroller accepts compressed DFT entries
+	bool peer_accepts_compressed_;
 };
 
 // Class EnrolleeStateMachine
 EnrolleeStateMachine::EnrolleeStateMachine(IPCProcess * ipc_process,
 					   const rina::ApplicationProcessNamingInformation& remote_naming_info,
-					   int timeout):
+					   int timeout,
+					   DIFStateTransfer * state_transfer):
 		BaseEnrollmentStateMachine(ipc_process,
 					   remote_naming_info,
 					   timeout,
-					   rina::ApplicationProcessNamingInformation())
+					   rina::ApplicationProcessNamingInformation(),
+					   state_transfer)
 {
 	was_dif_member_before_enrollment_ = false;
 	last_scheduled_task_ = 0;
 	allowed_to_start_early_ = false;
 	stop_request_invoke_id_ = 0;
 	start_request_invoke_id = 0;
+	dft_removals_ = 0;
+	peer_dft_epoch_ = 0;
+	peer_dft_version_ = 0;
+	peer_accepts_compressed_ = false;
 }
 
 void EnrolleeStateMachine::initiateEnrollment(const rina::EnrollmentRequest& enrollmentRequest,
@@ -493,9 +665,21 @@ void EnrolleeStateMachine::connectResponse(int result,
 			}
 		}
 
+		eiRequest.accepts_compressed_ = true;
+		dft_removals_ = ipc_process_->namespace_manager_->getDFTRemovals();
 		if (ipc_process_->get_address() != 0) {
 			was_dif_member_before_enrollment_ = true;
 			eiRequest.address_ = ipc_process_->get_address();
+
+			//Only ask for the DFT entries we did not get yet
+			state_transfer_->get_dft_version(remote_peer_.name_.processName,
+							 dft_removals_,
+							 eiRequest.dft_epoch_,
+							 eiRequest.dft_version_);
+
+			//Find out which entries the enroller no longer has,
+			//in case it sends all of them
+			ipc_process_->namespace_manager_->startDFTResync(con.port_id);
 		} else {
 			rina::DIFInformation difInformation;
 			difInformation.dif_name_ = enr_request.event_.dafName;
@@ -597,6 +781,17 @@ void EnrolleeStateMachine::stop(const configs::EnrollmentInformationRequest& eiR
 	allowed_to_start_early_ = eiRequest.allowed_to_start_early_;
 	stop_request_invoke_id_ = invoke_id;
 	token = eiRequest.token;
+	peer_dft_epoch_ = eiRequest.dft_epoch_;
+	peer_dft_version_ = eiRequest.dft_version_;
+	peer_accepts_compressed_ = eiRequest.accepts_compressed_;
+
+	//The DFT entries were sent before the M_STOP
+	ipc_process_->namespace_manager_->finishDFTResync(con_handle.port_id,
+							  eiRequest.dft_full_);
+	if (eiRequest.dft_full_) {
+		//In sync with the enroller, whatever we removed before
+		dft_removals_ = ipc_process_->namespace_manager_->getDFTRemovals();
+	}
 
 	LOG_IPCP_DBG("Allowed to start early: %d \n Token: %s",
 		     allowed_to_start_early_,
@@ -740,8 +935,19 @@ void EnrolleeStateMachine::enrollmentCompleted()
 	//Create or update the neighbor information in the RIB
 	createOrUpdateNeighborInformation(true);;
 
+	//Remember what we got from the enroller, for the next time
+	if (peer_dft_epoch_ != 0) {
+		state_transfer_->set_dft_version(remote_peer_.name_.processName,
+						 dft_removals_,
+						 peer_dft_epoch_,
+						 peer_dft_version_);
+	}
+
 	//Send DirectoryForwardingTableEntries
-	sendDFTEntries();
+	unsigned long long epoch = 0;
+	unsigned long long version = 0;
+	bool full = false;
+	sendDFTEntries(epoch, version, full, peer_accepts_compressed_);
 
 	enrollment_task_->enrollmentCompleted(remote_peer_, true,
 					      enr_request.event_.prepare_for_handover,
@@ -973,7 +1179,8 @@ public:
 	EnrollerStateMachine(IPCProcess * ipc_process,
 			     const rina::ApplicationProcessNamingInformation& remote_naming_info,
 			     int timeout,
-			     const rina::ApplicationProcessNamingInformation& supporting_dif_name);
+			     const rina::ApplicationProcessNamingInformation& supporting_dif_name,
+			     DIFStateTransfer * state_transfer);
 	~EnrollerStateMachine() { };
 
 	/// An M_CONNECT message has been received.  Handle the transition from the
@@ -1048,11 +1255,13 @@ private:
 EnrollerStateMachine::EnrollerStateMachine(IPCProcess * ipc_process,
 					   const rina::ApplicationProcessNamingInformation& remote_naming_info,
 					   int timeout,
-					   const rina::ApplicationProcessNamingInformation& supporting_dif_name):
+					   const rina::ApplicationProcessNamingInformation& supporting_dif_name,
+					   DIFStateTransfer * state_transfer):
 		BaseEnrollmentStateMachine(ipc_process,
 					   remote_naming_info,
 					   timeout,
-					   supporting_dif_name)
+					   supporting_dif_name,
+					   state_transfer)
 {
 	namespace_manager_ = ipc_process->namespace_manager_;
 	enroller_ = true;
@@ -1359,6 +1568,10 @@ void EnrollerStateMachine::start(configs::EnrollmentInformationRequest& eiReques
 
 		LOG_IPCP_DBG("Remote IPC Process requires initialization, assigning address %u", address);
 		eiRequest.address_ = address;
+
+		//Whatever it knew about our DFT, it needs all of it
+		eiRequest.dft_epoch_ = 0;
+		eiRequest.dft_version_ = 0;
 	}
 
 	try {
@@ -1393,7 +1606,7 @@ void EnrollerStateMachine::start(configs::EnrollmentInformationRequest& eiReques
 		sendDIFStaticInformation();
 	}
 
-	sendDIFDynamicInformation();
+	sendDIFDynamicInformation(eiRequest);
 
 	int temp = std::rand();
 	ss << temp;
@@ -1407,6 +1620,7 @@ void EnrollerStateMachine::start(configs::EnrollmentInformationRequest& eiReques
 		encoders::EnrollmentInformationRequestEncoder encoder;
 		eiRequest.allowed_to_start_early_ = false;
 		eiRequest.token = token;
+		eiRequest.accepts_compressed_ = true;
 		encoder.encode(eiRequest, obj.value_);
 		rina::cdap_rib::flags_t flags;
 		rina::cdap_rib::filt_info_t filt;
@@ -1707,6 +1921,7 @@ private:
         rina::Lockable lock;
         rina::IPCResourceManager * irm;
         IPCPRIBDaemon * rib_daemon;
+        DIFStateTransfer state_transfer;
 };
 
 EnrollmentTaskPs::EnrollmentTaskPs(IPCProcess * ipcp_) :
@@ -1921,12 +2136,14 @@ IEnrollmentStateMachine * EnrollmentTaskPs::createEnrollmentStateMachine(const r
 		if (enrollee){
 			stateMachine = new EnrolleeStateMachine(ipcp,
 								apNamingInfo,
-								timeout);
+								timeout,
+								&state_transfer);
 		}else{
 			stateMachine = new EnrollerStateMachine(ipcp,
 								apNamingInfo,
 								timeout,
-								supportingDifName);
+								supportingDifName,
+								&state_transfer);
 		}
 
 		et->add_enrollment_state_machine(portId, stateMachine);
@@ -1943,12 +2160,46 @@ void EnrollmentTaskPs::set_dif_configuration(const rina::DIFConfiguration& dif_c
 {
 	rina::PolicyConfig psconf = dif_configuration.et_configuration_.policy_set_;
 	timeout = psconf.get_param_value_as_int(EnrollmentTask::ENROLL_TIMEOUT_IN_MS);
+
+	try {
+		int chunk_entries = psconf.get_param_value_as_int(DIFStateTransfer::DFT_CHUNK_ENTRIES);
+		if (chunk_entries > 0) {
+			state_transfer.dft_chunk_entries = chunk_entries;
+		}
+	} catch (rina::Exception &e) {
+		LOG_IPCP_INFO("Could not parse dft_chunk_entries, using default value: %u",
+			      state_transfer.dft_chunk_entries);
+	}
+
+	try {
+		state_transfer.compress =
+			psconf.get_param_value_as_bool(DIFStateTransfer::COMPRESS_ENROLLMENT_STATE);
+	} catch (rina::Exception &e) {
+		LOG_IPCP_INFO("Could not parse compress, using default value: %d",
+			      state_transfer.compress);
+	}
 }
 
 int EnrollmentTaskPs::set_policy_set_param(const std::string& name,
                                             const std::string& value)
 {
-        LOG_IPCP_DBG("No policy-set-specific parameters to set (%s, %s)",
+	if (name == DIFStateTransfer::DFT_CHUNK_ENTRIES) {
+		int chunk_entries = atoi(value.c_str());
+		if (chunk_entries <= 0) {
+			LOG_IPCP_ERR("Invalid value for %s: %s",
+				     name.c_str(), value.c_str());
+			return -1;
+		}
+		state_transfer.dft_chunk_entries = chunk_entries;
+		return 0;
+	}
+
+	if (name == DIFStateTransfer::COMPRESS_ENROLLMENT_STATE) {
+		state_transfer.compress = value == "true";
+		return 0;
+	}
+
+        LOG_IPCP_DBG("Unknown policy-set-specific parameter to set (%s, %s)",
                         name.c_str(), value.c_str());
         return -1;
 }
@@ -22,6 +22,9 @@
 
 #include <list>
 #include <iostream>
+#include <sstream>
+#include <vector>
+#include <zlib.h>
 
 #define IPCP_MODULE "encoders-tests"
 
@@ -29,8 +32,10 @@
 
 #include <librina/configuration.h>
 #include "common/encoder.h"
+#include "common/encoders/DirectoryForwardingTableEntryArrayMessage.pb.h"
 #include "ipcp/enrollment-task.h"
 #include "ipcp/flow-allocator.h"
+#include "ipcp/namespace-manager.h"
 
 int ipcp_id = 1;
 
@@ -320,6 +325,78 @@ bool test_directory_forwarding_table_entry_list() {
 	return true;
 }
 
+bool test_compressed_directory_forwarding_table_entry_list() {
+	rinad::encoders::CompressedDFTEListEncoder encoder;
+	rina::messages::compressedDirectoryForwardingTableEntrySet_t gpb_c;
+	const Bytef garbage[] = { 0xff, 0xff, 0xff, 0xff };
+	std::vector<Bytef> compressed(compressBound(sizeof(garbage)));
+	uLongf length = compressed.size();
+	rina::ser_obj_t encoded_obj;
+	rina::ser_obj_t garbage_obj;
+	std::list<rina::DirectoryForwardingTableEntry> dfte_list;
+	rina::DirectoryForwardingTableEntry dfte;
+	std::list<rina::DirectoryForwardingTableEntry> recovered_obj;
+	std::list<rina::DirectoryForwardingTableEntry>::iterator it, jt;
+	std::stringstream ss;
+
+	for (int i = 0; i < 100; i++) {
+		ss.str("");
+		ss << "test" << i;
+		dfte.address_ = 232 + i;
+		dfte.seqnum_ = 5265235 + i;
+		dfte.ap_naming_info_.processName = ss.str();
+		dfte.ap_naming_info_.processInstance = "1";
+		dfte.ap_naming_info_.entityName = "ae";
+		dfte.ap_naming_info_.entityInstance = "1";
+		dfte_list.push_back(dfte);
+	}
+
+	encoder.encode(dfte_list, encoded_obj);
+	encoder.decode(encoded_obj, recovered_obj);
+
+	if (dfte_list.size() != recovered_obj.size()) {
+		return false;
+	}
+
+	for (it = dfte_list.begin(), jt = recovered_obj.begin();
+			it != dfte_list.end(); ++it, ++jt) {
+		if (it->address_ != jt->address_ ||
+				it->seqnum_ != jt->seqnum_ ||
+				it->ap_naming_info_.processName !=
+					jt->ap_naming_info_.processName) {
+			return false;
+		}
+	}
+
+	//Corrupted data must be rejected
+	encoded_obj.message_[encoded_obj.size_ - 1] ^= 0xff;
+	try {
+		recovered_obj.clear();
+		encoder.decode(encoded_obj, recovered_obj);
+		return false;
+	} catch (rina::Exception &e) {
+	}
+
+	//So must data that decompresses fine but is not a list of entries
+	if (compress(&compressed[0], &length, garbage, sizeof(garbage)) != Z_OK) {
+		return false;
+	}
+	gpb_c.set_length(sizeof(garbage));
+	gpb_c.set_data(&compressed[0], length);
+	garbage_obj.size_ = gpb_c.ByteSize();
+	garbage_obj.message_ = new unsigned char[garbage_obj.size_];
+	gpb_c.SerializeToArray(garbage_obj.message_, garbage_obj.size_);
+	try {
+		recovered_obj.clear();
+		encoder.decode(garbage_obj, recovered_obj);
+		return false;
+	} catch (rina::Exception &e) {
+	}
+
+	LOG_IPCP_INFO("Compressed Directory Forwarding Table Entry List Encoder tested successfully");
+	return true;
+}
+
 bool test_enrollment_information_request() {
 	rinad::encoders::EnrollmentInformationRequestEncoder encoder;
 	rina::ser_obj_t encoded_obj;
@@ -334,6 +411,10 @@ bool test_enrollment_information_request() {
 	request.supporting_difs_.push_back(name1);
 	request.supporting_difs_.push_back(name2);
 	request.address_ = 141234;
+	request.dft_epoch_ = 0x5e5e5e5e12345678ULL;
+	request.dft_version_ = 4123;
+	request.dft_full_ = true;
+	request.accepts_compressed_ = true;
 
 	encoder.encode(request, encoded_obj);
 	encoder.decode(encoded_obj, recovered_obj);
@@ -342,6 +423,13 @@ bool test_enrollment_information_request() {
 		return false;
 	}
 
+	if (request.dft_epoch_ != recovered_obj.dft_epoch_ ||
+			request.dft_version_ != recovered_obj.dft_version_ ||
+			request.dft_full_ != recovered_obj.dft_full_ ||
+			request.accepts_compressed_ != recovered_obj.accepts_compressed_) {
+		return false;
+	}
+
 	if (request.supporting_difs_.size() != recovered_obj.supporting_difs_.size()) {
 		return false;
 	}
@@ -721,6 +809,187 @@ bool test_ribobjectdatalist() {
     return true;
 }
 
+rina::DirectoryForwardingTableEntry * dft_entry(const std::string& name,
+						unsigned int address)
+{
+	rina::DirectoryForwardingTableEntry * entry;
+
+	entry = new rina::DirectoryForwardingTableEntry();
+	entry->ap_naming_info_.processName = name;
+	entry->ap_naming_info_.processInstance = "1";
+	entry->address_ = address;
+	entry->seqnum_ = 1;
+
+	return entry;
+}
+
+void dft_clear(rinad::DirectoryForwardingTable& dft)
+{
+	std::list<rina::DirectoryForwardingTableEntry> entries;
+	std::list<rina::DirectoryForwardingTableEntry>::iterator it;
+
+	entries = dft.getCopyofentries();
+	for (it = entries.begin(); it != entries.end(); ++it)
+		delete dft.erase(it->getKey());
+}
+
+bool test_dft_entries_since() {
+	rinad::DirectoryForwardingTable dft;
+	rina::DirectoryForwardingTableEntry * a = dft_entry("a", 10);
+	rina::DirectoryForwardingTableEntry * b = dft_entry("b", 20);
+	rina::DirectoryForwardingTableEntry * c = dft_entry("c", 30);
+	rina::DirectoryForwardingTableEntry * dup = dft_entry("a", 11);
+	rina::DirectoryForwardingTableEntry update;
+	std::list<rina::DirectoryForwardingTableEntry> changes;
+	unsigned long long epoch = 0;
+	unsigned long long version = 0;
+	bool full = false;
+	bool result = false;
+
+	dft.put(a);
+	dft.put(b);
+	if (dft.put(dup)) {
+		dup = 0;
+		goto out;
+	}
+	if (dft.get_entries_since(epoch, version, full).size() != 2 ||
+			!full || !epoch || version != 2)
+		goto out;
+
+	// Nothing changed since the version just returned
+	if (!dft.get_entries_since(epoch, version, full).empty() ||
+			full || version != 2)
+		goto out;
+
+	// Additions
+	dft.put(c);
+	changes = dft.get_entries_since(epoch, version, full);
+	if (changes.size() != 1 || changes.front().getKey() != c->getKey() ||
+			full || version != 3)
+		goto out;
+
+	// Updates only go through with a higher sequence number
+	update = *a;
+	update.address_ = 12;
+	update.seqnum_ = 2;
+	if (!dft.update(update))
+		goto out;
+	update.address_ = 13;
+	if (dft.update(update))
+		goto out;
+	changes = dft.get_entries_since(epoch, version, full);
+	if (changes.size() != 1 || changes.front().getKey() != a->getKey() ||
+			changes.front().address_ != 12 || full)
+		goto out;
+
+	// Address changes
+	changes.clear();
+	dft.change_address(20, 21, changes);
+	if (changes.size() != 1)
+		goto out;
+	changes = dft.get_entries_since(epoch, version, full);
+	if (changes.size() != 1 || changes.front().getKey() != b->getKey() ||
+			changes.front().address_ != 21 || full ||
+			changes.front().seqnum_ != 2)
+		goto out;
+
+	result = true;
+
+out:
+	// Entries the table did not take are still ours
+	if (dft.find(c->getKey()) != c)
+		delete c;
+	delete dup;
+	dft_clear(dft);
+
+	if (result)
+		LOG_IPCP_INFO("DFT changes since a version tested successfully");
+	return result;
+}
+
+bool test_dft_removals() {
+	rinad::DirectoryForwardingTable dft;
+	rina::DirectoryForwardingTableEntry * a = dft_entry("a", 10);
+	std::string key = a->getKey();
+	std::list<rina::DirectoryForwardingTableEntry> changes;
+	unsigned long long epoch = 0;
+	unsigned long long version = 0;
+	unsigned long long old_version;
+	bool full = false;
+	bool result = false;
+
+	dft.put(a);
+	dft.put(dft_entry("b", 20));
+	dft.get_entries_since(epoch, version, full);
+	old_version = version;
+
+	if (dft.get_removals() != 0)
+		goto out;
+
+	delete dft.erase(key);
+	if (dft.erase(key) || dft.get_removals() != 1 || dft.find(key))
+		goto out;
+
+	// Deltas cannot carry removals: peers that know a version older
+	// than the removal get all the entries left, flagged as such
+	changes = dft.get_entries_since(epoch, version, full);
+	if (changes.size() != 1 || changes.front().getKey() == key ||
+			!full || version <= old_version)
+		goto out;
+
+	// Peers that know a version after the removal get deltas again
+	if (!dft.get_entries_since(epoch, version, full).empty() || full)
+		goto out;
+
+	result = true;
+
+out:
+	dft_clear(dft);
+
+	if (result)
+		LOG_IPCP_INFO("DFT removal tracking tested successfully");
+	return result;
+}
+
+bool test_dft_epoch_change() {
+	rinad::DirectoryForwardingTable old_dft;
+	rinad::DirectoryForwardingTable new_dft;
+	unsigned long long epoch = 0;
+	unsigned long long version = 0;
+	unsigned long long old_epoch;
+	bool full = false;
+	bool result = false;
+
+	old_dft.put(dft_entry("a", 10));
+	old_dft.put(dft_entry("b", 20));
+	old_dft.get_entries_since(epoch, version, full);
+	old_epoch = epoch;
+
+	// A table created again (e.g. after a restart) has another epoch
+	new_dft.put(dft_entry("a", 10));
+	new_dft.put(dft_entry("b", 20));
+	new_dft.put(dft_entry("c", 30));
+	if (new_dft.get_entries_since(epoch, version, full).size() != 3 ||
+			!full || epoch == old_epoch || !epoch || version != 3)
+		goto out;
+
+	// Versions of another epoch are ignored, even if they look recent
+	epoch = old_epoch;
+	version = 1000;
+	if (new_dft.get_entries_since(epoch, version, full).size() != 3 ||
+			!full)
+		goto out;
+
+	result = true;
+
+out:
+	dft_clear(old_dft);
+	dft_clear(new_dft);
+
+	if (result)
+		LOG_IPCP_INFO("DFT epoch change tested successfully");
+	return result;
+}
 
 int main()
 {
@@ -742,6 +1011,12 @@ int main()
 		return -1;
 	}
 
+	result = test_compressed_directory_forwarding_table_entry_list();
+	if (!result) {
+		LOG_IPCP_ERR("Problems testing Compressed Directory Forwarding Table Entry List Encoder");
+		return -1;
+	}
+
 	result = test_enrollment_information_request();
 	if (!result) {
 		LOG_IPCP_ERR("Problems testing Enrollment Information Request Encoder");
@@ -813,5 +1088,23 @@ int main()
                 LOG_IPCP_ERR("Problems testing RIBObjectDataList Encoder");
                 return -1;
         }
+
+	result = test_dft_entries_since();
+	if (!result) {
+		LOG_IPCP_ERR("Problems testing the DFT changes since a version");
+		return -1;
+	}
+
+	result = test_dft_removals();
+	if (!result) {
+		LOG_IPCP_ERR("Problems testing the DFT removal tracking");
+		return -1;
+	}
+
+	result = test_dft_epoch_change();
+	if (!result) {
+		LOG_IPCP_ERR("Problems testing the DFT epoch change");
+		return -1;
+	}
 	return 0;
 }